@@ -2236,7 +2236,7 @@ MGlycan::MGlycan ( clipper::String chain, clipper::MMonomer& root_aa, clipper::M
 }
 
 
-clipper::String MGlycan::print_linear ( const bool print_info, const bool html_format, const bool translate )
+clipper::String MGlycan::print_linear ( const bool print_info, const bool html_format, const bool translate ) const
 {
     clipper::String buffer = "";
 
@@ -2614,7 +2614,7 @@ for linkage information.
 
 Last modified on: 03/01/2020
 */
-char MGlycan::convertNumberToLetter(int number)
+char MGlycan::convertNumberToLetter(int number) const
 {
     std::string alphabet("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ");
     return alphabet.at(number % alphabet.size());
@@ -2633,7 +2633,7 @@ Performance considerations: uses a non ideal implementation of making sure that
 
 Last modified on: 03/01/2020
 */
-std::vector < std::string > MGlycan::obtain_unique_WURCS_residues()
+std::vector < std::string > MGlycan::obtain_unique_WURCS_residues() const
 {
     std::vector < std::string > uniqueResidues;
     
@@ -2658,7 +2658,7 @@ Function used to obtain a total number of glycosidic bonds within the chain. Nee
 
 Last modified on: 03/01/2020
 */
-const int MGlycan::obtain_total_number_of_glycosidic_bonds()
+const int MGlycan::obtain_total_number_of_glycosidic_bonds() const
 {
     int totalConnections = 0;
     
@@ -2697,7 +2697,7 @@ Last modified on: 12/02/2020
 // TO DO: Determine whether 2-3 or 1-3 linkages are supported by privateer. 
 // TO DO: Find out whether a carbohydrate can form three covalent connections to other residues.
 */
-clipper::String MGlycan::generate_wurcs()
+clipper::String MGlycan::generate_wurcs() const
 {
     int glycanLength = sugars.size();
     const int numberOfConnections = obtain_total_number_of_glycosidic_bonds();
@@ -449,7 +449,7 @@ namespace clipper
                     void set_anomericity ( std::string anomericity ) { type = anomericity; }
                     //!< alpha or beta
 
-                    std::string get_description ( bool is_ketose = false )
+                    std::string get_description ( bool is_ketose = false ) const
                     {
                         std::ostringstream message;
                         std::vector< float > torsions = get_torsions();
@@ -566,6 +566,14 @@ namespace clipper
                             return connections[index];
                     }
 
+                    const Linkage& get_connection ( const int index ) const
+                    {
+                        if ( index > connections.size() -1 )
+                            return connections.back();
+                        else
+                            return connections[index];
+                    }
+
                     const std::string format() const
                     {
                         std::stringstream s;
@@ -595,20 +603,21 @@ namespace clipper
             const std::pair < clipper::MMonomer, clipper::MSugar >& get_root () const { return this->root; }
             const clipper::String& get_type () const { return kind_of_glycan; } // n-glycan, o-glycan or s-glycan
             std::string get_root_by_name () const { return get_root().first.type().trim() + "-" + get_root().first.id().trim() + "/" + get_chain().substr(0,1); }
-            std::string get_root_for_filename () { return "[" + get_chain().trim().substr(0,1) + "]-" + get_root().first.type().trim() + get_root().first.id().trim(); }
+            std::string get_root_for_filename () const { return "[" + get_chain().trim().substr(0,1) + "]-" + get_root().first.type().trim() + get_root().first.id().trim(); }
 
-            clipper::String print_linear ( const bool print_info, const bool html_format, const bool translate );
+            clipper::String print_linear ( const bool print_info, const bool html_format, const bool translate ) const;
             clipper::String print_SVG ( bool vertical, bool print_info, bool colour_gradient );
             
             // NEW FUNCTIONS INTRODUCED DUE TO WURCS IMPLEMENTATION BEGIN //
-            char convertNumberToLetter(int number); // need to be relocated, doesn't really belong under ::MGlycan.
-            std::vector < std::string > obtain_unique_WURCS_residues();
-            const int obtain_total_number_of_glycosidic_bonds();
-            clipper::String generate_wurcs ();
+            char convertNumberToLetter(int number) const; // need to be relocated, doesn't really belong under ::MGlycan.
+            std::vector < std::string > obtain_unique_WURCS_residues() const;
+            const int obtain_total_number_of_glycosidic_bonds() const;
+            clipper::String generate_wurcs () const;
             // NEW FUNCTIONS INTRODUCED DUE TO WURCS IMPLEMENTATION END // 
 
 
             std::vector < clipper::MSugar >& get_sugars () { return sugars; }
+            const std::vector < clipper::MSugar >& get_sugars () const { return sugars; }
 
             const Node& get_node ( int index ) const { if (index>node_list.size()-1) return node_list.back(); else return node_list[index]; }
 
@@ -633,7 +642,7 @@ namespace clipper
 
             void set_glycosylation_torsions ( float phi, float psi ) { torsion_phi = phi; torsion_psi = psi; }
 
-            std::string get_link_description ( )
+            std::string get_link_description ( ) const
             {
                 std::ostringstream message;
 
@@ -645,7 +654,7 @@ namespace clipper
 
             }
 
-            std::string get_root_description ( )
+            std::string get_root_description ( ) const
             {
                 std::ostringstream message;
 
@@ -0,0 +1,56 @@
+import numpy
+
+# Reader for the file written by privateer -columnar, see privateer::util::write_columnar_export
+
+MAGIC = b"PRVCOLS1"
+VERSION = 1
+
+SCHEMA = [ ( "q",           "<f4" ),
+           ( "phi",         "<f4" ),
+           ( "theta",       "<f4" ),
+           ( "rscc",        "<f4" ),
+           ( "bfactor",     "<f4" ),
+           ( "conformation","<i2" ),
+           ( "anomer",      "u1"  ),
+           ( "context",     "u1"  ),
+           ( "flags",       "u1"  ),
+           ( "glycan",      "<i4" ),
+           ( "node",        "<i4" ),
+           ( "parent_node", "<i4" ),
+           ( "link_order",  "<i4" ),
+           ( "name",        "S4"  ),
+           ( "chain",       "S4"  ),
+           ( "residue",     "S8"  ) ]
+
+ANOMERS  = { 0 : "unknown", 1 : "alpha", 2 : "beta" }
+CONTEXTS = { 0 : "unknown", 1 : "n-glycan", 2 : "o-glycan", 3 : "s-glycan", 4 : "c-glycan", 5 : "ligand" }
+FLAGS    = [ "ring", "bonds_rmsd", "angles_rmsd", "anomer", "chirality", "conformation", "puckering", "sane" ]
+
+
+def read_columnar ( filename = "" ) :
+    """ Returns a dict of NumPy arrays, one per column, viewing the file's contents without parsing """
+    with open ( filename, "rb" ) as f :
+        data = f.read()
+
+    if data[:8] != MAGIC :
+        raise ValueError ( filename + " is not a Privateer columnar file" )
+
+    version, rows = numpy.frombuffer ( data, dtype="<u4", count=2, offset=8 )
+
+    if version != VERSION :
+        raise ValueError ( "Unsupported columnar schema version %i" % version )
+
+    columns = { }
+    offset = 16
+
+    for name, dtype in SCHEMA :
+        dtype = numpy.dtype ( dtype )
+        columns[name] = numpy.frombuffer ( data, dtype=dtype, count=int(rows), offset=offset )
+        offset += -(-dtype.itemsize * int(rows) // 8) * 8
+
+    return columns
+
+
+def flag_set ( columns, flag = "sane" ) :
+    """ Boolean array telling which sugars passed the named check """
+    return ( columns["flags"] & ( 1 << FLAGS.index ( flag ) ) ) != 0
@@ -13,11 +13,87 @@
 
 #include "privateer-blobs.h"
 
-bool bestPointFinder(std::pair<clipper::Coord_orth, double> p1, std::pair<clipper::Coord_orth, double> p2) {
-    return p1.second<p2.second;
+// One-letter code of the residue found offset positions away from mon, '?' if it is not modelled
+static char get_neighbour_one_letter_code(const clipper::MPolymer& polymer, int mon, int offset)
+{
+	static const char* threeLetterCodes[] = { "ALA", "ARG", "ASN", "ASP", "CYS", "GLN", "GLU", "GLY", "HIS", "ILE",
+											  "LEU", "LYS", "MET", "PHE", "PRO", "SER", "THR", "TRP", "TYR", "VAL" };
+	static const char oneLetterCodes[] = "ARNDCQEGHILKMFPSTWYV";
+
+	int neighbour = mon + offset;
+	if ( neighbour < 0 || neighbour >= polymer.size() )
+		return '?';
+
+	// chain breaks would otherwise make unrelated residues look like sequence neighbours
+	if ( polymer[neighbour].seqnum() - polymer[mon].seqnum() != offset )
+		return '?';
+
+	for ( int i = 0; i < 20; i++ )
+		if ( polymer[neighbour].type().trim() == threeLetterCodes[i] )
+			return oneLetterCodes[i];
+
+	return 'X';
+}
+
+// A motif is written in one-letter code with 'X' as wildcard and the glycosylated residue in lower case, e.g. CXsXPC.
+// Positions that are not modelled are given the benefit of the doubt.
+static bool match_glycosylation_motif(const clipper::MPolymer& polymer, int mon, const clipper::String& motif)
+{
+	int anchor = -1;
+	for ( int i = 0; i < motif.size(); i++ )
+		if ( islower((unsigned char) motif[i]) )
+		{
+			anchor = i;
+			break;
+		}
+
+	if ( anchor < 0 )
+		return false;
+
+	for ( int i = 0; i < motif.size(); i++ )
+	{
+		char residue = get_neighbour_one_letter_code(polymer, mon, i - anchor);
+		char expected = toupper((unsigned char) motif[i]);
+
+		if ( residue != '?' && expected != 'X' && residue != expected )
+			return false;
+	}
+	return true;
+}
+
+static bool is_plausible_glycosylation_site(const clipper::MPolymer& polymer, int mon, const std::vector<clipper::String>& oGlycanMotifs)
+{
+	const clipper::String type = polymer[mon].type().trim();
+
+	if ( type == "ASN" ) // N-X-S/T/C sequon, X != P
+	{
+		char x = get_neighbour_one_letter_code(polymer, mon, 1);
+		char acceptor = get_neighbour_one_letter_code(polymer, mon, 2);
+		return x != 'P' && ( acceptor == '?' || acceptor == 'S' || acceptor == 'T' || acceptor == 'C' );
+	}
+
+	if ( type == "TRP" ) // C-mannosylation happens on the first W of W-x-x-W
+	{
+		char acceptor = get_neighbour_one_letter_code(polymer, mon, 3);
+		return acceptor == '?' || acceptor == 'W';
+	}
+
+	if ( type == "SER" || type == "THR" ) // mucin-type O-glycans have no consensus, so only filter when motifs are given
+	{
+		if ( oGlycanMotifs.empty() )
+			return true;
+
+		for ( int i = 0; i < oGlycanMotifs.size(); i++ )
+			if ( match_glycosylation_motif(polymer, mon, oGlycanMotifs[i]) )
+				return true;
+
+		return false;
+	}
+
+	return true;
 }
 
-std::vector<std::vector<GlycosylationMonomerMatch> > get_matching_monomer_positions(clipper::MiniMol& inputModel)
+std::vector<std::vector<GlycosylationMonomerMatch> > get_matching_monomer_positions(clipper::MiniMol& inputModel, bool useMotifFilter, const std::vector<clipper::String>& oGlycanMotifs)
 {
 
 	std::vector<GlycosylationMonomerMatch> NMMonomers;
@@ -33,6 +109,9 @@ std::vector<std::vector<GlycosylationMonomerMatch> > get_matching_monomer_positi
    {
 	 for ( int mon = 0; mon < inputModel[pol].size(); mon++ ) 
 	 {
+		if ( useMotifFilter && !is_plausible_glycosylation_site(inputModel[pol], mon, oGlycanMotifs) )
+			continue;
+
 		if (inputModel[pol][mon].type() == "ASN" || inputModel[pol][mon].type() == "ARG")
 		{
 			NMMonomers.push_back({pol, mon});
@@ -80,31 +159,51 @@ clipper::MiniMol get_model_without_waters(const clipper::String& ippdb)
 	mmdbwrk.read_file(ippdb);
 	mmdbwrk.import_minimol(molwrk);
 
+	return get_model_without_waters(molwrk);
+}
+
+bool is_solvent_residue(const clipper::String& residueType, bool includeOtherSolvent)
+{
+	static const char* waterCodes[] = { "HOH", "WAT", "DOD", "H2O", "D2O" };
+	// common buffer and cryoprotectant components, only removed on request
+	static const char* solventCodes[] = { "SO4", "PO4", "GOL", "EDO", "PEG", "PG4", "PGE", "1PE", "MPD", "DMS", "ACT", "FMT", "EOH", "IPA" };
+
+	const clipper::String type = residueType.trim();
+
+	for ( int i = 0; i < sizeof(waterCodes) / sizeof(waterCodes[0]); i++ )
+		if ( type == waterCodes[i] )
+			return true;
+
+	if ( includeOtherSolvent )
+		for ( int i = 0; i < sizeof(solventCodes) / sizeof(solventCodes[0]); i++ )
+			if ( type == solventCodes[i] )
+				return true;
+
+	return false;
+}
+
+clipper::MiniMol get_model_without_waters(const clipper::MiniMol& inputModel, bool removeOtherSolvent)
+{
+	clipper::MiniMol molwrk_new( inputModel.spacegroup(), inputModel.cell() );
 
-	clipper::MiniMol molwrk_new( molwrk.spacegroup(), molwrk.cell() );
-	for ( int c = 0; c < molwrk.size(); c++ )
+	// Every chain is kept, even if it ends up empty, so chain indices stay the same as in inputModel. Monomer indices shift
+	// past every removed residue, so hits found on this model must be reported from it or looked up in inputModel by ID
+	for ( int c = 0; c < inputModel.size(); c++ )
 	{
 		clipper::MPolymer mp;
-		for ( int r = 0; r < molwrk[c].size(); r++ )
-		{
-				if ( molwrk[c][r].type() != "HOH" )
-				{
-					mp.insert( molwrk[c][r] );
-				}
-				if ( r == (molwrk[c].size() - 1))
-				{
-					clipper::String chainID = molwrk[c].id();
-					mp.set_id(chainID);
-					molwrk_new.insert(mp);
-					mp = clipper::MPolymer();
-				}
-		}
-	 }
+		mp.copy( inputModel[c], clipper::MM::COPY_MP );
+
+		for ( int r = 0; r < inputModel[c].size(); r++ )
+			if ( !is_solvent_residue( inputModel[c][r].type(), removeOtherSolvent ) )
+				mp.insert( inputModel[c][r] );
+
+		molwrk_new.insert( mp );
+	}
 
 	return molwrk_new;
 }
 
-bool check_glycosylation_presence(clipper::String chainID, clipper::String residueID, std::vector < clipper::MGlycan > glycanList)
+bool check_glycosylation_presence(const clipper::String& chainID, const clipper::String& residueID, const std::vector < clipper::MGlycan >& glycanList)
 {
 	for ( int i = 0 ; i < glycanList.size() ; i++ )
         {
@@ -117,7 +216,7 @@ bool check_glycosylation_presence(clipper::String chainID, clipper::String resid
 	return false;	
 }
 
-clipper::Coord_orth getTargetPoint(clipper::Coord_orth& coord1, clipper::Coord_orth& coord2, int vectorShiftDistance)
+clipper::Coord_orth getTargetPoint(const clipper::Coord_orth& coord1, const clipper::Coord_orth& coord2, int vectorShiftDistance)
 {
 	clipper::Coord_orth coord; 
 
@@ -134,29 +233,23 @@ clipper::Coord_orth getTargetPoint(clipper::Coord_orth& coord1, clipper::Coord_o
 
 void fillSearchArea(clipper::MiniMol& inputModel, clipper::Coord_orth& targetPos, clipper::Xmap<float>& sigmaa_dif_map, clipper::HKL_info& hklinfo, clipper::Map_stats& mapstats, int chainID, int monomerID)
 {
-	// Define origin and destination for drawing the sphere. Electron density data obtained from within the sphere later on.
-	clipper::Coord_orth origin(targetPos.x()-2, targetPos.y()-2, targetPos.z()-2);
-	clipper::Coord_orth destination(targetPos.x()+2, targetPos.y()+2, targetPos.z()+2);
-
-	clipper::Xmap_base::Map_reference_coord i0, iu, iv, iw;
-
-	clipper::Grid_sampling grid( hklinfo.spacegroup(), hklinfo.cell(), hklinfo.resolution() );  // define grid
+	// Grid points within 2A of the target, taken from the sampling of the map itself
+	const clipper::Grid_sampling& grid = sigmaa_dif_map.grid_sampling();
+	const std::vector<clipper::Coord_grid>& offsets = get_spherical_stencil(sigmaa_dif_map.cell(), grid, 2.0).offsets();
 
-	if(!origin.is_null() && !destination.is_null())
+	if(!targetPos.is_null())
 	{
-		i0 = clipper::Xmap_base::Map_reference_coord( sigmaa_dif_map, origin.coord_frac(hklinfo.cell()).coord_grid(grid) );
-
-		for ( iu = i0; iu.coord().u() <= destination.coord_frac(hklinfo.cell()).coord_grid(grid).u(); iu.next_u() )
-			for ( iv = iu; iv.coord().v() <= destination.coord_frac(hklinfo.cell()).coord_grid(grid).v(); iv.next_v() )
-				for ( iw = iv; iw.coord().w() <= destination.coord_frac(hklinfo.cell()).coord_grid(grid).w(); iw.next_w() )
-					{
-						clipper::Coord_orth targetuvw = iw.coord_orth();
-						clipper::Atom dummyAtom;
-						dummyAtom.set_coord_orth(targetuvw);
-						dummyAtom.set_element("H");
-						clipper::MAtom dummyAtomExport(dummyAtom);
-						inputModel[chainID][monomerID].insert(dummyAtomExport);
-					}
+		clipper::Coord_grid centre = targetPos.coord_frac(sigmaa_dif_map.cell()).coord_grid(grid);
+
+		for ( int i = 0; i < offsets.size(); i++ )
+			{
+				clipper::Coord_orth targetuvw = (centre + offsets[i]).coord_frac(grid).coord_orth(sigmaa_dif_map.cell());
+				clipper::Atom dummyAtom;
+				dummyAtom.set_coord_orth(targetuvw);
+				dummyAtom.set_element("H");
+				clipper::MAtom dummyAtomExport(dummyAtom);
+				inputModel[chainID][monomerID].insert(dummyAtomExport);
+			}
 	}
  } 
 
@@ -177,7 +270,7 @@ void drawOriginPoint(clipper::MiniMol& inputModel, clipper::Coord_orth target, i
 }
 
 
-GlycanToMiniMolIDs getCarbohydrateRelationshipToMiniMol(clipper::MiniMol& inputModel, clipper::MSugar& carbohydrate, std::vector < clipper::MGlycan >& allSugars, int mglycanid, int sugaringlycanid)
+GlycanToMiniMolIDs getCarbohydrateRelationshipToMiniMol(const clipper::MiniMol& inputModel, const clipper::MSugar& carbohydrate, const std::vector < clipper::MGlycan >& allSugars, int mglycanid, int sugaringlycanid)
 {
 	std::string tempString = allSugars[mglycanid].get_chain();
 	tempString = tempString[0];
@@ -208,127 +301,595 @@ GlycanToMiniMolIDs getCarbohydrateRelationshipToMiniMol(clipper::MiniMol& inputM
 	return output;
 }
 
-// FIX ME: I mistook arguments in coot code. box_radius = radius, not contour_level. contour_level is tIsoLevel. Need to rewrite this bit.
-double calculateMeanElectronDensityInTargetPosition(clipper::Coord_orth targetPos, clipper::Xmap<float>& sigmaa_dif_map, clipper::Map_stats& mapstats)
+DensitySummedAreaTable::DensitySummedAreaTable(const clipper::Xmap<float>& densityMap, size_t maximumGridPoints)
 {
-	double meanElectronDensity = 0.0;
-	int n_points = 0;
+	mapCell = densityMap.cell();
+	mapGrid = densityMap.grid_sampling();
+	nu = mapGrid.nu();
+	nv = mapGrid.nv();
+	nw = mapGrid.nw();
+	localMap = NULL;
+
+	// A table of doubles costs twice the map itself, on large boxes sum each probe locally instead
+	if ( maximumGridPoints > 0 && (size_t) nu * nv * nw > maximumGridPoints )
+	{
+		localMap = &densityMap;
+		return;
+	}
+
+	table.assign( (size_t) (nu + 1) * (nv + 1) * (nw + 1), 0.0 );
+
+	// Walk the whole unit cell, symmetry-related points are expanded by the map reference
+	clipper::Xmap_base::Map_reference_coord ix( densityMap );
+	size_t strideU = (size_t) (nv + 1) * (nw + 1);
+	size_t strideV = (size_t) (nw + 1);
+
+	for ( int u = 0; u < nu; u++ )
+		for ( int v = 0; v < nv; v++ )
+		{
+			ix.set_coord( clipper::Coord_grid( u, v, 0 ) );
+			size_t index = (u + 1) * strideU + (v + 1) * strideV + 1;
+			for ( int w = 0; w < nw; w++, index++ )
+			{
+				table[index] = densityMap[ix]
+							 + table[index - strideU] + table[index - strideV] + table[index - 1]
+							 - table[index - strideU - strideV] - table[index - strideU - 1] - table[index - strideV - 1]
+							 + table[index - strideU - strideV - 1];
+				ix.next_w();
+			}
+		}
+}
 
+double DensitySummedAreaTable::periodicPrefix(int u, int v, int w) const
+{
+	// [0,u) is made of u/nu whole cells plus a remainder of u%nu points, same for v and w
+	const double countU[2] = { double(u / nu), 1.0 };
+	const double countV[2] = { double(v / nv), 1.0 };
+	const double countW[2] = { double(w / nw), 1.0 };
+	const int extentU[2] = { nu, u % nu };
+	const int extentV[2] = { nv, v % nv };
+	const int extentW[2] = { nw, w % nw };
+
+	double sum = 0.0;
+	for ( int a = 0; a < 2; a++ )
+		for ( int b = 0; b < 2; b++ )
+			for ( int c = 0; c < 2; c++ )
+			{
+				double weight = countU[a] * countV[b] * countW[c];
+				if ( weight != 0.0 )
+					sum += weight * prefix( extentU[a], extentV[b], extentW[c] );
+			}
+	return sum;
+}
+
+double DensitySummedAreaTable::boxSum(const clipper::Coord_grid& minCorner, const clipper::Coord_grid& maxCorner) const
+{
+	if ( is_null() || maxCorner.u() < minCorner.u() || maxCorner.v() < minCorner.v() || maxCorner.w() < minCorner.w() )
+		return 0.0;
+
+	if ( is_local() )
+		return localBoxSum( minCorner, maxCorner );
+
+	// Translate the box by whole cells so that its first corner lies inside the unit cell
+	int u0 = clipper::Util::mod( minCorner.u(), nu );
+	int v0 = clipper::Util::mod( minCorner.v(), nv );
+	int w0 = clipper::Util::mod( minCorner.w(), nw );
+	int u1 = u0 + maxCorner.u() - minCorner.u() + 1;
+	int v1 = v0 + maxCorner.v() - minCorner.v() + 1;
+	int w1 = w0 + maxCorner.w() - minCorner.w() + 1;
+
+	if ( u1 <= nu && v1 <= nv && w1 <= nw )
+		return prefix(u1, v1, w1) - prefix(u0, v1, w1) - prefix(u1, v0, w1) - prefix(u1, v1, w0)
+			 + prefix(u0, v0, w1) + prefix(u0, v1, w0) + prefix(u1, v0, w0) - prefix(u0, v0, w0);
+
+	return periodicPrefix(u1, v1, w1) - periodicPrefix(u0, v1, w1) - periodicPrefix(u1, v0, w1) - periodicPrefix(u1, v1, w0)
+		 + periodicPrefix(u0, v0, w1) + periodicPrefix(u0, v1, w0) + periodicPrefix(u1, v0, w0) - periodicPrefix(u0, v0, w0);
+}
+
+double DensitySummedAreaTable::localBoxSum(const clipper::Coord_grid& minCorner, const clipper::Coord_grid& maxCorner) const
+{
+	double sum = 0.0;
+	clipper::Xmap_base::Map_reference_coord i0, iu, iv, iw;
+	i0 = clipper::Xmap_base::Map_reference_coord( *localMap, minCorner );
+
+	for ( iu = i0; iu.coord().u() <= maxCorner.u(); iu.next_u() )
+		for ( iv = iu; iv.coord().v() <= maxCorner.v(); iv.next_v() )
+			for ( iw = iv; iw.coord().w() <= maxCorner.w(); iw.next_w() )
+				sum += (*localMap)[iw];
+
+	return sum;
+}
+
+double DensitySummedAreaTable::boxMean(const clipper::Coord_grid& minCorner, const clipper::Coord_grid& maxCorner) const
+{
+	double n_points = double( maxCorner.u() - minCorner.u() + 1 ) * double( maxCorner.v() - minCorner.v() + 1 ) * double( maxCorner.w() - minCorner.w() + 1 );
+
+	if ( n_points <= 0.0 )
+		return 0.0;
+
+	return boxSum( minCorner, maxCorner ) / n_points;
+}
+
+// Symmetry operator taking grid point from onto grid point to, up to a lattice translation. 0 (identity) if there is none
+static int find_grid_symop(const clipper::Spacegroup& spgr, const clipper::Grid_sampling& grid, const clipper::Coord_grid& from, const clipper::Coord_grid& to)
+{
+	if ( from.u() == to.u() && from.v() == to.v() && from.w() == to.w() )
+		return 0;
+
+	const clipper::Coord_frac f = from.coord_frac( grid );
+	const clipper::Coord_frac t = to.coord_frac( grid );
+
+	for ( int s = 0; s < spgr.num_symops(); s++ )
+	{
+		clipper::Coord_frac d = spgr.symop( s ) * f - t;
+		if ( fabs( d.u() - rint( d.u() ) ) < 1.0e-4 && fabs( d.v() - rint( d.v() ) ) < 1.0e-4 && fabs( d.w() - rint( d.w() ) ) < 1.0e-4 )
+			return s;
+	}
+	return 0;
+}
+
+DensityBlobCatalogue::DensityBlobCatalogue(const clipper::Xmap<float>& densityMap, const clipper::Map_stats& mapstats, float cutoff, int minimumGridPoints)
+{
+	sigmaCutoff = cutoff;
+	mapSigma = mapstats.std_dev();
+	minimumPoints = minimumGridPoints;
+	float densityLimit = sigmaCutoff * mapSigma;
+
+	labels.init( densityMap.spacegroup(), densityMap.cell(), densityMap.grid_sampling() );
+	labels = -1;
+
+	const clipper::Grid_sampling& grid = densityMap.grid_sampling();
+	const clipper::Spacegroup& spgr = densityMap.spacegroup();
+	const clipper::Coord_grid offsets[6] = { clipper::Coord_grid( 1, 0, 0), clipper::Coord_grid(-1, 0, 0),
+											 clipper::Coord_grid( 0, 1, 0), clipper::Coord_grid( 0,-1, 0),
+											 clipper::Coord_grid( 0, 0, 1), clipper::Coord_grid( 0, 0,-1) };
+
+	// Grid points above the cutoff, by their index in the asymmetric unit
+	std::vector<int> aboveIndex;
+	std::vector<clipper::Coord_grid> aboveCoord;
+	int maxIndex = 0;
+
+	for ( clipper::Xmap_base::Map_reference_index ix = densityMap.first(); !ix.last(); ix.next() )
+	{
+		maxIndex = std::max( maxIndex, ix.index() );
+		if ( densityMap[ix] > densityLimit )
+		{
+			aboveIndex.push_back( ix.index() );
+			aboveCoord.push_back( ix.coord() );
+		}
+	}
+
+	std::vector<int> compactOf( maxIndex + 1, -1 );
+	for ( int i = 0; i < aboveIndex.size(); i++ )
+		compactOf[aboveIndex[i]] = i;
+
+	// Resolving neighbours through the symmetry is the expensive part, and it only reads the map. The operator that
+	// takes each neighbour back into the asymmetric unit is kept, so the flood fill can follow a blob across the border
+	std::vector<int> neighbours( 6 * aboveIndex.size(), -1 );
+	std::vector<int> neighbourSymops( 6 * aboveIndex.size(), 0 );
+
+	#pragma omp parallel for schedule(static)
+	for ( int i = 0; i < (int) aboveIndex.size(); i++ )
+		for ( int k = 0; k < 6; k++ )
+		{
+			clipper::Coord_grid position = aboveCoord[i] + offsets[k];
+			clipper::Xmap_base::Map_reference_coord nb( densityMap, position );
+			if ( densityMap[nb] > densityLimit )
+			{
+				int next = compactOf[nb.index()];
+				neighbours[6*i + k] = next;
+				neighbourSymops[6*i + k] = find_grid_symop( spgr, grid, position, aboveCoord[next] );
+			}
+		}
+
+	// Flood fill in real space. Each point carries its fractional position and the rotation that took its asymmetric
+	// unit copy there: a step k from the asymmetric unit copy is a step rotation * k in space, and entering a neighbour
+	// that was mapped back into the asymmetric unit by operator S composes the rotation with the inverse of S. Blobs
+	// crossing the asymmetric unit border thus stay in one contiguous piece, whatever operator relates the two sides.
+	std::vector<clipper::Mat33<> > inverseRotations;
+	for ( int s = 0; s < spgr.num_symops(); s++ )
+		inverseRotations.push_back( spgr.symop( s ).rot().inverse() );
+
+	std::vector<clipper::Vec3<> > steps;
+	for ( int k = 0; k < 6; k++ )
+		steps.push_back( offsets[k].coord_frac( grid ) );
+
+	struct FloodPoint
+	{
+		int index;
+		clipper::Coord_frac position;
+		clipper::Mat33<> rotation;
+	};
+
+	const clipper::Cell& cell = densityMap.cell();
+	double voxelVolume = cell.volume() / ( double(grid.nu()) * grid.nv() * grid.nw() );
+	std::vector<char> visited( aboveIndex.size(), 0 );
+	std::vector<FloodPoint> queue;
+
+	for ( int seed = 0; seed < aboveIndex.size(); seed++ )
+	{
+		if ( visited[seed] )
+			continue;
+
+		DensityBlob blob = DensityBlob();
+		blob.nearestResidueDistance = -1.0;
+		clipper::Vec3<> sum( 0.0, 0.0, 0.0 );
+
+		queue.clear();
+		queue.push_back( FloodPoint{ seed, aboveCoord[seed].coord_frac( grid ), clipper::Mat33<>::identity() } );
+		visited[seed] = 1;
+
+		for ( int head = 0; head < queue.size(); head++ )
+		{
+			const FloodPoint point = queue[head];
+			float value = densityMap.get_data( aboveIndex[point.index] );
+
+			blob.integratedDensity += value;
+			blob.peakDensity = std::max( blob.peakDensity, double(value) );
+			sum = sum + point.position;
+
+			for ( int k = 0; k < 6; k++ )
+			{
+				int next = neighbours[6*point.index + k];
+				if ( next >= 0 && !visited[next] )
+				{
+					int symop = neighbourSymops[6*point.index + k];
+					visited[next] = 1;
+					queue.push_back( FloodPoint{ next, clipper::Coord_frac( point.position + point.rotation * steps[k] ),
+												 symop == 0 ? point.rotation : point.rotation * inverseRotations[symop] } );
+				}
+			}
+		}
+
+		if ( queue.size() < minimumGridPoints )
+			continue;
+
+		blob.gridPoints = queue.size();
+		blob.volume = blob.gridPoints * voxelVolume;
+		blob.integratedDensity *= voxelVolume;
+
+		const clipper::Coord_frac centroid( sum * ( 1.0 / blob.gridPoints ) );
+		blob.centroid = centroid.coord_orth( cell );
+
+		for ( int i = 0; i < queue.size(); i++ )
+		{
+			blob.extent = std::max( blob.extent, sqrt( ( queue[i].position - centroid ).lengthsq( cell ) ) );
+			labels.set_data( aboveIndex[queue[i].index], blobList.size() );
+		}
+
+		for ( int s = 0; s < spgr.num_symops(); s++ )
+			centroidImages.push_back( std::make_pair( int( blobList.size() ), spgr.symop( s ) * centroid ) );
+
+		blobList.push_back( blob );
+	}
+}
+
+void DensityBlobCatalogue::assign_nearest_residues(const clipper::MiniMol& inputModel, float searchRadius)
+{
+	clipper::MAtomNonBond nb( inputModel, searchRadius );
+	clipper::Spacegroup spgr = inputModel.spacegroup();
+
+	for ( int b = 0; b < blobList.size(); b++ )
+	{
+		DensityBlob& blob = blobList[b];
+		const std::vector<clipper::MAtomIndexSymmetry> neighbourhood = nb.atoms_near( blob.centroid, searchRadius );
+		clipper::Coord_frac f2 = blob.centroid.coord_frac( inputModel.cell() );
+
+		blob.nearestResidueDistance = -1.0;
+
+		for ( int k = 0; k < neighbourhood.size(); k++ )
+		{
+			if ( inputModel.atom( neighbourhood[k] ).id().trim() == "DUM" )
+				continue;
+
+			clipper::Coord_frac f1 = inputModel.atom( neighbourhood[k] ).coord_orth().coord_frac( inputModel.cell() );
+			f1 = spgr.symop( neighbourhood[k].symmetry() ) * f1;
+			f1 = f1.lattice_copy_near( f2 );
+			double distance = sqrt( ( f2 - f1 ).lengthsq( inputModel.cell() ) );
+
+			if ( blob.nearestResidueDistance < 0.0 || distance < blob.nearestResidueDistance )
+			{
+				blob.nearestResidueDistance = distance;
+				blob.nearestChain = inputModel[neighbourhood[k].polymer()].id();
+				blob.nearestResidue = inputModel[neighbourhood[k].polymer()][neighbourhood[k].monomer()].id().trim();
+				blob.nearestResidueType = inputModel[neighbourhood[k].polymer()][neighbourhood[k].monomer()].type().trim();
+			}
+		}
+	}
+}
+
+int DensityBlobCatalogue::blob_at(const clipper::Coord_orth& position) const
+{
+	if ( labels.is_null() )
+		return -1;
+
+	return labels.get_data( position.coord_frac( labels.cell() ).coord_grid( labels.grid_sampling() ) );
+}
+
+bool DensityBlobCatalogue::any_blob_near(const clipper::Coord_orth& position, double radius) const
+{
+	if ( labels.is_null() )
+		return false;
+
+	const clipper::Cell& cell = labels.cell();
+	const clipper::Coord_frac target = position.coord_frac( cell );
+
+	// A sphere of radius r spans r * a* along u, and likewise along v and w, so blobs whose centroid copies fall
+	// outside that box, widened by their extent, cannot come within radius of the position
+	for ( int i = 0; i < centroidImages.size(); i++ )
+	{
+		const double reach = radius + blobList[centroidImages[i].first].extent;
+		const clipper::Coord_frac d = centroidImages[i].second - target;
+
+		if ( fabs( d.u() - rint( d.u() ) ) <= reach * cell.a_star()
+		  && fabs( d.v() - rint( d.v() ) ) <= reach * cell.b_star()
+		  && fabs( d.w() - rint( d.w() ) ) <= reach * cell.c_star() )
+			return true;
+	}
+	return false;
+}
+
+std::string DensityBlobCatalogue::describe(int blobID) const
+{
+	if ( blobID < 0 || blobID >= blobList.size() )
+		return "";
+
+	std::ostringstream summary;
+	summary << std::fixed << std::setprecision(1) << " (blob " << blobID << ": " << blobList[blobID].volume << " A^3, "
+			<< std::setprecision(3) << "integrated density " << blobList[blobID].integratedDensity << ")";
+	return summary.str();
+}
+
+nlohmann::json DensityBlobCatalogue::to_json() const
+{
+	nlohmann::json catalogue;
+	catalogue["sigma_cutoff"] = sigmaCutoff;
+	catalogue["map_sigma"] = mapSigma;
+	catalogue["blobs"] = nlohmann::json::array();
+
+	for ( int b = 0; b < blobList.size(); b++ )
+	{
+		const DensityBlob& blob = blobList[b];
+		nlohmann::json entry;
+		entry["id"] = b;
+		entry["grid_points"] = blob.gridPoints;
+		entry["volume"] = blob.volume;
+		entry["integrated_density"] = blob.integratedDensity;
+		entry["peak_density"] = blob.peakDensity;
+		entry["centroid"] = { blob.centroid.x(), blob.centroid.y(), blob.centroid.z() };
+
+		if ( blob.nearestResidueDistance >= 0.0 )
+			entry["nearest_residue"] = { { "chain", std::string(blob.nearestChain) },
+										 { "residue", std::string(blob.nearestResidue) },
+										 { "type", std::string(blob.nearestResidueType) },
+										 { "distance", blob.nearestResidueDistance } };
+		else
+			entry["nearest_residue"] = nullptr;
+
+		catalogue["blobs"].push_back( entry );
+	}
+	return catalogue;
+}
+
+bool DensityBlobCatalogue::write_json(const clipper::String& path) const
+{
+	std::ofstream out( path.c_str() );
+
+	if ( !out )
+		return true;
+
+	out << to_json().dump(4) << std::endl;
+	return !out.good();
+}
+
+// FIX ME: I mistook arguments in coot code. box_radius = radius, not contour_level. contour_level is tIsoLevel. Need to rewrite this bit.
+double calculateMeanElectronDensityInTargetPosition(const clipper::Coord_orth& targetPos, const DensitySummedAreaTable& densityTable, const clipper::Map_stats& mapstats)
+{
 	float map_sigma = mapstats.std_dev();
 	float box_radius = 5.00 * map_sigma;
 
-	int isample_step = 1;
+	const clipper::Cell& cell = densityTable.cell();
 
 		// Define origin and destination for drawing the sphere. Electron density data obtained from within the sphere later on.
 	clipper::Coord_orth origin(targetPos.x()-0.8, targetPos.y()-0.8, targetPos.z()-0.8);
 	clipper::Coord_orth destination(targetPos.x()+0.8, targetPos.y()+0.8, targetPos.z()+0.8);
 
-	clipper::Coord_frac originref = origin.coord_frac(sigmaa_dif_map.cell());
-	clipper::Coord_frac destinationref = destination.coord_frac(sigmaa_dif_map.cell());
-	
+	clipper::Coord_frac originref = origin.coord_frac(cell);
+	clipper::Coord_frac destinationref = destination.coord_frac(cell);
+
+	if(originref.is_null() || destinationref.is_null())
+		return 0.0;
+
 	clipper::Coord_frac origin0(
-			    originref.u() - box_radius/sigmaa_dif_map.cell().descr().a(),
-			    originref.v() - box_radius/sigmaa_dif_map.cell().descr().b(),
-			    originref.w() - box_radius/sigmaa_dif_map.cell().descr().c() );
-   	clipper::Coord_frac origin1(
-			    originref.u() + box_radius/sigmaa_dif_map.cell().descr().a(),
-			    originref.v() + box_radius/sigmaa_dif_map.cell().descr().b(),
-			    originref.w() + box_radius/sigmaa_dif_map.cell().descr().c() );
-
-	clipper::Coord_frac destination0(
-			    destinationref.u() - box_radius/sigmaa_dif_map.cell().descr().a(),
-			    destinationref.v() - box_radius/sigmaa_dif_map.cell().descr().b(),
-			    destinationref.w() - box_radius/sigmaa_dif_map.cell().descr().c() );
-   	clipper::Coord_frac destination1(
-			    destinationref.u() + box_radius/sigmaa_dif_map.cell().descr().a(),
-			    destinationref.v() + box_radius/sigmaa_dif_map.cell().descr().b(),
-			    destinationref.w() + box_radius/sigmaa_dif_map.cell().descr().c() );
-
-	clipper::Grid_range gridorigin(origin0.coord_grid(sigmaa_dif_map.grid_sampling()),
-			origin1.coord_grid(sigmaa_dif_map.grid_sampling()));
-
-	clipper::Grid_range griddestination(destination0.coord_grid(sigmaa_dif_map.grid_sampling()),
-			destination1.coord_grid(sigmaa_dif_map.grid_sampling()));
-	
+			    originref.u() - box_radius/cell.descr().a(),
+			    originref.v() - box_radius/cell.descr().b(),
+			    originref.w() - box_radius/cell.descr().c() );
+	clipper::Coord_frac destination1(
+			    destinationref.u() + box_radius/cell.descr().a(),
+			    destinationref.v() + box_radius/cell.descr().b(),
+			    destinationref.w() + box_radius/cell.descr().c() );
+
+	// Same grid box as the former point-by-point sum, now answered from the summed-area table
+	return densityTable.boxMean(origin0.coord_grid(densityTable.grid_sampling()), destination1.coord_grid(densityTable.grid_sampling()));
+}
+
+void ProbeBatch::reserve(size_t probes, size_t segments)
+{
+	x.reserve( probes );
+	y.reserve( probes );
+	z.reserve( probes );
+	segmentStarts.reserve( segments );
+}
 
-    //  std::cout << "    box_radius " << box_radius << std::endl;
-    //  std::cout << "    centre_point: " << targetPos.format() << std::endl;
-    //  std::cout << "    origin0: " << origin0.format() << std::endl;
-    //  std::cout << "    origin1: " << origin1.format() << std::endl;
-    //  std::cout << "    destination0: " << destination0.format() << std::endl;
-    //  std::cout << "    destination1: " << destination1.format() << std::endl;
-    //  std::cout << "    origin0.coord_orth(): " << origin0.coord_orth(sigmaa_dif_map.cell()).format() << std::endl;
-    //  std::cout << "    origin1.coord_orth(): " << origin1.coord_orth(sigmaa_dif_map.cell()).format() << std::endl;
-    //  std::cout << "    destination0.coord_orth(): " << destination0.coord_orth(sigmaa_dif_map.cell()).format() << std::endl;
-    //  std::cout << "    destination1.coord_orth(): " << destination1.coord_orth(sigmaa_dif_map.cell()).format() << std::endl;
-    //  std::cout << "    grid: " << grid.format() << std::endl;
-	//  std::cout << "    gridorigin: " << gridorigin.format() << std::endl;
-	//  std::cout << "    griddestination: " << griddestination.format() << std::endl;
-	if(!originref.is_null() && !destinationref.is_null())
+void ProbeBatch::add_ray(const clipper::Coord_orth& origin, const clipper::Vec3<clipper::ftype>& unitDirection, int steps)
+{
+	for ( int k = 1; k <= steps; k++ )
 	{
-		clipper::Xmap_base::Map_reference_coord ix( sigmaa_dif_map );
-		int u, v, w, ii;
-		for (w = gridorigin.min().w(); w <= griddestination.max().w(); w+=isample_step ) {
-			for (v = gridorigin.min().v(); v <= griddestination.max().v(); v+=isample_step) {
-				ix.set_coord(clipper::Coord_grid( gridorigin.min().u(), v, w ));
-				for (u = gridorigin.min().u(); u <= griddestination.max().u(); u+=isample_step) 
-					{
-						// std::cout << "    ix: " << ix.coord_orth().format() << std::endl;
-						meanElectronDensity = meanElectronDensity + sigmaa_dif_map[ix];
-						n_points++;
-						for(ii=0; ii<isample_step; ii++) ix.next_u(); 
-					} 
-			}
-		}
+		x.push_back( origin.x() + unitDirection[0] * k );
+		y.push_back( origin.y() + unitDirection[1] * k );
+		z.push_back( origin.z() + unitDirection[2] * k );
 	}
+}
 
+void ProbeBatch::append(const ProbeBatch& other)
+{
+	const size_t offset = x.size();
 
-	meanElectronDensity = meanElectronDensity / n_points;
+	for ( int i = 0; i < other.segmentStarts.size(); i++ )
+		segmentStarts.push_back( offset + other.segmentStarts[i] );
 
-	return meanElectronDensity;
+	x.insert( x.end(), other.x.begin(), other.x.end() );
+	y.insert( y.end(), other.y.begin(), other.y.end() );
+	z.insert( z.end(), other.z.begin(), other.z.end() );
+}
+
+size_t ProbeBatch::segment_argmax(int segment, const std::vector<double>& values) const
+{
+	size_t begin = segment_begin( segment );
+	size_t end = segment_end( segment );
+	size_t best = begin;
+
+	for ( size_t i = begin + 1; i < end; i++ )
+		if ( values[i] > values[best] )
+			best = i;
+
+	return begin == end ? end : best;
+}
+
+// Batched calculateMeanElectronDensityInTargetPosition(), same boxes and same values. Box corners for all probes are first
+// converted to fractional coordinates in flat loops over the coordinate arrays, then summed from the table.
+void calculateMeanElectronDensityInTargetPositions(const ProbeBatch& probes, const DensitySummedAreaTable& densityTable, const clipper::Map_stats& mapstats, std::vector<double>& densities)
+{
+	const int n = probes.size();
+	densities.assign( n, 0.0 );
+
+	if ( n == 0 || densityTable.is_null() )
+		return;
+
+	float map_sigma = mapstats.std_dev();
+	float box_radius = 5.00 * map_sigma;
+
+	const clipper::Cell& cell = densityTable.cell();
+	const clipper::Grid_sampling& grid = densityTable.grid_sampling();
+	const clipper::Mat33<> toFrac = cell.matrix_frac();
+	const double m00 = toFrac(0,0), m01 = toFrac(0,1), m02 = toFrac(0,2);
+	const double m10 = toFrac(1,0), m11 = toFrac(1,1), m12 = toFrac(1,2);
+	const double m20 = toFrac(2,0), m21 = toFrac(2,1), m22 = toFrac(2,2);
+	const double padU = box_radius/cell.descr().a();
+	const double padV = box_radius/cell.descr().b();
+	const double padW = box_radius/cell.descr().c();
+
+	const double* x = &probes.xs()[0];
+	const double* y = &probes.ys()[0];
+	const double* z = &probes.zs()[0];
+
+	std::vector<double> lowerU( n ), lowerV( n ), lowerW( n ), upperU( n ), upperV( n ), upperW( n );
+
+	#pragma omp parallel for schedule(static)
+	for ( int i = 0; i < n; i++ )
+	{
+		double ox = x[i] - 0.8, oy = y[i] - 0.8, oz = z[i] - 0.8;
+		double dx = x[i] + 0.8, dy = y[i] + 0.8, dz = z[i] + 0.8;
+		lowerU[i] = ( m00*ox + m01*oy + m02*oz ) - padU;
+		lowerV[i] = ( m10*ox + m11*oy + m12*oz ) - padV;
+		lowerW[i] = ( m20*ox + m21*oy + m22*oz ) - padW;
+		upperU[i] = ( m00*dx + m01*dy + m02*dz ) + padU;
+		upperV[i] = ( m10*dx + m11*dy + m12*dz ) + padV;
+		upperW[i] = ( m20*dx + m21*dy + m22*dz ) + padW;
+	}
+
+	#pragma omp parallel for schedule(static)
+	for ( int i = 0; i < n; i++ )
+	{
+		clipper::Coord_frac lower( lowerU[i], lowerV[i], lowerW[i] );
+		clipper::Coord_frac upper( upperU[i], upperV[i], upperW[i] );
+
+		if ( lower.is_null() || upper.is_null() )
+			continue;
+
+		densities[i] = densityTable.boxMean( lower.coord_grid( grid ), upper.coord_grid( grid ) );
+	}
+}
+
+SphericalStencil::SphericalStencil(const clipper::Cell& cell, const clipper::Grid_sampling& grid, double radius)
+{
+	stencilCell = cell;
+	stencilGrid = grid;
+	stencilRadius = radius;
+
+	// Reciprocal lengths give the extent of the sphere along each grid axis, also for non-orthogonal cells
+	int iu = int( ceil( radius * cell.a_star() * grid.nu() ) );
+	int iv = int( ceil( radius * cell.b_star() * grid.nv() ) );
+	int iw = int( ceil( radius * cell.c_star() * grid.nw() ) );
+	double radiusSquared = radius * radius;
+
+	for ( int u = -iu; u <= iu; u++ )
+		for ( int v = -iv; v <= iv; v++ )
+			for ( int w = -iw; w <= iw; w++ )
+			{
+				clipper::Coord_grid offset( u, v, w );
+				if ( offset.coord_frac(grid).lengthsq(cell) <= radiusSquared )
+					gridOffsets.push_back( offset );
+			}
+}
+
+bool SphericalStencil::matches(const clipper::Cell& cell, const clipper::Grid_sampling& grid, double radius) const
+{
+	return stencilRadius == radius && stencilGrid.nu() == grid.nu() && stencilGrid.nv() == grid.nv() && stencilGrid.nw() == grid.nw() && stencilCell.equals(cell);
+}
+
+const SphericalStencil& get_spherical_stencil(const clipper::Cell& cell, const clipper::Grid_sampling& grid, double radius)
+{
+	static std::list<SphericalStencil> cache; // list elements never move, so references stay valid
+	const SphericalStencil* stencil = NULL;
+
+	#pragma omp critical (blobs_stencil_cache)
+	{
+		for ( std::list<SphericalStencil>::const_iterator it = cache.begin(); it != cache.end() && stencil == NULL; ++it )
+			if ( it->matches(cell, grid, radius) )
+				stencil = &(*it);
+
+		if ( stencil == NULL )
+		{
+			cache.push_back( SphericalStencil(cell, grid, radius) );
+			stencil = &cache.back();
+		}
+	}
+	return *stencil;
 }
 
-// FIX ME: I mistook arguments in coot code. box_radius = radius, not contour_level. contour_level is tIsoLevel. Need to rewrite this bit. 
-double calculateMeanElectronDensityForBiggerSphere(clipper::Coord_orth& targetPos, clipper::Xmap<float>& sigmaa_dif_map, clipper::Map_stats& mapstats, clipper::HKL_info& hklinfo)
+// Mean density in a 2A sphere around the target, where only points above 3 sigma contribute to the sum
+double calculateMeanElectronDensityForBiggerSphere(const clipper::Coord_orth& targetPos, const clipper::Xmap<float>& sigmaa_dif_map, const clipper::Map_stats& mapstats, const clipper::HKL_info& hklinfo)
 {
 	double meanElectronDensity = 0.0;
-	int n_points = 0;
 
 	float map_sigma = mapstats.std_dev();
 	float rmsdLimit = 3.00 * map_sigma;
 
-	clipper::Grid_sampling grid( hklinfo.spacegroup(), hklinfo.cell(), hklinfo.resolution() );  // define grid
+	const clipper::Grid_sampling& grid = sigmaa_dif_map.grid_sampling();
+	const std::vector<clipper::Coord_grid>& offsets = get_spherical_stencil(sigmaa_dif_map.cell(), grid, 2.0).offsets();
 
-	// Define origin and destination for drawing the sphere. Electron density data obtained from within the sphere later on.
-	clipper::Coord_orth origin(targetPos.x()-2, targetPos.y()-2, targetPos.z()-2);
-	clipper::Coord_orth destination(targetPos.x()+2, targetPos.y()+2, targetPos.z()+2);
+	if(targetPos.is_null() || offsets.empty())
+		return 0.0;
 
-	clipper::Xmap_base::Map_reference_coord i0, iu, iv, iw;
+	clipper::Coord_grid centre = targetPos.coord_frac(sigmaa_dif_map.cell()).coord_grid(grid);
+	clipper::Xmap_base::Map_reference_coord ix( sigmaa_dif_map );
 
-	if(!origin.is_null() && !destination.is_null())
+	for ( int i = 0; i < offsets.size(); i++ )
 	{
-		i0 = clipper::Xmap_base::Map_reference_coord( sigmaa_dif_map, origin.coord_frac(hklinfo.cell()).coord_grid(grid) );
-
-		for ( iu = i0; iu.coord().u() <= destination.coord_frac(hklinfo.cell()).coord_grid(grid).u(); iu.next_u() )
-			for ( iv = iu; iv.coord().v() <= destination.coord_frac(hklinfo.cell()).coord_grid(grid).v(); iv.next_v() )
-				for ( iw = iv; iw.coord().w() <= destination.coord_frac(hklinfo.cell()).coord_grid(grid).w(); iw.next_w() )
-					{
-						if(sigmaa_dif_map[iw] > rmsdLimit)
-						meanElectronDensity = meanElectronDensity + sigmaa_dif_map[iw];
-						n_points++;
-					}
+		ix.set_coord( centre + offsets[i] );
+		if(sigmaa_dif_map[ix] > rmsdLimit)
+			meanElectronDensity = meanElectronDensity + sigmaa_dif_map[ix];
 	}
- 
-	meanElectronDensity = meanElectronDensity / n_points;
+
+	meanElectronDensity = meanElectronDensity / offsets.size();
 
 	return meanElectronDensity;
 }
  
 
 
-
-
-std::vector<clipper::String> create_list_of_ignored_sugar_atoms(clipper::MSugar& carbohydrate)
+std::vector<clipper::String> create_list_of_ignored_sugar_atoms(const clipper::MSugar& carbohydrate)
 {
 	std::vector<clipper::String> ignoreAtomList;
 	std::vector<clipper::MAtom> ringMembers = carbohydrate.ring_members();
@@ -350,677 +911,388 @@ std::vector<clipper::String> create_list_of_ignored_sugar_atoms(clipper::MSugar&
 }
 
 
+// Probe set used for each kind of glycosylation site. Probes are cast from every non-ignored atom of the residue through the
+// attachment atom, in 1A steps up to vectorShiftLimit. For GLN the probe starts at the attachment atom instead.
+struct GlycosylationSiteProbe
+{
+	int typeOfGlycosylation;
+	const char* residueType;
+	const char* attachmentAtom;
+	std::vector<clipper::String> ignoredAtoms;
+	int vectorShiftLimit;
+	bool shiftFromAttachmentAtom;
+};
+
+static const GlycosylationSiteProbe glycosylationSiteProbes[] =
+{
+	{ 0, "ASN", " ND2", { " ND2" },                         5,  false }, // N-Glycosylation
+	{ 0, "ARG", " NH1", { " NH2", " NH1" },                 5,  false }, // NH2 probes used to be aimed through NH1 too, so NH1 alone gives the same answer
+	{ 1, "TRP", " CD1", { " O  ", " N  ", " C  ", " CD1" }, 10, false }, // C-Glycosylation
+	{ 2, "SER", " OG ", { " O  ", " OG " },                 5,  false }, // O-Glycosylation
+	{ 2, "THR", " OG1", { " O  ", " N  ", " C  ", " OG1" }, 5,  false },
+	{ 3, "CYS", " SG ", { " O  ", " SG " },                 3,  false }, // S-Glycosylation
+	{ 3, "MET", " SD ", { " SD " },                         3,  false },
+	{ 4, "ALA", " CB ", { " CB " },                         5,  false }, // PNGase-treated sites, CA to CB for Ala, CG to NE2 for GLN
+	{ 4, "GLN", " CG ", { " CG " },                         5,  true  }
+};
+
+static const int numberOfGlycosylationSiteProbes = sizeof(glycosylationSiteProbes) / sizeof(glycosylationSiteProbes[0]);
+
+// Probe set of a residue: a ray from every non-ignored atom through the attachment atom (or the reverse, for GLN)
+static void add_site_probes(const clipper::MMonomer& residue, const GlycosylationSiteProbe& probe, const clipper::Coord_orth& attachmentCoordinate, ProbeBatch& probes)
+{
+	for (int natom = 0; natom < residue.size(); natom++)
+	{
+		bool atomIgnored = (std::find(probe.ignoredAtoms.begin(), probe.ignoredAtoms.end(), residue[natom].id()) != probe.ignoredAtoms.end());
+		if(atomIgnored)
+			continue;
+
+		clipper::Coord_orth atomCoordinate = residue[natom].coord_orth();
+
+		if(probe.shiftFromAttachmentAtom)
+			probes.add_ray( attachmentCoordinate, clipper::Vec3<clipper::ftype>( atomCoordinate - attachmentCoordinate ).unit(), probe.vectorShiftLimit );
+		else
+			probes.add_ray( atomCoordinate, clipper::Vec3<clipper::ftype>( attachmentCoordinate - atomCoordinate ).unit(), probe.vectorShiftLimit );
+	}
+}
+
+// Whether any probe of a batch cast around centre may come close enough to a blob of the catalogue to be a hit. Only density
+// above 3 sigma, within 2A of the grid point nearest to the probe, counts towards calculateMeanElectronDensityForBiggerSphere(),
+// and all of it belongs to some blob. A NULL catalogue rules nothing out.
+static bool probes_may_reach_blobs(const ProbeBatch& probes, const clipper::Coord_orth& centre, const DensityBlobCatalogue* blobCatalogue, const clipper::Xmap<float>& sigmaa_dif_map)
+{
+	if(blobCatalogue == NULL || probes.size() == 0)
+		return true;
+
+	double reach = 0.0;
+	for (size_t i = 0; i < probes.size(); i++)
+		reach = std::max(reach, sqrt(clipper::Coord_orth(probes.position(i) - centre).lengthsq()));
+
+	const clipper::Cell& cell = sigmaa_dif_map.cell();
+	const clipper::Grid_sampling& grid = sigmaa_dif_map.grid_sampling();
+	const double sphere = 2.0 + cell.a() / grid.nu() + cell.b() / grid.nv() + cell.c() / grid.nw();
+
+	return blobCatalogue->any_blob_near(centre, reach + sphere);
+}
+
 // TO DO after: possible improvements, after determining best point, expand the cube at that point to get all electron density and see whether there would be discernible difference between false positives and true positives. 
-std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > get_electron_density_of_potential_glycosylation_sites(const std::vector<std::vector<GlycosylationMonomerMatch>>& informationVector, int vectorIndex, clipper::MiniMol& inputModel, clipper::Xmap<float>& sigmaa_dif_map, clipper::HKL_info& hklinfo, std::vector < clipper::MGlycan >& glycanList, clipper::Map_stats& mapstats, float thresholdED, bool pdbexport) 
+std::vector<std::vector<GlycosylationSiteBlobHit> > score_potential_glycosylation_sites(const std::vector<std::vector<GlycosylationMonomerMatch>>& informationVector, const clipper::MiniMol& inputModel, const clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, const clipper::HKL_info& hklinfo, const std::vector < clipper::MGlycan >& glycanList, const clipper::Map_stats& mapstats, float thresholdED, float thresholdProbe, int onlyVectorIndex, const DensityBlobCatalogue* blobCatalogue)
 {
-	float thresholdEDBestBlob = 0.070;
-	std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > finalVectorForBlobValues;
-		if(vectorIndex == 0)
-		{
-			if (!informationVector[vectorIndex].empty())
-			{
-				std::list<clipper::String> ignoreAtomList = {" ND2"};
-				int vectorShiftLimit = 5;
-				for (int c = 0; c < informationVector[vectorIndex].size(); c++)
-				{
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "ASN") // in N-Glycosylation a glycan is attached through ASN residue
-                            {	
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{
-										clipper::MAtom ND2Atom;
-										
-										try {
-										ND2Atom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" ND2", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary ND2 atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-										
-										clipper::Coord_orth ND2Coordinate; // ND2 atom is used as a direction towards the glycan density
-										ND2Coordinate = ND2Atom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-											bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-											if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTarget = getTargetPoint(ND2Coordinate, vectorOrigin, vectorShift);
-
-															double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-															pairs.push_back(tempDensityInfo);
-														}
-												}
-										}
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED)
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}
-							}
-				}
-			}
-			if (!informationVector[vectorIndex].empty())
-			{
-				std::list<clipper::String> ignoreAtomList = {" NH2", " NH1"};
-				int vectorShiftLimit = 5;
-				for (int c = 0; c < informationVector[vectorIndex].size(); c++)
-				{
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "ARG") // in N-Glycosylation a glycan is attached through ARG residue
-                            {	
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{
-										clipper::MAtom NH1Atom;
-										clipper::MAtom NH2Atom;
-										
-										try {
-										NH1Atom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" NH1", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary NH1 atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-
-										try {
-										NH2Atom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" NH2", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary NH2 atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-										
-										clipper::Coord_orth NH1Coordinate; // NH1 atom is used as a direction towards the glycan density
-										NH1Coordinate = NH1Atom.coord_orth();
-
-										clipper::Coord_orth NH2Coordinate; // NH1 atom is used as a direction towards the glycan density
-										NH2Coordinate = NH2Atom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-											bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-											if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTargetNH1 = getTargetPoint(NH1Coordinate, vectorOrigin, vectorShift);
-															clipper::Coord_orth potentialTargetNH2 = getTargetPoint(NH1Coordinate, vectorOrigin, vectorShift);
-
-															double meanDensityValueNH1 = calculateMeanElectronDensityInTargetPosition(potentialTargetNH1, sigmaa_dif_map, mapstats);
-															double meanDensityValueNH2 = calculateMeanElectronDensityInTargetPosition(potentialTargetNH1, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfoNH1(potentialTargetNH1, meanDensityValueNH1);
-															std::pair<clipper::Coord_orth, double> tempDensityInfoNH2(potentialTargetNH2, meanDensityValueNH2);
-															pairs.push_back(tempDensityInfoNH1);
-															pairs.push_back(tempDensityInfoNH2);
-														}
-												}
-										}
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED)
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}
-							}
-				}
-			}			
-		}
-		if(vectorIndex == 1)
+	// The lookup is exact only if the catalogue holds all density above 3 sigma and hits need positive density
+	if(blobCatalogue != NULL && (!blobCatalogue->covers_density_above(3.0) || thresholdED < 0.0))
+		blobCatalogue = NULL;
+
+	struct ScoringTask
+	{
+		int vectorIndex;
+		int position;
+		int probe;
+	};
+
+	// Flatten all residue classes into one task list, so the five classes are scored together
+	std::vector<ScoringTask> tasks;
+	for (int vectorIndex = 0; vectorIndex < informationVector.size(); vectorIndex++)
+	{
+		if (onlyVectorIndex >= 0 && vectorIndex != onlyVectorIndex)
+			continue;
+
+		for (int c = 0; c < informationVector[vectorIndex].size(); c++)
 		{
-			if (!informationVector[vectorIndex].empty())
-			{
-				std::list<clipper::String> ignoreAtomList = {" O  ", " N  ", " C  ", " CD1"};
-				int vectorShiftLimit = 10;
-				for (int c = 0; c < informationVector[vectorIndex].size(); c++)
+			const clipper::MMonomer& residue = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID];
+			for (int probe = 0; probe < numberOfGlycosylationSiteProbes; probe++)
+				if (glycosylationSiteProbes[probe].typeOfGlycosylation == vectorIndex && residue.type() == glycosylationSiteProbes[probe].residueType)
 				{
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "TRP") // in C-Glycosylation a glycan is attached through TRP residue
-                            {	
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{                                
-										clipper::MAtom CD1Atom; // A glycan is attached to TRP residue via CD1 atom
-										
-										try {
-										CD1Atom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" CD1", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary CD1 atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-										
-										clipper::Coord_orth CD1Coordinate; // CD1 atom is used as a direction towards the glycan density
-										CD1Coordinate = CD1Atom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-											bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-											if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTarget = getTargetPoint(CD1Coordinate, vectorOrigin, vectorShift);
-
-															double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-															pairs.push_back(tempDensityInfo);
-														}
-												}
-										}
-										
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED)
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}
-							}
+					tasks.push_back(ScoringTask{vectorIndex, c, probe});
+					break;
 				}
-			}
 		}
-		if(vectorIndex == 2)
-		{
-			if (!informationVector[vectorIndex].empty())
-			{
-				for (int c = 0; c < informationVector[vectorIndex].size(); c++)
-				{
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "SER") // in O-Glycosylation a glycan is attached through Thr or Ser residue
-                            {	
-								int vectorShiftLimit = 5; 
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{
-										std::list<clipper::String> ignoreAtomList = {" O  ", " OG "};
-										clipper::MAtom OGAtom; // On Ser glycan attaches to OG, on Thr glycan attaches to OG1
-										
-										try {
-										OGAtom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" OG ", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary OG atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-										
-
-										clipper::Coord_orth OGCoordinate; // OG atom is used as a point of attachement of a glycan
-										OGCoordinate = OGAtom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-											bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-											if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTarget = getTargetPoint(OGCoordinate, vectorOrigin, vectorShift);
-
-															double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-															pairs.push_back(tempDensityInfo);
-														}
-												}
-										}
-										
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED)
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}
-							}
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "THR")
-							{
-								int vectorShiftLimit = 5;  
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{   
-										std::list<clipper::String> ignoreAtomList = {" O  ", " N  ", " C  ", " OG1"};
-										clipper::MAtom OG1Atom; // On Thr glycan attaches to OG1
-
-										try {
-										OG1Atom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" OG1", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary OG1 atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-
-										clipper::Coord_orth OG1Coordinate; // OG atom is used as a point of attachement of a glycan
-										OG1Coordinate = OG1Atom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-												bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-												if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTarget = getTargetPoint(OG1Coordinate, vectorOrigin, vectorShift);
-
-															double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-															pairs.push_back(tempDensityInfo);
-														}
-												}
-										}
-											
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED)
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}
-							}
-				}
-			}
+	}
+
+	// Generate the probes of every task in parallel, then join them into one buffer where segment t belongs to task t.
+	// Sites that are already glycosylated or lack their attachment atom get an empty segment.
+	std::vector<ProbeBatch> taskProbes(tasks.size());
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < (int) tasks.size(); t++)
+	{
+		const GlycosylationMonomerMatch& match = informationVector[tasks[t].vectorIndex][tasks[t].position];
+		const clipper::MPolymer& chain = inputModel[match.PolymerID];
+		const clipper::MMonomer& residue = chain[match.ResidueID];
+		const GlycosylationSiteProbe& probe = glycosylationSiteProbes[tasks[t].probe];
+
+		bool siteAlreadyGlycosylated = check_glycosylation_presence(chain.id(), residue.id().trim(), glycanList);
+		if(siteAlreadyGlycosylated)
+			continue;
+
+		clipper::Coord_orth attachmentCoordinate; // attachment atom is used as a direction towards the glycan density
+
+		try {
+		attachmentCoordinate = residue.find(probe.attachmentAtom, clipper::MM::ANY).coord_orth();
+		} catch (const clipper::Message_fatal& error) {
+		#pragma omp critical (blobs_console)
+		std::cerr << "Unable to find necessary" << probe.attachmentAtom << " atom for residue" << residue.id() << "-" << residue.type() << " in Chain " << chain.id() << "\n" << "\n";
+		continue;
 		}
-		if(vectorIndex == 3)
+
+		add_site_probes(residue, probe, attachmentCoordinate, taskProbes[t]);
+
+		if(!probes_may_reach_blobs(taskProbes[t], attachmentCoordinate, blobCatalogue, sigmaa_dif_map))
+			taskProbes[t] = ProbeBatch();
+	}
+
+	ProbeBatch probes;
+	probes.reserve(tasks.size() * 48, tasks.size());
+
+	for (int t = 0; t < tasks.size(); t++)
+	{
+		probes.begin_segment();
+		probes.append(taskProbes[t]);
+	}
+
+	std::vector<double> densities;
+	calculateMeanElectronDensityInTargetPositions(probes, densityTable, mapstats, densities);
+
+	std::vector<GlycosylationSiteBlobHit> taskHits(tasks.size());
+	std::vector<char> taskHasHit(tasks.size(), 0);
+
+	// Best probe of each segment, only those go on to the more expensive bigger sphere
+	#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < (int) tasks.size(); t++)
+	{
+		size_t best = probes.segment_argmax(t, densities);
+		if(best == probes.segment_end(t) || densities[best] <= thresholdProbe)
+			continue;
+
+		clipper::Coord_orth bestTarget = probes.position(best);
+		double bestDensity = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
+
+		if(bestDensity > thresholdED)
 		{
-			if (!informationVector[vectorIndex].empty())
-			{
-				for (int c = 0; c < informationVector[vectorIndex].size(); c++)
-				{
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "CYS") // in S-Glycosylation a glycan is attached through CYS or MET residue
-                            {	
-								int vectorShiftLimit = 3;  
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{                								
-										std::list<clipper::String> ignoreAtomList = {" O  ", " SG "};
-										clipper::MAtom SGAtom; // On Ser glycan attaches to OG, on Thr glycan attaches to OG1
-
-										try {
-										SGAtom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" SG ", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary SG atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-
-										clipper::Coord_orth SGCoordinate; // SG atom is used as a point of attachement of a glycan
-										SGCoordinate = SGAtom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-											bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-											if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTarget = getTargetPoint(SGCoordinate, vectorOrigin, vectorShift);
-
-															double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-															pairs.push_back(tempDensityInfo);
-														}
-												}
-										}
-										
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED)
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}
-							}
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "MET") // in S-Glycosylation a glycan is attached through CYS or MET residue
-							{
-								int vectorShiftLimit = 3;
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{   
-										               							
-										std::list<clipper::String> ignoreAtomList = {" SD "};
-										clipper::MAtom SDAtom; // On Thr glycan attaches to OG1
-										
-										try {
-										SDAtom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" SD ", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary SD atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-
-										clipper::Coord_orth SDCoordinate; // OG atom is used as a point of attachement of a glycan
-										SDCoordinate = SDAtom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-												bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-												if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTarget = getTargetPoint(SDCoordinate, vectorOrigin, vectorShift);
-
-															double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-															pairs.push_back(tempDensityInfo);
-														}
-												}
-										}
-											
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED)
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}
-							}
-				}
-			}
+			const GlycosylationMonomerMatch& match = informationVector[tasks[t].vectorIndex][tasks[t].position];
+			taskHits[t] = GlycosylationSiteBlobHit{PotentialGlycosylationSiteInfo{match.PolymerID, match.ResidueID, tasks[t].vectorIndex}, bestTarget, densities[best], bestDensity, -1};
+			taskHasHit[t] = 1;
 		}
-		if(vectorIndex == 4) // this one doesn't make sense, why would you find glycosylation if it was removed... especially in a crystal.
+	}
+
+	std::vector<std::vector<GlycosylationSiteBlobHit> > hits(informationVector.size());
+	for (int t = 0; t < tasks.size(); t++)
+		if (taskHasHit[t])
+			hits[tasks[t].vectorIndex].push_back(taskHits[t]);
+
+	return hits;
+}
+
+std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > apply_glycosylation_site_hits(const std::vector<GlycosylationSiteBlobHit>& hits, clipper::MiniMol& inputModel, bool pdbexport)
+{
+	std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > finalVectorForBlobValues;
+
+	for (int i = 0; i < hits.size(); i++)
+	{
+		finalVectorForBlobValues.push_back(std::pair<PotentialGlycosylationSiteInfo, double>(hits[i].site, hits[i].density));
+
+		if(pdbexport)
 		{
-			if (!informationVector[vectorIndex].empty())
-			{
-				for (int c = 0; c < informationVector[vectorIndex].size(); c++)
-				{
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "ALA") 
-                            {
-								int vectorShiftLimit = 5;
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{                   								
-										std::list<clipper::String> ignoreAtomList = {" CB "};
-										clipper::MAtom CBAtom; // CA to CB for Ala, CG to NE2 for GLN
-
-										try {
-										CBAtom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" CB ", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary CB atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-
-										clipper::Coord_orth CBCoordinate; // CB atom is used as a direction towards the glycan density
-										CBCoordinate = CBAtom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-											
-											bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-											if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTarget = getTargetPoint(CBCoordinate, vectorOrigin, vectorShift);
-
-															double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-															pairs.push_back(tempDensityInfo);
-														}
-												}
-										}
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED) 
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}	
-							}
-						if (inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() == "GLN") 
-                            {	
-								int vectorShiftLimit = 5;
-								bool siteAlreadyGlycosylated = check_glycosylation_presence(inputModel[informationVector[vectorIndex][c].PolymerID].id(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id().trim(), glycanList);
-								if(!siteAlreadyGlycosylated)
-									{                   								
-										std::list<clipper::String> ignoreAtomList = {" CG "};
-										
-										clipper::MAtom CGAtom; // CA to CB for Ala, CG to NE2 for GLN
-
-										try {
-										CGAtom = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].find(" CG ", clipper::MM::ANY);
-										} catch (const clipper::Message_fatal& error) {
-										std::cerr << "Unable to find necessary CG atom for residue" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].id() << "-" << inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].type() << " in Chain " << inputModel[informationVector[vectorIndex][c].PolymerID].id() << "\n" << "\n";
-										}
-
-										
-										clipper::Coord_orth CGCoordinate; // CB atom is used as a direction towards the glycan density
-										CGCoordinate = CGAtom.coord_orth();
-
-										std::vector<std::pair<clipper::Coord_orth, double>> pairs;
-
-										for (int natom = 0; natom < inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID].size(); natom++)
-										{
-											
-											bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].id()) != ignoreAtomList.end());
-											if(!atomIgnored)
-												{
-													clipper::Coord_orth vectorOrigin;
-
-													vectorOrigin = inputModel[informationVector[vectorIndex][c].PolymerID][informationVector[vectorIndex][c].ResidueID][natom].coord_orth();
-													
-													for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-														{
-															clipper::Coord_orth potentialTarget = getTargetPoint(vectorOrigin, CGCoordinate, vectorShift);
-
-															double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-															std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-															pairs.push_back(tempDensityInfo);
-														}
-												}
-										}
-										const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-										clipper::Coord_orth bestTarget = bestPair->first;
-										double bestDensityValue = bestPair->second;
-
-										if(bestDensityValue > thresholdEDBestBlob)
-										{
-											double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-											if(meanDensityValueBiggerArea > thresholdED)
-											{
-												std::pair<PotentialGlycosylationSiteInfo, double> densityInfo(PotentialGlycosylationSiteInfo{informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID, vectorIndex}, meanDensityValueBiggerArea);
-												finalVectorForBlobValues.push_back(densityInfo);
-													if(pdbexport)
-													{
-														drawOriginPoint(inputModel, bestTarget, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-														// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, hklinfo, mapstats, informationVector[vectorIndex][c].PolymerID, informationVector[vectorIndex][c].ResidueID);
-													}
-											}
-										}
-									}
-							}
-				}
-			}
+			drawOriginPoint(inputModel, hits[i].target, hits[i].site.chainID, hits[i].site.monomerID);
+			// fillSearchArea(inputModel, hits[i].target, sigmaa_dif_map, hklinfo, mapstats, hits[i].site.chainID, hits[i].site.monomerID);
 		}
+	}
 	return finalVectorForBlobValues;
 }
 
-std::vector<std::pair<GlycanToMiniMolIDs, double> > get_electron_density_of_potential_unmodelled_carbohydrate_monomers(std::vector < clipper::MSugar > glycanChain, clipper::MiniMol&inputModel, std::vector < clipper::MGlycan >& allSugars, int id, clipper::Xmap<float>& sigmaa_dif_map, clipper::HKL_info& hklinfo, clipper::Map_stats& mapstats, float thresholdED, bool pdbexport)
+std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > get_electron_density_of_potential_glycosylation_sites(const std::vector<std::vector<GlycosylationMonomerMatch>>& informationVector, int vectorIndex, clipper::MiniMol& inputModel, clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, clipper::HKL_info& hklinfo, std::vector < clipper::MGlycan >& glycanList, clipper::Map_stats& mapstats, float thresholdED, bool pdbexport) 
 {
-	float thresholdEDBestBlob = 0.070;
-	std::vector<std::pair<GlycanToMiniMolIDs, double> > finalVectorForBlobValues;
-	int vectorShiftLimit = 5;
-	for (int monomer = 0; monomer < glycanChain.size(); monomer++)
+	std::vector<std::vector<GlycosylationSiteBlobHit> > hits = score_potential_glycosylation_sites(informationVector, inputModel, sigmaa_dif_map, densityTable, hklinfo, glycanList, mapstats, thresholdED, probe_density_threshold(mapstats, false), vectorIndex);
+
+	return apply_glycosylation_site_hits(hits[vectorIndex], inputModel, pdbexport);
+}
+
+// Scoring phase for the monomers of a set of glycan chains, reads the model and the map only. Probes are cast from the ring
+// centre through every non-ignored atom; all of them are generated into one batch, each atom owning a segment.
+static std::vector<std::vector<CarbohydrateBlobHit> > score_unmodelled_carbohydrate_chains(const std::vector<const std::vector < clipper::MSugar >* >& glycanChains, const std::vector<int>& glycanIDs, const clipper::MiniMol& inputModel, const std::vector < clipper::MGlycan >& allSugars, const clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, const clipper::HKL_info& hklinfo, const clipper::Map_stats& mapstats, float thresholdED, float thresholdProbe, const DensityBlobCatalogue* blobCatalogue = NULL)
+{
+	const int vectorShiftLimit = 5;
+
+	if(blobCatalogue != NULL && (!blobCatalogue->covers_density_above(3.0) || thresholdED < 0.0))
+		blobCatalogue = NULL;
+
+	struct ProbeSource
 	{
-		std::vector<clipper::String> ignoreAtomList = create_list_of_ignored_sugar_atoms(glycanChain[monomer]);
+		int chain;
+		int monomer;
+	};
+
+	// Each glycan chain generates its probes in parallel, they are then joined in chain order
+	std::vector<ProbeBatch> chainProbes(glycanChains.size());
+	std::vector<std::vector<ProbeSource> > chainSources(glycanChains.size());
 
-		for (int atom = 0; atom < glycanChain[monomer].size(); atom++)
+	#pragma omp parallel for schedule(dynamic)
+	for (int chain = 0; chain < (int) glycanChains.size(); chain++)
+	{
+		const std::vector < clipper::MSugar >& glycanChain = *glycanChains[chain];
+		for (int monomer = 0; monomer < glycanChain.size(); monomer++)
 		{
-			std::vector<std::pair<clipper::Coord_orth, double>> pairs;
+			std::vector<clipper::String> ignoreAtomList = create_list_of_ignored_sugar_atoms(glycanChain[monomer]);
 			clipper::Coord_orth sugarCentre = glycanChain[monomer].ring_centre();
-			bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), glycanChain[monomer][atom].id()) != ignoreAtomList.end());
-			if (!atomIgnored) {
+			ProbeBatch monomerProbes;
+			int monomerSegments = 0;
+
+			for (int atom = 0; atom < glycanChain[monomer].size(); atom++)
+			{
+				bool atomIgnored = (std::find(ignoreAtomList.begin(), ignoreAtomList.end(), glycanChain[monomer][atom].id()) != ignoreAtomList.end());
+				if (atomIgnored)
+					continue;
+
 				clipper::Coord_orth linkageAtomLocation = glycanChain[monomer][atom].coord_orth();
 
+				monomerProbes.begin_segment();
+				monomerProbes.add_ray(sugarCentre, clipper::Vec3<clipper::ftype>( linkageAtomLocation - sugarCentre ).unit(), vectorShiftLimit);
+				monomerSegments++;
+			}
 
-				for(int vectorShift = 1; vectorShift <= vectorShiftLimit; vectorShift++)
-					{
-						clipper::Coord_orth potentialTarget = getTargetPoint(linkageAtomLocation, sugarCentre, vectorShift);
+			if(!probes_may_reach_blobs(monomerProbes, sugarCentre, blobCatalogue, sigmaa_dif_map))
+				continue;
 
-						double meanDensityValue = calculateMeanElectronDensityInTargetPosition(potentialTarget, sigmaa_dif_map, mapstats);
-						std::pair<clipper::Coord_orth, double> tempDensityInfo(potentialTarget, meanDensityValue);
-						pairs.push_back(tempDensityInfo);
-					}
-			
-			const auto bestPair = max_element(pairs.begin(), pairs.end(), bestPointFinder);
-			clipper::Coord_orth bestTarget = bestPair->first;
-			double bestDensityValue = bestPair->second;
+			chainProbes[chain].append(monomerProbes);
+			chainSources[chain].insert(chainSources[chain].end(), monomerSegments, ProbeSource{chain, monomer});
+		}
+	}
 
-			if(bestDensityValue > thresholdEDBestBlob)
-			{
-				GlycanToMiniMolIDs identification = getCarbohydrateRelationshipToMiniMol(inputModel, glycanChain[monomer], allSugars, id, monomer);
-				double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
-				if(meanDensityValueBiggerArea > thresholdED)
-				{
-					std::pair<GlycanToMiniMolIDs, double> densityInfo(GlycanToMiniMolIDs{identification.proteinMiniMolID, identification.carbohydrateChainMiniMolID, identification.carbohydrateID}, meanDensityValueBiggerArea);
-					finalVectorForBlobValues.push_back(densityInfo);
-						if(pdbexport) 
-						{
-							drawOriginPoint(inputModel, bestTarget, identification.proteinMiniMolID, identification.carbohydrateChainMiniMolID);
-							// fillSearchArea(inputModel, bestTarget, sigmaa_dif_map, mapstats, identification.proteinMiniMolID, identification.carbohydrateChainMiniMolID);
-						}
-				}
+	ProbeBatch probes;
+	std::vector<ProbeSource> sources;
 
-			}
-			}
+	for (int chain = 0; chain < glycanChains.size(); chain++)
+	{
+		probes.append(chainProbes[chain]);
+		sources.insert(sources.end(), chainSources[chain].begin(), chainSources[chain].end());
+	}
+
+	std::vector<double> densities;
+	calculateMeanElectronDensityInTargetPositions(probes, densityTable, mapstats, densities);
+
+	std::vector<CarbohydrateBlobHit> segmentHits(sources.size());
+	std::vector<char> segmentHasHit(sources.size(), 0);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int segment = 0; segment < (int) sources.size(); segment++)
+	{
+		size_t best = probes.segment_argmax(segment, densities);
+		if(best == probes.segment_end(segment) || densities[best] <= thresholdProbe)
+			continue;
+
+		clipper::Coord_orth bestTarget = probes.position(best);
+		double meanDensityValueBiggerArea = calculateMeanElectronDensityForBiggerSphere(bestTarget, sigmaa_dif_map, mapstats, hklinfo);
+
+		if(meanDensityValueBiggerArea > thresholdED)
+		{
+			const ProbeSource& source = sources[segment];
+			GlycanToMiniMolIDs identification = getCarbohydrateRelationshipToMiniMol(inputModel, (*glycanChains[source.chain])[source.monomer], allSugars, glycanIDs[source.chain], source.monomer);
+			segmentHits[segment] = CarbohydrateBlobHit{identification, bestTarget, densities[best], meanDensityValueBiggerArea, -1};
+			segmentHasHit[segment] = 1;
+		}
+	}
+
+	std::vector<std::vector<CarbohydrateBlobHit> > hits(glycanChains.size());
+	for (int segment = 0; segment < sources.size(); segment++)
+		if (segmentHasHit[segment])
+			hits[sources[segment].chain].push_back(segmentHits[segment]);
+
+	return hits;
+}
+
+std::vector<std::vector<CarbohydrateBlobHit> > score_potential_unmodelled_carbohydrate_monomers(std::vector < clipper::MGlycan >& allSugars, const clipper::MiniMol& inputModel, const clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, const clipper::HKL_info& hklinfo, const clipper::Map_stats& mapstats, float thresholdED, float thresholdProbe, const DensityBlobCatalogue* blobCatalogue)
+{
+	std::vector<const std::vector < clipper::MSugar >* > glycanChains;
+	std::vector<int> glycanIDs;
+
+	for (int id = 0; id < allSugars.size(); id++)
+	{
+		glycanChains.push_back(&allSugars[id].get_sugars());
+		glycanIDs.push_back(id);
+	}
+
+	return score_unmodelled_carbohydrate_chains(glycanChains, glycanIDs, inputModel, allSugars, sigmaa_dif_map, densityTable, hklinfo, mapstats, thresholdED, thresholdProbe, blobCatalogue);
+}
+
+std::vector<std::pair<GlycanToMiniMolIDs, double> > apply_carbohydrate_blob_hits(const std::vector<CarbohydrateBlobHit>& hits, clipper::MiniMol& inputModel, bool pdbexport)
+{
+	std::vector<std::pair<GlycanToMiniMolIDs, double> > finalVectorForBlobValues;
+
+	for (int i = 0; i < hits.size(); i++)
+	{
+		finalVectorForBlobValues.push_back(std::pair<GlycanToMiniMolIDs, double>(hits[i].ids, hits[i].density));
+
+		if(pdbexport) 
+		{
+			drawOriginPoint(inputModel, hits[i].target, hits[i].ids.proteinMiniMolID, hits[i].ids.carbohydrateChainMiniMolID);
+			// fillSearchArea(inputModel, hits[i].target, sigmaa_dif_map, mapstats, hits[i].ids.proteinMiniMolID, hits[i].ids.carbohydrateChainMiniMolID);
 		}
 	}
 	return finalVectorForBlobValues;
 }
-	
 
+std::vector<std::pair<GlycanToMiniMolIDs, double> > get_electron_density_of_potential_unmodelled_carbohydrate_monomers(std::vector < clipper::MSugar > glycanChain, clipper::MiniMol&inputModel, std::vector < clipper::MGlycan >& allSugars, int id, clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, clipper::HKL_info& hklinfo, clipper::Map_stats& mapstats, float thresholdED, bool pdbexport)
+{
+	std::vector<std::vector<CarbohydrateBlobHit> > hits = score_unmodelled_carbohydrate_chains(std::vector<const std::vector < clipper::MSugar >* >(1, &glycanChain), std::vector<int>(1, id), inputModel, allSugars, sigmaa_dif_map, densityTable, hklinfo, mapstats, thresholdED, probe_density_threshold(mapstats, false));
+
+	return apply_carbohydrate_blob_hits(hits[0], inputModel, pdbexport);
+}
 
 
 
+static nlohmann::json blob_report_entry(const char* siteClass, const clipper::MPolymer& chain, const clipper::MMonomer& residue, const clipper::Coord_orth& target, double probeDensity, double density, int blobID, const clipper::Map_stats& mapstats, float thresholdED, const DensityBlobCatalogue& blobCatalogue)
+{
+	nlohmann::json entry;
+	entry["class"] = siteClass;
+	entry["chain"] = std::string(chain.id().trim());
+	entry["residue"] = std::string(residue.id().trim());
+	entry["residue_type"] = std::string(residue.type().trim());
+	entry["probe"] = { target.x(), target.y(), target.z() };
+	entry["probe_density"] = probeDensity;
+	entry["sphere_density"] = density;
+	entry["sigma_level"] = mapstats.std_dev() > 0.0 ? density / mapstats.std_dev() : 0.0;
+	entry["threshold"] = thresholdED;
+	entry["map_mean"] = mapstats.mean();
+	entry["map_sigma"] = mapstats.std_dev();
+
+	if ( blobID >= 0 && blobID < blobCatalogue.blobs().size() )
+		entry["blob"] = { { "id", blobID },
+						  { "volume", blobCatalogue.blobs()[blobID].volume },
+						  { "integrated_density", blobCatalogue.blobs()[blobID].integratedDensity } };
+	else
+		entry["blob"] = nullptr;
+
+	return entry;
+}
+
+bool write_blob_report(const clipper::String& path, const clipper::MiniMol& inputModel, const std::vector<std::vector<GlycosylationSiteBlobHit> >& siteHits, const std::vector<std::vector<CarbohydrateBlobHit> >& carbohydrateHits, const clipper::Map_stats& mapstats, float thresholdED, const DensityBlobCatalogue& blobCatalogue)
+{
+	static const char* siteClasses[] = { "N-linked", "C-linked", "O-linked", "S-linked", "PNGase" };
+
+	std::ofstream out( path.c_str() );
+
+	if ( !out )
+		return true;
+
+	// One JSON object per line, so pipelines can stream the report
+	for ( int type = 0; type < siteHits.size() && type < 5; type++ )
+		for ( int i = 0; i < siteHits[type].size(); i++ )
+		{
+			const GlycosylationSiteBlobHit& hit = siteHits[type][i];
+			const clipper::MPolymer& chain = inputModel[hit.site.chainID];
+			out << blob_report_entry( siteClasses[type], chain, chain[hit.site.monomerID], hit.target, hit.probeDensity, hit.density, hit.blobID, mapstats, thresholdED, blobCatalogue ).dump() << "\n";
+		}
+
+	for ( int id = 0; id < carbohydrateHits.size(); id++ )
+		for ( int i = 0; i < carbohydrateHits[id].size(); i++ )
+		{
+			const CarbohydrateBlobHit& hit = carbohydrateHits[id][i];
+			const clipper::MPolymer& chain = inputModel[hit.ids.proteinMiniMolID];
+			nlohmann::json entry = blob_report_entry( "Glycan chain", chain, chain[hit.ids.carbohydrateChainMiniMolID], hit.target, hit.probeDensity, hit.density, hit.blobID, mapstats, thresholdED, blobCatalogue );
+			entry["glycan"] = id;
+			entry["glycan_monomer"] = hit.ids.carbohydrateID;
+			out << entry.dump() << "\n";
+		}
+
+	out.flush();
+	return !out.good();
+}
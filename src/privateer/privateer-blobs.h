@@ -23,6 +23,8 @@
 #include <cmath>
 #include <algorithm>
 #include <list>
+#include <cctype>
+#include <sstream>
 #include "privateer-lib.h"
 #include <clipper/clipper.h>
 #include <clipper/clipper-cif.h>
@@ -60,19 +62,195 @@ struct GlycanToMiniMolIDs
 	int carbohydrateID;
 };
 
+struct GlycosylationSiteBlobHit
+{
+	PotentialGlycosylationSiteInfo site;
+	clipper::Coord_orth target;
+	double probeDensity;    // mean density of the best probe box
+	double density;         // mean density of the 2A sphere around it
+	int blobID;     // index into a DensityBlobCatalogue, -1 if not assigned
+};
+
+struct CarbohydrateBlobHit
+{
+	GlycanToMiniMolIDs ids;
+	clipper::Coord_orth target;
+	double probeDensity;
+	double density;
+	int blobID;
+};
+
+// Summed-area table (3D integral image) of a map over one unit cell of its grid. Built once per map,
+// box sums over any grid range are then answered with 8 table lookups; boxes crossing the cell
+// boundary are folded back into the cell using the map periodicity.
+class DensitySummedAreaTable
+{
+	public:
+		DensitySummedAreaTable() : nu(0), nv(0), nw(0), localMap(NULL) { }
+		// maximumGridPoints > 0 caps the table size; bigger cells (e.g. cryo-EM boxes) are summed box by box from the map instead
+		DensitySummedAreaTable(const clipper::Xmap<float>& densityMap, size_t maximumGridPoints = 0);
+
+		double boxSum(const clipper::Coord_grid& minCorner, const clipper::Coord_grid& maxCorner) const;
+		double boxMean(const clipper::Coord_grid& minCorner, const clipper::Coord_grid& maxCorner) const;
+
+		const clipper::Cell& cell() const { return mapCell; }
+		const clipper::Grid_sampling& grid_sampling() const { return mapGrid; }
+		bool is_null() const { return table.empty() && localMap == NULL; }
+		bool is_local() const { return localMap != NULL; }
+
+	private:
+		// sum over [0,u) x [0,v) x [0,w), with 0 <= u <= nu etc.
+		double prefix(int u, int v, int w) const { return table[ ( (size_t) u * (nv + 1) + v ) * (nw + 1) + w ]; }
+		// same as prefix(), but for any non-negative corner using whole periods of the cell
+		double periodicPrefix(int u, int v, int w) const;
+		// direct summation over the map, used when no table was built
+		double localBoxSum(const clipper::Coord_grid& minCorner, const clipper::Coord_grid& maxCorner) const;
+
+		int nu, nv, nw;
+		const clipper::Xmap<float>* localMap;
+		clipper::Cell mapCell;
+		clipper::Grid_sampling mapGrid;
+		std::vector<double> table;
+};
+
+
+// Probe positions of many candidates in structure-of-arrays layout, generated up front and scored in one batch.
+// Each candidate owns a contiguous segment of probes, possibly empty.
+class ProbeBatch
+{
+	public:
+		void reserve(size_t probes, size_t segments);
+		void begin_segment() { segmentStarts.push_back( x.size() ); }
+		void add(const clipper::Coord_orth& position) { x.push_back( position.x() ); y.push_back( position.y() ); z.push_back( position.z() ); }
+		// origin + unitDirection * k for k = 1..steps, same points as getTargetPoint() for the matching shifts
+		void add_ray(const clipper::Coord_orth& origin, const clipper::Vec3<clipper::ftype>& unitDirection, int steps);
+		// appends the probes of other, and its segments if it has any; lets batches be generated in parallel and joined in order
+		void append(const ProbeBatch& other);
+
+		size_t size() const { return x.size(); }
+		int segments() const { return segmentStarts.size(); }
+		size_t segment_begin(int segment) const { return segmentStarts[segment]; }
+		size_t segment_end(int segment) const { return segment + 1 < segmentStarts.size() ? segmentStarts[segment + 1] : x.size(); }
+		clipper::Coord_orth position(size_t i) const { return clipper::Coord_orth( x[i], y[i], z[i] ); }
+
+		// index of the first highest value within a segment, or segment_end() if the segment is empty
+		size_t segment_argmax(int segment, const std::vector<double>& values) const;
+
+		const std::vector<double>& xs() const { return x; }
+		const std::vector<double>& ys() const { return y; }
+		const std::vector<double>& zs() const { return z; }
+
+	private:
+		std::vector<double> x, y, z;
+		std::vector<size_t> segmentStarts;
+};
 
-std::vector<std::vector<GlycosylationMonomerMatch> > get_matching_monomer_positions(clipper::MiniMol& inputModel);
+// Integer grid offsets of all points inside a sphere, for a given cell, grid sampling and radius
+class SphericalStencil
+{
+	public:
+		SphericalStencil(const clipper::Cell& cell, const clipper::Grid_sampling& grid, double radius);
+
+		bool matches(const clipper::Cell& cell, const clipper::Grid_sampling& grid, double radius) const;
+		const std::vector<clipper::Coord_grid>& offsets() const { return gridOffsets; }
+
+	private:
+		clipper::Cell stencilCell;
+		clipper::Grid_sampling stencilGrid;
+		double stencilRadius;
+		std::vector<clipper::Coord_grid> gridOffsets;
+};
+
+// Stencils are built once per (cell, grid, radius) and shared; safe to call from parallel blob scoring
+const SphericalStencil& get_spherical_stencil(const clipper::Cell& cell, const clipper::Grid_sampling& grid, double radius);
+
+struct DensityBlob
+{
+	int gridPoints;
+	double volume;                  // in A^3
+	double integratedDensity;       // density summed over the blob, times the volume of a grid cell
+	double peakDensity;
+	clipper::Coord_orth centroid;
+	double extent;                  // largest distance from the centroid to a grid point of the blob, in A
+	clipper::String nearestChain;   // empty if no residue was found within the search radius
+	clipper::String nearestResidue;
+	clipper::String nearestResidueType;
+	double nearestResidueDistance;
+};
+
+// Connected components of a map above a sigma cutoff. Neighbours are followed through the map symmetry, so each blob
+// is recorded once per asymmetric unit, and its centroid is computed on a contiguous copy of it.
+class DensityBlobCatalogue
+{
+	public:
+		DensityBlobCatalogue() : sigmaCutoff(0.0), mapSigma(0.0), minimumPoints(1) { }
+		DensityBlobCatalogue(const clipper::Xmap<float>& densityMap, const clipper::Map_stats& mapstats, float cutoff, int minimumGridPoints = 1);
+
+		void assign_nearest_residues(const clipper::MiniMol& inputModel, float searchRadius = 6.0);
+		int blob_at(const clipper::Coord_orth& position) const; //!< index into blobs(), -1 if position is not inside a blob
+		//! false only if no blob, nor any symmetry copy of one, comes within radius of position; true may include blobs slightly further away
+		bool any_blob_near(const clipper::Coord_orth& position, double radius) const;
+		//! whether every grid point above sigmaLevel map sigmas belongs to a blob, so that any_blob_near() rules such density out
+		bool covers_density_above(float sigmaLevel) const { return !labels.is_null() && minimumPoints <= 1 && sigmaCutoff <= sigmaLevel; }
+		std::string describe(int blobID) const; //!< short summary for console output, empty for -1
+
+		const std::vector<DensityBlob>& blobs() const { return blobList; }
+		nlohmann::json to_json() const;
+		bool write_json(const clipper::String& path) const; //!< returns true if there have been any problems
+
+	private:
+		float sigmaCutoff;
+		float mapSigma;
+		int minimumPoints;
+		clipper::Xmap<int> labels;
+		std::vector<DensityBlob> blobList;
+		std::vector<std::pair<int, clipper::Coord_frac> > centroidImages; // blob index and centroid, under every symmetry operator
+};
+
+// With useMotifFilter, ASN is kept only in N-X-S/T/C sequons (X != P), TRP only in W-x-x-W motifs and SER/THR only when
+// matching one of oGlycanMotifs (one-letter code, X as wildcard, glycosylated residue in lower case, e.g. CXsXPC)
+std::vector<std::vector<GlycosylationMonomerMatch> > get_matching_monomer_positions(clipper::MiniMol& inputModel, bool useMotifFilter = false, const std::vector<clipper::String>& oGlycanMotifs = std::vector<clipper::String>());
 clipper::MiniMol get_model_without_waters(const clipper::String& ippdb);
-bool check_glycosylation_presence(int chainID, int residueID, std::vector < clipper::MGlycan > glycanList);
-clipper::Coord_orth getTargetPoint(clipper::Coord_orth& coord1, clipper::Coord_orth& coord2, int vectorShiftDistance);
+clipper::MiniMol get_model_without_waters(const clipper::MiniMol& inputModel, bool removeOtherSolvent = false); // no file access, chain indices match inputModel but monomer indices do not, identify residues by chain and residue ID
+bool is_solvent_residue(const clipper::String& residueType, bool includeOtherSolvent = false);
+bool check_glycosylation_presence(const clipper::String& chainID, const clipper::String& residueID, const std::vector < clipper::MGlycan >& glycanList);
+clipper::Coord_orth getTargetPoint(const clipper::Coord_orth& coord1, const clipper::Coord_orth& coord2, int vectorShiftDistance);
 void fillSearchArea(clipper::MiniMol& inputModel, clipper::Coord_orth& targetPos, clipper::Xmap<float>& sigmaa_dif_map, clipper::HKL_info& hklinfo, clipper::Map_stats& mapstats, int chainID, int monomerID);
 void drawOriginPoint(clipper::MiniMol& inputModel, clipper::Coord_orth target, int chainID, int monomerID);
-GlycanToMiniMolIDs getCarbohydrateRelationshipToMiniMol(clipper::MiniMol& inputModel, clipper::MSugar& carbohydrate, std::vector < clipper::MGlycan >& allSugars, int mglycanid, int sugaringlycanid);
-double calculateMeanElectronDensityInTargetPosition(clipper::Coord_orth targetPos, clipper::Xmap<float>& sigmaa_dif_map, clipper::Map_stats& mapstats);
-double calculateMeanElectronDensityForBiggerSphere(clipper::Coord_orth& targetPos, clipper::Xmap<float>& sigmaa_dif_map, clipper::Map_stats& mapstats, clipper::HKL_info& hklinfo);
-std::vector<clipper::String> create_list_of_ignored_sugar_atoms(clipper::MSugar& carbohydrate);
-std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > get_electron_density_of_potential_glycosylation_sites(const std::vector<std::vector<GlycosylationMonomerMatch>>& informationVector, int vectorIndex, clipper::MiniMol& mmol, clipper::Xmap<float>& sigmaa_dif_map, clipper::HKL_info& hklinfo, std::vector < clipper::MGlycan >& glycanList, clipper::Map_stats& mapstats, float thresholdED, bool pdbexport = false);
-std::vector<std::pair<GlycanToMiniMolIDs, double> > get_electron_density_of_potential_unmodelled_carbohydrate_monomers(std::vector < clipper::MSugar > glycanChain, clipper::MiniMol&inputModel, std::vector < clipper::MGlycan >& allSugars, int id, clipper::Xmap<float>& sigmaa_dif_map, clipper::HKL_info& hklinfo, clipper::Map_stats& mapstats, float thresholdED, bool pdbexport = false);
+GlycanToMiniMolIDs getCarbohydrateRelationshipToMiniMol(const clipper::MiniMol& inputModel, const clipper::MSugar& carbohydrate, const std::vector < clipper::MGlycan >& allSugars, int mglycanid, int sugaringlycanid);
+double calculateMeanElectronDensityInTargetPosition(const clipper::Coord_orth& targetPos, const DensitySummedAreaTable& densityTable, const clipper::Map_stats& mapstats);
+void calculateMeanElectronDensityInTargetPositions(const ProbeBatch& probes, const DensitySummedAreaTable& densityTable, const clipper::Map_stats& mapstats, std::vector<double>& densities);
+double calculateMeanElectronDensityForBiggerSphere(const clipper::Coord_orth& targetPos, const clipper::Xmap<float>& sigmaa_dif_map, const clipper::Map_stats& mapstats, const clipper::HKL_info& hklinfo);
+std::vector<clipper::String> create_list_of_ignored_sugar_atoms(const clipper::MSugar& carbohydrate);
+
+// Mean density that the best probe box of a candidate must exceed before its 2A sphere is checked. Sigmaa difference maps
+// are on an absolute scale, where 0.07 is about one sigma of a typical map and is kept as it always was. Cryo-EM maps come
+// in arbitrary units, so there the cutoff is one map sigma instead.
+inline float probe_density_threshold(const clipper::Map_stats& mapstats, bool relativeToSigma) { return relativeToSigma ? mapstats.std_dev() : 0.070; }
+
+// Mean density that the 2A sphere around the best probe must exceed to make a hit. The -blobs_threshold value is used as
+// it is on sigmaa difference maps; on cryo-EM maps it is read in map sigmas, where the 0.02 default of the absolute scale
+// would be meaningless, and defaults to 0.3 sigma, which is what 0.02 is on a typical sigmaa map.
+const float cryoem_sphere_threshold_sigmas = 0.3;
+inline float sphere_density_threshold(const clipper::Map_stats& mapstats, float threshold, bool relativeToSigma) { return relativeToSigma ? threshold * mapstats.std_dev() : threshold; }
+
+// Cryo-EM boxes can be large: above this many grid points (256^3) the map is not walked as a whole, probes are summed
+// locally instead of through a DensitySummedAreaTable and no DensityBlobCatalogue is built
+const size_t maximum_whole_map_grid_points = 16777216;
+
+// Blob search is split in two: a scoring phase that only reads the model and the map and runs in parallel,
+// and a serial phase that records the hits and, if requested, inserts DUM atoms into the model.
+// Given a catalogue that covers the 3 sigma level of the map, candidates whose probes cannot reach any blob are looked up
+// in it and skipped without probing; since only density above 3 sigma makes a hit, this does not change the results.
+std::vector<std::vector<GlycosylationSiteBlobHit> > score_potential_glycosylation_sites(const std::vector<std::vector<GlycosylationMonomerMatch>>& informationVector, const clipper::MiniMol& inputModel, const clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, const clipper::HKL_info& hklinfo, const std::vector < clipper::MGlycan >& glycanList, const clipper::Map_stats& mapstats, float thresholdED, float thresholdProbe, int onlyVectorIndex = -1, const DensityBlobCatalogue* blobCatalogue = NULL);
+std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > apply_glycosylation_site_hits(const std::vector<GlycosylationSiteBlobHit>& hits, clipper::MiniMol& inputModel, bool pdbexport);
+std::vector<std::vector<CarbohydrateBlobHit> > score_potential_unmodelled_carbohydrate_monomers(std::vector < clipper::MGlycan >& allSugars, const clipper::MiniMol& inputModel, const clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, const clipper::HKL_info& hklinfo, const clipper::Map_stats& mapstats, float thresholdED, float thresholdProbe, const DensityBlobCatalogue* blobCatalogue = NULL);
+std::vector<std::pair<GlycanToMiniMolIDs, double> > apply_carbohydrate_blob_hits(const std::vector<CarbohydrateBlobHit>& hits, clipper::MiniMol& inputModel, bool pdbexport);
+
+// JSON-lines report with one object per hit, written straight from the scoring results; returns true if there have been any problems
+bool write_blob_report(const clipper::String& path, const clipper::MiniMol& inputModel, const std::vector<std::vector<GlycosylationSiteBlobHit> >& siteHits, const std::vector<std::vector<CarbohydrateBlobHit> >& carbohydrateHits, const clipper::Map_stats& mapstats, float thresholdED, const DensityBlobCatalogue& blobCatalogue);
+std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > get_electron_density_of_potential_glycosylation_sites(const std::vector<std::vector<GlycosylationMonomerMatch>>& informationVector, int vectorIndex, clipper::MiniMol& mmol, clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, clipper::HKL_info& hklinfo, std::vector < clipper::MGlycan >& glycanList, clipper::Map_stats& mapstats, float thresholdED, bool pdbexport = false);
+std::vector<std::pair<GlycanToMiniMolIDs, double> > get_electron_density_of_potential_unmodelled_carbohydrate_monomers(std::vector < clipper::MSugar > glycanChain, clipper::MiniMol&inputModel, std::vector < clipper::MGlycan >& allSugars, int id, clipper::Xmap<float>& sigmaa_dif_map, const DensitySummedAreaTable& densityTable, clipper::HKL_info& hklinfo, clipper::Map_stats& mapstats, float thresholdED, bool pdbexport = false);
 
 
 
@@ -16,10 +16,13 @@
 // award UF160039
 
 #include "privateer-cryo_em.h"
+#include "privateer-xray.h"
 
-void privateer::cryo_em::read_cryoem_map  ( clipper::String const pathname, clipper::HKL_info& hklinfo, clipper::Xmap<double>& output_map, clipper::CCP4MAPfile& mrcin, float const resolution_value )
+void privateer::cryo_em::read_cryoem_map  ( clipper::String const pathname, clipper::HKL_info& hklinfo, clipper::Xmap<double>& output_map, clipper::CCP4MAPfile& mrcin, float const resolution_value, bool batch )
 {
-    std::cout << "Reading " << pathname.trim().c_str() << "... ";
+    std::ostream messages ( batch ? NULL : std::cout.rdbuf() );
+
+    messages << "Reading " << pathname.trim().c_str() << "... ";
     fflush(0);
     try
     {
@@ -27,7 +30,7 @@ void privateer::cryo_em::read_cryoem_map  ( clipper::String const pathname, clip
         mrcin.import_xmap( output_map );
         mrcin.close_read();
 
-        std::cout << "done." << std::endl;
+        messages << "done." << std::endl;
 
         clipper::Resolution resolution(resolution_value);
         hklinfo = clipper::HKL_info(output_map.spacegroup(), output_map.cell(), resolution, true);
@@ -40,7 +43,6 @@ void privateer::cryo_em::read_cryoem_map  ( clipper::String const pathname, clip
 
 void privateer::cryo_em::initialize_dummy_fobs(clipper::HKL_data<clipper::data32::F_sigF>& fobs, clipper::HKL_data<clipper::data32::F_phi>& fc_cryoem_obs)
 {
-    int iteration = 0;
     for (HRI ih = fc_cryoem_obs.first(); !ih.last(); ih.next() ) // we want to use all available reflections
         {
             if(!fc_cryoem_obs[ih].missing())
@@ -49,15 +51,12 @@ void privateer::cryo_em::initialize_dummy_fobs(clipper::HKL_data<clipper::data32
                 // fobs[ih].sigf() = fc_cryoem_obs[ih].f();
                 // fobs[ih].sigf() = 0;
                 fobs[ih].sigf() = 1;
-                iteration++;
-                if(iteration == 420 || iteration == 6743) std::cout << "fobs[" << ih.index() << "].f() = " << fobs[ih].f() << "\tfobs[" << ih.index() << "].sigf() = " << fobs[ih].sigf() << std::endl;
-                // std::cout << "fobs[" << ih.index() << "].f() = " << fobs[ih].f() << "\tfobs[" << ih.index() << "].sigf() = " << fobs[ih].sigf() << std::endl;
             }
         }
 }
 
 
-void privateer::cryo_em::calculate_sfcs_of_fc_maps ( clipper::HKL_data<clipper::data32::F_phi>& fc_all_cryoem_data, clipper::HKL_data<clipper::data32::F_phi>& fc_ligands_only_cryoem_data, clipper::Atom_list& allAtoms, clipper::Atom_list& ligandAtoms) //calculated ligandmap here, lacks atom list of ligands. Replace reference_map with direct object of fc_ligands_bsc
+void privateer::cryo_em::calculate_sfcs_of_fc_maps ( clipper::HKL_data<clipper::data32::F_phi>& fc_all_cryoem_data, clipper::HKL_data<clipper::data32::F_phi>& fc_ligands_only_cryoem_data, clipper::Atom_list& allAtoms, clipper::Atom_list& ligandAtoms, bool batch ) //calculated ligandmap here, lacks atom list of ligands. Replace reference_map with direct object of fc_ligands_bsc
 {
   clipper::SFcalc_iso_fft<float> sfcligands;
   clipper::SFcalc_iso_fft<float> sfcall;
@@ -74,7 +73,8 @@ void privateer::cryo_em::calculate_sfcs_of_fc_maps ( clipper::HKL_data<clipper::
     }
     catch ( ... ) 
     {
-      std::cout << "\nThe input file has unrecognised atoms. Might cause unexpected results...\n";  // this causes clipper to freak out, so better remove those unknowns
+      if ( !batch )
+        std::cout << "\nThe input file has unrecognised atoms. Might cause unexpected results...\n";  // this causes clipper to freak out, so better remove those unknowns
     }
 }
 
@@ -125,6 +125,30 @@ bool privateer::cryo_em::generate_output_map_coefficients (clipper::HKL_data<cli
   return true;
 }
 
+bool privateer::cryo_em::calculate_difference_map ( clipper::Xmap<float>& difference_map, clipper::HKL_data<clipper::data32::F_phi>& fc_cryoem_obs, clipper::Atom_list& modelAtoms, clipper::HKL_info& hklinfo, bool batch )
+{
+  clipper::HKL_data<clipper::data32::F_phi> fc_model ( hklinfo );
+  clipper::HKL_data<clipper::data32::F_phi> difference_coefficients ( hklinfo );
+  clipper::SFcalc_iso_fft<float> sfcall;
+
+  try
+  {
+    sfcall( fc_model, modelAtoms );
+  }
+  catch ( ... )
+  {
+    if ( !batch )
+      std::cout << "\nThe input file has unrecognised atoms. Might cause unexpected results...\n";
+  }
+
+  if ( !generate_output_map_coefficients ( difference_coefficients, fc_cryoem_obs, fc_model, hklinfo ) )
+    return false;
+
+  difference_map.fft_from( difference_coefficients );
+
+  return true;
+}
+
 std::pair<double, double> privateer::cryo_em::calculate_rscc  ( clipper::Xmap<double>& experimental_map,
                                             clipper::Xmap<double>& fc_map, // equivalent to lignadmap in xray implementation
                                             clipper::Xmap<double>& mask,
@@ -133,62 +157,7 @@ std::pair<double, double> privateer::cryo_em::calculate_rscc  ( clipper::Xmap<do
                                             clipper::Coord_orth& origin,
                                             clipper::Coord_orth& destination )
 {
-  clipper::Map_stats ms;
-
-
-  ms = clipper::Map_stats(experimental_map);
-
-  double mean_rho_exp, mean_rho_calc, num, den1, den2, corr_coeff;
-  mean_rho_calc = mean_rho_exp = num = den1 = den2 = corr_coeff = 0.0;
-
-  int n_points = 0;
-  clipper::Xmap_base::Map_reference_coord i0, iu, iv, iw;
-
-  double accum = 0.0;
-
-  // calculation of the mean densities of the two input maps
-
-  i0 = clipper::Xmap_base::Map_reference_coord( experimental_map, origin.coord_frac(hklinfo.cell()).coord_grid(mygrid) );
-
-  for ( iu = i0; iu.coord().u() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).u(); iu.next_u() )
-      for ( iv = iu; iv.coord().v() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).v(); iv.next_v() )
-          for ( iw = iv; iw.coord().w() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).w(); iw.next_w() )
-          {
-              if ( mask[iw] == 1.0)
-              {
-                  mean_rho_calc = mean_rho_calc + fc_map[iw];
-                  mean_rho_exp = mean_rho_exp + experimental_map[iw];
-                  n_points++;
-              }
-          }
-
-
-  accum = mean_rho_exp / ms.std_dev();
-  accum /= n_points;
-
-  mean_rho_calc = mean_rho_calc / n_points;
-  mean_rho_exp = mean_rho_exp / n_points;
-
-
-  i0 = clipper::Xmap_base::Map_reference_coord( experimental_map, origin.coord_frac(hklinfo.cell()).coord_grid(mygrid) );
-
-  for ( iu = i0; iu.coord().u() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).u(); iu.next_u() )
-    for ( iv = iu; iv.coord().v() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).v(); iv.next_v() )
-        for ( iw = iv; iw.coord().w() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).w(); iw.next_w() )
-        {
-            if ( mask[iw] == 1.0)
-            {
-
-              num = num + (experimental_map[iw] - mean_rho_exp) * (fc_map[iw] - mean_rho_calc);
-              den1 = den1 + pow((experimental_map[iw] - mean_rho_exp),2);
-              den2 = den2 + pow((fc_map[iw] - mean_rho_calc),2);
-            }
-        }
-
-  corr_coeff = num / (sqrt(den1) * sqrt(den2));
-
-
-  return std::make_pair(corr_coeff, accum);
+  return privateer::xray::calculate_rscc ( experimental_map, fc_map, mask, clipper::Map_stats ( experimental_map ), hklinfo, mygrid, origin, destination );
 }
 
   void privateer::cryo_em::write_cryoem_map ( clipper::String const pathname, clipper::Xmap<float> const &input_map )
@@ -29,15 +29,19 @@ namespace privateer
 {
   namespace cryo_em
   {
-    void read_cryoem_map  ( clipper::String const pathname, clipper::HKL_info& hklinfo, clipper::Xmap<double>& output_map, clipper::CCP4MAPfile& mrcin, float const resolution_value );
+    // batch silences the progress messages here and in calculate_sfcs_of_fc_maps and calculate_difference_map
+    void read_cryoem_map  ( clipper::String const pathname, clipper::HKL_info& hklinfo, clipper::Xmap<double>& output_map, clipper::CCP4MAPfile& mrcin, float const resolution_value, bool batch = false );
 
     void initialize_dummy_fobs(clipper::HKL_data<clipper::data32::F_sigF>& fobs, clipper::HKL_data<clipper::data32::F_phi>& fc_cryoem_obs);
 
-    void calculate_sfcs_of_fc_maps ( clipper::HKL_data<clipper::data32::F_phi>& fc_all_cryoem_data, clipper::HKL_data<clipper::data32::F_phi>& fc_ligands_only_cryoem_data, clipper::Atom_list& allAtoms, clipper::Atom_list& ligandAtoms);
+    void calculate_sfcs_of_fc_maps ( clipper::HKL_data<clipper::data32::F_phi>& fc_all_cryoem_data, clipper::HKL_data<clipper::data32::F_phi>& fc_ligands_only_cryoem_data, clipper::Atom_list& allAtoms, clipper::Atom_list& ligandAtoms, bool batch = false );
 
     bool generate_output_map_coefficients (clipper::HKL_data<clipper::data32::F_phi>& difference_coefficients, clipper::HKL_data<clipper::data32::F_phi>& fc_cryoem_obs, clipper::HKL_data<clipper::data32::F_phi>& fc_all_cryoem_data, clipper::HKL_info& hklinfo);
-    
 
+    // Fo-Fc style difference map of a model against the experimental map coefficients, sampled on the grid of difference_map
+    bool calculate_difference_map ( clipper::Xmap<float>& difference_map, clipper::HKL_data<clipper::data32::F_phi>& fc_cryoem_obs, clipper::Atom_list& modelAtoms, clipper::HKL_info& hklinfo, bool batch = false );
+
+    // Same as xray::calculate_rscc, with the statistics taken from experimental_map
     std::pair<double, double> calculate_rscc  ( clipper::Xmap<double> &experimental_map,
                                                 clipper::Xmap<double> &fc_map, 
                                                 clipper::Xmap<double> &mask,
@@ -11,8 +11,17 @@
 
 // #define DUMP 1
 #include "privateer-lib.h"
-
-void privateer::coot::insert_coot_prologue_scheme ( std::fstream& output )
+#include "privateer-xray.h"
+#include "privateer-cryo_em.h"
+#include "privateer-blobs.h"
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <map>
+#include <limits>
+#include <stdexcept>
+
+void privateer::coot::insert_coot_prologue_scheme ( std::ostream& output )
 {
     output  << "; This script has been created by Privateer (Agirre, Iglesias, Rovira, Davies, Wilson and Cowtan, 2013-17)\n"
             << "(set-graphics-window-size 1873 968)\n"
@@ -47,7 +56,7 @@ void privateer::coot::insert_coot_prologue_scheme ( std::fstream& output )
             << "(set-run-state-file-status 0)\n";
 }
 
-void privateer::coot::insert_coot_files_loadup_scheme ( std::fstream& output, const clipper::String& pdb, const clipper::String& mapbest, const clipper::String& mapdiff, const clipper::String& mapomit, bool mode, const clipper::String& pdbblobs, bool blobsoutput)
+void privateer::coot::insert_coot_files_loadup_scheme ( std::ostream& output, const clipper::String& pdb, const clipper::String& mapbest, const clipper::String& mapdiff, const clipper::String& mapomit, bool mode, const clipper::String& pdbblobs, bool blobsoutput)
 {
      if (blobsoutput && pdbblobs != "NONE") output << "(handle-read-draw-molecule \"" << pdbblobs << "\")\n";
     if (!mode) output << "(handle-read-draw-molecule \"" << pdb << "\")\n";
@@ -72,7 +81,7 @@ void privateer::coot::insert_coot_files_loadup_scheme ( std::fstream& output, co
     }
 }
 
-void privateer::coot::insert_coot_files_loadup_python ( std::fstream& output, const clipper::String& pdb, const clipper::String& mapbest, const clipper::String& mapdiff, const clipper::String& mapomit, bool mode, const clipper::String& pdbblobs, bool blobsoutput )
+void privateer::coot::insert_coot_files_loadup_python ( std::ostream& output, const clipper::String& pdb, const clipper::String& mapbest, const clipper::String& mapdiff, const clipper::String& mapomit, bool mode, const clipper::String& pdbblobs, bool blobsoutput )
 {
     if (blobsoutput && pdbblobs != "NONE") output  << "handle_read_draw_molecule (\"" << pdbblobs << "\")\n";
     if (!mode) output  << "handle_read_draw_molecule (\"" << pdb << "\")\n";
@@ -92,7 +101,7 @@ void privateer::coot::insert_coot_files_loadup_python ( std::fstream& output, co
     }  
 }
 
-void privateer::coot::insert_coot_epilogue_scheme ( std::fstream& output )
+void privateer::coot::insert_coot_epilogue_scheme ( std::ostream& output )
 {
     output  << "\n\n))\n(set-scroll-wheel-map 3)\n"
             << "(set-matrix 20.00)\n"
@@ -100,7 +109,7 @@ void privateer::coot::insert_coot_epilogue_scheme ( std::fstream& output )
             << "(set-show-symmetry-master 0)\n";
 }
 
-void privateer::coot::insert_coot_prologue_python ( std::fstream& output )
+void privateer::coot::insert_coot_prologue_python ( std::ostream& output )
 {
 
     output  << "# This script has been created by Privateer (Agirre, Iglesias, Rovira, Davies, Wilson and Cowtan, 2013-16)\n"
@@ -136,7 +145,7 @@ void privateer::coot::insert_coot_prologue_python ( std::fstream& output )
             << "toggle_idle_spin_function\n";
 }
 
-void privateer::coot::insert_coot_epilogue_python ( std::fstream& output )
+void privateer::coot::insert_coot_epilogue_python ( std::ostream& output )
 {
     output  << "\n\n])\nset_scroll_wheel_map (3)\n"
             << "set_matrix (20.00)\n"
@@ -144,41 +153,111 @@ void privateer::coot::insert_coot_epilogue_python ( std::fstream& output )
             << "set_show_symmetry_master (0)\n";
 }
 
-void privateer::coot::insert_coot_command ( std::fstream& output, std::string command )
+void privateer::coot::insert_coot_command ( std::ostream& output, std::string command )
 {
     output << command << "\n" ;
 }
 
-void privateer::coot::insert_coot_go_to_blob_scheme ( std::fstream& output, const clipper::Coord_orth& blob_centre, const clipper::String& diagnostic )
+void privateer::coot::insert_coot_go_to_blob_scheme ( std::ostream& output, const clipper::Coord_orth& blob_centre, const clipper::String& diagnostic )
 {
     output  << "\t(list\t\"" << diagnostic << "\"\t" << blob_centre.x() << "\t" << blob_centre.y() << "\t" << blob_centre.z() << ")\n";
 }
 
-void privateer::coot::insert_coot_go_to_blob_python ( std::fstream& output, const clipper::Coord_orth& blob_centre, const clipper::String& diagnostic )
+void privateer::coot::insert_coot_go_to_blob_python ( std::ostream& output, const clipper::Coord_orth& blob_centre, const clipper::String& diagnostic )
 {
     output  << "\t[\"" << diagnostic << "\",\t" << blob_centre.x() << ",\t" << blob_centre.y() << ",\t" << blob_centre.z() << "],\n";
 }
 
-void privateer::coot::insert_coot_go_to_sugar_scheme ( std::fstream& output, const clipper::Coord_orth& sugar_centre, const clipper::String& diagnostic )
+void privateer::coot::insert_coot_go_to_sugar_scheme ( std::ostream& output, const clipper::Coord_orth& sugar_centre, const clipper::String& diagnostic )
 {
     output  << "\t(list\t\"" << diagnostic << "\"\t" << sugar_centre.x() << "\t" << sugar_centre.y() << "\t" << sugar_centre.z() << ")\n";
 }
 
-void privateer::coot::insert_coot_go_to_sugar_python ( std::fstream& output, const clipper::Coord_orth& sugar_centre, const clipper::String& diagnostic )
+void privateer::coot::insert_coot_go_to_sugar_python ( std::ostream& output, const clipper::Coord_orth& sugar_centre, const clipper::String& diagnostic )
 {
     output  << "\t[\"" << diagnostic << "\",\t" << sugar_centre.x() << ",\t" << sugar_centre.y() << ",\t" << sugar_centre.z() << "],\n";
 }
 
-void privateer::coot::insert_coot_statusbar_text_scheme ( std::fstream& output, clipper::String& text)
+void privateer::coot::insert_coot_statusbar_text_scheme ( std::ostream& output, clipper::String& text)
 {
     output  << "(add-status-bar-text \"" << text << "\")" ;
 }
 
-void privateer::coot::insert_coot_statusbar_text_python ( std::fstream& output, clipper::String& text )
+void privateer::coot::insert_coot_statusbar_text_python ( std::ostream& output, clipper::String& text )
 {
     output  << "add_status_bar_text (\"" << text << "\")" ;
 }
 
+void privateer::coot::NavigationList::set_files ( const clipper::String& pdb, const clipper::String& mapbest, const clipper::String& mapdiff, const clipper::String& mapomit, bool mode, const clipper::String& pdbblobs, bool blobsoutput )
+{
+    this->pdb = pdb;
+    this->mapbest = mapbest;
+    this->mapdiff = mapdiff;
+    this->mapomit = mapomit;
+    this->mode = mode;
+    this->pdbblobs = pdbblobs;
+    this->blobsoutput = blobsoutput;
+}
+
+std::string privateer::coot::NavigationList::render_scheme ( )
+{
+    std::ostringstream output;
+
+    insert_coot_prologue_scheme ( output );
+    insert_coot_files_loadup_scheme ( output, pdb, mapbest, mapdiff, mapomit, mode, pdbblobs, blobsoutput );
+
+    for ( int i = 0 ; i < entries.size() ; i++ )
+        insert_coot_go_to_sugar_scheme ( output, entries[i].first, entries[i].second );
+
+    insert_coot_epilogue_scheme ( output );
+
+    if ( !status_bar_text.empty() )
+        insert_coot_statusbar_text_scheme ( output, status_bar_text );
+
+    return output.str();
+}
+
+std::string privateer::coot::NavigationList::render_python ( )
+{
+    std::ostringstream output;
+
+    insert_coot_prologue_python ( output );
+    insert_coot_files_loadup_python ( output, pdb, mapbest, mapdiff, mapomit, mode, pdbblobs, blobsoutput );
+
+    for ( int i = 0 ; i < entries.size() ; i++ )
+        insert_coot_go_to_sugar_python ( output, entries[i].first, entries[i].second );
+
+    insert_coot_epilogue_python ( output );
+
+    if ( !status_bar_text.empty() )
+        insert_coot_statusbar_text_python ( output, status_bar_text );
+
+    return output.str();
+}
+
+bool privateer::coot::NavigationList::write ( const std::string& scheme_path, const std::string& python_path )
+{
+    bool problems = false;
+
+    if ( !scheme_path.empty() )
+    {
+        const std::string script = render_scheme ( );
+        std::ofstream out ( scheme_path.c_str() );
+        out.write ( script.data(), script.size() );
+        problems = problems || !out;
+    }
+
+    if ( !python_path.empty() )
+    {
+        const std::string script = render_python ( );
+        std::ofstream out ( python_path.c_str() );
+        out.write ( script.data(), script.size() );
+        problems = problems || !out;
+    }
+
+    return problems;
+}
+
 
 
 ///////// Privateer - utilities /////////
@@ -606,184 +685,407 @@ bool privateer::util::write_libraries ( std::vector < std::string > code_list, f
     return false;
 }
 
-void privateer::util::print_XML ( std::vector < std::pair < clipper::String, clipper::MSugar > > sugarList, std::vector < clipper::MGlycan > list_of_glycans, std::vector<std::vector<std::pair<std::pair<clipper::MGlycan, std::vector<int>>,float>>>& list_of_glycans_associated_to_permutations, clipper::String pdbname, nlohmann::json &jsonObject )
+// program.xml is assembled in memory and written once; these keep the per-field cost down
+
+static void append_element ( std::string& out, const char* open, const std::string& value, const char* close )
+{
+    out.append ( open );
+    out.append ( value );
+    out.append ( close );
+}
+
+static void append_element ( std::string& out, const char* open, double value, const char* close )
 {
-    std::fstream of_xml;
+    char digits[32];
+    int length = snprintf ( digits, sizeof(digits), "%g", value ); // same as an ostream's default formatting
+    out.append ( open );
+    out.append ( digits, length );
+    out.append ( close );
+}
 
-    of_xml.open("program.xml", std::fstream::out);
+static void append_element ( std::string& out, const char* open, int value, const char* close )
+{
+    char digits[16];
+    int length = snprintf ( digits, sizeof(digits), "%d", value );
+    out.append ( open );
+    out.append ( digits, length );
+    out.append ( close );
+}
 
-    of_xml << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
-    of_xml << "<?xml-stylesheet type=\"text/xsl\" href=\"program.xml\"?>\n";
-    of_xml << "<xsl:stylesheet id=\"stylesheet\" version=\"1.0\" xmlns:xsl=\"http://www.w3.org/1999/XSL/Transform\">\n";
-    of_xml << "<xsl:value-of select=\".\" disable-output-escaping = \"yes\"/>\n" ;
+// formats like clipper::String ( value ) followed by resize ( width )
 
-    of_xml << "<PrivateerResult>\n";
-    of_xml << "  <ValidationData>\n";
+static void append_truncated_element ( std::string& out, const char* open, double value, size_t width, const char* close )
+{
+    char digits[32];
+    int length = snprintf ( digits, sizeof(digits), "%5.10g", value );
+    out.append ( open );
+    out.append ( digits, std::min ( (size_t) length, width ) ); // the width of 5 means there is always enough to cut
+    out.append ( close );
+}
 
-    for (int i = 0; i < sugarList.size() ; i++ )
+static void lookup_database_ids ( nlohmann::json& jsonObject, int valueLocation, std::string& glyTouCanID, std::string& glyConnectID )
+{
+    if (valueLocation != -1)
     {
-        if ( ( sugarList[i].second.ring_cardinality() == 6 ) || ( sugarList[i].second.ring_cardinality() == 5 ) )
+        glyTouCanID = jsonObject[valueLocation]["AccessionNumber"];
+        if (glyTouCanID.front() == '"' && glyTouCanID.front() == '"')
         {
-            std::vector<clipper::ftype> cpParams = sugarList[i].second.cremer_pople_params();
+            glyTouCanID.erase(0, 1);
+            glyTouCanID.pop_back();
+        }
+
+        if      (jsonObject[valueLocation]["glyconnect"] != "NotFound") glyConnectID = to_string(jsonObject[valueLocation]["glyconnect"]["id"]);
+        else     glyConnectID = "NotFound";
+    }
+    else glyTouCanID = "NotFound", glyConnectID = "NotFound";
+}
+
+void privateer::util::print_XML ( const std::vector < std::pair < clipper::String, clipper::MSugar > >& sugarList, const std::vector < clipper::MGlycan >& list_of_glycans, const std::vector<std::vector<std::pair<std::pair<clipper::MGlycan, std::vector<int>>,float>>>& list_of_glycans_associated_to_permutations, const clipper::String& pdbname, nlohmann::json &jsonObject )
+{
+    std::string of_xml;
+
+    size_t permutations = 0;
+    for ( int i = 0 ; i < list_of_glycans_associated_to_permutations.size() ; i++ )
+        permutations += list_of_glycans_associated_to_permutations[i].size();
 
-            clipper::String sugarRSCC = clipper::String ( sugarList[i].second.get_rscc() );
-            sugarRSCC.resize(4);
+    of_xml.reserve ( 1024 + 1024 * sugarList.size() + 1024 * list_of_glycans.size() + 768 * permutations );
 
-            clipper::String puckering_amplitude = clipper::String ( sugarList[i].second.puckering_amplitude() );
-            puckering_amplitude.resize(5);
+    of_xml += "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+    of_xml += "<?xml-stylesheet type=\"text/xsl\" href=\"program.xml\"?>\n";
+    of_xml += "<xsl:stylesheet id=\"stylesheet\" version=\"1.0\" xmlns:xsl=\"http://www.w3.org/1999/XSL/Transform\">\n";
+    of_xml += "<xsl:value-of select=\".\" disable-output-escaping = \"yes\"/>\n" ;
 
-            if (sugarList[i].second.ring_cardinality() == 6 )
-                of_xml << "    <Pyranose>\n";
+    of_xml += "<PrivateerResult>\n";
+    of_xml += "  <ValidationData>\n";
+
+    for (int i = 0; i < sugarList.size() ; i++ )
+    {
+        const clipper::MSugar& sugar = sugarList[i].second;
+
+        if ( ( sugar.ring_cardinality() == 6 ) || ( sugar.ring_cardinality() == 5 ) )
+        {
+            const std::vector<clipper::ftype> cpParams = sugar.cremer_pople_params();
+
+            if (sugar.ring_cardinality() == 6 )
+                of_xml += "    <Pyranose>\n";
             else
-                of_xml << "    <Furanose>\n";
-
-            of_xml << "      <SugarPDB>"            << pdbname                                          << "</SugarPDB>\n"          ;
-            of_xml << "      <SugarName>"           << sugarList[i].second.type()                       << "</SugarName>\n"         ;
-            of_xml << "      <SugarChain>"          << sugarList[i].first                               << "</SugarChain>\n"        ;
-            of_xml << "      <SugarQ>"              << puckering_amplitude                              << "</SugarQ>\n"            ;
-
-            of_xml << "      <SugarPhi>"            << cpParams[1]                                      << "</SugarPhi>\n"          ;
-
-            if (sugarList[i].second.ring_cardinality() == 6 )
-                of_xml << "      <SugarTheta>"          << cpParams[2]                                  << "</SugarTheta>\n"        ;
-
-            of_xml << "      <SugarAnomer>"         << sugarList[i].second.anomer()                     << "</SugarAnomer>\n"       ;
-            of_xml << "      <SugarHand>"           << sugarList[i].second.handedness()                 << "</SugarHand>\n"         ;
-            of_xml << "      <SugarConformation><![CDATA["   << sugarList[i].second.conformation_name_iupac()          << "]]></SugarConformation>\n" ;
-            of_xml << "      <SugarBondRMSD>"       << sugarList[i].second.ring_bond_rmsd()             << "</SugarBondRMSD>\n"     ;
-            of_xml << "      <SugarAngleRMSD>"      << sugarList[i].second.ring_angle_rmsd()            << "</SugarAngleRMSD>\n"    ;
-            of_xml << "      <SugarBFactor>"        << sugarList[i].second.get_bfactor()                << "</SugarBFactor>\n"      ;
-            of_xml << "      <SugarRSCC>"           << sugarRSCC                                        << "</SugarRSCC>\n"         ;
-            of_xml << "      <SugarDiagnostic>"     << sugarList[i].second.get_diagnostic()             << "</SugarDiagnostic>\n"   ;
-            of_xml << "      <SugarContext>"        << sugarList[i].second.get_context()                << "</SugarContext>\n"      ;
-
-            if (sugarList[i].second.ring_cardinality() == 6 )
-                of_xml << "    </Pyranose>\n\n";
+                of_xml += "    <Furanose>\n";
+
+            append_element ( of_xml, "      <SugarPDB>",            pdbname,                                 "</SugarPDB>\n"          );
+            append_element ( of_xml, "      <SugarName>",           sugar.type(),                            "</SugarName>\n"         );
+            append_element ( of_xml, "      <SugarChain>",          sugarList[i].first,                      "</SugarChain>\n"        );
+            append_truncated_element ( of_xml, "      <SugarQ>",    sugar.puckering_amplitude(), 5,          "</SugarQ>\n"            );
+
+            append_element ( of_xml, "      <SugarPhi>",            cpParams[1],                             "</SugarPhi>\n"          );
+
+            if (sugar.ring_cardinality() == 6 )
+                append_element ( of_xml, "      <SugarTheta>",      cpParams[2],                             "</SugarTheta>\n"        );
+
+            append_element ( of_xml, "      <SugarAnomer>",         sugar.anomer(),                          "</SugarAnomer>\n"       );
+            append_element ( of_xml, "      <SugarHand>",           sugar.handedness(),                      "</SugarHand>\n"         );
+            append_element ( of_xml, "      <SugarConformation><![CDATA[", sugar.conformation_name_iupac(),  "]]></SugarConformation>\n" );
+            append_element ( of_xml, "      <SugarBondRMSD>",       sugar.ring_bond_rmsd(),                  "</SugarBondRMSD>\n"     );
+            append_element ( of_xml, "      <SugarAngleRMSD>",      sugar.ring_angle_rmsd(),                 "</SugarAngleRMSD>\n"    );
+            append_element ( of_xml, "      <SugarBFactor>",        sugar.get_bfactor(),                     "</SugarBFactor>\n"      );
+            append_truncated_element ( of_xml, "      <SugarRSCC>", sugar.get_rscc(), 4,                     "</SugarRSCC>\n"         );
+            append_element ( of_xml, "      <SugarDiagnostic>",     sugar.get_diagnostic(),                  "</SugarDiagnostic>\n"   );
+            append_element ( of_xml, "      <SugarContext>",        sugar.get_context(),                     "</SugarContext>\n"      );
+
+            if (sugar.ring_cardinality() == 6 )
+                of_xml += "    </Pyranose>\n\n";
             else
-                of_xml << "    </Furanose>\n\n";
+                of_xml += "    </Furanose>\n\n";
         }
     }
 
     for ( int i = 0 ; i < list_of_glycans.size() ; i++ )
     {
-        std::ostringstream os;
-        os << list_of_glycans[i].get_root_for_filename() << ".svg";
-
-        clipper::String glycanWURCS = list_of_glycans[i].generate_wurcs();
-
-        
-
+        const clipper::MGlycan& glycan = list_of_glycans[i];
+        const clipper::String glycanWURCS = glycan.generate_wurcs();
+
+        of_xml += "    <Glycan>\n" ;
+        append_element ( of_xml, "     <GlycanPDB>",          pdbname,                                               "</GlycanPDB>\n"    );
+        append_element ( of_xml, "     <GlycanType>",         glycan.get_type(),                                     "</GlycanType>\n"   );
+        append_element ( of_xml, "     <GlycanRoot>",         glycan.get_root().first.type().trim() + glycan.get_root().first.id().trim(), "</GlycanRoot>\n" );
+        append_element ( of_xml, "     <GlycanChain>",        glycan.get_chain(),                                    "</GlycanChain>\n"  );
+        append_element ( of_xml, "     <GlycanText><![CDATA[", glycan.print_linear ( false, true, true ),            "]]></GlycanText>\n" );
+        append_element ( of_xml, "     <GlycanSVG>",          glycan.get_root_for_filename() + ".svg",               "</GlycanSVG>\n"    );
+        append_element ( of_xml, "     <GlycanWURCS>",        glycanWURCS,                                           "</GlycanWURCS>\n"  );
 
-        of_xml << "    <Glycan>\n" ;
-        of_xml << "     <GlycanPDB>"        << pdbname                                           << "</GlycanPDB>\n"                                         ;
-        of_xml << "     <GlycanType>"       << list_of_glycans[i].get_type()                     << "</GlycanType>\n"                                       ;
-        of_xml << "     <GlycanRoot>"       << list_of_glycans[i].get_root().first.type().trim() + list_of_glycans[i].get_root().first.id().trim() << "</GlycanRoot>\n" ;
-        of_xml << "     <GlycanChain>"      << list_of_glycans[i].get_chain()                    << "</GlycanChain>\n"                                      ;
-        of_xml << "     <GlycanText><![CDATA["<< list_of_glycans[i].print_linear ( false, true, true )    << "]]></GlycanText>\n"                           ;
-        of_xml << "     <GlycanSVG>"        << os.str()                                          << "</GlycanSVG>\n"                                        ;
-        of_xml << "     <GlycanWURCS>"      << glycanWURCS                                       << "</GlycanWURCS>\n"                                      ;
-        
         if(!jsonObject.empty())
         {
             int valueLocation = privateer::util::find_index_of_value(jsonObject, "Sequence", glycanWURCS);
-            
-            std::string glyTouCanID, glyConnectID;
-            if (valueLocation != -1)
-                {
-                    glyTouCanID = jsonObject[valueLocation]["AccessionNumber"];
-                    if (glyTouCanID.front() == '"' && glyTouCanID.front() == '"')
-                    {
-                        glyTouCanID.erase(0, 1);
-                        glyTouCanID.pop_back();
-                    }
-
-                    if      (jsonObject[valueLocation]["glyconnect"] != "NotFound") glyConnectID = to_string(jsonObject[valueLocation]["glyconnect"]["id"]);
-                    else     glyConnectID = "NotFound";
-                }
-            else glyTouCanID = "NotFound", glyConnectID = "NotFound";
 
+            std::string glyTouCanID, glyConnectID;
+            lookup_database_ids ( jsonObject, valueLocation, glyTouCanID, glyConnectID );
 
             if(valueLocation == -1)
-            of_xml << "     <GlycanGTCID>"      << "Unable to find GlyTouCan ID"                     << "</GlycanGTCID>\n"                                      ;
+                of_xml += "     <GlycanGTCID>Unable to find GlyTouCan ID</GlycanGTCID>\n";
             else
-            of_xml << "     <GlycanGTCID>"      << glyTouCanID                                       << "</GlycanGTCID>\n"                                      ; 
-            
+                append_element ( of_xml, "     <GlycanGTCID>", glyTouCanID, "</GlycanGTCID>\n" );
+
             if(glyConnectID == "NotFound")
-            of_xml << "     <GlycanGlyConnectID>" << "Unable to find GlyConnect ID"                  << "</GlycanGlyConnectID>\n"                               ;
+                of_xml += "     <GlycanGlyConnectID>Unable to find GlyConnect ID</GlycanGlyConnectID>\n";
             else
-            of_xml << "     <GlycanGlyConnectID>" << glyConnectID                                    << "</GlycanGlyConnectID>\n"                               ;                                  
-            
-            // std::vector<std::vector<std::pair<std::pair<clipper::MGlycan, std::vector<int>>,float>>>
-            
-            if(!list_of_glycans_associated_to_permutations[i].empty())
+                append_element ( of_xml, "     <GlycanGlyConnectID>", glyConnectID, "</GlycanGlyConnectID>\n" );
+
+            const std::vector<std::pair<std::pair<clipper::MGlycan, std::vector<int>>,float>>& permutations_of_glycan = list_of_glycans_associated_to_permutations[i];
+
+            if(!permutations_of_glycan.empty())
                 {
-                    of_xml << "     <GlycanPermutations>\n" ;
-                    for(int j = 0; j < list_of_glycans_associated_to_permutations[i].size(); j++)
+                    of_xml += "     <GlycanPermutations>\n" ;
+                    for(int j = 0; j < permutations_of_glycan.size(); j++)
                         {
-                            std::ostringstream os_permutation;
+                            const clipper::MGlycan& permutation = permutations_of_glycan[j].first.first;
+                            const std::vector<int>& counts = permutations_of_glycan[j].first.second;
 
-                            of_xml << "       <GlycanPermutation>\n" ;
-                            float permutationScore = list_of_glycans_associated_to_permutations[i][j].second;
+                            of_xml += "       <GlycanPermutation>\n" ;
 
-                            int anomerPermutations = list_of_glycans_associated_to_permutations[i][j].first.second[0],
-                                residuePermutations = list_of_glycans_associated_to_permutations[i][j].first.second[1],
-                                residueDeletions = list_of_glycans_associated_to_permutations[i][j].first.second[2];
+                            const clipper::String permutationWURCS = permutation.generate_wurcs();
+                            int valueLocation = privateer::util::find_index_of_value(jsonObject, "Sequence", permutationWURCS);
 
-                            clipper::String glycanWURCS = list_of_glycans_associated_to_permutations[i][j].first.first.generate_wurcs();
-                            int valueLocation = privateer::util::find_index_of_value(jsonObject, "Sequence", glycanWURCS);
-
-                            os_permutation << list_of_glycans_associated_to_permutations[i][j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
-                            
                             std::string glyTouCanID, glyConnectID;
-                            if (valueLocation != -1)
-                                {
-                                    glyTouCanID = jsonObject[valueLocation]["AccessionNumber"];
-                                    if (glyTouCanID.front() == '"' && glyTouCanID.front() == '"')
-                                    {
-                                        glyTouCanID.erase(0, 1);
-                                        glyTouCanID.pop_back();
-                                    }
-
-                                    if      (jsonObject[valueLocation]["glyconnect"] != "NotFound") glyConnectID = to_string(jsonObject[valueLocation]["glyconnect"]["id"]);
-                                    else     glyConnectID = "NotFound";
-                                }
-                            else glyTouCanID = "NotFound", glyConnectID = "NotFound";
-                            
-                            of_xml << "        <PermutationWURCS>"      << glycanWURCS                                       << "</PermutationWURCS>\n"                                      ;
-            
-                            of_xml << "        <PermutationScore>"      << permutationScore                                  << "</PermutationScore>\n"                                      ;
-                            
-                            of_xml << "        <anomerPermutations>"    << anomerPermutations                                << "</anomerPermutations>\n"                                    ;
+                            lookup_database_ids ( jsonObject, valueLocation, glyTouCanID, glyConnectID );
 
-                            of_xml << "        <residuePermutations>"   << residuePermutations                               << "</residuePermutations>\n"                                   ;
+                            append_element ( of_xml, "        <PermutationWURCS>",      permutationWURCS,                      "</PermutationWURCS>\n"    );
+                            append_element ( of_xml, "        <PermutationScore>",      permutations_of_glycan[j].second,      "</PermutationScore>\n"    );
+                            append_element ( of_xml, "        <anomerPermutations>",    counts[0],                             "</anomerPermutations>\n"  );
+                            append_element ( of_xml, "        <residuePermutations>",   counts[1],                             "</residuePermutations>\n" );
+                            append_element ( of_xml, "        <residueDeletions>",      counts[2],                             "</residueDeletions>\n"    );
 
-                            of_xml << "        <residueDeletions>"      << residueDeletions                                  << "</residueDeletions>\n"                                   ;
-                            
                             if(valueLocation == -1)
-                            of_xml << "        <PermutationGTCID>"      << "Unable to find GlyTouCan ID"                     << "</PermutationGTCID>\n"                                      ;
+                                of_xml += "        <PermutationGTCID>Unable to find GlyTouCan ID</PermutationGTCID>\n";
                             else
-                            of_xml << "        <PermutationGTCID>"      << glyTouCanID                                       << "</PermutationGTCID>\n"                                      ; 
-                            
+                                append_element ( of_xml, "        <PermutationGTCID>", glyTouCanID, "</PermutationGTCID>\n" );
+
                             if(glyConnectID == "NotFound")
-                            of_xml << "        <PermutationGlyConnectID>" << "Unable to find GlyConnect ID"                  << "</PermutationGlyConnectID>\n"                               ;
+                                of_xml += "        <PermutationGlyConnectID>Unable to find GlyConnect ID</PermutationGlyConnectID>\n";
                             else
-                            of_xml << "        <PermutationGlyConnectID>" << glyConnectID                                    << "</PermutationGlyConnectID>\n"                               ;
+                                append_element ( of_xml, "        <PermutationGlyConnectID>", glyConnectID, "</PermutationGlyConnectID>\n" );
 
-                            of_xml << "        <PermutationSVG>"        << os_permutation.str()                                          << "</PermutationSVG>\n"                                 ;
+                            std::ostringstream os_permutation;
+                            os_permutation << permutation.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
+                            append_element ( of_xml, "        <PermutationSVG>", os_permutation.str(), "</PermutationSVG>\n" );
 
-                            of_xml << "       </GlycanPermutation>\n" ;
+                            of_xml += "       </GlycanPermutation>\n" ;
                         }
-                    of_xml << "     </GlycanPermutations>\n" ;
+                    of_xml += "     </GlycanPermutations>\n" ;
+                }
+        }
+        of_xml += "    </Glycan>\n" ;
+    }
+
+    of_xml += "  </ValidationData>\n";
+    of_xml += "</PrivateerResult>\n";
+    of_xml += "</xsl:stylesheet>\n\n";
+
+    std::ofstream out ( "program.xml" );
+    out.write ( of_xml.data(), of_xml.size() );
+}
+
+
+// the columnar export is little-endian whatever the host, so values are laid out byte by byte
+
+class ColumnWriter
+{
+    public:
+
+        ColumnWriter ( size_t rows, size_t bytes_per_row ) { buffer.reserve ( 16 + rows * bytes_per_row + 16 * 8 ); }
+
+        void add_bytes  ( const char* bytes, size_t length ) { buffer.append ( bytes, length ); }
+        void add_uint8  ( unsigned char value ) { buffer.push_back ( (char) value ); }
+        void add_int16  ( int value ) { add_little_endian ( (uint32_t) value, 2 ); }
+        void add_int32  ( int value ) { add_little_endian ( (uint32_t) value, 4 ); }
+        void add_uint32 ( uint32_t value ) { add_little_endian ( value, 4 ); }
+        void add_float32 ( float value ) { uint32_t bits; memcpy ( &bits, &value, 4 ); add_little_endian ( bits, 4 ); }
+
+        void add_fixed_string ( const std::string& value, size_t width )
+        {
+            std::string field = value.substr ( 0, width );
+            field.resize ( width, '\0' );
+            buffer.append ( field );
+        }
+
+        void end_column ( ) { buffer.append ( ( 8 - buffer.size() % 8 ) % 8, '\0' ); }
+
+        const std::string& data ( ) const { return buffer; }
+
+    private:
+
+        void add_little_endian ( uint32_t value, int bytes )
+        {
+            for ( int i = 0; i < bytes; i++ )
+                buffer.push_back ( (char) ( ( value >> ( 8 * i ) ) & 0xff ) );
+        }
+
+        std::string buffer;
+};
+
+static unsigned char context_code ( const clipper::String& context )
+{
+    if      ( context == "n-glycan" ) return 1;
+    else if ( context == "o-glycan" ) return 2;
+    else if ( context == "s-glycan" ) return 3;
+    else if ( context == "c-glycan" ) return 4;
+    else if ( context == "ligand"   ) return 5;
+    else return 0;
+}
+
+bool privateer::util::write_columnar_export ( const std::vector < std::pair < clipper::String, clipper::MSugar > >& sugarList, const std::vector < clipper::MGlycan >& list_of_glycans, std::string file_path )
+{
+    const int n = sugarList.size();
+
+    // glycan, node, parent node and link order of every sugar found in a glycan, keyed by chain/residue. sugarList only
+    // keeps the first character of each chain ID, so glycan chains are cut the same way
+
+    std::map < std::string, std::vector<int> > placements;
+
+    for ( int i = 0 ; i < list_of_glycans.size() ; i++ )
+    {
+        const clipper::MGlycan& glycan = list_of_glycans[i];
+        std::vector < std::vector<int> > nodes ( glycan.number_of_nodes(), std::vector<int> { i, 0, -1, 0 } );
+
+        for ( int j = 0 ; j < glycan.number_of_nodes() ; j++ )
+        {
+            nodes[j][1] = j;
+            const clipper::MGlycan::Node& node = glycan.get_node ( j );
+
+            for ( int k = 0 ; k < node.number_of_connections() ; k++ )
+            {
+                const int child = node.get_connection(k).get_linked_node_id();
+                if ( child >= 0 && child < nodes.size() )
+                {
+                    nodes[child][2] = j;
+                    nodes[child][3] = node.get_connection(k).get_order();
                 }
+            }
         }
-        of_xml << "    </Glycan>\n" ;
+
+        for ( int j = 0 ; j < glycan.number_of_nodes() ; j++ )
+            placements[glycan.get_chain().substr(0,1) + "/" + glycan.get_node(j).get_sugar().id().trim()] = nodes[j];
+    }
+
+    std::vector < std::vector<int> > ids ( n, std::vector<int> { -1, -1, -1, 0 } );
+
+    for ( int i = 0 ; i < n ; i++ )
+    {
+        std::map < std::string, std::vector<int> >::const_iterator found = placements.find ( sugarList[i].first.substr(0,1) + "/" + sugarList[i].second.id().trim() );
+        if ( found != placements.end() )
+            ids[i] = found->second;
+    }
+
+    ColumnWriter columns ( n, 5 * 4 + 2 + 3 + 4 * 4 + 4 + 4 + 8 );
+
+    columns.add_bytes ( "PRVCOLS1", 8 );
+    columns.add_uint32 ( 1 );
+    columns.add_uint32 ( n );
+
+    for ( int i = 0 ; i < n ; i++ ) columns.add_float32 ( sugarList[i].second.puckering_amplitude() );
+    columns.end_column();
+    for ( int i = 0 ; i < n ; i++ ) columns.add_float32 ( sugarList[i].second.cremer_pople_params()[1] );
+    columns.end_column();
+    for ( int i = 0 ; i < n ; i++ )
+        columns.add_float32 ( sugarList[i].second.ring_cardinality() == 6 ? sugarList[i].second.cremer_pople_params()[2] : std::numeric_limits<float>::quiet_NaN() );
+    columns.end_column();
+    for ( int i = 0 ; i < n ; i++ ) columns.add_float32 ( sugarList[i].second.get_rscc() );
+    columns.end_column();
+    for ( int i = 0 ; i < n ; i++ ) columns.add_float32 ( sugarList[i].second.get_bfactor() );
+    columns.end_column();
+
+    for ( int i = 0 ; i < n ; i++ ) columns.add_int16 ( sugarList[i].second.conformation_code() );
+    columns.end_column();
+
+    for ( int i = 0 ; i < n ; i++ )
+    {
+        const clipper::String anomer = sugarList[i].second.anomer();
+        columns.add_uint8 ( anomer == "alpha" ? 1 : anomer == "beta" ? 2 : 0 );
     }
+    columns.end_column();
+    for ( int i = 0 ; i < n ; i++ ) columns.add_uint8 ( context_code ( sugarList[i].second.get_context() ) );
+    columns.end_column();
 
-    of_xml << "  </ValidationData>\n";
-    of_xml << "</PrivateerResult>\n";
-    of_xml << "</xsl:stylesheet>\n\n";
+    for ( int i = 0 ; i < n ; i++ )
+    {
+        const clipper::MSugar& sugar = sugarList[i].second;
+        columns.add_uint8 (   ( sugar.ok_with_ring()         ? 1   : 0 )
+                            | ( sugar.ok_with_bonds_rmsd()   ? 2   : 0 )
+                            | ( sugar.ok_with_angles_rmsd()  ? 4   : 0 )
+                            | ( sugar.ok_with_anomer()       ? 8   : 0 )
+                            | ( sugar.ok_with_chirality()    ? 16  : 0 )
+                            | ( sugar.ok_with_conformation() ? 32  : 0 )
+                            | ( sugar.ok_with_puckering()    ? 64  : 0 )
+                            | ( sugar.is_sane()              ? 128 : 0 ) );
+    }
+    columns.end_column();
+
+    for ( int column = 0 ; column < 4 ; column++ )
+    {
+        for ( int i = 0 ; i < n ; i++ ) columns.add_int32 ( ids[i][column] );
+        columns.end_column();
+    }
+
+    for ( int i = 0 ; i < n ; i++ ) columns.add_fixed_string ( sugarList[i].second.type().trim(), 4 );
+    columns.end_column();
+    for ( int i = 0 ; i < n ; i++ ) columns.add_fixed_string ( sugarList[i].first.trim(), 4 );
+    columns.end_column();
+    for ( int i = 0 ; i < n ; i++ ) columns.add_fixed_string ( sugarList[i].second.id().trim(), 8 );
+    columns.end_column();
+
+    std::ofstream out ( file_path.c_str(), std::ios::binary );
+    out.write ( columns.data().data(), columns.data().size() );
+
+    return !out;
+}
+
+
+const char* privateer::util::OutputSinks::name ( OutputSink sink )
+{
+    static const char* names[number_of_sinks] = { "console", "xml", "coot_scm", "coot_py", "svg", "maps", "mtz", "json" };
+    return names[sink];
+}
+
+std::string privateer::util::OutputSinks::known_names ( )
+{
+    std::string names;
+
+    for ( int i = 0 ; i < number_of_sinks ; i++ )
+    {
+        if ( i > 0 ) names += ",";
+        names += name ( (OutputSink) i );
+    }
+
+    return names;
+}
+
+bool privateer::util::OutputSinks::parse ( const std::string& list )
+{
+    std::vector<bool> requested ( number_of_sinks, false );
+    std::stringstream stream ( list );
+    std::string item;
+
+    while ( std::getline ( stream, item, ',' ) )
+    {
+        if ( item == "none" || item.empty() )
+            continue;
+
+        if ( item == "coot" )
+        {
+            requested[coot_scheme_sink] = requested[coot_python_sink] = true;
+            continue;
+        }
+
+        int sink = 0;
+        while ( sink < number_of_sinks && item != name ( (OutputSink) sink ) )
+            sink++;
+
+        if ( sink == number_of_sinks )
+            return true;
 
-    of_xml.close();
+        requested[sink] = true;
+    }
+
+    enabled = requested;
+    return false;
 }
 
 
@@ -1010,7 +1312,18 @@ void privateer::util::print_usage ( )
               << "\t\t\t\t\tSupported systems: undefined, fungal, yeast, plant, insect, mammalian, human\n"
               << "\t-vertical\t\t\tGenerate vertical glycan plots\n"
               << "\t-essentials\t\t\tUse the Essentials of glycobiology colour code for the glycan plots\n"
-              << "\t-invert\t\t\t\tUse white outlines (hint: good for dark background slides?)\n\n"
+              << "\t-invert\t\t\t\tUse white outlines (hint: good for dark background slides?)\n"
+              << "\t-svg_sheet\t\t\tWrite all glycan plots to a single privateer-glycans.svg instead of one file each\n"
+              << "\t-columnar <.bin>\t\tAlso write per-sugar results as a columnar binary file, see privateer.columnar\n"
+              << "\t-outputs <list>\t\t\tOnly produce these outputs, skipping the work behind the rest. Comma-separated from\n"
+              << "\t\t\t\t\tconsole,xml,coot,coot_scm,coot_py,svg,maps,mtz,json or none. All of them are produced by default\n"
+              << "\t-check-unmodelled\t\tScan the difference map (X-ray or cryo-EM) for unmodelled glycosylation\n"
+              << "\t-blobs_threshold <value>\tMean density a probe sphere must reach, 0.02 by default. In map sigmas for\n"
+              << "\t\t\t\t\tcryo-EM maps, where it defaults to 0.3\n"
+              << "\t-blobs_scan_all\t\t\tProbe every candidate residue, not only N-X-S/T/C sequons and W-x-x-W motifs\n"
+              << "\t-blobs_strip_solvent\t\tAlso remove common buffer and cryoprotectant molecules before the scan\n"
+              << "\t-blobs_omotifs <motifs>\t\tComma-separated O-glycosylation motifs, glycosylated residue in lower case\n"
+              << "\t\t\t\t\tExample: CXsXPC,CXXGGsC. If not supplied, every Ser and Thr is probed\n\n"
               << "\tThe program will also produce a visual checklist with the conflicting sugar models in the form\n"
               << "\tof Scheme and Python scripts for use with Coot\n"
               << "\n\tTo use them: 'coot --script privateer-results.scm' or 'coot --script privateer-results.py'\n"
@@ -1087,34 +1400,25 @@ std::string privateer::glycoplot::get_colour ( Colour colour, bool original_styl
     }
 }
 
-void privateer::glycoplot::Plot::write_svg_header   ( std::fstream& of )
-{
+/*! Shared <defs> block for a colour scheme. Each of the eight variants is built once and reused by every plot
+ * 	\param embedded true for the compact definitions used by get_svg_string_contents, false for the ones written to SVG files
+ */
 
-    of << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n\n"
-       << "<!-- Generator: Privateer (YSBL, University of York, distributed by CCP4) -->\n"
-       << "<!-- Please reference: Agirre, Iglesias, Rovira, Davies, Wilson & Cowtan (2015) Nat Struct & Mol Biol 22(11), 833-834 -->\n\n"
-       << "<svg xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
-       << "     xmlns:cc=\"http://creativecommons.org/ns#\"\n"
-       << "     xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\"\n"
-       << "     xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
-       << "     xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
-       << "     xmlns=\"http://www.w3.org/2000/svg\"\n"
-       << "     version=\"1.1\"\n"
-       << "     width=\"" << get_width() << "\" \n"
-       << "     height=\"" << get_height() << "\" \n"
-       << "     viewBox=\"" << get_viewbox() << " \"\n"
-       << "     preserveAspectRatio=\"xMinYMinXMaxYMax meet\">\n\n"
-       << "  <style>\n"
-       << "    .my_blue   { fill:" << get_colour ( blue, original_colour_scheme ) << " }\n"
-       << "    .my_red    { fill:" << get_colour ( red, original_colour_scheme  ) << " }\n"
-       << "    .my_yellow { fill:" << get_colour ( yellow, original_colour_scheme  ) << " }\n"
-       << "  </style>\n";
+const std::string& privateer::glycoplot::Plot::get_svg_definitions ( bool original_style, bool inverted_background, bool embedded )
+{
+    static const std::string cache[8] = { build_file_definitions   ( false, false ), build_file_definitions   ( false, true ),
+                                          build_file_definitions   ( true,  false ), build_file_definitions   ( true,  true ),
+                                          build_string_definitions ( false, false ), build_string_definitions ( false, true ),
+                                          build_string_definitions ( true,  false ), build_string_definitions ( true,  true ) };
 
+    return cache[ ( embedded ? 4 : 0 ) + ( original_style ? 2 : 0 ) + ( inverted_background ? 1 : 0 ) ];
 }
 
 
-void privateer::glycoplot::Plot::write_svg_definitions( std::fstream& of )
+std::string privateer::glycoplot::Plot::build_file_definitions ( bool original_colour_scheme, bool inverted_background )
 {
+    std::ostringstream of;
+
     of << "  <defs>\n"
 
        // colour patterns for two-colour shapes
@@ -1304,51 +1608,11 @@ void privateer::glycoplot::Plot::write_svg_definitions( std::fstream& of )
 
        << "  </defs>\n\n" ;
 
-}
-
-void privateer::glycoplot::Plot::write_svg_contents ( std::fstream& of )
-{
-    of << "<title>" << get_title() << "</title>\n";
-
-    for (int i = 0; i < list_of_shapes.size() ; i ++)
-    {
-        of << list_of_shapes[i]->get_XML();
-    }
-} //!< doesn't add html anchors, as SVG files are supposed to be standalone and not linked to any other CCP4 application
-
-
-void privateer::glycoplot::Plot::write_svg_footer ( std::fstream& of )
-{
-    of << "\n</svg>" ;
-}
-
-
-std::string privateer::glycoplot::Plot::get_svg_string_header   ( )
-{
-    std::ostringstream of;
-
-    of << "<svg xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
-       << "     xmlns:cc=\"http://creativecommons.org/ns#\"\n"
-       << "     xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\"\n"
-       << "     xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
-       << "     xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
-       << "     xmlns=\"http://www.w3.org/2000/svg\"\n"
-       << "     version=\"1.1\"\n"
-       << "     width=\"" << get_width() << "\" \n"
-       << "     height=\"" << get_height() << "\" \n"
-       << "     viewBox=\"" << get_viewbox() << " \"\n"
-       << "     preserveAspectRatio=\"xMinYMinXMaxYMax meet\">\n\n"
-       << "  <style>\n"
-       << "    .my_blue   { fill:" << get_colour ( blue, original_colour_scheme ) << " }\n"
-       << "    .my_red    { fill:" << get_colour ( red, original_colour_scheme  ) << " }\n"
-       << "    .my_yellow { fill:" << get_colour ( yellow, original_colour_scheme  ) << " }\n"
-       << "  </style>\n";
-
     return of.str();
 }
 
 
-std::string privateer::glycoplot::Plot::get_svg_string_contents ( )
+std::string privateer::glycoplot::Plot::build_string_definitions ( bool original_colour_scheme, bool inverted_background )
 {
     std::ostringstream of;
 
@@ -1513,59 +1777,186 @@ std::string privateer::glycoplot::Plot::get_svg_string_contents ( )
 
        << "  </defs>\n\n" ;
 
-    for (int i = 0; i < list_of_shapes.size() ; i ++)
-    {
-        of << "<a xmlns=\"http://www.w3.org/2000/svg\" id=\"anchor\" xlink:href=\""
-           << list_of_shapes[i]->get_mmdbsel() << "\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" target=\"_top\">";
-        of << list_of_shapes[i]->get_XML();
-        of << "</a>\n";
-    }
-
     return of.str();
 }
 
 
-std::string privateer::glycoplot::Plot::get_svg_string_footer ( )
+std::string privateer::glycoplot::Plot::get_svg_style ( bool original_style )
 {
     std::ostringstream of;
 
-    of << "</svg>" ;
+    of << "  <style>\n"
+       << "    .my_blue   { fill:" << get_colour ( blue, original_style ) << " }\n"
+       << "    .my_red    { fill:" << get_colour ( red, original_style  ) << " }\n"
+       << "    .my_yellow { fill:" << get_colour ( yellow, original_style  ) << " }\n"
+       << "  </style>\n";
 
     return of.str();
 }
 
 
-bool privateer::glycoplot::Plot::write_to_file  ( std::string file_path )
+void privateer::glycoplot::Plot::write_svg_header   ( std::ostream& of )
 {
-    std::fstream out;
-
-    out.open( file_path.c_str(), std::fstream::out);
-
-    write_svg_header      ( out );
-    write_svg_definitions ( out );
-    write_svg_contents    ( out );
-    write_svg_footer      ( out );
 
-    out.close();
+    of << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n\n"
+       << "<!-- Generator: Privateer (YSBL, University of York, distributed by CCP4) -->\n"
+       << "<!-- Please reference: Agirre, Iglesias, Rovira, Davies, Wilson & Cowtan (2015) Nat Struct & Mol Biol 22(11), 833-834 -->\n\n"
+       << "<svg xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
+       << "     xmlns:cc=\"http://creativecommons.org/ns#\"\n"
+       << "     xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\"\n"
+       << "     xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
+       << "     xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
+       << "     xmlns=\"http://www.w3.org/2000/svg\"\n"
+       << "     version=\"1.1\"\n"
+       << "     width=\"" << get_width() << "\" \n"
+       << "     height=\"" << get_height() << "\" \n"
+       << "     viewBox=\"" << get_viewbox() << " \"\n"
+       << "     preserveAspectRatio=\"xMinYMinXMaxYMax meet\">\n\n"
+       << get_svg_style ( original_colour_scheme );
 
-    return false;
 }
 
 
-std::string privateer::glycoplot::Plot::get_XML  ( )
+void privateer::glycoplot::Plot::write_svg_definitions( std::ostream& of )
 {
-    return get_svg_string_header() + get_svg_string_contents() + get_svg_string_footer();
+    of << get_svg_definitions ( original_colour_scheme, inverted_background, false );
 }
 
-
-bool privateer::glycoplot::Plot::plot_glycan ( clipper::MGlycan glycan, bool oxford_angles )
+void privateer::glycoplot::Plot::write_svg_contents ( std::ostream& of )
 {
+    std::string contents = "<title>" + get_title() + "</title>\n";
+    contents.reserve ( contents.size() + 256 * number_of_shapes() );
 
-    this->set_size(3000,3000);
+    for (int i = 0; i < number_of_shapes() ; i ++)
+    {
+        shape_at(i)->append_XML ( contents );
+    }
 
-    const clipper::String type = glycan.get_type();
-    privateer::glycoplot::GlycanRoot *root;
-    std::string mmdbsel = "mmdb:///" + glycan.get_chain().substr(0,1) + "/" + glycan.get_root().first.id().trim();
+    of << contents;
+} //!< doesn't add html anchors, as SVG files are supposed to be standalone and not linked to any other CCP4 application
+
+
+void privateer::glycoplot::Plot::write_svg_footer ( std::ostream& of )
+{
+    of << "\n</svg>" ;
+}
+
+
+std::string privateer::glycoplot::Plot::get_svg_string_header   ( )
+{
+    std::ostringstream of;
+
+    of << "<svg xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
+       << "     xmlns:cc=\"http://creativecommons.org/ns#\"\n"
+       << "     xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\"\n"
+       << "     xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
+       << "     xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
+       << "     xmlns=\"http://www.w3.org/2000/svg\"\n"
+       << "     version=\"1.1\"\n"
+       << "     width=\"" << get_width() << "\" \n"
+       << "     height=\"" << get_height() << "\" \n"
+       << "     viewBox=\"" << get_viewbox() << " \"\n"
+       << "     preserveAspectRatio=\"xMinYMinXMaxYMax meet\">\n\n"
+       << get_svg_style ( original_colour_scheme );
+
+    return of.str();
+}
+
+
+std::string privateer::glycoplot::Plot::get_svg_string_contents ( )
+{
+    std::string contents = get_svg_definitions ( original_colour_scheme, inverted_background, true );
+    contents.reserve ( contents.size() + 384 * number_of_shapes() );
+
+    for (int i = 0; i < number_of_shapes() ; i ++)
+    {
+        contents += "<a xmlns=\"http://www.w3.org/2000/svg\" id=\"anchor\" xlink:href=\"";
+        contents += shape_at(i)->get_mmdbsel();
+        contents += "\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" target=\"_top\">";
+        shape_at(i)->append_XML ( contents );
+        contents += "</a>\n";
+    }
+
+    return contents;
+}
+
+
+std::string privateer::glycoplot::Plot::get_svg_symbol ( const std::string& id )
+{
+    std::string symbol = "  <symbol id=\"" + id + "\" viewBox=\"" + get_viewbox() + "\">\n"
+                       + "    <title>" + get_title() + "</title>\n";
+
+    symbol.reserve ( symbol.size() + 384 * number_of_shapes() );
+
+    for (int i = 0; i < number_of_shapes() ; i ++)
+    {
+        symbol += "<a xmlns=\"http://www.w3.org/2000/svg\" id=\"anchor\" xlink:href=\"";
+        symbol += shape_at(i)->get_mmdbsel();
+        symbol += "\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" target=\"_top\">";
+        shape_at(i)->append_XML ( symbol );
+        symbol += "</a>\n";
+    }
+
+    symbol += "  </symbol>\n";
+
+    return symbol;
+}
+
+
+std::string privateer::glycoplot::Plot::get_svg_string_footer ( )
+{
+    std::ostringstream of;
+
+    of << "</svg>" ;
+
+    return of.str();
+}
+
+
+std::string privateer::glycoplot::Plot::write_to_string ( )
+{
+    std::ostringstream out;
+
+    write_svg_header      ( out );
+    write_svg_definitions ( out );
+    write_svg_contents    ( out );
+    write_svg_footer      ( out );
+
+    return out.str();
+} //!< same document as write_to_file
+
+
+bool privateer::glycoplot::Plot::write_to_file  ( std::string file_path )
+{
+    std::fstream out;
+
+    out.open( file_path.c_str(), std::fstream::out);
+
+    write_svg_header      ( out );
+    write_svg_definitions ( out );
+    write_svg_contents    ( out );
+    write_svg_footer      ( out );
+
+    out.close();
+
+    return false;
+}
+
+
+std::string privateer::glycoplot::Plot::get_XML  ( )
+{
+    return get_svg_string_header() + get_svg_string_contents() + get_svg_string_footer();
+}
+
+
+bool privateer::glycoplot::Plot::plot_glycan ( const clipper::MGlycan& glycan, bool oxford_angles )
+{
+
+    this->set_size(3000,3000);
+
+    const clipper::String type = glycan.get_type();
+    privateer::glycoplot::GlycanRoot *root;
+    std::string mmdbsel = "mmdb:///" + glycan.get_chain().substr(0,1) + "/" + glycan.get_root().first.id().trim();
 
     // first, let us draw the root
 
@@ -1596,20 +1987,175 @@ bool privateer::glycoplot::Plot::plot_glycan ( clipper::MGlycan glycan, bool oxf
 
     // let the fun begin: paint the tree with yet another recursive function
 
-    const clipper::MGlycan::Node node = glycan.get_node ( 0 ); // get the first node
+    GlycanLayout layout;
 
-    recursive_paint ( glycan, node, 2685, 990 ); // and initiate House Party protocol
+    recursive_paint ( glycan, 0, 2685, 990, layout ); // and initiate House Party protocol
+    paint_layout ( glycan, layout );
 
     this->tighten_viewbox();
 
     return false;
 }
 
-void privateer::glycoplot::Plot::recursive_paint ( clipper::MGlycan mg, clipper::MGlycan::Node node, int x, int y, bool oxford_angles )
+void privateer::glycoplot::Plot::recursive_paint ( const clipper::MGlycan& mg, int node_index, int x, int y, GlycanLayout& layout, bool oxford_angles )
 {
-    const clipper::MSugar& sugar = node.get_sugar();
+    const clipper::MGlycan::Node& node = mg.get_node ( node_index );
+
+    BlockPlacement block = { node_index, x, y };
+    layout.blocks.push_back ( block );
+
+    int up_down = 0; // number of special cases with perpendicular link
+    int branches = node.number_of_connections();
+
+    // decide here based on 2D notation
+    //////////////////////////////////////
+
+    for ( int j = 0; j < node.number_of_connections(); j++)
+    {
+        const clipper::MGlycan::Linkage& link = node.get_connection(j);
+        const int linked_index = link.get_linked_node_id();
+        const clipper::MGlycan::Node& linked_node = mg.get_node(linked_index);
+
+        bool is_ketose = false;
+
+        if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
+            is_ketose = true;
+
+        LinkPlacement placement = { node_index, j, x, y, side, is_ketose };
+        int next_x, next_y;
+
+        if ( oxford_angles )
+        {
+            if ( link.get_order() >= 7 ) // up. should be == 8, but just to prevent unforeseen circumstances
+            {
+                placement.orientation = up;
+                placement.x = x + 25; placement.y = y + 35;
+                next_x = x; next_y = y - 80;
+            }
+            else if ( link.get_order() == 6 ) // up-left
+            {
+                placement.orientation = up_side;
+                placement.x = x + 25; placement.y = y + 25;
+                next_x = x - 80; next_y = y - 80;
+            }
+            else if ( link.get_order() == 4 ) // left
+            {
+                placement.orientation = side;
+                placement.x = x + 35; placement.y = y + 25;
+                next_x = x - 80; next_y = y;
+            }
+            else if ( link.get_order() == 3 ) // left-down
+            {
+                placement.orientation = down_side;
+                placement.x = x + 25; placement.y = y + 25;
+                next_x = x - 80; next_y = y + 80;
+            }
+            else if ( link.get_order() == 2 ) // down
+            {
+                placement.orientation = down;
+                placement.x = x + 25; placement.y = y + 15;
+                next_x = x; next_y = y + 80;
+            }
+            else
+                continue;
+        }   /// end oxford notation
+            ////////////////////////////
+        else
+        {
+            // first deal with a couple of special cases: Fucose and Xylose
+
+            const std::string linked_name = clipper::data::carbname_of(linked_node.get_sugar().type());
 
-    std::string mmdbsel = "mmdb:///" + mg.get_chain().substr(0,1) + "/" + sugar.id().trim();
+            if ( linked_name == "Fuc" || linked_name == "Xyl" )
+            {
+                up_down++;
+
+                placement.is_ketose = false;
+                placement.x = x + 25; placement.y = y + 25;
+                next_x = x;
+
+                if ( link.get_order() == 3 ) // it goes up
+                {
+                    placement.orientation = up;
+                    next_y = y - 110;
+                }
+                else // down it goes, then
+                {
+                    placement.orientation = down;
+                    next_y = y + 110;
+                }
+            }
+            else // pseudo-general case
+            {
+                int sign = 0;
+
+                switch (branches - j - up_down)
+                {
+                    case 3:
+                        placement.orientation = up_side;
+                        sign = -1;
+                        break;
+                    case 2:
+                        placement.orientation = side;
+                        break;
+                    case 1:
+                        if ( branches != 1 )
+                        {
+                            placement.orientation = down_side;
+                            sign = 1;
+                        }
+                        else
+                        {
+                            placement.orientation = side;
+                            sign = 0;
+                        }
+                        break;
+                    default:
+                        placement.orientation = side;
+                        break;
+                }
+
+                placement.x = x; placement.y = y + 25 + (sign * 15);
+                next_x = x - 110; next_y = y + ( sign * 80 );
+            }
+        }
+
+        layout.links.push_back ( placement );
+        recursive_paint ( mg, linked_index, next_x, next_y, layout );
+    }
+}
+
+void privateer::glycoplot::Plot::paint_layout ( const clipper::MGlycan& mg, const GlycanLayout& layout )
+{
+    const std::string selection_prefix = "mmdb:///" + mg.get_chain().substr(0,1) + "/";
+
+    for ( int i = 0; i < layout.blocks.size(); i++ )
+    {
+        const clipper::MSugar& sugar = mg.get_node ( layout.blocks[i].node ).get_sugar();
+        add_sugar_block ( sugar, layout.blocks[i].x, layout.blocks[i].y, selection_prefix + sugar.id().trim() );
+    }
+
+    for ( int i = 0; i < layout.links.size(); i++ )
+    {
+        const LinkPlacement& placement = layout.links[i];
+        const clipper::MGlycan::Linkage& link = mg.get_node ( placement.node ).get_connection ( placement.connection );
+        const std::string mmdbsel = selection_prefix + mg.get_node ( placement.node ).get_sugar().id().trim();
+
+        if ( link.get_anomericity ( ) == "alpha" )
+        {
+            AlphaBond * new_bond = new AlphaBond( placement.x, placement.y, placement.orientation, link.get_description(placement.is_ketose), mmdbsel );
+            add_link ( new_bond );
+        }
+        else
+        {
+            BetaBond * new_bond = new BetaBond( placement.x, placement.y, placement.orientation, link.get_description(placement.is_ketose), mmdbsel );
+            add_link ( new_bond );
+        }
+    }
+}
+
+void privateer::glycoplot::Plot::add_sugar_block ( const clipper::MSugar& sugar, int x, int y, const std::string& mmdbsel )
+{
     std::string sugname = clipper::data::carbname_of ( sugar.type() );
 
     if ( sugname == "Glc" )
@@ -1707,301 +2253,57 @@ void privateer::glycoplot::Plot::recursive_paint ( clipper::MGlycan mg, clipper:
         Unk *unk = new Unk ( x, y, *(sugar.type().substr(0,1).c_str()), get_svg_tooltip ( sugar, validation ), mmdbsel  );
         add_block ( unk );
     }
+}
 
-    int up_down = 0; // number of special cases with perpendicular link
-    int branches = node.number_of_connections();
-
-    // decide here based on 2D notation
-    //////////////////////////////////////
 
-    if ( oxford_angles )
-    {
-        for ( int j = 0; j < node.number_of_connections(); j++)
-        {
-            clipper::MGlycan::Linkage link = node.get_connection(j);
-            const clipper::MGlycan::Node& linked_node = mg.get_node(link.get_linked_node_id());
+/*! Remodel the SVG viewport to the contents
+ * 	\return A std::vector<int> containing the new viewport coordinates, in this order: ( x0, y0, x1, y1 )
+ */
 
-            Link_type orientation;
+void privateer::glycoplot::Plot::tighten_viewbox ()
+{
 
-            if ( link.get_order() >= 7 ) // up. should be == 8, but just to prevent unforeseen circumstances
-            {
-                orientation = up;
-                bool is_ketose = false;
+    int min_x, min_y, max_x, max_y;
+    min_x = 99999; max_x = this->width-60;
+    min_y = 99999; max_y = 0;
 
-                if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
-                    is_ketose = true;
+    for ( int i = 0; i < number_of_shapes() ; i++ )
+    {
+        if ( shape_at(i)->get_x() < min_x )
+            min_x = shape_at(i)->get_x();
 
-                if ( link.get_anomericity ( ) == "alpha" )
-                {
-                    AlphaBond * new_bond = new AlphaBond( x + 25, y + 35, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                else
-                {
-                    BetaBond * new_bond = new BetaBond( x + 25, y + 35, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                recursive_paint ( mg, linked_node, x, y - 80 );
-            }
-            if ( link.get_order() == 6 ) // up-left
-            {
-                orientation = up_side;
-                bool is_ketose = false;
+        if ( shape_at(i)->get_y() < min_y )
+            min_y = shape_at(i)->get_y();
+        if ( shape_at(i)->get_y() > max_y )
+            max_y = shape_at(i)->get_y();
+    }
 
-                if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
-                    is_ketose = true;
+    std::vector<int> new_viewbox;
+    new_viewbox.push_back ( min_x -10 );
+    new_viewbox.push_back ( min_y -10 );
+    new_viewbox.push_back ( max_x -min_x );
+    new_viewbox.push_back ( max_y -min_y +70 );
+    this->set_viewbox ( new_viewbox );
+    smaller ? this->set_size((max_x-min_x)*0.7, (max_y-min_y+70)*0.7) : this->set_size(max_x-min_x, max_y-min_y+70);
 
-                if ( link.get_anomericity ( ) == "alpha" )
-                {
-                    AlphaBond * new_bond = new AlphaBond( x + 25, y + 25, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                else
-                {
-                    BetaBond * new_bond = new BetaBond( x + 25, y + 25, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                recursive_paint ( mg, linked_node, x - 80, y - 80 );
-            }
-            if ( link.get_order() == 4 ) // left
-            {
-                orientation = side;
-                bool is_ketose = false;
+}
 
-                if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
-                    is_ketose = true;
 
-                if ( link.get_anomericity ( ) == "alpha" )
-                {
-                    AlphaBond * new_bond = new AlphaBond( x + 35, y + 25, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                else
-                {
-                    BetaBond * new_bond = new BetaBond( x + 35, y + 25, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                recursive_paint ( mg, linked_node, x - 80, y );
-            }
-            if ( link.get_order() == 3 ) // left-down
-            {
-                orientation = down_side;
-                bool is_ketose = false;
+bool privateer::glycoplot::Plot::plot_demo ( )
+{
+    // add positioning, etc
 
-                if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
-                    is_ketose = true;
+    this->set_size_and_viewbox(1000, 500);
 
-                if ( link.get_anomericity ( ) == "alpha" )
-                {
-                    AlphaBond * new_bond = new AlphaBond( x + 25, y + 25, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                else
-                {
-                    BetaBond * new_bond = new BetaBond( x + 25, y + 25, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                recursive_paint ( mg, linked_node, x - 80, y + 80 );
-            }
-            if ( link.get_order() == 2 ) // down
-            {
-                orientation = down;
-                bool is_ketose = false;
+    privateer::glycoplot::Glc *glc = new privateer::glycoplot::Glc (60,  60, "Glucose" );
+    privateer::glycoplot::Gal *gal = new privateer::glycoplot::Gal (170, 60, "Galactose" );
+    privateer::glycoplot::Man *man = new privateer::glycoplot::Man (280, 60, "Mannose" );
+    privateer::glycoplot::Fuc *fuc = new privateer::glycoplot::Fuc (390, 60, "Fucose" );
+    privateer::glycoplot::Xyl *xyl = new privateer::glycoplot::Xyl (500, 60, "Xylose");
 
-                if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
-                    is_ketose = true;
-
-                if ( link.get_anomericity ( ) == "alpha" )
-                {
-                    AlphaBond * new_bond = new AlphaBond( x + 25, y + 15, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                else
-                {
-                    BetaBond * new_bond = new BetaBond( x + 25, y + 15, orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                recursive_paint ( mg, linked_node, x, y + 80 );
-            }
-        }
-    }       /// end oxford notation
-            ////////////////////////////
-    else
-    {
-        for ( int j = 0; j < node.number_of_connections(); j++)
-        {
-            clipper::MGlycan::Linkage link = node.get_connection(j);
-            const clipper::MGlycan::Node& linked_node = mg.get_node(link.get_linked_node_id());
-
-            // first deal with a couple of special cases: Fucose and Xylose
-
-            if ( clipper::data::carbname_of(linked_node.get_sugar().type()) == "Fuc" )
-            {
-                up_down++;
-
-                if ( link.get_order() == 3 ) // it goes up
-                {
-                    if ( link.get_anomericity ( ) == "alpha" )
-                    {
-                        AlphaBond * new_bond = new AlphaBond( x+25, y + 25, up, link.get_description(), mmdbsel );
-                        add_link ( new_bond );
-                    }
-                    else
-                    {
-                        BetaBond * new_bond = new BetaBond( x+25, y + 25, up, link.get_description(), mmdbsel  );
-                        add_link ( new_bond );
-                    }
-                    recursive_paint ( mg, linked_node, x, y - 110 );
-                }
-                else // down it goes, then
-                {
-                    if ( link.get_anomericity ( ) == "alpha" )
-                    {
-                        AlphaBond * new_bond = new AlphaBond( x+25, y + 25, down, link.get_description(), mmdbsel  );
-                        add_link ( new_bond );
-                    }
-                    else
-                    {
-                        BetaBond * new_bond = new BetaBond( x+25, y + 25, down, link.get_description(), mmdbsel  );
-                        add_link ( new_bond );
-                    }
-                    recursive_paint ( mg, linked_node, x, y + 110 );
-                }
-            }
-            else if ( clipper::data::carbname_of(linked_node.get_sugar().type()) == "Xyl" )
-            {
-                up_down++;
-
-                if ( link.get_order() == 3 ) // it goes up
-                {
-                    if ( link.get_anomericity ( ) == "alpha" )
-                    {
-                        AlphaBond * new_bond = new AlphaBond( x+25, y + 25, up, link.get_description(), mmdbsel  );
-                        add_link ( new_bond );
-                    }
-                    else
-                    {
-                        BetaBond * new_bond = new BetaBond( x+25, y + 25, up, link.get_description(), mmdbsel  );
-                        add_link ( new_bond );
-                    }
-                    recursive_paint ( mg, linked_node, x, y - 110 );
-                }
-                else // down it goes, then
-                {
-                    if ( link.get_anomericity ( ) == "alpha" )
-                    {
-                        AlphaBond * new_bond = new AlphaBond( x+25, y + 25, down, link.get_description(), mmdbsel  );
-                        add_link ( new_bond );
-                    }
-                    else
-                    {
-                        BetaBond * new_bond = new BetaBond( x+25, y + 25, down, link.get_description(), mmdbsel  );
-                        add_link ( new_bond );
-                    }
-                    recursive_paint ( mg, linked_node, x, y + 110 );
-                }
-            }
-            else // pseudo-general case
-            {
-                Link_type orientation;
-                int sign = 0;
-
-                switch (branches - j - up_down)
-                {
-                    case 3:
-                        orientation = up_side;
-                        sign = -1;
-                        break;
-                    case 2:
-                        orientation = side;
-                        break;
-                    case 1:
-                        if ( branches != 1 )
-                        {
-                            orientation = down_side;
-                            sign = 1;
-                        }
-                        else
-                        {
-                            orientation = side;
-                            sign = 0;
-                        }
-                        break;
-                    default:
-                        orientation = side;
-                        break;
-                }
-
-                bool is_ketose = false;
-
-                if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
-                    is_ketose = true;
-
-                if ( link.get_anomericity ( ) == "alpha" )
-                {
-                    AlphaBond * new_bond = new AlphaBond( x, y + 25 + (sign * 15), orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                else
-                {
-                    BetaBond * new_bond = new BetaBond( x, y + 25 + (sign * 15), orientation, link.get_description(is_ketose), mmdbsel  );
-                    add_link ( new_bond );
-                }
-                recursive_paint ( mg, linked_node, x - 110, y + ( sign * 80 ) );
-            }
-        }
-    }
-}
-
-
-/*! Remodel the SVG viewport to the contents
- * 	\return A std::vector<int> containing the new viewport coordinates, in this order: ( x0, y0, x1, y1 )
- */
-
-void privateer::glycoplot::Plot::tighten_viewbox ()
-{
-
-    int min_x, min_y, max_x, max_y;
-    min_x = 99999; max_x = this->width-60;
-    min_y = 99999; max_y = 0;
-
-    for ( int i = 0; i < list_of_shapes.size() ; i++ )
-    {
-        if ( list_of_shapes[i]->get_x() < min_x )
-            min_x = list_of_shapes[i]->get_x();
-
-        if ( list_of_shapes[i]->get_y() < min_y )
-            min_y = list_of_shapes[i]->get_y();
-        if ( list_of_shapes[i]->get_y() > max_y )
-            max_y = list_of_shapes[i]->get_y();
-    }
-
-    std::vector<int> new_viewbox;
-    new_viewbox.push_back ( min_x -10 );
-    new_viewbox.push_back ( min_y -10 );
-    new_viewbox.push_back ( max_x -min_x );
-    new_viewbox.push_back ( max_y -min_y +70 );
-    this->set_viewbox ( new_viewbox );
-    smaller ? this->set_size((max_x-min_x)*0.7, (max_y-min_y+70)*0.7) : this->set_size(max_x-min_x, max_y-min_y+70);
-
-}
-
-
-bool privateer::glycoplot::Plot::plot_demo ( )
-{
-    // add positioning, etc
-
-    this->set_size_and_viewbox(1000, 500);
-
-    privateer::glycoplot::Glc *glc = new privateer::glycoplot::Glc (60,  60, "Glucose" );
-    privateer::glycoplot::Gal *gal = new privateer::glycoplot::Gal (170, 60, "Galactose" );
-    privateer::glycoplot::Man *man = new privateer::glycoplot::Man (280, 60, "Mannose" );
-    privateer::glycoplot::Fuc *fuc = new privateer::glycoplot::Fuc (390, 60, "Fucose" );
-    privateer::glycoplot::Xyl *xyl = new privateer::glycoplot::Xyl (500, 60, "Xylose");
-
-    privateer::glycoplot::GlcN *glcn = new privateer::glycoplot::GlcN (60,  170, "Glucosamine" );
-    privateer::glycoplot::GalN *galn = new privateer::glycoplot::GalN (170, 170, "Galactosamine" );
-    privateer::glycoplot::ManN *mann = new privateer::glycoplot::ManN (280, 170, "Mannosamine" );
+    privateer::glycoplot::GlcN *glcn = new privateer::glycoplot::GlcN (60,  170, "Glucosamine" );
+    privateer::glycoplot::GalN *galn = new privateer::glycoplot::GalN (170, 170, "Galactosamine" );
+    privateer::glycoplot::ManN *mann = new privateer::glycoplot::ManN (280, 170, "Mannosamine" );
 
     privateer::glycoplot::GlcA *glca = new privateer::glycoplot::GlcA (390, 170, "Glucuronic acid" );
     privateer::glycoplot::GalA *gala = new privateer::glycoplot::GalA (500, 170, "Galacturonic acid" );
@@ -2032,263 +2334,171 @@ bool privateer::glycoplot::Plot::plot_demo ( )
     return false;
 }
 
-// get XML from hexoses
+// Sugar glyphs and bonds <use> a symbol from the definitions, so the markup up to the position is
+// rendered once per symbol and shapes are appended straight into one buffer
 
-std::string privateer::glycoplot::Glc::get_XML ()
+static std::string glyph_template ( const std::string& symbol )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#glc\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    return "  <use xlink:href=\"#" + symbol + "\" x=\"";
 }
 
-std::string privateer::glycoplot::Man::get_XML ()
+static void append_integer ( std::string& buffer, int value )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#man\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    char digits[16];
+    int length = snprintf ( digits, sizeof(digits), "%d", value );
+    buffer.append ( digits, length );
 }
 
-std::string privateer::glycoplot::Gal::get_XML ()
+static void append_glyph ( std::string& buffer, const std::string& glyph, int x, int y, const std::string& id, const std::string& tooltip )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#gal\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
+    buffer += glyph;
+    append_integer ( buffer, x );
+    buffer += "\" y=\"";
+    append_integer ( buffer, y );
+    buffer += "\" id=\"";
+    buffer += id;
+    buffer += "\" ><title>";
+    buffer += tooltip;
+    buffer += "</title></use>\n";
+}
 
+// get XML from hexoses
 
-    return tmp.str();
+void privateer::glycoplot::Glc::append_XML ( std::string& buffer )
+{
+    static const std::string glyph = glyph_template ( "glc" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::Fuc::get_XML ()
+void privateer::glycoplot::Man::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#fuc\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "man" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::Xyl::get_XML ()
+void privateer::glycoplot::Gal::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#xyl\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
+    static const std::string glyph = glyph_template ( "gal" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
+}
 
+void privateer::glycoplot::Fuc::append_XML ( std::string& buffer )
+{
+    static const std::string glyph = glyph_template ( "fuc" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
+}
 
-    return tmp.str();
+void privateer::glycoplot::Xyl::append_XML ( std::string& buffer )
+{
+    static const std::string glyph = glyph_template ( "xyl" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
 
 // get XML from hexosamines
 
-std::string privateer::glycoplot::GalN::get_XML ()
+void privateer::glycoplot::GalN::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#galn\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "galn" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::GlcN::get_XML ()
+void privateer::glycoplot::GlcN::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#glcn\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "glcn" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::ManN::get_XML ()
+void privateer::glycoplot::ManN::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#mann\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "mann" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
 
 // get XML from N-acetyl hexosamines
 
-std::string privateer::glycoplot::GlcNAc::get_XML ()
+void privateer::glycoplot::GlcNAc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#glcnac\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "glcnac" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::GalNAc::get_XML ()
+void privateer::glycoplot::GalNAc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#galnac\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "galnac" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::ManNAc::get_XML ()
+void privateer::glycoplot::ManNAc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#mannac\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "mannac" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
 
 // get XML from acidic sugars
 
-std::string privateer::glycoplot::Neu5Ac::get_XML ()
+void privateer::glycoplot::Neu5Ac::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#neu5ac\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "neu5ac" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::Neu5Gc::get_XML ()
+void privateer::glycoplot::Neu5Gc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#neu5gc\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "neu5gc" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::KDN::get_XML ()
+void privateer::glycoplot::KDN::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#kdn\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "kdn" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::GlcA::get_XML ()
+void privateer::glycoplot::GlcA::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#glca\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "glca" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::ManA::get_XML ()
+void privateer::glycoplot::ManA::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#mana\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "mana" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::GalA::get_XML ()
+void privateer::glycoplot::GalA::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#gala\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "gala" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycoplot::IdoA::get_XML ()
+void privateer::glycoplot::IdoA::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#idoa\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "idoa" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
 
-std::string privateer::glycoplot::Unk::get_XML ()
+void privateer::glycoplot::Unk::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#unk\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n"
-          <<  "<text x=\"" << get_x() + 25 << "\""
-          <<  " y=\"" << get_y() +34 << "\" text-anchor=\"middle\" font-family=\"Helvetica\" font-size=\"24\" font-weight=\"bold\">" << code << "</text>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "unk" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
+
+    buffer += "<text x=\"";
+    append_integer ( buffer, get_x() + 25 );
+    buffer += "\" y=\"";
+    append_integer ( buffer, get_y() + 34 );
+    buffer += "\" text-anchor=\"middle\" font-family=\"Helvetica\" font-size=\"24\" font-weight=\"bold\">";
+    buffer += code;
+    buffer += "</text>\n";
 }
 
 // plus, get XML from the glycan root (protein part)
 
-std::string privateer::glycoplot::GlycanRoot::get_XML ()
+void privateer::glycoplot::GlycanRoot::append_XML ( std::string& buffer )
 {
     std::ostringstream tmp;
     std::string link_name = get_link_atom();
@@ -2308,14 +2518,15 @@ std::string privateer::glycoplot::GlycanRoot::get_XML ()
         << get_root_name() << "<tspan baseline-shift=\"sub\" font-weight=\"normal\" font-size=\"20\">" << get_root_id() << "</tspan></text>\n"
         << "</g>\n";
 
-    return tmp.str();
+    buffer += tmp.str();
 }
 
 
 // last but not least, get XML from the bonds
 
-std::string privateer::glycoplot::AlphaBond::get_XML ()
+void privateer::glycoplot::AlphaBond::append_XML ( std::string& buffer )
 {
+    static const std::string glyph = glyph_template ( "alpha" );
     std::ostringstream tmp;
 
     std::string transformation = "";
@@ -2356,17 +2567,18 @@ std::string privateer::glycoplot::AlphaBond::get_XML ()
             transformation = stream.str();
     }
 
-    tmp   <<  "  <use xlink:href=\"#alpha\" x=\"" << get_x() << "\""
+    tmp   <<  glyph << get_x() << "\""
           <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\"" << transformation << " >"
           <<  "<title>" << get_tooltip() << "</title>"
           <<  "</use>\n";
 
-    return tmp.str();
+    buffer += tmp.str();
 }
 
 
-std::string privateer::glycoplot::BetaBond::get_XML ()
+void privateer::glycoplot::BetaBond::append_XML ( std::string& buffer )
 {
+    static const std::string glyph = glyph_template ( "beta" );
     std::ostringstream tmp;
 
     std::string transformation = "";
@@ -2408,12 +2620,12 @@ std::string privateer::glycoplot::BetaBond::get_XML ()
             stream << " transform=\"rotate(180 " << get_x() << " " << get_y() << ")\"";
             transformation = stream.str();
     }
-    tmp   <<  "  <use xlink:href=\"#beta\" x=\"" << get_x() << "\""
+    tmp   <<  glyph << get_x() << "\""
           <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\"" << transformation << " >"
           <<  "<title>" << get_tooltip() << "</title>"
           <<  "</use>\n";
 
-    return tmp.str();
+    buffer += tmp.str();
 } ///////// End of Glycoplot /////////
 
 ///////// Privateer's glycanbuilderplot /////////
@@ -2503,34 +2715,25 @@ std::string privateer::glycanbuilderplot::get_colour ( Colour colour, bool origi
     }
 }
 
-void privateer::glycanbuilderplot::Plot::write_svg_header   ( std::fstream& of )
+/*! Shared <defs> block for a colour scheme. Each of the eight variants is built once and reused by every plot
+ * 	\param embedded true for the compact definitions used by get_svg_string_contents, false for the ones written to SVG files
+ */
+
+const std::string& privateer::glycanbuilderplot::Plot::get_svg_definitions ( bool original_style, bool inverted_background, bool embedded )
 {
+    static const std::string cache[8] = { build_file_definitions   ( false, false ), build_file_definitions   ( false, true ),
+                                          build_file_definitions   ( true,  false ), build_file_definitions   ( true,  true ),
+                                          build_string_definitions ( false, false ), build_string_definitions ( false, true ),
+                                          build_string_definitions ( true,  false ), build_string_definitions ( true,  true ) };
 
-    of << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n\n"
-       << "<!-- Generator: Privateer (YSBL, University of York, distributed by CCP4) -->\n"
-       << "<!-- Please reference: Agirre, Iglesias, Rovira, Davies, Wilson & Cowtan (2015) Nat Struct & Mol Biol 22(11), 833-834 -->\n\n"
-       << "<svg xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
-       << "     xmlns:cc=\"http://creativecommons.org/ns#\"\n"
-       << "     xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\"\n"
-       << "     xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
-       << "     xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
-       << "     xmlns=\"http://www.w3.org/2000/svg\"\n"
-       << "     version=\"1.1\"\n"
-       << "     width=\"" << get_width() << "\" \n"
-       << "     height=\"" << get_height() << "\" \n"
-       << "     viewBox=\"" << get_viewbox() << " \"\n"
-       << "     preserveAspectRatio=\"xMinYMinXMaxYMax meet\">\n\n"
-       << "  <style>\n"
-       << "    .my_blue   { fill:" << get_colour ( rootblue, original_colour_scheme ) << " }\n"
-       << "    .my_red    { fill:" << get_colour ( rootred, original_colour_scheme  ) << " }\n"
-       << "    .my_yellow { fill:" << get_colour ( rootyellow, original_colour_scheme  ) << " }\n"
-       << "  </style>\n";
-
+    return cache[ ( embedded ? 4 : 0 ) + ( original_style ? 2 : 0 ) + ( inverted_background ? 1 : 0 ) ];
 }
 
 
-void privateer::glycanbuilderplot::Plot::write_svg_definitions( std::fstream& of )
+std::string privateer::glycanbuilderplot::Plot::build_file_definitions ( bool original_colour_scheme, bool inverted_background )
 {
+    std::ostringstream of;
+
     of << "  <defs>\n"
 
        // colour patterns for two-colour shapes
@@ -2716,51 +2919,11 @@ void privateer::glycanbuilderplot::Plot::write_svg_definitions( std::fstream& of
 
        << "  </defs>\n\n" ;
 
-}
-
-void privateer::glycanbuilderplot::Plot::write_svg_contents ( std::fstream& of )
-{
-    of << "<title>" << get_title() << "</title>\n";
-
-    for (int i = 0; i < list_of_shapes.size() ; i ++)
-    {
-        of << list_of_shapes[i]->get_XML();
-    }
-} //!< doesn't add html anchors, as SVG files are supposed to be standalone and not linked to any other CCP4 application
-
-
-void privateer::glycanbuilderplot::Plot::write_svg_footer ( std::fstream& of )
-{
-    of << "\n</svg>" ;
-}
-
-
-std::string privateer::glycanbuilderplot::Plot::get_svg_string_header   ( )
-{
-    std::ostringstream of;
-
-    of << "<svg xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
-       << "     xmlns:cc=\"http://creativecommons.org/ns#\"\n"
-       << "     xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\"\n"
-       << "     xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
-       << "     xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
-       << "     xmlns=\"http://www.w3.org/2000/svg\"\n"
-       << "     version=\"1.1\"\n"
-       << "     width=\"" << get_width() << "\" \n"
-       << "     height=\"" << get_height() << "\" \n"
-       << "     viewBox=\"" << get_viewbox() << " \"\n"
-       << "     preserveAspectRatio=\"xMinYMinXMaxYMax meet\">\n\n"
-       << "  <style>\n"
-       << "    .my_blue   { fill:" << get_colour ( rootblue, original_colour_scheme ) << " }\n"
-       << "    .my_red    { fill:" << get_colour ( rootred, original_colour_scheme  ) << " }\n"
-       << "    .my_yellow { fill:" << get_colour ( rootyellow, original_colour_scheme  ) << " }\n"
-       << "  </style>\n";
-
     return of.str();
 }
 
 
-std::string privateer::glycanbuilderplot::Plot::get_svg_string_contents ( )
+std::string privateer::glycanbuilderplot::Plot::build_string_definitions ( bool original_colour_scheme, bool inverted_background )
 {
     std::ostringstream of;
 
@@ -2923,18 +3086,132 @@ std::string privateer::glycanbuilderplot::Plot::get_svg_string_contents ( )
 
        << "  </defs>\n\n" ;
 
-    for (int i = 0; i < list_of_shapes.size() ; i ++)
+    return of.str();
+}
+
+
+std::string privateer::glycanbuilderplot::Plot::get_svg_style ( bool original_style )
+{
+    std::ostringstream of;
+
+    of << "  <style>\n"
+       << "    .my_blue   { fill:" << get_colour ( rootblue, original_style ) << " }\n"
+       << "    .my_red    { fill:" << get_colour ( rootred, original_style  ) << " }\n"
+       << "    .my_yellow { fill:" << get_colour ( rootyellow, original_style  ) << " }\n"
+       << "  </style>\n";
+
+    return of.str();
+}
+
+
+void privateer::glycanbuilderplot::Plot::write_svg_header   ( std::ostream& of )
+{
+
+    of << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n\n"
+       << "<!-- Generator: Privateer (YSBL, University of York, distributed by CCP4) -->\n"
+       << "<!-- Please reference: Agirre, Iglesias, Rovira, Davies, Wilson & Cowtan (2015) Nat Struct & Mol Biol 22(11), 833-834 -->\n\n"
+       << "<svg xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
+       << "     xmlns:cc=\"http://creativecommons.org/ns#\"\n"
+       << "     xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\"\n"
+       << "     xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
+       << "     xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
+       << "     xmlns=\"http://www.w3.org/2000/svg\"\n"
+       << "     version=\"1.1\"\n"
+       << "     width=\"" << get_width() << "\" \n"
+       << "     height=\"" << get_height() << "\" \n"
+       << "     viewBox=\"" << get_viewbox() << " \"\n"
+       << "     preserveAspectRatio=\"xMinYMinXMaxYMax meet\">\n\n"
+       << get_svg_style ( original_colour_scheme );
+
+}
+
+
+void privateer::glycanbuilderplot::Plot::write_svg_definitions( std::ostream& of )
+{
+    of << get_svg_definitions ( original_colour_scheme, inverted_background, false );
+}
+
+void privateer::glycanbuilderplot::Plot::write_svg_contents ( std::ostream& of )
+{
+    std::string contents = "<title>" + get_title() + "</title>\n";
+    contents.reserve ( contents.size() + 256 * number_of_shapes() );
+
+    for (int i = 0; i < number_of_shapes() ; i ++)
     {
-        of << "<a xmlns=\"http://www.w3.org/2000/svg\" id=\"anchor\" xlink:href=\""
-           << list_of_shapes[i]->get_mmdbsel() << "\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" target=\"_top\">";
-        of << list_of_shapes[i]->get_XML();
-        of << "</a>\n";
+        shape_at(i)->append_XML ( contents );
     }
 
+    of << contents;
+} //!< doesn't add html anchors, as SVG files are supposed to be standalone and not linked to any other CCP4 application
+
+
+void privateer::glycanbuilderplot::Plot::write_svg_footer ( std::ostream& of )
+{
+    of << "\n</svg>" ;
+}
+
+
+std::string privateer::glycanbuilderplot::Plot::get_svg_string_header   ( )
+{
+    std::ostringstream of;
+
+    of << "<svg xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
+       << "     xmlns:cc=\"http://creativecommons.org/ns#\"\n"
+       << "     xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\"\n"
+       << "     xmlns:svg=\"http://www.w3.org/2000/svg\"\n"
+       << "     xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n"
+       << "     xmlns=\"http://www.w3.org/2000/svg\"\n"
+       << "     version=\"1.1\"\n"
+       << "     width=\"" << get_width() << "\" \n"
+       << "     height=\"" << get_height() << "\" \n"
+       << "     viewBox=\"" << get_viewbox() << " \"\n"
+       << "     preserveAspectRatio=\"xMinYMinXMaxYMax meet\">\n\n"
+       << get_svg_style ( original_colour_scheme );
+
     return of.str();
 }
 
 
+std::string privateer::glycanbuilderplot::Plot::get_svg_string_contents ( )
+{
+    std::string contents = get_svg_definitions ( original_colour_scheme, inverted_background, true );
+    contents.reserve ( contents.size() + 384 * number_of_shapes() );
+
+    for (int i = 0; i < number_of_shapes() ; i ++)
+    {
+        contents += "<a xmlns=\"http://www.w3.org/2000/svg\" id=\"anchor\" xlink:href=\"";
+        contents += shape_at(i)->get_mmdbsel();
+        contents += "\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" target=\"_top\">";
+        shape_at(i)->append_XML ( contents );
+        contents += "</a>\n";
+    }
+
+    return contents;
+}
+
+
+std::string privateer::glycanbuilderplot::Plot::get_svg_symbol ( const std::string& id )
+{
+    std::string symbol = "  <symbol id=\"" + id + "\" viewBox=\"" + get_viewbox() + "\">\n"
+                       + "    <title>" + get_title() + "</title>\n";
+
+    symbol.reserve ( symbol.size() + 384 * number_of_shapes() );
+
+    for (int i = 0; i < number_of_shapes() ; i ++)
+    {
+        symbol += "<a xmlns=\"http://www.w3.org/2000/svg\" id=\"anchor\" xlink:href=\"";
+        symbol += shape_at(i)->get_mmdbsel();
+        symbol += "\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" target=\"_top\">";
+        shape_at(i)->append_XML ( symbol );
+        symbol += "</a>\n";
+    }
+
+    symbol += "  </symbol>\n";
+
+    return symbol;
+}
+
+
 std::string privateer::glycanbuilderplot::Plot::get_svg_string_footer ( )
 {
     std::ostringstream of;
@@ -2945,6 +3222,19 @@ std::string privateer::glycanbuilderplot::Plot::get_svg_string_footer ( )
 }
 
 
+std::string privateer::glycanbuilderplot::Plot::write_to_string ( )
+{
+    std::ostringstream out;
+
+    write_svg_header      ( out );
+    write_svg_definitions ( out );
+    write_svg_contents    ( out );
+    write_svg_footer      ( out );
+
+    return out.str();
+} //!< same document as write_to_file
+
+
 bool privateer::glycanbuilderplot::Plot::write_to_file  ( std::string file_path )
 {
     std::fstream out;
@@ -2968,7 +3258,7 @@ std::string privateer::glycanbuilderplot::Plot::get_XML  ( )
 }
 
 
-bool privateer::glycanbuilderplot::Plot::plot_glycan ( clipper::MGlycan glycan )
+bool privateer::glycanbuilderplot::Plot::plot_glycan ( const clipper::MGlycan& glycan )
 {
 
     this->set_size(3000,3000);
@@ -3004,20 +3294,162 @@ bool privateer::glycanbuilderplot::Plot::plot_glycan ( clipper::MGlycan glycan )
 
     // let the fun begin: paint the tree with yet another recursive function
 
-    const clipper::MGlycan::Node node = glycan.get_node ( 0 ); // get the first node
+    GlycanLayout layout;
 
-    recursive_paint ( glycan, node, 2685, 990 ); // and initiate House Party protocol
+    recursive_paint ( glycan, 0, 2685, 990, layout ); // and initiate House Party protocol
+    paint_layout ( glycan, layout );
 
     this->tighten_viewbox();
 
     return false;
 }
 
-void privateer::glycanbuilderplot::Plot::recursive_paint ( clipper::MGlycan mg, clipper::MGlycan::Node node, int x, int y, bool oxford_angles )
+void privateer::glycanbuilderplot::Plot::recursive_paint ( const clipper::MGlycan& mg, int node_index, int x, int y, GlycanLayout& layout, bool oxford_angles )
 {
-    const clipper::MSugar& sugar = node.get_sugar();
+    const clipper::MGlycan::Node& node = mg.get_node ( node_index );
+
+    BlockPlacement block = { node_index, x, y };
+    layout.blocks.push_back ( block );
+
+    int up_down = 0; // number of special cases with perpendicular link
+    int branches = node.number_of_connections();
+
+    // decide here based on 2D notation
+    //////////////////////////////////////
+
+    for ( int j = 0; j < node.number_of_connections(); j++)
+    {
+        const clipper::MGlycan::Linkage& link = node.get_connection(j);
+        const int linked_index = link.get_linked_node_id();
+        const clipper::MGlycan::Node& linked_node = mg.get_node(linked_index);
+        const std::string linked_name = clipper::data::carbname_of(linked_node.get_sugar().type());
+
+        LinkPlacement placement = { node_index, j, x, y, side, false };
+        int next_x, next_y;
+
+        // first deal with a couple of special cases: Fucose and Xylose
+
+        if ( linked_name == "Fuc" || linked_name == "Xyl" )
+        {
+            up_down++;
+
+            placement.x = x + 25; placement.y = y + 25;
+            next_x = x;
+
+            if ( link.get_order() == 3 ) // it goes down
+            {
+                placement.orientation = up;
+                next_y = y + 110;
+            }
+            else // up it goes, then
+            {
+                placement.orientation = down;
+                next_y = y - 110;
+            }
+        }
+        else // pseudo-general case
+        {
+            int sign = 0;
+            bool nodeHasSpecialCase = false;
+
+            for ( int k = 0; k < node.number_of_connections(); k++)
+            {
+                const std::string sibling_name = clipper::data::carbname_of(mg.get_node(node.get_connection(k).get_linked_node_id()).get_sugar().type());
+
+                if ( sibling_name == "Fuc" || sibling_name == "Xyl" )
+                {
+                    nodeHasSpecialCase = true;
+                    break;
+                }
+            }
+
+            switch (branches - j - up_down)
+            {
+                case 3:
+                    placement.orientation = down_side; // up_side
+                    sign = 1; // -1
+                    break;
+                case 2:
+                    if (nodeHasSpecialCase)
+                    {
+                        sign = 0; // 1 not here before
+                        placement.orientation = side;
+                    }
+                    else
+                    {
+                        sign = 1;
+                        placement.orientation = branch_side;
+                    }
+                    break;
+                case 1:
+                    if ( branches != 1 )
+                    {
+                        if (nodeHasSpecialCase)
+                        {
+                            sign = 0; // 1 not here before
+                            placement.orientation = side;
+                        }
+                        else
+                        {
+                            sign = -1;
+                            placement.orientation = up_side;
+                        }
+                    }
+                    else
+                    {
+                        placement.orientation = side;
+                        sign = 0;
+                    }
+                    break;
+                default:
+                    placement.orientation = side;
+                    sign = 0; // not here before
+                    break;
+            }
+
+            if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
+                placement.is_ketose = true;
+
+            placement.x = x; placement.y = y + 25 + (sign * 15);
+            next_x = x - 110; next_y = y + ( sign * 80 );
+        }
 
-    std::string mmdbsel = "mmdb:///" + mg.get_chain().substr(0,1) + "/" + sugar.id().trim();
+        layout.links.push_back ( placement );
+        recursive_paint ( mg, linked_index, next_x, next_y, layout );
+    }
+}
+
+void privateer::glycanbuilderplot::Plot::paint_layout ( const clipper::MGlycan& mg, const GlycanLayout& layout )
+{
+    const std::string selection_prefix = "mmdb:///" + mg.get_chain().substr(0,1) + "/";
+
+    for ( int i = 0; i < layout.blocks.size(); i++ )
+    {
+        const clipper::MSugar& sugar = mg.get_node ( layout.blocks[i].node ).get_sugar();
+        add_sugar_block ( sugar, layout.blocks[i].x, layout.blocks[i].y, selection_prefix + sugar.id().trim() );
+    }
+
+    for ( int i = 0; i < layout.links.size(); i++ )
+    {
+        const LinkPlacement& placement = layout.links[i];
+        const clipper::MGlycan::Node& node = mg.get_node ( placement.node );
+        const clipper::MGlycan::Linkage& link = node.get_connection ( placement.connection );
+        const clipper::MSugar& linked_sugar = mg.get_node ( link.get_linked_node_id() ).get_sugar();
+
+        std::string anomerSymbol;
+        if (clipper::data::get_anomer(linked_sugar.type().trim()) == "alpha")     anomerSymbol = "&#945;";
+        else if (clipper::data::get_anomer(linked_sugar.type().trim()) == "beta") anomerSymbol = "&#946;";
+        else                                                                      anomerSymbol = "&#63;";
+
+        std::string linkagePosition = std::to_string(link.get_order());
+
+        Bond * new_bond = new Bond( placement.x, placement.y, placement.orientation, anomerSymbol, linkagePosition, link.get_description(placement.is_ketose), selection_prefix + node.get_sugar().id().trim() );
+        add_link ( new_bond );
+    }
+}
+
+void privateer::glycanbuilderplot::Plot::add_sugar_block ( const clipper::MSugar& sugar, int x, int y, const std::string& mmdbsel )
+{
     std::string sugname = clipper::data::carbname_of ( sugar.type() );
 
     if ( sugname == "Glc" )
@@ -3115,203 +3547,40 @@ void privateer::glycanbuilderplot::Plot::recursive_paint ( clipper::MGlycan mg,
         Unk *unk = new Unk ( x, y, *(sugar.type().substr(0,1).c_str()), get_svg_tooltip ( sugar, validation ), mmdbsel  );
         add_block ( unk );
     }
+}
 
-    int up_down = 0; // number of special cases with perpendicular link
-    int branches = node.number_of_connections();
 
-    // decide here based on 2D notation
-    //////////////////////////////////////
-    // need to change x and y values in the recursive function for both bonds and shapes.
+/*! Remodel the SVG viewport to the contents
+ * 	\return A std::vector<int> containing the new viewport coordinates, in this order: ( x0, y0, x1, y1 )
+ */
 
+void privateer::glycanbuilderplot::Plot::tighten_viewbox ()
+{
 
-    for ( int j = 0; j < node.number_of_connections(); j++)
+    int min_x, min_y, max_x, max_y;
+    min_x = 99999; max_x = this->width-60;
+    min_y = 99999; max_y = 0;
+
+    for ( int i = 0; i < number_of_shapes() ; i++ )
     {
-        clipper::MGlycan::Linkage link = node.get_connection(j);
-        const clipper::MGlycan::Node& linked_node = mg.get_node(link.get_linked_node_id());
+        if ( shape_at(i)->get_x() < min_x )
+            min_x = shape_at(i)->get_x();
 
-        // first deal with a couple of special cases: Fucose and Xylose
+        if ( shape_at(i)->get_y() < min_y )
+            min_y = shape_at(i)->get_y();
+        if ( shape_at(i)->get_y() > max_y )
+            max_y = shape_at(i)->get_y();
+    }
 
-        if ( clipper::data::carbname_of(linked_node.get_sugar().type()) == "Fuc" )
-        {
-            up_down++;
-            if ( link.get_order() == 3 ) // it goes down
-            {
-                
-                std::string anomerSymbol;
-                if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "alpha")     anomerSymbol = "&#945;";
-                else if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "beta") anomerSymbol = "&#946;";
-                else                                                                                 anomerSymbol = "&#63;";
+    std::vector<int> new_viewbox;
+    new_viewbox.push_back ( min_x -10 );
+    new_viewbox.push_back ( min_y -10 );
+    new_viewbox.push_back ( max_x -min_x );
+    new_viewbox.push_back ( max_y -min_y +70 );
+    this->set_viewbox ( new_viewbox );
+    smaller ? this->set_size((max_x-min_x)*0.7, (max_y-min_y+70)*0.7) : this->set_size(max_x-min_x, max_y-min_y+70);
 
-                std::string linkagePosition = std::to_string(link.get_order());
-
-                Bond * new_bond = new Bond( x+25, y + 25, up, anomerSymbol, linkagePosition, link.get_description(), mmdbsel  );
-                add_link ( new_bond );
-
-                recursive_paint ( mg, linked_node, x, y + 110 );
-            }
-            else // up it goes, then
-            {
-
-                std::string anomerSymbol;
-                if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "alpha")     anomerSymbol = "&#945;";
-                else if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "beta") anomerSymbol = "&#946;";
-                else                                                                                 anomerSymbol = "&#63;";
-
-                std::string linkagePosition = std::to_string(link.get_order());
-
-                Bond * new_bond = new Bond( x+25, y + 25, down, anomerSymbol, linkagePosition, link.get_description(), mmdbsel  );
-                add_link ( new_bond );
-                // }
-                recursive_paint ( mg, linked_node, x, y - 110 );
-            }
-        }
-        else if ( clipper::data::carbname_of(linked_node.get_sugar().type()) == "Xyl" )
-        {
-            up_down++;
-            if ( link.get_order() == 3 ) // it goes down
-            {
-
-                std::string anomerSymbol;
-                if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "alpha")     anomerSymbol = "&#945;";
-                else if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "beta") anomerSymbol = "&#946;";
-                else                                                                                 anomerSymbol = "&#63;";
-
-                std::string linkagePosition = std::to_string(link.get_order());
-
-                Bond * new_bond = new Bond( x+25, y + 25, up, anomerSymbol, linkagePosition, link.get_description(), mmdbsel  );
-                add_link ( new_bond );
-
-                recursive_paint ( mg, linked_node, x, y + 110 );
-            }
-            else // up it goes, then
-            {
-
-                std::string anomerSymbol;
-                if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "alpha")     anomerSymbol = "&#945;";
-                else if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "beta") anomerSymbol = "&#946;";
-                else                                                                                 anomerSymbol = "&#63;";
-
-                std::string linkagePosition = std::to_string(link.get_order());
-
-                Bond * new_bond = new Bond( x+25, y + 25, down, anomerSymbol, linkagePosition, link.get_description(), mmdbsel  );
-                add_link ( new_bond );
-
-                recursive_paint ( mg, linked_node, x, y - 110 );
-            }
-        }
-        else // pseudo-general case
-        {
-            Link_type orientation;
-            int sign = 0;
-            bool nodeHasSpecialCase = false; 
-
-            for ( int j = 0; j < node.number_of_connections(); j++)
-                {
-                    clipper::MGlycan::Linkage link = node.get_connection(j);
-                    const clipper::MGlycan::Node& linked_node = mg.get_node(link.get_linked_node_id());
-
-                    if ( clipper::data::carbname_of(linked_node.get_sugar().type()) == "Fuc" || clipper::data::carbname_of(linked_node.get_sugar().type()) == "Xyl")
-                    nodeHasSpecialCase = true;
-
-                    if(nodeHasSpecialCase) break;
-                }
-            
-            switch (branches - j - up_down)
-            {
-                case 3:
-                    orientation = down_side; // up_side
-                    sign = 1; // -1
-                    break;
-                case 2:
-                    if (nodeHasSpecialCase)
-                    {
-                        sign = 0; // 1 not here before
-                        orientation = side;
-                    }
-                    else
-                    {
-                        sign = 1;
-                        orientation = branch_side;
-                    }      
-                    break;
-                case 1:
-                    if ( branches != 1 )
-                    {
-                        if (nodeHasSpecialCase)
-                        {
-                            sign = 0; // 1 not here before
-                            orientation = side;
-                        }
-                        else
-                        {
-                            sign = -1;
-                            orientation = up_side;
-                        }      
-                    }
-                    else
-                    {
-                        orientation = side;
-                        sign = 0;
-                    }
-                    break;
-                default:
-                    orientation = side;
-                    sign = 0; // not here before
-                    break;
-            }
-
-            bool is_ketose = false;
-
-            if ( linked_node.get_sugar().full_type() == "ketose" ) // ketoses
-                is_ketose = true;
-
-            std::string anomerSymbol;
-            if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "alpha")     anomerSymbol = "&#945;";
-            else if (clipper::data::get_anomer(linked_node.get_sugar().type().trim()) == "beta") anomerSymbol = "&#946;";
-            else                                                                                 anomerSymbol = "&#63;";
-
-            std::string linkagePosition = std::to_string(link.get_order());
-
-            Bond * new_bond = new Bond( x, y + 25 + (sign * 15), orientation, anomerSymbol, linkagePosition, link.get_description(is_ketose), mmdbsel  );
-            add_link ( new_bond );
-
-            recursive_paint ( mg, linked_node, x - 110, y + ( sign * 80 ) );
-        }
-    }
-}
-
-
-/*! Remodel the SVG viewport to the contents
- * 	\return A std::vector<int> containing the new viewport coordinates, in this order: ( x0, y0, x1, y1 )
- */
-
-void privateer::glycanbuilderplot::Plot::tighten_viewbox ()
-{
-
-    int min_x, min_y, max_x, max_y;
-    min_x = 99999; max_x = this->width-60;
-    min_y = 99999; max_y = 0;
-
-    for ( int i = 0; i < list_of_shapes.size() ; i++ )
-    {
-        if ( list_of_shapes[i]->get_x() < min_x )
-            min_x = list_of_shapes[i]->get_x();
-
-        if ( list_of_shapes[i]->get_y() < min_y )
-            min_y = list_of_shapes[i]->get_y();
-        if ( list_of_shapes[i]->get_y() > max_y )
-            max_y = list_of_shapes[i]->get_y();
-    }
-
-    std::vector<int> new_viewbox;
-    new_viewbox.push_back ( min_x -10 );
-    new_viewbox.push_back ( min_y -10 );
-    new_viewbox.push_back ( max_x -min_x );
-    new_viewbox.push_back ( max_y -min_y +70 );
-    this->set_viewbox ( new_viewbox );
-    smaller ? this->set_size((max_x-min_x)*0.7, (max_y-min_y+70)*0.7) : this->set_size(max_x-min_x, max_y-min_y+70);
-
-}
+}
 
 
 bool privateer::glycanbuilderplot::Plot::plot_demo ( )
@@ -3361,261 +3630,141 @@ bool privateer::glycanbuilderplot::Plot::plot_demo ( )
 
 // get XML from hexoses
 
-std::string privateer::glycanbuilderplot::Glc::get_XML ()
+void privateer::glycanbuilderplot::Glc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#glc\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "glc" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::Man::get_XML ()
+void privateer::glycanbuilderplot::Man::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#man\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "man" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::Gal::get_XML ()
+void privateer::glycanbuilderplot::Gal::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#gal\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "gal" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::Fuc::get_XML ()
+void privateer::glycanbuilderplot::Fuc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#fuc\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "fuc" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::Xyl::get_XML ()
+void privateer::glycanbuilderplot::Xyl::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#xyl\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "xyl" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
 
 // get XML from hexosamines
 
-std::string privateer::glycanbuilderplot::GalN::get_XML ()
+void privateer::glycanbuilderplot::GalN::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#galn\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "galn" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::GlcN::get_XML ()
+void privateer::glycanbuilderplot::GlcN::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#glcn\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "glcn" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::ManN::get_XML ()
+void privateer::glycanbuilderplot::ManN::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#mann\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "mann" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
 
 // get XML from N-acetyl hexosamines
 
-std::string privateer::glycanbuilderplot::GlcNAc::get_XML ()
+void privateer::glycanbuilderplot::GlcNAc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#glcnac\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "glcnac" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::GalNAc::get_XML ()
+void privateer::glycanbuilderplot::GalNAc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#galnac\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "galnac" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::ManNAc::get_XML ()
+void privateer::glycanbuilderplot::ManNAc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#mannac\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "mannac" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
 
 // get XML from acidic sugars
 
-std::string privateer::glycanbuilderplot::Neu5Ac::get_XML ()
+void privateer::glycanbuilderplot::Neu5Ac::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#neu5ac\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "neu5ac" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::Neu5Gc::get_XML ()
+void privateer::glycanbuilderplot::Neu5Gc::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#neu5gc\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "neu5gc" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::KDN::get_XML ()
+void privateer::glycanbuilderplot::KDN::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#kdn\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "kdn" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::GlcA::get_XML ()
+void privateer::glycanbuilderplot::GlcA::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#glca\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "glca" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::ManA::get_XML ()
+void privateer::glycanbuilderplot::ManA::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#mana\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "mana" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::GalA::get_XML ()
+void privateer::glycanbuilderplot::GalA::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#gala\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "gala" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
-std::string privateer::glycanbuilderplot::IdoA::get_XML ()
+void privateer::glycanbuilderplot::IdoA::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#idoa\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "idoa" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
 }
 
 
-std::string privateer::glycanbuilderplot::Unk::get_XML ()
+void privateer::glycanbuilderplot::Unk::append_XML ( std::string& buffer )
 {
-    std::ostringstream tmp;
-
-    tmp   <<  "  <use xlink:href=\"#unk\" x=\"" << get_x() << "\""
-          <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\" >"
-          <<  "<title>" << get_tooltip() << "</title>"
-          <<  "</use>\n"
-          <<  "<text x=\"" << get_x() + 25 << "\""
-          <<  " y=\"" << get_y() +34 << "\" text-anchor=\"middle\" font-family=\"Helvetica\" font-size=\"24\" font-weight=\"bold\">" << code << "</text>\n";
-
-
-    return tmp.str();
+    static const std::string glyph = glyph_template ( "unk" );
+    append_glyph ( buffer, glyph, get_x(), get_y(), get_id(), get_tooltip() );
+
+    buffer += "<text x=\"";
+    append_integer ( buffer, get_x() + 25 );
+    buffer += "\" y=\"";
+    append_integer ( buffer, get_y() + 34 );
+    buffer += "\" text-anchor=\"middle\" font-family=\"Helvetica\" font-size=\"24\" font-weight=\"bold\">";
+    buffer += code;
+    buffer += "</text>\n";
 }
 
 // plus, get XML from the glycan root (protein part)
 
-std::string privateer::glycanbuilderplot::GlycanRoot::get_XML ()
+void privateer::glycanbuilderplot::GlycanRoot::append_XML ( std::string& buffer )
 {
     std::ostringstream tmp;
     std::string link_name = get_link_atom();
@@ -3635,12 +3784,12 @@ std::string privateer::glycanbuilderplot::GlycanRoot::get_XML ()
         << get_root_name() << "<tspan baseline-shift=\"sub\" font-weight=\"normal\" font-size=\"20\">" << get_root_id() << "</tspan></text>\n"
         << "</g>\n";
 
-    return tmp.str();
+    buffer += tmp.str();
 }
 
 
 
-std::string privateer::glycanbuilderplot::Bond::get_XML ()
+void privateer::glycanbuilderplot::Bond::append_XML ( std::string& buffer )
 {
     std::ostringstream tmp;
 
@@ -3728,232 +3877,808 @@ std::string privateer::glycanbuilderplot::Bond::get_XML ()
     }
 
 
-    if(linkagePosition.empty())
+    if(linkagePosition.empty())
+        {
+            anomerSymbolPosX = get_x() - 60;
+            anomerSymbolPosY = get_y() + 20;
+
+            tmp << "  <g id=\"bondas\">\n"
+            <<  "  <use xlink:href=\"#bond\"" << transformation <<  " x=\"" << get_x() << "\"" <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\">" << " <title>" << get_tooltip() << "</title>"<<  "</use>\n"
+            <<  "  <text x=\"" << anomerSymbolPosX << "\"" << " y=\"" << anomerSymbolPosY << "\"" << " class =\"black\" font-weight=\"bold\" font-family=\"Helvetica\" font-size=\"24\">" << anomerSymbol << "</text>\n"
+            << "</g>\n";
+        }
+    else
+        {
+            tmp << "  <g id=\"bondas\">\n"
+            <<  "  <use xlink:href=\"#bond\"" << transformation <<  " x=\"" << get_x() << "\"" <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\">" << " <title>" << get_tooltip() << "</title>"<<  "</use>\n"
+            <<  "  <text x=\"" << anomerSymbolPosX << "\"" << " y=\"" << anomerSymbolPosY << "\"" << " class =\"black\" font-weight=\"bold\" font-family=\"Helvetica\" font-size=\"24\">" << anomerSymbol << "</text>\n"
+            <<  "  <text x=\"" << linkageSymbolPosX << "\"" << " y=\"" << linkageSymbolPosY << "\"" << " class =\"black\" font-weight=\"bold\" font-family=\"Helvetica\" font-size=\"24\">" << linkagePosition << "</text>\n"
+            << "</g>\n";
+        }
+
+    buffer += tmp.str();
+} ///////// End of glycanbuilderplot /////////
+
+clipper::MiniMol privateer::scripting::Model::read_minimol ( const std::string& pdb_filename )
+{
+    // MMDB keeps global tables while reading, so only one file is parsed at a time
+    static std::mutex mmdb_mutex;
+    std::lock_guard<std::mutex> lock ( mmdb_mutex );
+
+    clipper::MMDBfile mfile;
+    clipper::MiniMol mmol;
+
+    const int mmdbflags = mmdb::MMDBF_IgnoreBlankLines | mmdb::MMDBF_IgnoreDuplSeqNum |
+                          mmdb::MMDBF_IgnoreNonCoorPDBErrors | mmdb::MMDBF_IgnoreRemarks |
+                          mmdb::MMDBF_EnforceUniqueChainID;
+
+    mfile.SetFlag( mmdbflags );
+
+    mfile.read_file( pdb_filename );
+    mfile.import_minimol( mmol );
+
+    if ( mmol.cell().is_null() )  // fixme: crystal-less NMR models were causing trouble
+        mmol.init ( clipper::Spacegroup::p1(), clipper::Cell(clipper::Cell_descr ( 300, 300, 300, 90, 90, 90 )) );
+
+    return mmol;
+}
+
+
+static privateer::scripting::SugarCoordinates gather_sugar_coordinates ( const std::vector < clipper::MGlycan >& glycans )
+{
+    privateer::scripting::SugarCoordinates coordinates;
+
+    for ( int i = 0 ; i < glycans.size() ; i++ )
+    {
+        coordinates.glycan_offsets.push_back ( coordinates.atom_offsets.size() );
+
+        for ( int j = 0 ; j < glycans[i].number_of_nodes() ; j++ )
+        {
+            const clipper::MSugar& sugar = glycans[i].get_node(j).get_sugar();
+            coordinates.atom_offsets.push_back ( coordinates.atom_names.size() );
+
+            for ( int k = 0 ; k < sugar.size() ; k++ )
+            {
+                const clipper::Coord_orth& xyz = sugar[k].coord_orth();
+                coordinates.xyz.push_back ( xyz.x() );
+                coordinates.xyz.push_back ( xyz.y() );
+                coordinates.xyz.push_back ( xyz.z() );
+                coordinates.atom_names.push_back ( sugar[k].id().trim() );
+            }
+        }
+    }
+
+    coordinates.glycan_offsets.push_back ( coordinates.atom_offsets.size() );
+    coordinates.atom_offsets.push_back ( coordinates.atom_names.size() );
+
+    return coordinates;
+}
+
+
+privateer::scripting::Model::Model ( std::string pdb_filename, std::string expression_system ) :
+    filename ( pdb_filename ),
+    expression_system ( expression_system ),
+    mmol ( read_minimol ( pdb_filename ) ),
+    manb ( mmol, 1.0 ),
+    mgl ( mmol, manb, expression_system ),
+    list_of_glycans ( mgl.get_list_of_glycans() ),
+    sugar_coordinates ( gather_sugar_coordinates ( list_of_glycans ) )
+{
+}
+
+
+int privateer::scripting::Model::sugar_row ( int glycan, int node ) const
+{
+    if ( glycan < 0 || glycan >= list_of_glycans.size() )
+        throw std::out_of_range ( "glycan index out of range" );
+
+    if ( node < 0 || node >= list_of_glycans[glycan].number_of_nodes() )
+        throw std::out_of_range ( "node index out of range" );
+
+    return sugar_coordinates.glycan_offsets[glycan] + node;
+}
+
+
+std::string privateer::scripting::Model::get_annotated_glycans ( bool original_colour_scheme ) const
+{
+    std::ostringstream of_xml;
+
+    of_xml << "<privateer>\n" ;
+
+    for ( int i = 0 ; i < list_of_glycans.size() ; i++ )
+    {
+        privateer::glycanbuilderplot::Plot plot(false, original_colour_scheme, list_of_glycans[i].get_root_by_name(), false, true, true, true);
+        plot.plot_glycan ( list_of_glycans[i] );
+
+        of_xml << "  <glycan type=\"" << list_of_glycans[i].get_type() << "\" root=\""
+               << "/" + list_of_glycans[i].get_chain().substr(0,1)
+                      + "/" + list_of_glycans[i].get_root().first.id().trim()
+                      + "(" + list_of_glycans[i].get_root().first.type().trim() + ")\""
+               << " chain=\"" << list_of_glycans[i].get_chain().substr(0,1) << "\">\n";
+
+        of_xml << "    <svg_graphics>\n" << plot.get_svg_string_header()
+               << plot.get_svg_string_contents() << plot.get_svg_string_footer()
+               << "    </svg_graphics>\n";
+
+        const std::vector< clipper::MSugar>& sugars = list_of_glycans[i].get_sugars();
+
+        for ( int j = 0 ; j < sugars.size(); j++ )
+        {
+            of_xml << "    <sugar id=\""
+                   << "/" + list_of_glycans[i].get_chain().substr(0,1)
+                          + "/" + sugars[j].id().trim()
+                          + "(" + sugars[j].type().trim() << ")\" >\n";
+
+            of_xml << "      <detected_type>"    << sugars[j].type_of_sugar()               << "</detected_type>\n"
+                   << "      <cremer-pople_Q>"   << sugars[j].puckering_amplitude()         << "</cremer-pople_Q>\n"
+                   << "      <cremer-pople_Phi>" << sugars[j].cremer_pople_params()[1]      << "</cremer-pople_Phi>\n";
+            if (sugars[j].ring_cardinality() == 6 )
+                of_xml << "      <cremer-pople_Theta>" << sugars[j].get_bfactor()           << "</cremer-pople_Theta>\n";
+
+            of_xml << "      <mean_bfactor>"     << sugars[j].get_bfactor()                 << "</mean_bfactor>\n"
+                   << "      <conformation>"     << sugars[j].conformation_name()           << "</conformation>\n"
+                   << "      <anomer>"           << sugars[j].anomer()                      << "</anomer>\n"
+                   << "      <hand>"             << sugars[j].handedness()                  << "</hand>\n"
+                   << "      <stacked_against>\n";
+
+            std::vector < std::pair < clipper::MAtomIndexSymmetry, clipper::ftype > > contacts = sugars[j].get_stacked_residues();
+
+            for ( int cont = 0 ; cont < contacts.size() ; cont++ )
+                of_xml << "        <residue id=\"/" << mmol[contacts[cont].first.polymer()].id().substr(0,1) << "/"
+                                                   << mmol[contacts[cont].first.polymer()][contacts[cont].first.monomer()].id().trim()
+                                                   << "(" << mmol[contacts[cont].first.polymer()][contacts[cont].first.monomer()].type().trim()
+                                                   << ")\" >\n"
+                                                   << "          <angle>" << contacts[cont].second << "</angle>\n"
+                                                   << "        </residue>\n";
+               of_xml << "      </stacked_against>\n";
+
+
+            of_xml << "      <validation>\n"
+                   << "        <conformation>"   << b2s(sugars[j].ok_with_conformation())   << "</conformation>\n"
+                   << "        <anomer>"         << b2s(sugars[j].ok_with_anomer())         << "</anomer>\n"
+                   << "        <hand>"           << b2s(sugars[j].ok_with_chirality())      << "</hand>\n"
+                   << "        <puckering>"      << b2s(sugars[j].ok_with_puckering())      << "</puckering>\n"
+                   << "      </validation>\n";
+
+            of_xml << "    </sugar>\n";
+        }
+
+        of_xml << "  </glycan>\n" ;
+    }
+
+    of_xml << "</privateer>\n";
+
+    return of_xml.str();
+}
+
+
+std::string privateer::scripting::Model::get_annotated_glycans_hierarchical ( bool original_colour_scheme ) const
+{
+    std::ostringstream of_xml;
+
+    of_xml << "<privateer>\n" ;
+
+    for ( int i = 0 ; i < list_of_glycans.size() ; i++ )
+    {
+        privateer::glycoplot::Plot plot(false, original_colour_scheme, list_of_glycans[i].get_root_by_name(), false, true, true, true);
+        plot.plot_glycan ( list_of_glycans[i] );
+
+        of_xml << "  <glycan type=\"" << list_of_glycans[i].get_type() << "\" root=\""
+               << "/" + list_of_glycans[i].get_chain().substr(0,1)
+                      + "/" + list_of_glycans[i].get_root().first.id().trim()
+                      + "(" + list_of_glycans[i].get_root().first.type().trim() + ")\""
+               << " chain=\"" << list_of_glycans[i].get_chain().substr(0,1) << "\">\n";
+
+        of_xml << "    <svg_graphics>\n" << plot.get_svg_string_header()
+               << plot.get_svg_string_contents() << plot.get_svg_string_footer()
+               << "    </svg_graphics>\n";
+
+        const clipper::MGlycan::Node& first_node = list_of_glycans[i].get_node(0);
+
+        // create the first connection, which does not really exist as it is not a sugar-sugar linkage
+        clipper::MGlycan::Linkage link (0, first_node.get_sugar().anomer(), 0);
+        link.set_torsions (list_of_glycans[i].get_glycosylation_torsions()[0], list_of_glycans[i].get_glycosylation_torsions()[1]);
+
+        of_xml << print_node ( mmol, list_of_glycans[i], first_node, list_of_glycans[i].get_chain().substr(0,1), link );
+
+        of_xml << "  </glycan>\n";
+
+        plot.delete_shapes();
+
+    }
+
+    of_xml << "</privateer>\n";
+
+    return of_xml.str();
+}
+
+
+std::string privateer::scripting::Model::print_wurcs ( ) const
+{
+    if (!list_of_glycans.empty())
+    {
+        std::string summaryString;
+        summaryString = "Total Glycans Found: ";
+        summaryString.append(std::to_string(list_of_glycans.size()));
+        summaryString.append("\n");
+        for (int i = 0; i < list_of_glycans.size(); i++)
+        {
+            std::string glycanRoot;
+            clipper::String wurcsDescription;
+            clipper::String temporaryString;
+
+            glycanRoot = list_of_glycans[i].get_root_by_name();
+            wurcsDescription = list_of_glycans[i].generate_wurcs();
+ 
+            temporaryString = temporaryString + glycanRoot + "\n" + wurcsDescription + "\n";
+            summaryString.append(temporaryString);
+        }
+            return summaryString;
+    }
+    else
+    {
+       std::string error = "ERROR: No Glycans found in the model!";
+       return error;
+    }
+}
+
+
+std::vector < privateer::scripting::GlycanRecord > privateer::scripting::Model::get_glycans ( ) const
+{
+    std::vector < GlycanRecord > glycans ( list_of_glycans.size() );
+
+    for ( int i = 0 ; i < list_of_glycans.size() ; i++ )
+    {
+        const clipper::MGlycan& glycan = list_of_glycans[i];
+        const std::string chain = glycan.get_chain().substr(0,1);
+        GlycanRecord& record = glycans[i];
+
+        record.index = i;
+        record.type  = glycan.get_type();
+        record.chain = chain;
+        record.root  = "/" + chain + "/" + glycan.get_root().first.id().trim() + "(" + glycan.get_root().first.type().trim() + ")";
+        record.sugars.resize ( glycan.number_of_nodes() );
+
+        for ( int j = 0 ; j < glycan.number_of_nodes() ; j++ )
+        {
+            const clipper::MSugar& sugar = glycan.get_node(j).get_sugar();
+            SugarRecord& entry = record.sugars[j];
+
+            entry.name          = sugar.type().trim();
+            entry.chain         = chain;
+            entry.residue       = sugar.id().trim();
+            entry.id            = "/" + chain + "/" + entry.residue + "(" + entry.name + ")";
+            entry.detected_type = sugar.type_of_sugar();
+            entry.conformation  = sugar.conformation_name();
+            entry.anomer        = sugar.anomer();
+            entry.handedness    = sugar.handedness();
+            entry.context       = sugar.get_context();
+
+            entry.q       = sugar.puckering_amplitude();
+            entry.phi     = sugar.cremer_pople_params()[1];
+            entry.theta   = sugar.ring_cardinality() == 6 ? sugar.cremer_pople_params()[2] : std::numeric_limits<float>::quiet_NaN();
+            entry.bfactor = sugar.get_bfactor();
+            entry.rscc    = std::numeric_limits<float>::quiet_NaN(); // a Model carries no map
+
+            entry.ok_conformation = sugar.ok_with_conformation();
+            entry.ok_anomer       = sugar.ok_with_anomer();
+            entry.ok_handedness   = sugar.ok_with_chirality();
+            entry.ok_puckering    = sugar.ok_with_puckering();
+
+            entry.node        = j;
+            entry.parent_node = -1;
+            entry.link_order  = 0;
+
+            const std::vector < std::pair < clipper::MAtomIndexSymmetry, clipper::ftype > > contacts = sugar.get_stacked_residues();
+
+            for ( int cont = 0 ; cont < contacts.size() ; cont++ )
+            {
+                const clipper::MMonomer& residue = mmol[contacts[cont].first.polymer()][contacts[cont].first.monomer()];
+                StackingContact contact;
+                contact.residue = "/" + mmol[contacts[cont].first.polymer()].id().substr(0,1) + "/" + residue.id().trim() + "(" + residue.type().trim() + ")";
+                contact.angle   = contacts[cont].second;
+                entry.stacked_against.push_back ( contact );
+            }
+        }
+
+        if ( !record.sugars.empty() )
+            record.sugars[0].link_torsions = glycan.get_glycosylation_torsions();
+
+        for ( int j = 0 ; j < glycan.number_of_nodes() ; j++ )
+        {
+            const clipper::MGlycan::Node& node = glycan.get_node ( j );
+
+            for ( int k = 0 ; k < node.number_of_connections() ; k++ )
+            {
+                const clipper::MGlycan::Linkage& link = node.get_connection ( k );
+                const int child = link.get_linked_node_id();
+
+                if ( child >= 0 && child < record.sugars.size() )
+                {
+                    record.sugars[child].parent_node   = j;
+                    record.sugars[child].link_order    = link.get_order();
+                    record.sugars[child].link_torsions = link.get_torsions();
+                }
+            }
+        }
+    }
+
+    return glycans;
+}
+
+
+privateer::scripting::SugarColumns privateer::scripting::Model::get_sugar_columns ( ) const
+{
+    SugarColumns columns;
+
+    for ( int i = 0 ; i < list_of_glycans.size() ; i++ )
+        for ( int j = 0 ; j < list_of_glycans[i].number_of_nodes() ; j++ )
+        {
+            const clipper::MSugar& sugar = list_of_glycans[i].get_node(j).get_sugar();
+
+            columns.q.push_back       ( sugar.puckering_amplitude() );
+            columns.phi.push_back     ( sugar.cremer_pople_params()[1] );
+            columns.theta.push_back   ( sugar.ring_cardinality() == 6 ? sugar.cremer_pople_params()[2] : std::numeric_limits<float>::quiet_NaN() );
+            columns.bfactor.push_back ( sugar.get_bfactor() );
+            columns.rscc.push_back    ( std::numeric_limits<float>::quiet_NaN() );
+            columns.glycan.push_back  ( i );
+            columns.node.push_back    ( j );
+        }
+
+    return columns;
+}
+
+
+std::string privateer::scripting::Model::get_glycan_svg ( int glycan, bool original_colour_scheme ) const
+{
+    if ( glycan < 0 || glycan >= list_of_glycans.size() )
+        throw std::out_of_range ( "glycan index out of range" );
+
+    privateer::glycoplot::Plot plot(false, original_colour_scheme, list_of_glycans[glycan].get_root_by_name(), false, true, true, true);
+    plot.plot_glycan ( list_of_glycans[glycan] );
+
+    std::string svg = plot.get_svg_string_header() + plot.get_svg_string_contents() + plot.get_svg_string_footer();
+    plot.delete_shapes();
+
+    return svg;
+}
+
+
+std::string privateer::scripting::Model::get_glycan_wurcs ( int glycan ) const
+{
+    if ( glycan < 0 || glycan >= list_of_glycans.size() )
+        throw std::out_of_range ( "glycan index out of range" );
+
+    return list_of_glycans[glycan].generate_wurcs();
+}
+
+
+std::string privateer::scripting::get_annotated_glycans ( std::string pdb_filename, bool original_colour_scheme, std::string expression_system )
+{
+    return Model ( pdb_filename, expression_system ).get_annotated_glycans ( original_colour_scheme );
+}
+
+
+std::string privateer::scripting::get_annotated_glycans_hierarchical ( std::string pdb_filename, bool original_colour_scheme, std::string expression_system )
+{
+    return Model ( pdb_filename, expression_system ).get_annotated_glycans_hierarchical ( original_colour_scheme );
+}
+
+
+std::string privateer::scripting::print_wurcs ( std::string pdb_filename, std::string expression_system )
+{
+    return Model ( pdb_filename, expression_system ).print_wurcs ( );
+}
+
+
+privateer::scripting::BatchAnalysis::BatchAnalysis ( const std::vector<std::string>& paths, int n_threads, std::string expression_system ) :
+    paths ( paths ),
+    expression_system ( expression_system ),
+    next_path ( 0 ),
+    cancelled ( false ),
+    delivered ( 0 ),
+    closed ( false )
+{
+    if ( n_threads <= 0 )
+        n_threads = std::max ( 1u, std::thread::hardware_concurrency() );
+
+    n_threads = std::min ( n_threads, (int) paths.size() );
+
+    for ( int i = 0 ; i < n_threads ; i++ )
+        workers.push_back ( std::thread ( &BatchAnalysis::work, this ) );
+}
+
+
+privateer::scripting::BatchAnalysis::~BatchAnalysis ( )
+{
+    close ( );
+}
+
+
+void privateer::scripting::BatchAnalysis::close ( )
+{
+    cancelled = true;
+
+    for ( int i = 0 ; i < workers.size() ; i++ )
+        if ( workers[i].joinable() )
+            workers[i].join();
+
+    std::lock_guard<std::mutex> lock ( finished_mutex );
+    closed = true;
+    result_ready.notify_all();
+}
+
+
+void privateer::scripting::BatchAnalysis::work ( )
+{
+    for ( int i = next_path++ ; i < paths.size() && !cancelled ; i = next_path++ )
+    {
+        BatchResult result;
+        result.index = i;
+        result.filename = paths[i];
+
+        try
         {
-            anomerSymbolPosX = get_x() - 60;
-            anomerSymbolPosY = get_y() + 20;
-
-            tmp << "  <g id=\"bondas\">\n"
-            <<  "  <use xlink:href=\"#bond\"" << transformation <<  " x=\"" << get_x() << "\"" <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\">" << " <title>" << get_tooltip() << "</title>"<<  "</use>\n"
-            <<  "  <text x=\"" << anomerSymbolPosX << "\"" << " y=\"" << anomerSymbolPosY << "\"" << " class =\"black\" font-weight=\"bold\" font-family=\"Helvetica\" font-size=\"24\">" << anomerSymbol << "</text>\n"
-            << "</g>\n";
+            result.model.reset ( new Model ( paths[i], expression_system ) );
         }
-    else
+        catch ( const clipper::Message_fatal& message )
         {
-            tmp << "  <g id=\"bondas\">\n"
-            <<  "  <use xlink:href=\"#bond\"" << transformation <<  " x=\"" << get_x() << "\"" <<  " y=\"" << get_y() << "\" id=\"" << get_id() << "\">" << " <title>" << get_tooltip() << "</title>"<<  "</use>\n"
-            <<  "  <text x=\"" << anomerSymbolPosX << "\"" << " y=\"" << anomerSymbolPosY << "\"" << " class =\"black\" font-weight=\"bold\" font-family=\"Helvetica\" font-size=\"24\">" << anomerSymbol << "</text>\n"
-            <<  "  <text x=\"" << linkageSymbolPosX << "\"" << " y=\"" << linkageSymbolPosY << "\"" << " class =\"black\" font-weight=\"bold\" font-family=\"Helvetica\" font-size=\"24\">" << linkagePosition << "</text>\n"
-            << "</g>\n";
+            result.error = message.text();
+        }
+        catch ( const std::exception& exception )
+        {
+            result.error = exception.what();
+        }
+        catch ( ... )
+        {
+            result.error = "could not analyse " + paths[i];
         }
 
-    return tmp.str();
-} ///////// End of glycanbuilderplot /////////
+        std::lock_guard<std::mutex> lock ( finished_mutex );
+        finished.push_back ( std::move ( result ) );
+        result_ready.notify_one();
+    }
+}
 
-std::string privateer::scripting::get_annotated_glycans ( std::string pdb_filename, bool original_colour_scheme, std::string expression_system )
+
+bool privateer::scripting::BatchAnalysis::next ( BatchResult& result )
 {
-    std::ostringstream of_xml;
+    std::unique_lock<std::mutex> lock ( finished_mutex );
 
-    clipper::MMDBfile mfile;
-    clipper::MiniMol mmol;
+    if ( delivered == paths.size() )
+        return false;
 
-    const int mmdbflags = mmdb::MMDBF_IgnoreBlankLines | mmdb::MMDBF_IgnoreDuplSeqNum |
-                          mmdb::MMDBF_IgnoreNonCoorPDBErrors | mmdb::MMDBF_IgnoreRemarks |
-                          mmdb::MMDBF_EnforceUniqueChainID;
+    result_ready.wait ( lock, [this] { return !finished.empty() || closed; } );
 
-    mfile.SetFlag( mmdbflags );
+    if ( finished.empty() ) // closed before every file was read
+        return false;
 
-    mfile.read_file( pdb_filename );
-    mfile.import_minimol( mmol );
+    result = std::move ( finished.front() );
+    finished.pop_front();
+    delivered++;
 
-    if ( mmol.cell().is_null() )  // fixme: crystal-less NMR models were causing trouble
-        mmol.init ( clipper::Spacegroup::p1(), clipper::Cell(clipper::Cell_descr ( 300, 300, 300, 90, 90, 90 )) );
+    return true;
+}
 
-    const clipper::MAtomNonBond& manb = clipper::MAtomNonBond( mmol, 1.0 );
 
-    clipper::MGlycology mgl = clipper::MGlycology(mmol, manb, expression_system);
+// The CCP4 MTZ and map readers share library state, so Python threads take turns reading experimental data
+static std::mutex ccp4_io_mutex;
 
-    std::vector < clipper::MGlycan > list_of_glycans = mgl.get_list_of_glycans();
+// Sugar monomers are left out of mainAtoms so that omit data can be calculated; their polymer/monomer indices go to sugars,
+// twice for disaccharides so that each half gets its own entry, as in the command line program
+static void split_sugar_atoms ( const clipper::MiniMol& mmol, clipper::Atom_list& mainAtoms, clipper::Atom_list& ligandAtoms, clipper::Atom_list& allAtoms, std::vector < std::pair<int, int> >& sugars )
+{
+    for ( int p = 0; p < mmol.size(); p++ )
+        for ( int m = 0; m < mmol[p].size(); m++ )
+        {
+            const clipper::MMonomer& mm = mmol[p][m];
+            const bool disaccharide = clipper::MDisaccharide::search_disaccharides ( mm.type().c_str() ) != -1;
+            const bool sugar = disaccharide || clipper::MSugar::search_database ( mm.type().c_str() );
 
-    of_xml << "<privateer>\n" ;
+            if ( sugar )
+                sugars.push_back ( std::make_pair ( p, m ) );
+            if ( disaccharide )
+                sugars.push_back ( std::make_pair ( p, m ) );
 
-    for ( int i = 0 ; i < list_of_glycans.size() ; i++ )
-    {
-        privateer::glycanbuilderplot::Plot plot(false, original_colour_scheme, list_of_glycans[i].get_root_by_name(), false, true, true, true);
-        plot.plot_glycan ( list_of_glycans[i] );
+            for ( int id = 0; id < mm.size(); id++ )
+            {
+                if ( sugar )
+                    ligandAtoms.push_back ( mm[id] );
+                else
+                    mainAtoms.push_back ( mm[id] );
 
-        of_xml << "  <glycan type=\"" << list_of_glycans[i].get_type() << "\" root=\""
-               << "/" + list_of_glycans[i].get_chain().substr(0,1)
-                      + "/" + list_of_glycans[i].get_root().first.id().trim()
-                      + "(" + list_of_glycans[i].get_root().first.type().trim() + ")\""
-               << " chain=\"" << list_of_glycans[i].get_chain().substr(0,1) << "\">\n";
+                allAtoms.push_back ( mm[id] );
+            }
+        }
+}
 
-        of_xml << "    <svg_graphics>\n" << plot.get_svg_string_header()
-               << plot.get_svg_string_contents() << plot.get_svg_string_footer()
-               << "    </svg_graphics>\n";
+static std::vector < privateer::scripting::SugarFit > list_sugar_fits ( const clipper::MiniMol& mmol, const std::vector < clipper::MGlycan >& glycans, const std::vector < std::pair<int, int> >& sugars )
+{
+    std::map < std::string, std::pair<int, int> > placements;
 
-        std::vector< clipper::MSugar> sugars = list_of_glycans[i].get_sugars();
+    for ( int i = 0 ; i < glycans.size() ; i++ )
+        for ( int j = 0 ; j < glycans[i].number_of_nodes() ; j++ )
+            placements[glycans[i].get_chain().substr(0,1) + "/" + glycans[i].get_node(j).get_sugar().id().trim()] = std::make_pair ( i, j );
 
-        for ( int j = 0 ; j < sugars.size(); j++ )
+    std::vector < privateer::scripting::SugarFit > fits ( sugars.size() );
+
+    for ( int i = 0 ; i < sugars.size() ; i++ )
+    {
+        const clipper::MMonomer& mm = mmol[sugars[i].first][sugars[i].second];
+        privateer::scripting::SugarFit& fit = fits[i];
+
+        fit.name    = mm.type().trim();
+
+        // the halves of a disaccharide are named like MDisaccharide does, e.g. "LAT[GAL]" and "LAT[GLC]"
+        const int disaccharide = clipper::MDisaccharide::search_disaccharides ( mm.type().c_str() );
+        if ( disaccharide != -1 )
         {
-            of_xml << "    <sugar id=\""
-                   << "/" + list_of_glycans[i].get_chain().substr(0,1)
-                          + "/" + sugars[j].id().trim()
-                          + "(" + sugars[j].type().trim() << ")\" >\n";
+            const bool second = i > 0 && sugars[i-1] == sugars[i];
+            const clipper::data::sugar_database_entry& half = second ? clipper::data::disaccharide_database[disaccharide].sugar_two
+                                                                     : clipper::data::disaccharide_database[disaccharide].sugar_one;
+            fit.name += "[" + half.name_short + "]";
+        }
 
-            of_xml << "      <detected_type>"    << sugars[j].type_of_sugar()               << "</detected_type>\n"
-                   << "      <cremer-pople_Q>"   << sugars[j].puckering_amplitude()         << "</cremer-pople_Q>\n"
-                   << "      <cremer-pople_Phi>" << sugars[j].cremer_pople_params()[1]      << "</cremer-pople_Phi>\n";
-            if (sugars[j].ring_cardinality() == 6 )
-                of_xml << "      <cremer-pople_Theta>" << sugars[j].get_bfactor()           << "</cremer-pople_Theta>\n";
+        fit.chain   = mmol[sugars[i].first].id().substr(0,1);
+        fit.residue = mm.id().trim();
+        fit.id      = "/" + fit.chain + "/" + fit.residue + "(" + fit.name + ")";
 
-            of_xml << "      <mean_bfactor>"     << sugars[j].get_bfactor()                 << "</mean_bfactor>\n"
-                   << "      <conformation>"     << sugars[j].conformation_name()           << "</conformation>\n"
-                   << "      <anomer>"           << sugars[j].anomer()                      << "</anomer>\n"
-                   << "      <hand>"             << sugars[j].handedness()                  << "</hand>\n"
-                   << "      <stacked_against>\n";
+        std::map < std::string, std::pair<int, int> >::const_iterator found = placements.find ( fit.chain + "/" + fit.residue );
+        fit.glycan = found != placements.end() ? found->second.first  : -1;
+        fit.node   = found != placements.end() ? found->second.second : -1;
+    }
 
-            std::vector < std::pair < clipper::MAtomIndexSymmetry, clipper::ftype > > contacts = sugars[j].get_stacked_residues();
+    return fits;
+}
 
-            for ( int cont = 0 ; cont < contacts.size() ; cont++ )
-                of_xml << "        <residue id=\"/" << mmol[contacts[cont].first.polymer()].id().substr(0,1) << "/"
-                                                   << mmol[contacts[cont].first.polymer()][contacts[cont].first.monomer()].id().trim()
-                                                   << "(" << mmol[contacts[cont].first.polymer()][contacts[cont].first.monomer()].type().trim()
-                                                   << ")\" >\n"
-                                                   << "          <angle>" << contacts[cont].second << "</angle>\n"
-                                                   << "        </residue>\n";
-               of_xml << "      </stacked_against>\n";
+// Box around a monomer, with a 2A margin, that RSCC calculations scan
+static void sugar_box ( const clipper::MMonomer& mm, clipper::Coord_orth& origin, clipper::Coord_orth& destination )
+{
+    float maxX, maxY, maxZ, minX, minY, minZ;
+    maxX = maxY = maxZ = -999999.0;
+    minX = minY = minZ = 999999.0;
 
+    for ( int natom = 0; natom < mm.size(); natom++ )
+    {
+        const clipper::Coord_orth& xyz = mm[natom].coord_orth();
+        maxX = std::max ( maxX, (float) xyz.x() ); minX = std::min ( minX, (float) xyz.x() );
+        maxY = std::max ( maxY, (float) xyz.y() ); minY = std::min ( minY, (float) xyz.y() );
+        maxZ = std::max ( maxZ, (float) xyz.z() ); minZ = std::min ( minZ, (float) xyz.z() );
+    }
 
-            of_xml << "      <validation>\n"
-                   << "        <conformation>"   << b2s(sugars[j].ok_with_conformation())   << "</conformation>\n"
-                   << "        <anomer>"         << b2s(sugars[j].ok_with_anomer())         << "</anomer>\n"
-                   << "        <hand>"           << b2s(sugars[j].ok_with_chirality())      << "</hand>\n"
-                   << "        <puckering>"      << b2s(sugars[j].ok_with_puckering())      << "</puckering>\n"
-                   << "      </validation>\n";
+    origin = clipper::Coord_orth ( minX-2, minY-2, minZ-2 );
+    destination = clipper::Coord_orth ( maxX+2, maxY+2, maxZ+2 );
+}
 
-            of_xml << "    </sugar>\n";
-        }
+static std::vector < privateer::scripting::DifferenceBlob > list_difference_blobs ( const clipper::Xmap<float>& difference_map, const clipper::MiniMol& mmol, float sigma )
+{
+    const clipper::Map_stats ms ( difference_map );
+    DensityBlobCatalogue catalogue ( difference_map, ms, sigma );
+    catalogue.assign_nearest_residues ( mmol );
 
-        of_xml << "  </glycan>\n" ;
+    std::vector < privateer::scripting::DifferenceBlob > blobs;
+
+    for ( int i = 0 ; i < catalogue.blobs().size() ; i++ )
+    {
+        const DensityBlob& blob = catalogue.blobs()[i];
+        privateer::scripting::DifferenceBlob entry;
+
+        entry.volume             = blob.volume;
+        entry.integrated_density = blob.integratedDensity;
+        entry.peak_density       = blob.peakDensity;
+        entry.centroid           = { (float) blob.centroid.x(), (float) blob.centroid.y(), (float) blob.centroid.z() };
+        entry.nearest_residue    = blob.nearestResidue.empty() ? "" : "/" + blob.nearestChain.substr(0,1) + "/" + blob.nearestResidue.trim() + "(" + blob.nearestResidueType.trim() + ")";
+        entry.nearest_residue_distance = blob.nearestResidue.empty() ? std::numeric_limits<float>::quiet_NaN() : (float) blob.nearestResidueDistance;
+
+        blobs.push_back ( entry );
     }
 
-    of_xml << "</privateer>\n";
+    return blobs;
+}
 
-    return of_xml.str();
+
+// Xmaps only store the asymmetric unit, so the whole cell is expanded once into a flat buffer that Python can view
+template < class T >
+static privateer::scripting::MapGrid map_grid ( const clipper::Xmap<T>& xmap )
+{
+    privateer::scripting::MapGrid grid;
+
+    const clipper::Cell& cell = xmap.cell();
+    const clipper::Grid_sampling& sampling = xmap.grid_sampling();
+    const int nu = sampling.nu(), nv = sampling.nv(), nw = sampling.nw();
+
+    grid.spacegroup = xmap.spacegroup().symbol_hm();
+    grid.cell  = { (float) cell.a(), (float) cell.b(), (float) cell.c(), (float) cell.alpha_deg(), (float) cell.beta_deg(), (float) cell.gamma_deg() };
+    grid.shape = { nu, nv, nw };
+    grid.data.resize ( size_t(nu) * nv * nw );
+
+    #pragma omp parallel for
+    for ( int u = 0 ; u < nu ; u++ )
+        for ( int v = 0 ; v < nv ; v++ )
+            for ( int w = 0 ; w < nw ; w++ )
+                grid.data[ ( size_t(u) * nv + v ) * nw + w ] = xmap.get_data ( clipper::Coord_grid ( u, v, w ) );
+
+    return grid;
 }
 
 
-std::string privateer::scripting::get_annotated_glycans_hierarchical ( std::string pdb_filename, bool original_colour_scheme, std::string expression_system )
+privateer::scripting::MapValidation privateer::scripting::validate_xray ( const Model& model, std::string mtz_filename, const MapValidationOptions& options )
 {
-    std::ostringstream of_xml;
+    const clipper::MiniMol& mmol = model.get_minimol();
 
-    clipper::MMDBfile mfile;
-    clipper::MiniMol mmol;
+    clipper::HKL_info hklinfo;
+    clipper::CCP4MTZfile mtzin, ampmtzin;
+    clipper::MTZcrystal opxtal;
+    clipper::MTZdataset opdset;
 
-    const int mmdbflags = mmdb::MMDBF_IgnoreBlankLines | mmdb::MMDBF_IgnoreDuplSeqNum |
-                          mmdb::MMDBF_IgnoreNonCoorPDBErrors | mmdb::MMDBF_IgnoreRemarks |
-                          mmdb::MMDBF_EnforceUniqueChainID;
+    clipper::HKL_data<clipper::data32::F_sigF> fobs;
+    {
+        std::lock_guard<std::mutex> lock ( ccp4_io_mutex );
+        privateer::xray::read_xray_map ( mtz_filename, model.get_filename(), mmol, hklinfo, mtzin, true );
+        fobs = clipper::HKL_data<clipper::data32::F_sigF> ( hklinfo );
+        privateer::xray::initialize_experimental_dataset ( mtzin, ampmtzin, options.fobs_column, fobs, hklinfo, opxtal, opdset, mtz_filename, true );
+    }
+    clipper::HKL_data<clipper::data32::F_sigF> fobs_scaled = fobs;
 
-    mfile.SetFlag( mmdbflags );
+    clipper::Atom_list mainAtoms, ligandAtoms, allAtoms;
+    std::vector < std::pair<int, int> > sugars;
+    split_sugar_atoms ( mmol, mainAtoms, ligandAtoms, allAtoms, sugars );
 
-    mfile.read_file( pdb_filename );
-    mfile.import_minimol( mmol );
+    clipper::HKL_data<clipper::data32::F_phi> fc_ligands ( hklinfo );
+    clipper::HKL_data<clipper::data32::F_phi> fb_all ( hklinfo );
+    clipper::HKL_data<clipper::data32::F_phi> fd_all ( hklinfo );
+    clipper::HKL_data<clipper::data32::F_phi> fd_omit ( hklinfo );
+    double r_all, r_omit;
 
-    if ( mmol.cell().is_null() )  // fixme: crystal-less NMR models were causing trouble
-        mmol.init ( clipper::Spacegroup::p1(), clipper::Cell(clipper::Cell_descr ( 300, 300, 300, 90, 90, 90 )) );
+    privateer::xray::calculate_sigmaa_coefficients ( fobs, fobs_scaled, mainAtoms, ligandAtoms, allAtoms, fc_ligands, fb_all, fd_all, fd_omit, options.n_refln, options.n_param, r_all, r_omit );
 
-    const clipper::MAtomNonBond& manb = clipper::MAtomNonBond( mmol, 1.0 );
+    MapValidation validation;
+    validation.resolution = hklinfo.resolution().limit();
+    validation.r_all = r_all;
+    validation.r_omit = r_omit;
+    validation.against_best_map = ( r_omit - r_all > 0.15 ) || clipper::Util::is_nan ( r_omit );
 
-    const clipper::MGlycology& mgl = clipper::MGlycology(mmol, manb, expression_system);
+    const clipper::Grid_sampling mygrid ( hklinfo.spacegroup(), hklinfo.cell(), hklinfo.resolution() );
+    clipper::Xmap<float> best_map, omit_map, difference_map;
+    clipper::Xmap<float> ligandmap ( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
 
-    const std::vector < clipper::MGlycan >& list_of_glycans = mgl.get_list_of_glycans();
+    // only the maps that will be used are allocated; each one takes a full asymmetric unit
+    const bool need_best = validation.against_best_map || options.keep_maps;
+    const bool need_omit = !validation.against_best_map || options.keep_maps;
+    const bool need_difference = options.find_blobs || options.keep_maps;
 
-    of_xml << "<privateer>\n" ;
+    if ( need_best ) best_map.init ( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
+    if ( need_omit ) omit_map.init ( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
+    if ( need_difference ) difference_map.init ( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
 
-    for ( int i = 0 ; i < list_of_glycans.size() ; i++ )
+    #pragma omp parallel sections
     {
-        privateer::glycoplot::Plot plot(false, original_colour_scheme, list_of_glycans[i].get_root_by_name(), false, true, true, true);
-        plot.plot_glycan ( list_of_glycans[i] );
+    #pragma omp section
+        if ( need_best ) best_map.fft_from ( fb_all );
+    #pragma omp section
+        if ( need_omit ) omit_map.fft_from ( fd_omit );
+    #pragma omp section
+        if ( need_difference ) difference_map.fft_from ( fd_all );
+    #pragma omp section
+        ligandmap.fft_from ( fc_ligands );
+    }
 
-        of_xml << "  <glycan type=\"" << list_of_glycans[i].get_type() << "\" root=\""
-               << "/" + list_of_glycans[i].get_chain().substr(0,1)
-                      + "/" + list_of_glycans[i].get_root().first.id().trim()
-                      + "(" + list_of_glycans[i].get_root().first.type().trim() + ")\""
-               << " chain=\"" << list_of_glycans[i].get_chain().substr(0,1) << "\">\n";
+    const clipper::Xmap<float>& experimental_map = validation.against_best_map ? best_map : omit_map;
+    const clipper::Map_stats ms ( experimental_map );
 
-        of_xml << "    <svg_graphics>\n" << plot.get_svg_string_header()
-               << plot.get_svg_string_contents() << plot.get_svg_string_footer()
-               << "    </svg_graphics>\n";
+    validation.sugars = list_sugar_fits ( mmol, model.get_list_of_glycans(), sugars );
 
-        const clipper::MGlycan::Node& first_node = list_of_glycans[i].get_node(0);
+    #pragma omp parallel
+    {
+        // one mask per thread; EDcalc_mask clears it before marking the atoms of each sugar
+        clipper::Xmap<float> mask ( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
+        clipper::EDcalc_mask<float> masker ( options.mask_radius );
 
-        // create the first connection, which does not really exist as it is not a sugar-sugar linkage
-        clipper::MGlycan::Linkage link (0, first_node.get_sugar().anomer(), 0);
-        link.set_torsions (list_of_glycans[i].get_glycosylation_torsions()[0], list_of_glycans[i].get_glycosylation_torsions()[1]);
+        #pragma omp for schedule(dynamic)
+        for ( int i = 0 ; i < sugars.size() ; i++ )
+        {
+            const clipper::MMonomer& mm = mmol[sugars[i].first][sugars[i].second];
+            masker ( mask, mm.atom_list() );
 
-        of_xml << print_node ( mmol, list_of_glycans[i], first_node, list_of_glycans[i].get_chain().substr(0,1), link );
+            clipper::Coord_orth origin, destination;
+            sugar_box ( mm, origin, destination );
 
-        of_xml << "  </glycan>\n";
+            const std::pair<double, double> rscc_and_accum = privateer::xray::calculate_rscc ( experimental_map, ligandmap, mask, ms, hklinfo, mygrid, origin, destination );
+            validation.sugars[i].rscc = rscc_and_accum.first;
+            validation.sugars[i].mean_density = rscc_and_accum.second;
+        }
+    }
 
-        plot.delete_shapes();
+    if ( options.find_blobs )
+        validation.blobs = list_difference_blobs ( difference_map, mmol, options.blob_sigma );
 
+    if ( options.keep_maps )
+    {
+        validation.maps["best"]       = map_grid ( best_map );
+        validation.maps["omit"]       = map_grid ( omit_map );
+        validation.maps["difference"] = map_grid ( difference_map );
+        validation.maps["ligand"]     = map_grid ( ligandmap );
     }
 
-    of_xml << "</privateer>\n";
-
-    return of_xml.str();
+    return validation;
 }
 
 
-std::string privateer::scripting::print_wurcs( std::string pdb_filename, std::string expression_system )
+privateer::scripting::MapValidation privateer::scripting::validate_cryoem ( const Model& model, std::string map_filename, float resolution, const MapValidationOptions& options )
 {
-    clipper::MMDBfile mfile;
-    clipper::MiniMol mmol;
- 
-    const int mmdbflags = mmdb::MMDBF_IgnoreBlankLines | mmdb::MMDBF_IgnoreDuplSeqNum |
-                          mmdb::MMDBF_IgnoreNonCoorPDBErrors | mmdb::MMDBF_IgnoreRemarks |
-                          mmdb::MMDBF_EnforceUniqueChainID;
- 
-    mfile.SetFlag(mmdbflags);
- 
-    mfile.read_file(pdb_filename);
-    mfile.import_minimol(mmol);
- 
-    if (mmol.cell().is_null()) // fixme: crystal-less NMR models were causing trouble
-        mmol.init(clipper::Spacegroup::p1(), clipper::Cell(clipper::Cell_descr(300, 300, 300, 90, 90, 90)));
- 
-    const clipper::MAtomNonBond &manb = clipper::MAtomNonBond(mmol, 1.0);
- 
-    clipper::MGlycology mgl = clipper::MGlycology(mmol, manb, expression_system);
- 
-    std::vector<clipper::MGlycan> list_of_glycans = mgl.get_list_of_glycans();
- 
-    if (!list_of_glycans.empty())
+    const clipper::MiniMol& mmol = model.get_minimol();
+
+    clipper::HKL_info hklinfo;
+    clipper::Xmap<double> cryo_em_map;
+    clipper::CCP4MAPfile mrcin;
+
     {
-        std::string summaryString;
-        summaryString = "Total Glycans Found: ";
-        summaryString.append(std::to_string(list_of_glycans.size()));
-        summaryString.append("\n");
-        for (int i = 0; i < list_of_glycans.size(); i++)
+        std::lock_guard<std::mutex> lock ( ccp4_io_mutex );
+        privateer::cryo_em::read_cryoem_map ( map_filename, hklinfo, cryo_em_map, mrcin, resolution, true );
+    }
+
+    clipper::HKL_data<clipper::data32::F_phi> fc_cryoem_obs ( hklinfo, cryo_em_map.cell() );
+    clipper::HKL_data<clipper::data32::F_phi> fc_all ( hklinfo );
+    clipper::HKL_data<clipper::data32::F_phi> fc_ligands ( hklinfo );
+    cryo_em_map.fft_to ( fc_cryoem_obs );
+
+    clipper::Atom_list mainAtoms, ligandAtoms, allAtoms;
+    std::vector < std::pair<int, int> > sugars;
+    split_sugar_atoms ( mmol, mainAtoms, ligandAtoms, allAtoms, sugars );
+
+    privateer::cryo_em::calculate_sfcs_of_fc_maps ( fc_all, fc_ligands, allAtoms, ligandAtoms, true );
+
+    MapValidation validation;
+    validation.resolution = hklinfo.resolution().limit();
+    validation.r_all = validation.r_omit = std::numeric_limits<float>::quiet_NaN();
+    validation.against_best_map = true;
+
+    clipper::Grid_sampling mygrid ( cryo_em_map.grid_asu().nu(), cryo_em_map.grid_asu().nv(), cryo_em_map.grid_asu().nw() );
+    clipper::Xmap<double> ligandmap ( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
+    ligandmap.fft_from ( fc_ligands );       // this is the map that will serve as Fc map for the RSCC calculation
+
+    validation.sugars = list_sugar_fits ( mmol, model.get_list_of_glycans(), sugars );
+
+    const clipper::Map_stats ms ( cryo_em_map );
+
+    #pragma omp parallel
+    {
+        // one mask per thread; EDcalc_mask clears it before marking the atoms of each sugar
+        clipper::Xmap<double> mask ( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
+        clipper::EDcalc_mask<double> masker ( options.mask_radius );
+
+        #pragma omp for schedule(dynamic)
+        for ( int i = 0 ; i < sugars.size() ; i++ )
         {
-            std::string glycanRoot;
-            clipper::String wurcsDescription;
-            clipper::String temporaryString;
+            const clipper::MMonomer& mm = mmol[sugars[i].first][sugars[i].second];
+            masker ( mask, mm.atom_list() );
 
-            glycanRoot = list_of_glycans[i].get_root_by_name();
-            wurcsDescription = list_of_glycans[i].generate_wurcs();
- 
-            temporaryString = temporaryString + glycanRoot + "\n" + wurcsDescription + "\n";
-            summaryString.append(temporaryString);
+            clipper::Coord_orth origin, destination;
+            sugar_box ( mm, origin, destination );
+
+            const std::pair<double, double> rscc_and_accum = privateer::xray::calculate_rscc ( cryo_em_map, ligandmap, mask, ms, hklinfo, mygrid, origin, destination );
+            validation.sugars[i].rscc = rscc_and_accum.first;
+            validation.sugars[i].mean_density = rscc_and_accum.second;
         }
-            return summaryString;
     }
-    else
+
+    if ( options.find_blobs || options.keep_maps )
     {
-       std::string error = "ERROR: No Glycans found in the model!";
-       return error;
+        // sampled at the map resolution rather than on the (often much finer) pixel grid of the input map
+        clipper::Xmap<float> difference_map ( hklinfo.spacegroup(), hklinfo.cell(), clipper::Grid_sampling ( hklinfo.spacegroup(), hklinfo.cell(), hklinfo.resolution() ) );
+        if ( privateer::cryo_em::calculate_difference_map ( difference_map, fc_cryoem_obs, allAtoms, hklinfo, true ) )
+        {
+            if ( options.find_blobs )
+                validation.blobs = list_difference_blobs ( difference_map, mmol, options.blob_sigma );
+            if ( options.keep_maps )
+                validation.maps["difference"] = map_grid ( difference_map );
+        }
     }
+
+    if ( options.keep_maps )
+        validation.maps["ligand"] = map_grid ( ligandmap );
+
+    return validation;
 }
 
 
@@ -4056,3 +4781,113 @@ std::vector <char> privateer::util::number_of_conformers ( clipper::MMonomer& mm
     }
     return alt_confs;
 }
+
+bool privateer::util::render_glycan_plots ( const std::vector<GlycanPlotJob>& jobs, bool old_style, bool vertical, bool original, bool invert, int io_threads )
+{
+    std::vector < std::string > documents ( jobs.size() );
+
+    // plots only read their glycan, so every one of them can be drawn independently
+
+    #pragma omp parallel for schedule(dynamic)
+    for ( int i = 0; i < jobs.size(); i++ )
+    {
+        if ( old_style )
+        {
+            privateer::glycoplot::Plot plot(vertical, original, jobs[i].title, invert, true);
+            plot.plot_glycan ( *jobs[i].glycan );
+            documents[i] = plot.write_to_string ( );
+        }
+        else
+        {
+            privateer::glycanbuilderplot::Plot plot(vertical, original, jobs[i].title, invert, true);
+            plot.plot_glycan ( *jobs[i].glycan );
+            documents[i] = plot.write_to_string ( );
+        }
+    }
+
+    int failed = 0;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(std::max(1, io_threads)) reduction(+:failed)
+    for ( int i = 0; i < jobs.size(); i++ )
+    {
+        std::ofstream out ( jobs[i].file_name.c_str() );
+        out.write ( documents[i].data(), documents[i].size() );
+
+        if ( !out )
+            failed++;
+    }
+
+    return failed > 0;
+}
+
+bool privateer::util::write_glycan_plot_sheet ( const std::vector<GlycanPlotJob>& jobs, std::string file_path, bool old_style, bool vertical, bool original, bool invert )
+{
+    const int spacing = 20;
+
+    std::vector < std::string > symbols ( jobs.size() );
+    std::vector < int > widths ( jobs.size() ), heights ( jobs.size() );
+
+    #pragma omp parallel for schedule(dynamic)
+    for ( int i = 0; i < jobs.size(); i++ )
+    {
+        std::ostringstream id;
+        id << "glycan_" << i;
+
+        if ( old_style )
+        {
+            privateer::glycoplot::Plot plot(vertical, original, jobs[i].title, invert, true);
+            plot.plot_glycan ( *jobs[i].glycan );
+            symbols[i] = plot.get_svg_symbol ( id.str() );
+            widths[i]  = plot.get_width ( );
+            heights[i] = plot.get_height ( );
+        }
+        else
+        {
+            privateer::glycanbuilderplot::Plot plot(vertical, original, jobs[i].title, invert, true);
+            plot.plot_glycan ( *jobs[i].glycan );
+            symbols[i] = plot.get_svg_symbol ( id.str() );
+            widths[i]  = plot.get_width ( );
+            heights[i] = plot.get_height ( );
+        }
+    }
+
+    int sheet_width = 0, sheet_height = 0;
+    std::ostringstream instances;
+
+    for ( int i = 0; i < jobs.size(); i++ )
+    {
+        instances << "  <use xlink:href=\"#glycan_" << i << "\" x=\"0\" y=\"" << sheet_height
+                  << "\" width=\"" << widths[i] << "\" height=\"" << heights[i]
+                  << "\" data-file=\"" << jobs[i].file_name << "\" />\n";
+
+        sheet_width = std::max ( sheet_width, widths[i] );
+        sheet_height += heights[i] + spacing;
+    }
+
+    std::ostringstream of;
+
+    of << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>\n\n"
+       << "<!-- Generator: Privateer (YSBL, University of York, distributed by CCP4) -->\n\n"
+       << "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" version=\"1.1\""
+       << " width=\"" << sheet_width << "\" height=\"" << sheet_height << "\" viewBox=\"0 0 " << sheet_width << " " << sheet_height << "\">\n";
+
+    if ( old_style )
+        of << privateer::glycoplot::Plot::get_svg_style ( original )
+           << privateer::glycoplot::Plot::get_svg_definitions ( original, invert, false );
+    else
+        of << privateer::glycanbuilderplot::Plot::get_svg_style ( original )
+           << privateer::glycanbuilderplot::Plot::get_svg_definitions ( original, invert, false );
+
+    for ( int i = 0; i < symbols.size(); i++ )
+        of << symbols[i];
+
+    of << instances.str() << "</svg>\n";
+
+    // everything goes out in one write
+
+    const std::string document = of.str();
+    std::ofstream out ( file_path.c_str() );
+    out.write ( document.data(), document.size() );
+
+    return !out;
+}
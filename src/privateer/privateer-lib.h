@@ -15,6 +15,13 @@
 #include <fstream>
 #include <iomanip>
 #include <algorithm>
+#include <memory>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
 #include "clipper-glyco.h"
 #include <clipper/clipper.h>
 #include <clipper/clipper-mmdb.h>
@@ -38,21 +45,49 @@ namespace privateer
     namespace coot
     {
         // Coot support, Scheme
-        void insert_coot_prologue_scheme ( std::fstream& );
-        void insert_coot_epilogue_scheme ( std::fstream& );
-        void insert_coot_files_loadup_scheme ( std::fstream&, const clipper::String&, const clipper::String&, const clipper::String&, const clipper::String&, bool mode, const clipper::String& pdbblobs, bool blobsoutput);
-        void insert_coot_go_to_blob_scheme ( std::fstream& output, const clipper::Coord_orth& blob_centre, const clipper::String& diagnostic );
-        void insert_coot_go_to_sugar_scheme ( std::fstream&, const clipper::Coord_orth& sugar_centre, const clipper::String& diagnostic );
-        void insert_coot_statusbar_text_scheme ( std::fstream&, clipper::String& );
-        void insert_coot_command ( std::fstream& output, std::string command );
+        void insert_coot_prologue_scheme ( std::ostream& );
+        void insert_coot_epilogue_scheme ( std::ostream& );
+        void insert_coot_files_loadup_scheme ( std::ostream&, const clipper::String&, const clipper::String&, const clipper::String&, const clipper::String&, bool mode, const clipper::String& pdbblobs, bool blobsoutput);
+        void insert_coot_go_to_blob_scheme ( std::ostream& output, const clipper::Coord_orth& blob_centre, const clipper::String& diagnostic );
+        void insert_coot_go_to_sugar_scheme ( std::ostream&, const clipper::Coord_orth& sugar_centre, const clipper::String& diagnostic );
+        void insert_coot_statusbar_text_scheme ( std::ostream&, clipper::String& );
+        void insert_coot_command ( std::ostream& output, std::string command );
 
         // Coot support, Python
-        void insert_coot_files_loadup_python ( std::fstream&, const clipper::String&, const clipper::String&, const clipper::String&, const clipper::String&, bool mode, const clipper::String& pdbblobs, bool blobsoutput);
-        void insert_coot_prologue_python ( std::fstream& );
-        void insert_coot_epilogue_python ( std::fstream& );
-        void insert_coot_go_to_blob_python ( std::fstream& output, const clipper::Coord_orth& blob_centre, const clipper::String& diagnostic );
-        void insert_coot_go_to_sugar_python ( std::fstream&, const clipper::Coord_orth& sugar_centre, const clipper::String& diagnostic );
-        void insert_coot_statusbar_text_python ( std::fstream&, clipper::String& );
+        void insert_coot_files_loadup_python ( std::ostream&, const clipper::String&, const clipper::String&, const clipper::String&, const clipper::String&, bool mode, const clipper::String& pdbblobs, bool blobsoutput);
+        void insert_coot_prologue_python ( std::ostream& );
+        void insert_coot_epilogue_python ( std::ostream& );
+        void insert_coot_go_to_blob_python ( std::ostream& output, const clipper::Coord_orth& blob_centre, const clipper::String& diagnostic );
+        void insert_coot_go_to_sugar_python ( std::ostream&, const clipper::Coord_orth& sugar_centre, const clipper::String& diagnostic );
+        void insert_coot_statusbar_text_python ( std::ostream&, clipper::String& );
+
+        /*! Language-neutral list of the places a Coot user is taken to, rendered to the Scheme and Python scripts in one pass each
+         * 	Sugars and blobs produce the same kind of entry, so both go through add()
+         */
+
+        class NavigationList
+        {
+            public:
+
+                NavigationList ( ) : mode ( false ), blobsoutput ( false ) { }
+
+                void set_files ( const clipper::String& pdb, const clipper::String& mapbest, const clipper::String& mapdiff, const clipper::String& mapomit,
+                                 bool mode, const clipper::String& pdbblobs, bool blobsoutput );
+                void set_status_bar_text ( const clipper::String& text ) { this->status_bar_text = text; }
+                void add ( const clipper::Coord_orth& centre, const clipper::String& diagnostic ) { entries.push_back ( std::make_pair ( centre, diagnostic ) ); }
+                int size ( ) const { return entries.size(); }
+
+                std::string render_scheme ( );
+                std::string render_python ( );
+
+                bool write ( const std::string& scheme_path, const std::string& python_path ); //!< an empty path skips that language. \return true if there have been any problems
+
+            private:
+
+                std::vector < std::pair < clipper::Coord_orth, clipper::String > > entries;
+                clipper::String pdb, mapbest, mapdiff, mapomit, pdbblobs, status_bar_text;
+                bool mode, blobsoutput;
+        };
     }
 
     namespace util
@@ -73,10 +108,10 @@ namespace privateer
         bool write_libraries ( std::vector < std::string > code_list, float esd = 5.0 );
         bool compute_and_print_external_validation ( const std::vector<clipper::String> validation_options,
                                                      clipper::data::sugar_database_entry& external_validation );
-        void print_XML ( std::vector < std::pair < clipper::String, clipper::MSugar > > sugarList,
-                         std::vector < clipper::MGlycan > list_of_glycans,
-                         std::vector<std::vector<std::pair<std::pair<clipper::MGlycan, std::vector<int>>,float>>>& list_of_glycans_associated_to_permutations,
-                         clipper::String pdbname,
+        void print_XML ( const std::vector < std::pair < clipper::String, clipper::MSugar > >& sugarList,
+                         const std::vector < clipper::MGlycan >& list_of_glycans,
+                         const std::vector<std::vector<std::pair<std::pair<clipper::MGlycan, std::vector<int>>,float>>>& list_of_glycans_associated_to_permutations,
+                         const clipper::String& pdbname,
                          nlohmann::json& jsonObject );
         bool read_coordinate_file_mtz (clipper::MMDBfile& mfile, clipper::MiniMol& mmol, clipper::String& ippdb, bool batch);
         bool read_coordinate_file_mrc (clipper::MMDBfile& mfile, clipper::MiniMol& mmol, clipper::String& ippdb, clipper::Xmap<double>& input_map, bool batch);
@@ -84,6 +119,43 @@ namespace privateer
         nlohmann::json read_json_file ( clipper::String& path, nlohmann::json& jsonContainer );
         int find_index_of_value ( nlohmann::json& jsonContainer, std::string key, std::string value );
 
+        /*! Writes one row per sugar as a fixed-schema, little-endian columnar file, read back by privateer.columnar
+         * 	Layout: "PRVCOLS1", uint32 schema version, uint32 row count, then every column in full, each padded to 8 bytes.
+         * 	Columns, in order: q, phi, theta (NaN for furanoses), rscc, bfactor as float32; conformation as int16;
+         * 	anomer (0 unknown, 1 alpha, 2 beta), context (0 unknown, 1 n-, 2 o-, 3 s-, 4 c-glycan, 5 ligand) and flags as uint8;
+         * 	glycan, node, parent_node and link_order as int32 (-1 or 0 outside glycans); name and chain as 4-byte, residue as 8-byte strings.
+         * 	Flag bits, lowest first: ring, bonds rmsd, angles rmsd, anomer, chirality, conformation, puckering, sane.
+         * 	\return true if there have been any problems
+         */
+
+        bool write_columnar_export ( const std::vector < std::pair < clipper::String, clipper::MSugar > >& sugarList,
+                                     const std::vector < clipper::MGlycan >& list_of_glycans,
+                                     std::string file_path );
+
+        enum OutputSink { console_sink, xml_sink, coot_scheme_sink, coot_python_sink, svg_sink, maps_sink, mtz_sink, json_sink, number_of_sinks };
+
+        /*! Registry of the outputs a run has been asked for. All sinks are on unless a list is given with -outputs,
+         * 	and the driver skips the stages whose only consumers are disabled sinks, e.g. map FFTs nobody will read
+         */
+
+        class OutputSinks
+        {
+            public:
+
+                OutputSinks ( ) : enabled ( number_of_sinks, true ) { }
+
+                bool parse ( const std::string& list ); //!< comma-separated sink names, "coot" for both scripts, or "none". \return true if there have been any problems
+                void enable ( OutputSink sink, bool on = true ) { enabled[sink] = on; }
+                bool wants ( OutputSink sink ) const { return enabled[sink]; }
+
+                static const char* name ( OutputSink sink );
+                static std::string known_names ( );
+
+            private:
+
+                std::vector<bool> enabled;
+        };
+
     }
 
     namespace glycoplot
@@ -93,7 +165,7 @@ namespace privateer
 
         std::string get_colour ( Colour colour, bool original_style, bool inverted = false  );
 
-        inline const std::string get_svg_tooltip ( clipper::MSugar sugar, bool validation )
+        inline const std::string get_svg_tooltip ( const clipper::MSugar& sugar, bool validation )
         {
             std::ostringstream str;
             str << std::setprecision(2) << std::fixed
@@ -133,12 +205,13 @@ namespace privateer
                 void set_pos( int x, int y ) { pos_x = x; pos_y =y ; }
                 int  get_y  ( ) { return pos_y; }
                 int  get_x  ( ) { return pos_x; }
-                std::string get_id() { return svg_id; }
-                virtual std::string get_XML ( ) = 0;
+                const std::string& get_id() const { return svg_id; }
+                virtual void append_XML ( std::string& buffer ) = 0; //!< adds the shape's markup to the end of buffer
+                std::string get_XML ( ) { std::string xml; append_XML ( xml ); return xml; }
                 void set_tooltip ( std::string tooltip ) { this->tooltip = tooltip;  }
-                std::string get_tooltip ( ) { return this->tooltip; }
+                const std::string& get_tooltip ( ) const { return this->tooltip; }
                 void set_mmdbsel ( std::string mmdbsel ) { this->mmdbsel = mmdbsel;  }
-                std::string get_mmdbsel ( ) { return this->mmdbsel; }
+                const std::string& get_mmdbsel ( ) const { return this->mmdbsel; }
 
             protected:
                 int pos_x;
@@ -263,17 +336,21 @@ namespace privateer
 
                 void set_title ( std::string title ) { this->title = title; }
                 std::string get_title () { return this->title; }
-                bool plot_glycan ( clipper::MGlycan glycan, bool oxford_angles = true );
+                bool plot_glycan ( const clipper::MGlycan& glycan, bool oxford_angles = true );
                 bool plot_demo ( ); //!< creates a demo plot with all the blocks, links and roots Privateer can generate
                 bool write_to_file  ( std::string file_path ); //!< returns true if there have been any problems
                 std::string write_to_string ( );
                 std::string get_XML ();
-                void delete_shapes ( ) { for (int i=0; i<list_of_shapes.size();i++) delete list_of_shapes[i]; }
+                void delete_shapes ( ) { links.clear(); blocks.clear(); } //!< shapes are owned by the plot, this only frees them early
 
                 std::string get_svg_string_header      ( );
                 std::string get_svg_string_contents    ( );
                 std::string get_svg_string_footer      ( );
 
+                static std::string get_svg_style ( bool original_style ); //!< <style> block colouring the N/O/S letters of the roots
+                static const std::string& get_svg_definitions ( bool original_style, bool inverted_background, bool embedded ); //!< <defs> block, built once per colour scheme
+                std::string get_svg_symbol ( const std::string& id ); //!< the plot as a <symbol>, for documents holding many glycans next to get_svg_definitions()
+
             private:
                 int width;
                 int height;
@@ -285,19 +362,39 @@ namespace privateer
                 bool validation;
                 bool add_links;
 
-                void write_svg_header        ( std::fstream& of );
-                void write_svg_definitions   ( std::fstream& of );
-                void write_svg_contents      ( std::fstream& of );
-                void write_svg_footer        ( std::fstream& of );
+                static std::string build_file_definitions   ( bool original_colour_scheme, bool inverted_background );
+                static std::string build_string_definitions ( bool original_colour_scheme, bool inverted_background );
+
+                void write_svg_header        ( std::ostream& of );
+                void write_svg_definitions   ( std::ostream& of );
+                void write_svg_contents      ( std::ostream& of );
+                void write_svg_footer        ( std::ostream& of );
+
+                // plot_glycan works in two passes: recursive_paint lays the tree out over node indices,
+                // then paint_layout creates the shapes in the same order the old single pass used to
+
+                struct BlockPlacement { int node; int x; int y; };
+                struct LinkPlacement  { int node; int connection; int x; int y; Link_type orientation; bool is_ketose; };
+                struct GlycanLayout
+                {
+                    std::vector < BlockPlacement > blocks;
+                    std::vector < LinkPlacement > links;
+                };
 
-                void recursive_paint ( clipper::MGlycan mg, clipper::MGlycan::Node node, int x, int y, bool oxford_angles = true );
+                void recursive_paint ( const clipper::MGlycan& mg, int node_index, int x, int y, GlycanLayout& layout, bool oxford_angles = true );
+                void paint_layout ( const clipper::MGlycan& mg, const GlycanLayout& layout );
+                void add_sugar_block ( const clipper::MSugar& sugar, int x, int y, const std::string& mmdbsel );
 
                 // we want to draw linkages first, so that the blocks are then drawn on top of them
+                // links are kept apart from blocks and drawn newest first, then blocks in the order they were added
 
-                void add_block ( Shape * block ) { list_of_shapes.push_back ( block );}
-                void add_link  ( Shape * link  ) { list_of_shapes.insert ( list_of_shapes.begin(), link ); }
+                void add_block ( Shape * block ) { blocks.push_back ( std::unique_ptr<Shape> ( block ) ); }
+                void add_link  ( Shape * link  ) { links.push_back  ( std::unique_ptr<Shape> ( link  ) ); }
+                int number_of_shapes ( ) const { return links.size() + blocks.size(); }
+                Shape * shape_at ( int i ) const { return i < links.size() ? links[links.size()-1-i].get() : blocks[i-links.size()].get(); } //!< i-th shape in drawing order
                 std::vector<int> viewbox;
-                std::vector < Shape * > list_of_shapes;
+                std::vector < std::unique_ptr<Shape> > links;
+                std::vector < std::unique_ptr<Shape> > blocks;
 
         };
 
@@ -311,7 +408,6 @@ namespace privateer
                 int  get_width  ( ) { return width;  }
                 int  get_height ( ) { return height; }
                 void set_size ( int w, int h ) { width=w; height=h; }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int width;
@@ -329,7 +425,6 @@ namespace privateer
                 int  get_width  ( ) { return width;  }
                 int  get_height ( ) { return height; }
                 void set_size ( int w, int h ) { width=w; height=h; }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int width;
@@ -347,7 +442,6 @@ namespace privateer
                 int  get_width  ( ) { return width;  }
                 int  get_height ( ) { return height; }
                 void set_size ( int w, int h ) { width=w; height=h; }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int width;
@@ -365,7 +459,6 @@ namespace privateer
                 int  get_width  ( ) { return width;  }
                 int  get_height ( ) { return height; }
                 void set_size ( int w, int h ) { width=w; height=h; }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int width;
@@ -382,7 +475,6 @@ namespace privateer
                 virtual ~Triangle() {};
                 void set_side ( int s ) { side=s; }
                 int get_side  ( ) { return side;  }
-                virtual std::string get_XML ( )=0;
 
             protected:
                 int side;
@@ -399,7 +491,6 @@ namespace privateer
                 virtual ~Circle() {};
                 void set_radius ( int r ) { radius=r; }
                 int  get_radius  ( ) { return radius;  }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int radius;
@@ -416,7 +507,7 @@ namespace privateer
             public:
                 Glc() { } //!< null constructor
                 Glc( int x, int y, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel);}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -425,7 +516,7 @@ namespace privateer
             public:
                 Gal() { } //!< null constructor
                 Gal( int x, int y, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -434,7 +525,7 @@ namespace privateer
             public:
                 Man() { } //!< null constructor
                 Man( int x, int y, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel);}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -443,7 +534,7 @@ namespace privateer
             public:
                 Fuc() { } //!< null constructor
                 Fuc( int x, int y, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel);}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -452,7 +543,7 @@ namespace privateer
             public:
                 Xyl() { } //!< null constructor
                 Xyl( int x, int y, std::string message,  std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -464,7 +555,7 @@ namespace privateer
             public:
                 GlcN() { } //!< null constructor
                 GlcN( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -473,7 +564,7 @@ namespace privateer
             public:
                 GalN() { } //!< null constructor
                 GalN( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -482,7 +573,7 @@ namespace privateer
             public:
                 ManN() { } //!< null constructor
                 ManN( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -494,7 +585,7 @@ namespace privateer
             public:
                 GlcNAc() { } //!< null constructor
                 GlcNAc( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -503,7 +594,7 @@ namespace privateer
             public:
                 GalNAc() { } //!< null constructor
                 GalNAc( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -512,7 +603,7 @@ namespace privateer
             public:
                 ManNAc() { } //!< null constructor
                 ManNAc( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -524,7 +615,7 @@ namespace privateer
             public:
                 Neu5Ac() { } //!< null constructor
                 Neu5Ac( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -533,7 +624,7 @@ namespace privateer
             public:
                 Neu5Gc() { } //!< null constructor
                 Neu5Gc( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -542,7 +633,7 @@ namespace privateer
             public:
                 KDN() { } //!< null constructor
                 KDN( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -551,7 +642,7 @@ namespace privateer
             public:
                 GlcA() { } //!< null constructor
                 GlcA( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -560,7 +651,7 @@ namespace privateer
             public:
                 IdoA() { } //!< null constructor
                 IdoA( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -569,7 +660,7 @@ namespace privateer
             public:
                 GalA() { } //!< null constructor
                 GalA( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -578,7 +669,7 @@ namespace privateer
             public:
                 ManA() { } //!< null constructor
                 ManA( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -587,7 +678,7 @@ namespace privateer
             public:
                 Unk() { } //!< null constructor
                 Unk( int x, int y, const char letter, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); code += letter;  set_mmdbsel(mmdbsel);}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
             private:
                 std::string code;
 
@@ -600,7 +691,7 @@ namespace privateer
             public:
                 AlphaBond() { } //!< null constructor
                 AlphaBond( int x, int y, Link_type bond, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_bond_type (bond); this->set_mmdbsel ( mmdbsel );}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
             private:
                 Link_type bond_type;
@@ -613,7 +704,7 @@ namespace privateer
             public:
                 BetaBond() { } //!< null constructor
                 BetaBond( int x, int y, Link_type bond, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_bond_type (bond); this->set_mmdbsel ( mmdbsel ); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
             private:
                 Link_type bond_type;
@@ -639,7 +730,7 @@ namespace privateer
                     set_mmdbsel ( mmdbsel );
                 }
 
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
                 void set_link_atom ( std::string name ) { this->link_atom = name; }
                 std::string get_link_atom ( ) { return this->link_atom; }
@@ -664,7 +755,7 @@ namespace privateer
 
         std::string get_colour ( Colour colour, bool original_style, bool inverted = false  );
 
-        inline const std::string get_svg_tooltip ( clipper::MSugar sugar, bool validation )
+        inline const std::string get_svg_tooltip ( const clipper::MSugar& sugar, bool validation )
         {
             std::ostringstream str;
             str << std::setprecision(2) << std::fixed
@@ -704,12 +795,13 @@ namespace privateer
                 void set_pos( int x, int y ) { pos_x = x; pos_y =y ; }
                 int  get_y  ( ) { return pos_y; }
                 int  get_x  ( ) { return pos_x; }
-                std::string get_id() { return svg_id; }
-                virtual std::string get_XML ( ) = 0;
+                const std::string& get_id() const { return svg_id; }
+                virtual void append_XML ( std::string& buffer ) = 0; //!< adds the shape's markup to the end of buffer
+                std::string get_XML ( ) { std::string xml; append_XML ( xml ); return xml; }
                 void set_tooltip ( std::string tooltip ) { this->tooltip = tooltip;  }
-                std::string get_tooltip ( ) { return this->tooltip; }
+                const std::string& get_tooltip ( ) const { return this->tooltip; }
                 void set_mmdbsel ( std::string mmdbsel ) { this->mmdbsel = mmdbsel;  }
-                std::string get_mmdbsel ( ) { return this->mmdbsel; }
+                const std::string& get_mmdbsel ( ) const { return this->mmdbsel; }
 
             protected:
                 int pos_x;
@@ -834,17 +926,21 @@ namespace privateer
 
                 void set_title ( std::string title ) { this->title = title; }
                 std::string get_title () { return this->title; }
-                bool plot_glycan ( clipper::MGlycan glycan );
+                bool plot_glycan ( const clipper::MGlycan& glycan );
                 bool plot_demo ( ); //!< creates a demo plot with all the blocks, links and roots Privateer can generate
                 bool write_to_file  ( std::string file_path ); //!< returns true if there have been any problems
                 std::string write_to_string ( );
                 std::string get_XML ();
-                void delete_shapes ( ) { for (int i=0; i<list_of_shapes.size();i++) delete list_of_shapes[i]; }
+                void delete_shapes ( ) { links.clear(); blocks.clear(); } //!< shapes are owned by the plot, this only frees them early
 
                 std::string get_svg_string_header      ( );
                 std::string get_svg_string_contents    ( );
                 std::string get_svg_string_footer      ( );
 
+                static std::string get_svg_style ( bool original_style ); //!< <style> block colouring the N/O/S letters of the roots
+                static const std::string& get_svg_definitions ( bool original_style, bool inverted_background, bool embedded ); //!< <defs> block, built once per colour scheme
+                std::string get_svg_symbol ( const std::string& id ); //!< the plot as a <symbol>, for documents holding many glycans next to get_svg_definitions()
+
             private:
                 int width;
                 int height;
@@ -856,19 +952,39 @@ namespace privateer
                 bool validation;
                 bool add_links;
 
-                void write_svg_header        ( std::fstream& of );
-                void write_svg_definitions   ( std::fstream& of );
-                void write_svg_contents      ( std::fstream& of );
-                void write_svg_footer        ( std::fstream& of );
+                static std::string build_file_definitions   ( bool original_colour_scheme, bool inverted_background );
+                static std::string build_string_definitions ( bool original_colour_scheme, bool inverted_background );
+
+                void write_svg_header        ( std::ostream& of );
+                void write_svg_definitions   ( std::ostream& of );
+                void write_svg_contents      ( std::ostream& of );
+                void write_svg_footer        ( std::ostream& of );
+
+                // plot_glycan works in two passes: recursive_paint lays the tree out over node indices,
+                // then paint_layout creates the shapes in the same order the old single pass used to
 
-                void recursive_paint ( clipper::MGlycan mg, clipper::MGlycan::Node node, int x, int y, bool oxford_angles = false );
+                struct BlockPlacement { int node; int x; int y; };
+                struct LinkPlacement  { int node; int connection; int x; int y; Link_type orientation; bool is_ketose; };
+                struct GlycanLayout
+                {
+                    std::vector < BlockPlacement > blocks;
+                    std::vector < LinkPlacement > links;
+                };
+
+                void recursive_paint ( const clipper::MGlycan& mg, int node_index, int x, int y, GlycanLayout& layout, bool oxford_angles = false );
+                void paint_layout ( const clipper::MGlycan& mg, const GlycanLayout& layout );
+                void add_sugar_block ( const clipper::MSugar& sugar, int x, int y, const std::string& mmdbsel );
 
                 // we want to draw linkages first, so that the blocks are then drawn on top of them
+                // links are kept apart from blocks and drawn newest first, then blocks in the order they were added
 
-                void add_block ( Shape * block ) { list_of_shapes.push_back ( block );}
-                void add_link  ( Shape * link  ) { list_of_shapes.insert ( list_of_shapes.begin(), link ); }
+                void add_block ( Shape * block ) { blocks.push_back ( std::unique_ptr<Shape> ( block ) ); }
+                void add_link  ( Shape * link  ) { links.push_back  ( std::unique_ptr<Shape> ( link  ) ); }
+                int number_of_shapes ( ) const { return links.size() + blocks.size(); }
+                Shape * shape_at ( int i ) const { return i < links.size() ? links[links.size()-1-i].get() : blocks[i-links.size()].get(); } //!< i-th shape in drawing order
                 std::vector<int> viewbox;
-                std::vector < Shape * > list_of_shapes;
+                std::vector < std::unique_ptr<Shape> > links;
+                std::vector < std::unique_ptr<Shape> > blocks;
 
         };
 
@@ -882,7 +998,6 @@ namespace privateer
                 int  get_width  ( ) { return width;  }
                 int  get_height ( ) { return height; }
                 void set_size ( int w, int h ) { width=w; height=h; }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int width;
@@ -900,7 +1015,6 @@ namespace privateer
                 int  get_width  ( ) { return width;  }
                 int  get_height ( ) { return height; }
                 void set_size ( int w, int h ) { width=w; height=h; }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int width;
@@ -918,7 +1032,6 @@ namespace privateer
                 int  get_width  ( ) { return width;  }
                 int  get_height ( ) { return height; }
                 void set_size ( int w, int h ) { width=w; height=h; }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int width;
@@ -936,7 +1049,6 @@ namespace privateer
                 int  get_width  ( ) { return width;  }
                 int  get_height ( ) { return height; }
                 void set_size ( int w, int h ) { width=w; height=h; }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int width;
@@ -953,7 +1065,6 @@ namespace privateer
                 virtual ~Triangle() {};
                 void set_side ( int s ) { side=s; }
                 int get_side  ( ) { return side;  }
-                virtual std::string get_XML ( )=0;
 
             protected:
                 int side;
@@ -970,7 +1081,6 @@ namespace privateer
                 virtual ~Circle() {};
                 void set_radius ( int r ) { radius=r; }
                 int  get_radius  ( ) { return radius;  }
-                virtual std::string get_XML ( ) = 0;
 
             protected:
                 int radius;
@@ -987,7 +1097,7 @@ namespace privateer
             public:
                 Glc() { } //!< null constructor
                 Glc( int x, int y, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel);}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -996,7 +1106,7 @@ namespace privateer
             public:
                 Gal() { } //!< null constructor
                 Gal( int x, int y, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1005,7 +1115,7 @@ namespace privateer
             public:
                 Man() { } //!< null constructor
                 Man( int x, int y, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel);}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1014,7 +1124,7 @@ namespace privateer
             public:
                 Fuc() { } //!< null constructor
                 Fuc( int x, int y, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel);}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1023,7 +1133,7 @@ namespace privateer
             public:
                 Xyl() { } //!< null constructor
                 Xyl( int x, int y, std::string message,  std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1035,7 +1145,7 @@ namespace privateer
             public:
                 GlcN() { } //!< null constructor
                 GlcN( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1044,7 +1154,7 @@ namespace privateer
             public:
                 GalN() { } //!< null constructor
                 GalN( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1053,7 +1163,7 @@ namespace privateer
             public:
                 ManN() { } //!< null constructor
                 ManN( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1065,7 +1175,7 @@ namespace privateer
             public:
                 GlcNAc() { } //!< null constructor
                 GlcNAc( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1074,7 +1184,7 @@ namespace privateer
             public:
                 GalNAc() { } //!< null constructor
                 GalNAc( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1083,7 +1193,7 @@ namespace privateer
             public:
                 ManNAc() { } //!< null constructor
                 ManNAc( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1095,7 +1205,7 @@ namespace privateer
             public:
                 Neu5Ac() { } //!< null constructor
                 Neu5Ac( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1104,7 +1214,7 @@ namespace privateer
             public:
                 Neu5Gc() { } //!< null constructor
                 Neu5Gc( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1113,7 +1223,7 @@ namespace privateer
             public:
                 KDN() { } //!< null constructor
                 KDN( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1122,7 +1232,7 @@ namespace privateer
             public:
                 GlcA() { } //!< null constructor
                 GlcA( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1131,7 +1241,7 @@ namespace privateer
             public:
                 IdoA() { } //!< null constructor
                 IdoA( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1140,7 +1250,7 @@ namespace privateer
             public:
                 GalA() { } //!< null constructor
                 GalA( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1149,7 +1259,7 @@ namespace privateer
             public:
                 ManA() { } //!< null constructor
                 ManA( int x, int y, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); set_mmdbsel(mmdbsel); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
         };
 
@@ -1158,7 +1268,7 @@ namespace privateer
             public:
                 Unk() { } //!< null constructor
                 Unk( int x, int y, const char letter, std::string message, std::string mmdbsel = "") { set_pos(x, y); set_tooltip ( message ); code += letter;  set_mmdbsel(mmdbsel);}
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
             private:
                 std::string code;
 
@@ -1186,7 +1296,7 @@ namespace privateer
                 Bond( int x, int y, Link_type bond, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_bond_type (bond); this->set_mmdbsel ( mmdbsel ); }
                 Bond( int x, int y, std::string anomerSymbol, Link_type bond, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_bond_type (bond); this->anomerSymbol = anomerSymbol; this->set_mmdbsel ( mmdbsel ); }
                 Bond( int x, int y, Link_type bond, std::string anomerSymbol, std::string linkagePosition, std::string message, std::string mmdbsel = "" ) { set_pos(x, y); set_tooltip ( message ); set_bond_type (bond); this->anomerSymbol = anomerSymbol; this->linkagePosition = linkagePosition; this->set_mmdbsel ( mmdbsel ); }
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
             private:
                 std::string anomerSymbol;
@@ -1214,7 +1324,7 @@ namespace privateer
                     set_mmdbsel ( mmdbsel );
                 }
 
-                std::string get_XML ( );
+                void append_XML ( std::string& buffer );
 
                 void set_link_atom ( std::string name ) { this->link_atom = name; }
                 std::string get_link_atom ( ) { return this->link_atom; }
@@ -1239,6 +1349,213 @@ namespace privateer
         std::string get_annotated_glycans ( std::string pdb_filename, bool original_colour_scheme = false, std::string expression_system = "undefined" );
         std::string get_annotated_glycans_hierarchical ( std::string pdb_filename, bool original_colour_scheme = false, std::string expression_system = "undefined"  );
         std::string print_wurcs ( std::string pdb_filename, std::string expression_system = "undefined");
+
+        //! A residue stacked against a sugar ring, and the angle between their planes
+        struct StackingContact
+        {
+            std::string residue;
+            float angle;
+        };
+
+        /*! Everything the annotated XML says about one sugar, as plain fields.
+            The linkage fields describe the bond to the parent node; for the root sugar they hold
+            the glycosylation torsions, parent_node is -1 and link_order is 0 */
+        struct SugarRecord
+        {
+            std::string id;             // "/B/1401(NAG)"
+            std::string name;
+            std::string chain;
+            std::string residue;
+            std::string detected_type;
+            std::string conformation;
+            std::string anomer;
+            std::string handedness;
+            std::string context;
+            float q, phi, theta, bfactor, rscc;
+            bool ok_conformation, ok_anomer, ok_handedness, ok_puckering;
+            int node, parent_node, link_order;
+            std::vector<float> link_torsions;   // phi, psi and omega for 1-6 linkages
+            std::vector<StackingContact> stacked_against;
+        };
+
+        //! One glycan, with its sugars in node order so parent_node indexes into sugars
+        struct GlycanRecord
+        {
+            int index;
+            std::string type;
+            std::string root;
+            std::string chain;
+            std::vector<SugarRecord> sugars;
+        };
+
+        //! Per-sugar numbers over all glycans, one entry per sugar in get_glycans() order
+        struct SugarColumns
+        {
+            std::vector<float> q, phi, theta, bfactor, rscc;
+            std::vector<int> glycan, node;
+        };
+
+        /*! Orthogonal coordinates of every sugar atom, gathered once into one buffer.
+            Rows follow get_sugar_columns(): the atoms of sugar row r are xyz[3*atom_offsets[r]] onwards,
+            up to atom_offsets[r+1]; the rows of glycan g start at glycan_offsets[g] */
+        struct SugarCoordinates
+        {
+            std::vector<float> xyz;             // x, y, z per atom, in Angstroms
+            std::vector<std::string> atom_names;
+            std::vector<int> atom_offsets;      // one per sugar, plus the total atom count
+            std::vector<int> glycan_offsets;    // one per glycan, plus the total sugar count
+        };
+
+        /*! A structure read once and kept for repeated queries from Python.
+            The nonbond index and glycology are built on construction; glycans and sugars keep pointers
+            into the model and the nonbond index, so a Model can be neither copied nor moved */
+        class Model
+        {
+            public:
+                Model ( std::string pdb_filename, std::string expression_system = "undefined" );
+
+                std::string get_annotated_glycans ( bool original_colour_scheme = false ) const;
+                std::string get_annotated_glycans_hierarchical ( bool original_colour_scheme = false ) const;
+                std::string print_wurcs ( ) const;
+
+                std::vector<GlycanRecord> get_glycans ( ) const;
+                SugarColumns get_sugar_columns ( ) const;
+                std::string get_glycan_svg ( int glycan, bool original_colour_scheme = true ) const;
+                std::string get_glycan_wurcs ( int glycan ) const;
+
+                //! Lives as long as the Model, which never moves, so views into it stay valid until then
+                const SugarCoordinates& get_sugar_coordinates ( ) const { return this->sugar_coordinates; }
+                int sugar_row ( int glycan, int node ) const;   //!< row of a sugar in get_sugar_columns(); throws std::out_of_range
+
+                const clipper::MiniMol& get_minimol ( ) const { return this->mmol; }
+                const std::vector < clipper::MGlycan >& get_list_of_glycans ( ) const { return this->list_of_glycans; }
+
+                const std::string& get_filename ( ) const { return this->filename; }
+                const std::string& get_expression_system ( ) const { return this->expression_system; }
+                int number_of_glycans ( ) const { return this->list_of_glycans.size(); }
+
+            private:
+                Model ( const Model& ) = delete;
+                Model& operator= ( const Model& ) = delete;
+
+                static clipper::MiniMol read_minimol ( const std::string& pdb_filename );
+
+                std::string filename;
+                std::string expression_system;
+                clipper::MiniMol mmol;
+                clipper::MAtomNonBond manb;
+                clipper::MGlycology mgl;
+                std::vector < clipper::MGlycan > list_of_glycans;
+                SugarCoordinates sugar_coordinates;
+        };
+
+        //! Settings for validate_xray and validate_cryoem, defaulting to those of the command line program
+        struct MapValidationOptions
+        {
+            std::string fobs_column = "NONE";   // MTZ amplitudes as "FP,SIGFP"; chosen from the usual labels if NONE
+            float mask_radius = 2.5;            // around sugar atoms, for RSCC
+            int n_refln = 1000;                 // sigmaa weighting
+            int n_param = 20;
+            bool find_blobs = false;            // catalogue difference density blobs; see MapValidation::blobs
+            float blob_sigma = 3.0;
+            bool keep_maps = false;             // return the computed maps in MapValidation::maps
+        };
+
+        /*! A map sampled over the whole unit cell. The value at grid point (u,v,w), fractional
+            coordinates (u/nu, v/nv, w/nw), is data[(u*nv + v)*nw + w] */
+        struct MapGrid
+        {
+            std::string spacegroup;
+            std::vector<float> cell;            // a, b, c in Angstroms; alpha, beta, gamma in degrees
+            std::vector<int> shape;             // nu, nv, nw
+            std::vector<float> data;
+        };
+
+        //! Agreement of one sugar monomer with the map
+        struct SugarFit
+        {
+            std::string id;             // "/B/1401(NAG)"
+            std::string name;
+            std::string chain;
+            std::string residue;
+            int glycan, node;           // position in Model::get_glycans(), -1 for sugars outside glycans
+            float rscc;
+            float mean_density;         // <mFo> or <Fo> in sigma units
+        };
+
+        //! A connected region of difference density above the cutoff, and the residue closest to it
+        struct DifferenceBlob
+        {
+            float volume, integrated_density, peak_density;
+            std::vector<float> centroid;
+            std::string nearest_residue;        // empty if nothing is within 6A
+            float nearest_residue_distance;
+        };
+
+        /*! Map-based validation of every sugar in a model. For X-ray data, RSCC is computed against the
+            sigmaa-weighted omit map unless the sugars account for most of the data, in which case the
+            2mFo-DFc map is used instead and against_best_map is set */
+        struct MapValidation
+        {
+            float resolution;
+            float r_all, r_omit;                // NaN for cryo-EM
+            bool against_best_map;
+            std::vector<SugarFit> sugars;
+            /*! Only filled with MapValidationOptions::find_blobs: every connected region of the mFo-DFc map
+                (map minus model for cryo-EM) above blob_sigma. The probe scan that -check-unmodelled runs on
+                glycosylation sites against a waterless difference map is not done here */
+            std::vector<DifferenceBlob> blobs;
+
+            /*! Only filled with MapValidationOptions::keep_maps. X-ray: "best" (2mFo-DFc), "omit"
+                (mFo-DFc with sugars omitted), "difference" (mFo-DFc) and "ligand" (Fc of the sugars alone).
+                Cryo-EM: "ligand", and "difference" (map minus model, at the map resolution) */
+            std::map<std::string, MapGrid> maps;
+        };
+
+        MapValidation validate_xray ( const Model& model, std::string mtz_filename, const MapValidationOptions& options = MapValidationOptions() );
+        MapValidation validate_cryoem ( const Model& model, std::string map_filename, float resolution, const MapValidationOptions& options = MapValidationOptions() );
+
+        //! One file processed by a BatchAnalysis: either model is set, or error says why it is not
+        struct BatchResult
+        {
+            int index;
+            std::string filename;
+            std::unique_ptr<Model> model;
+            std::string error;
+        };
+
+        /*! Builds a Model for every file on a pool of worker threads, handing results over in the
+            order they complete. Model parsing goes through MMDB, which keeps global state, so reads are
+            serialised; detection of glycans runs concurrently. Closing or destroying a BatchAnalysis before
+            all results have been collected stops the workers once their current file is done */
+        class BatchAnalysis
+        {
+            public:
+                BatchAnalysis ( const std::vector<std::string>& paths, int n_threads = 0, std::string expression_system = "undefined" );
+                ~BatchAnalysis ( );
+
+                bool next ( BatchResult& result ); //!< blocks until a result is ready; false once all have been handed over
+                void close ( ); //!< stops the workers and waits for them; results already finished can still be collected
+                int size ( ) const { return this->paths.size(); }
+
+            private:
+                BatchAnalysis ( const BatchAnalysis& ) = delete;
+                BatchAnalysis& operator= ( const BatchAnalysis& ) = delete;
+
+                void work ( );
+
+                std::vector<std::string> paths;
+                std::string expression_system;
+                std::vector<std::thread> workers;
+                std::atomic<int> next_path;
+                std::atomic<bool> cancelled;
+                int delivered;
+                bool closed;
+                std::deque<BatchResult> finished;
+                std::mutex finished_mutex;
+                std::condition_variable result_ready;
+        };
+
         std::string print_node ( const clipper::MiniMol& mmol, const clipper::MGlycan& mg, const clipper::MGlycan::Node& node, const std::string chain, const clipper::MGlycan::Linkage& connection );
         void svg_graphics_demo ( bool original_colour_scheme, bool inverted_background = false );
         inline void write_refmac_keywords ( std::vector < std::string > code_list ) { return privateer::util::write_refmac_keywords(code_list); }
@@ -1248,6 +1565,28 @@ namespace privateer
     namespace util
     {
          std::vector<char> number_of_conformers ( clipper::MMonomer& mmon );
+
+         // One SVG to be produced: the glycan to draw, the title of the plot and the file it goes to
+         struct GlycanPlotJob
+         {
+             const clipper::MGlycan* glycan;
+             std::string title;
+             std::string file_name;
+         };
+
+         /*! Renders all plots to strings in parallel, then writes the files using io_threads writers
+          * 	\param old_style Use glycoplot instead of glycanbuilderplot
+          * 	\return true if any of the files could not be written
+          */
+
+         bool render_glycan_plots ( const std::vector<GlycanPlotJob>& jobs, bool old_style, bool vertical, bool original, bool invert, int io_threads = 4 );
+
+         /*! Writes all plots to a single SVG: shared definitions, one <symbol> per glycan and a column of <use> instances.
+          * 	The file name each plot would have had is kept in the data-file attribute of its instance.
+          * 	\return true if there have been any problems
+          */
+
+         bool write_glycan_plot_sheet ( const std::vector<GlycanPlotJob>& jobs, std::string file_path, bool old_style, bool vertical, bool original, bool invert );
     }
 
 } // namespace privateer
@@ -11,11 +11,146 @@
 
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
 #include "privateer-lib.h"
 
 using namespace pybind11::literals;
 namespace pr = privateer::restraints;
 
+namespace ps = privateer::scripting;
+
+// Arrays handed to Python view C++ buffers directly rather than copying them. Each array keeps a
+// reference to owner, the object whose buffer it views, so the buffer lives at least as long as the
+// array does. Views are read-only: the buffers belong to the C++ objects; copy() them to modify
+//
+template < typename T >
+static pybind11::array_t<T> view_of ( const T* data, const std::vector<pybind11::ssize_t>& shape, pybind11::handle owner )
+{
+  pybind11::array_t<T> array ( shape, data, owner );
+  array.attr("setflags")("write"_a = false);
+  return array;
+}
+
+// Bulk per-sugar numbers come back as NumPy arrays keyed by column name. The columns are built once
+// and owned by a capsule that all seven arrays share; it is freed with the last of them
+//
+template < typename T >
+static pybind11::array_t<T> column_of ( const std::vector<T>& values, pybind11::handle owner )
+{
+  return view_of ( values.data(), { (pybind11::ssize_t) values.size() }, owner );
+}
+
+static pybind11::dict get_sugar_columns ( const ps::Model& model )
+{
+  std::unique_ptr<ps::SugarColumns> columns;
+  {
+    pybind11::gil_scoped_release release;
+    columns.reset ( new ps::SugarColumns ( model.get_sugar_columns() ) );
+  }
+
+  pybind11::capsule owner ( columns.get(), [] ( void* p ) { delete static_cast<ps::SugarColumns*> ( p ); } );
+  const ps::SugarColumns& c = *columns.release();
+
+  pybind11::dict arrays;
+
+  arrays["q"]       = column_of ( c.q, owner );
+  arrays["phi"]     = column_of ( c.phi, owner );
+  arrays["theta"]   = column_of ( c.theta, owner );
+  arrays["bfactor"] = column_of ( c.bfactor, owner );
+  arrays["rscc"]    = column_of ( c.rscc, owner );
+  arrays["glycan"]  = column_of ( c.glycan, owner );
+  arrays["node"]    = column_of ( c.node, owner );
+
+  return arrays;
+}
+
+// Coordinates are views into the Model, which never moves, so they stay valid while the Model object does
+//
+static pybind11::array_t<float> sugar_coordinates ( pybind11::object self )
+{
+  const ps::SugarCoordinates& coordinates = self.cast<const ps::Model&>().get_sugar_coordinates();
+  return view_of ( coordinates.xyz.data(), { (pybind11::ssize_t) coordinates.xyz.size() / 3, 3 }, self );
+}
+
+static pybind11::array_t<int> sugar_atom_offsets ( pybind11::object self )
+{
+  const ps::SugarCoordinates& coordinates = self.cast<const ps::Model&>().get_sugar_coordinates();
+  return view_of ( coordinates.atom_offsets.data(), { (pybind11::ssize_t) coordinates.atom_offsets.size() }, self );
+}
+
+static pybind11::array_t<float> get_sugar_coordinates ( pybind11::object self, int glycan, int node )
+{
+  const ps::Model& model = self.cast<const ps::Model&>();
+  const ps::SugarCoordinates& coordinates = model.get_sugar_coordinates();
+
+  const int row = model.sugar_row ( glycan, node );
+  const int first = coordinates.atom_offsets[row];
+  const int last = coordinates.atom_offsets[row+1];
+
+  return view_of ( coordinates.xyz.data() + 3 * first, { last - first, 3 }, self );
+}
+
+// Maps are only reachable through their MapValidation, which each MapGrid object keeps alive
+//
+static pybind11::array_t<float> map_values ( pybind11::object self )
+{
+  const ps::MapGrid& grid = self.cast<const ps::MapGrid&>();
+  return view_of ( grid.data.data(), { grid.shape[0], grid.shape[1], grid.shape[2] }, self );
+}
+
+static pybind11::dict map_validation_maps ( pybind11::object self )
+{
+  const ps::MapValidation& validation = self.cast<const ps::MapValidation&>();
+  pybind11::dict maps;
+
+  for ( std::map<std::string, ps::MapGrid>::const_iterator map = validation.maps.begin(); map != validation.maps.end(); ++map )
+    maps[map->first.c_str()] = pybind11::cast ( &map->second, pybind11::return_value_policy::reference_internal, self );
+
+  return maps;
+}
+
+// Destroying a BatchAnalysis joins its workers, which can take as long as reading a file, so other Python threads get the GIL meanwhile
+//
+struct BatchAnalysisDeleter
+{
+  void operator() ( ps::BatchAnalysis* batch ) const
+  {
+    if ( PyGILState_Check() )
+    {
+      pybind11::gil_scoped_release release;
+      delete batch;
+    }
+    else
+      delete batch;
+  }
+};
+
+typedef std::unique_ptr<ps::BatchAnalysis, BatchAnalysisDeleter> BatchAnalysisHolder;
+
+// Yields (index, filename, model, error) as each file completes; model is None when error is set
+//
+static BatchAnalysisHolder analyse_many ( const std::vector<std::string>& paths, int n_threads, std::string expression_system )
+{
+  return BatchAnalysisHolder ( new ps::BatchAnalysis ( paths, n_threads, expression_system ) );
+}
+
+static pybind11::tuple next_batch_result ( ps::BatchAnalysis& batch )
+{
+  ps::BatchResult result;
+  bool more;
+  {
+    pybind11::gil_scoped_release release;
+    more = batch.next ( result );
+  }
+
+  if ( !more )
+    throw pybind11::stop_iteration();
+
+  pybind11::object model = result.model ? pybind11::cast ( std::move ( result.model ) ) : pybind11::none();
+
+  return pybind11::make_tuple ( result.index, result.filename, model, result.error );
+}
+
 // pybind11 module definition
 //
 PYBIND11_MODULE(privateer_core, m)
@@ -32,12 +167,14 @@ PYBIND11_MODULE(privateer_core, m)
 
   m.def("svg_graphics_demo",
         &privateer::scripting::svg_graphics_demo,
+        pybind11::call_guard<pybind11::gil_scoped_release>(),
         "Creates an SVG file with a SNFG demo",
         "original_colour_scheme"_a = false,
         "inverted_background"_a = false );
 
   m.def("get_annotated_glycans",
         &privateer::scripting::get_annotated_glycans,
+        pybind11::call_guard<pybind11::gil_scoped_release>(),
         "Produces XML with validation info for protein glycosylation",
         "pdb_filename"_a,
         "original_colour_scheme"_a = true,
@@ -45,11 +182,186 @@ PYBIND11_MODULE(privateer_core, m)
 
   m.def("get_annotated_glycans_hierarchical",
         &privateer::scripting::get_annotated_glycans_hierarchical,
+        pybind11::call_guard<pybind11::gil_scoped_release>(),
         "Produces XML with hierarchical validation info for protein glycosylation",
         "pdb_filename"_a,
         "original_colour_scheme"_a = true,
         "expression_system"_a = "undefined" );
 
+  pybind11::class_<ps::StackingContact>(m, "StackingContact")
+            .def_readonly("residue", &ps::StackingContact::residue)
+            .def_readonly("angle",   &ps::StackingContact::angle);
+
+  pybind11::class_<ps::SugarRecord>(m, "SugarRecord")
+            .def_readonly("id",              &ps::SugarRecord::id)
+            .def_readonly("name",            &ps::SugarRecord::name)
+            .def_readonly("chain",           &ps::SugarRecord::chain)
+            .def_readonly("residue",         &ps::SugarRecord::residue)
+            .def_readonly("detected_type",   &ps::SugarRecord::detected_type)
+            .def_readonly("conformation",    &ps::SugarRecord::conformation)
+            .def_readonly("anomer",          &ps::SugarRecord::anomer)
+            .def_readonly("handedness",      &ps::SugarRecord::handedness)
+            .def_readonly("context",         &ps::SugarRecord::context)
+            .def_readonly("q",               &ps::SugarRecord::q)
+            .def_readonly("phi",             &ps::SugarRecord::phi)
+            .def_readonly("theta",           &ps::SugarRecord::theta)
+            .def_readonly("bfactor",         &ps::SugarRecord::bfactor)
+            .def_readonly("rscc",            &ps::SugarRecord::rscc)
+            .def_readonly("ok_conformation", &ps::SugarRecord::ok_conformation)
+            .def_readonly("ok_anomer",       &ps::SugarRecord::ok_anomer)
+            .def_readonly("ok_handedness",   &ps::SugarRecord::ok_handedness)
+            .def_readonly("ok_puckering",    &ps::SugarRecord::ok_puckering)
+            .def_readonly("node",            &ps::SugarRecord::node)
+            .def_readonly("parent_node",     &ps::SugarRecord::parent_node)
+            .def_readonly("link_order",      &ps::SugarRecord::link_order)
+            .def_readonly("link_torsions",   &ps::SugarRecord::link_torsions)
+            .def_readonly("stacked_against", &ps::SugarRecord::stacked_against);
+
+  pybind11::class_<ps::GlycanRecord>(m, "GlycanRecord")
+            .def_readonly("index",  &ps::GlycanRecord::index)
+            .def_readonly("type",   &ps::GlycanRecord::type)
+            .def_readonly("root",   &ps::GlycanRecord::root)
+            .def_readonly("chain",  &ps::GlycanRecord::chain)
+            .def_readonly("sugars", &ps::GlycanRecord::sugars);
+
+  pybind11::class_<privateer::scripting::Model>(m, "Model", "A glycoprotein model read once, with its glycans detected, for repeated queries")
+            .def(pybind11::init<std::string, std::string>(),
+                 pybind11::call_guard<pybind11::gil_scoped_release>(),
+                 "pdb_filename"_a,
+                 "expression_system"_a = "undefined")
+            .def("get_annotated_glycans",
+                 &privateer::scripting::Model::get_annotated_glycans,
+                 pybind11::call_guard<pybind11::gil_scoped_release>(),
+                 "Produces XML with validation info for protein glycosylation",
+                 "original_colour_scheme"_a = true)
+            .def("get_annotated_glycans_hierarchical",
+                 &privateer::scripting::Model::get_annotated_glycans_hierarchical,
+                 pybind11::call_guard<pybind11::gil_scoped_release>(),
+                 "Produces XML with hierarchical validation info for protein glycosylation",
+                 "original_colour_scheme"_a = true)
+            .def("print_wurcs",
+                 &privateer::scripting::Model::print_wurcs,
+                 pybind11::call_guard<pybind11::gil_scoped_release>(),
+                 "Returns a WURCS string of all glycans in the glycoprotein model")
+            .def("get_glycans",
+                 &privateer::scripting::Model::get_glycans,
+                 pybind11::call_guard<pybind11::gil_scoped_release>(),
+                 "Returns a list of glycans with their sugars, validation, linkages and torsions")
+            .def("get_sugar_columns",
+                 &get_sugar_columns,
+                 "Returns a dict of read-only NumPy arrays (q, phi, theta, bfactor, rscc, glycan, node), one entry per sugar in get_glycans() order. "
+                 "The arrays share one buffer, freed when the last of them is")
+            .def("get_sugar_coordinates",
+                 &get_sugar_coordinates,
+                 "Returns an (n_atoms, 3) read-only NumPy view of the orthogonal coordinates of one sugar. "
+                 "The view keeps the Model alive",
+                 "glycan"_a,
+                 "node"_a)
+            .def_property_readonly("sugar_coordinates",
+                 &sugar_coordinates,
+                 "(n_atoms, 3) read-only NumPy view of the coordinates of every sugar atom, sugars in get_sugar_columns() order. "
+                 "The view keeps the Model alive")
+            .def_property_readonly("sugar_atom_offsets",
+                 &sugar_atom_offsets,
+                 "Read-only NumPy view; the atoms of sugar row r are sugar_coordinates[sugar_atom_offsets[r]:sugar_atom_offsets[r+1]]")
+            .def_property_readonly("sugar_atom_names",
+                 [] ( const ps::Model& model ) { return model.get_sugar_coordinates().atom_names; },
+                 "Atom names matching the rows of sugar_coordinates")
+            .def("get_glycan_svg",
+                 &privateer::scripting::Model::get_glycan_svg,
+                 pybind11::call_guard<pybind11::gil_scoped_release>(),
+                 "Renders the SNFG diagram of one glycan as SVG",
+                 "glycan"_a,
+                 "original_colour_scheme"_a = true)
+            .def("get_glycan_wurcs",
+                 &privateer::scripting::Model::get_glycan_wurcs,
+                 pybind11::call_guard<pybind11::gil_scoped_release>(),
+                 "Returns the WURCS string of one glycan",
+                 "glycan"_a)
+            .def("number_of_glycans", &privateer::scripting::Model::number_of_glycans)
+            .def_property_readonly("filename",          &privateer::scripting::Model::get_filename)
+            .def_property_readonly("expression_system", &privateer::scripting::Model::get_expression_system);
+
+  pybind11::class_<ps::MapValidationOptions>(m, "MapValidationOptions")
+            .def(pybind11::init<>())
+            .def_readwrite("fobs_column",  &ps::MapValidationOptions::fobs_column)
+            .def_readwrite("mask_radius",  &ps::MapValidationOptions::mask_radius)
+            .def_readwrite("n_refln",      &ps::MapValidationOptions::n_refln)
+            .def_readwrite("n_param",      &ps::MapValidationOptions::n_param)
+            .def_readwrite("find_blobs",   &ps::MapValidationOptions::find_blobs)
+            .def_readwrite("blob_sigma",   &ps::MapValidationOptions::blob_sigma)
+            .def_readwrite("keep_maps",    &ps::MapValidationOptions::keep_maps);
+
+  pybind11::class_<ps::MapGrid>(m, "MapGrid")
+            .def_readonly("spacegroup", &ps::MapGrid::spacegroup)
+            .def_readonly("cell",       &ps::MapGrid::cell)
+            .def_readonly("shape",      &ps::MapGrid::shape)
+            .def_property_readonly("values",
+                 &map_values,
+                 "(nu, nv, nw) read-only NumPy view of the map over the whole unit cell; values[u, v, w] sits at "
+                 "fractional coordinates (u/nu, v/nv, w/nw). The view keeps the map, and the MapValidation holding it, alive");
+
+  pybind11::class_<ps::SugarFit>(m, "SugarFit")
+            .def_readonly("id",           &ps::SugarFit::id)
+            .def_readonly("name",         &ps::SugarFit::name)
+            .def_readonly("chain",        &ps::SugarFit::chain)
+            .def_readonly("residue",      &ps::SugarFit::residue)
+            .def_readonly("glycan",       &ps::SugarFit::glycan)
+            .def_readonly("node",         &ps::SugarFit::node)
+            .def_readonly("rscc",         &ps::SugarFit::rscc)
+            .def_readonly("mean_density", &ps::SugarFit::mean_density);
+
+  pybind11::class_<ps::DifferenceBlob>(m, "DifferenceBlob")
+            .def_readonly("volume",                   &ps::DifferenceBlob::volume)
+            .def_readonly("integrated_density",       &ps::DifferenceBlob::integrated_density)
+            .def_readonly("peak_density",             &ps::DifferenceBlob::peak_density)
+            .def_readonly("centroid",                 &ps::DifferenceBlob::centroid)
+            .def_readonly("nearest_residue",          &ps::DifferenceBlob::nearest_residue)
+            .def_readonly("nearest_residue_distance", &ps::DifferenceBlob::nearest_residue_distance);
+
+  pybind11::class_<ps::MapValidation>(m, "MapValidation")
+            .def_readonly("resolution",       &ps::MapValidation::resolution)
+            .def_readonly("r_all",            &ps::MapValidation::r_all)
+            .def_readonly("r_omit",           &ps::MapValidation::r_omit)
+            .def_readonly("against_best_map", &ps::MapValidation::against_best_map)
+            .def_readonly("sugars",           &ps::MapValidation::sugars)
+            .def_readonly("blobs",            &ps::MapValidation::blobs)
+            .def_property_readonly("maps",
+                 &map_validation_maps,
+                 "Dict of MapGrid by name, filled when MapValidationOptions.keep_maps is set. The maps are not copied: "
+                 "each MapGrid refers into this MapValidation and keeps it alive");
+
+  m.def("validate_xray",
+        &ps::validate_xray,
+        pybind11::call_guard<pybind11::gil_scoped_release>(),
+        "Computes sigmaa omit maps from an MTZ file and scores every sugar in the model against them (RSCC, <mFo>)",
+        "model"_a,
+        "mtz_filename"_a,
+        "options"_a = ps::MapValidationOptions() );
+
+  m.def("validate_cryoem",
+        &ps::validate_cryoem,
+        pybind11::call_guard<pybind11::gil_scoped_release>(),
+        "Scores every sugar in the model against a cryo-EM map at the given resolution (RSCC, <Fo>)",
+        "model"_a,
+        "map_filename"_a,
+        "resolution"_a,
+        "options"_a = ps::MapValidationOptions() );
+
+  pybind11::class_<ps::BatchAnalysis, BatchAnalysisHolder>(m, "BatchAnalysis", "Models being built on worker threads, iterated over as they complete")
+            .def("__iter__", [](pybind11::object batch) { return batch; })
+            .def("__next__", &next_batch_result)
+            .def("__len__",  &ps::BatchAnalysis::size)
+            .def("close",    &ps::BatchAnalysis::close, pybind11::call_guard<pybind11::gil_scoped_release>(),
+                 "Stops the workers once their current file is done; results already finished are still yielded");
+
+  m.def("analyse_many",
+        &analyse_many,
+        "Reads and analyses many models on a pool of n_threads (0: one per core), yielding (index, filename, model, error) tuples as they complete",
+        "paths"_a,
+        "n_threads"_a = 0,
+        "expression_system"_a = "undefined");
+
   m.def("write_refmac_keywords",
         &privateer::scripting::write_refmac_keywords,
         "Writes refmac5 keywords",
@@ -168,6 +480,7 @@ PYBIND11_MODULE(privateer_core, m)
 
   m.def("print_wurcs",
         &privateer::scripting::print_wurcs,
+        pybind11::call_guard<pybind11::gil_scoped_release>(),
         "Returns a WURCS string of all glycans in the glycoprotein model",
         "pdb_filename"_a,
         "expression_system"_a = "undefined");
@@ -18,16 +18,18 @@
 #include "privateer-xray.h"
 
 
-void privateer::xray::read_xray_map ( clipper::String const pathname, clipper::String const input_model_path, clipper::MiniMol& mmol, clipper::HKL_info& hklinfo, clipper::CCP4MTZfile& mtzin)
+void privateer::xray::read_xray_map ( clipper::String const pathname, clipper::String const input_model_path, const clipper::MiniMol& mmol, clipper::HKL_info& hklinfo, clipper::CCP4MTZfile& mtzin, bool batch )
 {
-    std::cout << "Reading " << pathname.trim().c_str() << "... ";
+    std::ostream messages ( batch ? NULL : std::cout.rdbuf() );
+
+    messages << "Reading " << pathname.trim().c_str() << "... ";
     fflush(0);
     
     mtzin.set_column_label_mode( clipper::CCP4MTZfile::Legacy );
     mtzin.open_read( pathname.trim() );
 
 
-    std::cout << "done." << std::endl;
+    messages << "done." << std::endl;
 
     try // we could be in trouble should the MTZ file have no cell parameters
     {
@@ -35,16 +37,17 @@ void privateer::xray::read_xray_map ( clipper::String const pathname, clipper::S
     }
     catch (...)
     {
-        std::cout << "\nReading cell and spacegroup parameters from the CRYST1 card in ";
-        std::cout << input_model_path << ":\n Spacegroup (" << mmol.spacegroup().spacegroup_number() << ")\n" << mmol.cell().format() << "\n\n" ;
+        messages << "\nReading cell and spacegroup parameters from the CRYST1 card in ";
+        messages << input_model_path << ":\n Spacegroup (" << mmol.spacegroup().spacegroup_number() << ")\n" << mmol.cell().format() << "\n\n" ;
 
         clipper::Resolution myRes(0.96);
         hklinfo = clipper::HKL_info( mmol.spacegroup(), mmol.cell(), myRes, true);
     }
 }
 
-void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzin, clipper::CCP4MTZfile& ampmtzin, clipper::String const input_column_fobs, clipper::HKL_data<clipper::data32::F_sigF>& fobs, clipper::HKL_info& hklinfo, clipper::MTZcrystal& opxtal, clipper::MTZdataset& opdset, clipper::String const input_reflections_mtz)
+void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzin, clipper::CCP4MTZfile& ampmtzin, clipper::String const input_column_fobs, clipper::HKL_data<clipper::data32::F_sigF>& fobs, clipper::HKL_info& hklinfo, clipper::MTZcrystal& opxtal, clipper::MTZdataset& opdset, clipper::String const input_reflections_mtz, bool batch )
 {
+    std::ostream messages ( batch ? NULL : std::cout.rdbuf() );
     bool notFound = true;
     // initialize_experimental_dataset 
     std::vector<clipper::String> mtzColumns;
@@ -52,7 +55,7 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
 
     if (input_column_fobs != "NONE")
     {
-        std::cout << "MTZ file supplied. Using " << input_column_fobs << "...\n";
+        messages << "MTZ file supplied. Using " << input_column_fobs << "...\n";
         mtzin.import_hkl_data( fobs, "*/*/["+ input_column_fobs+"]" );
         mtzin.import_crystal(opxtal, input_column_fobs);
         mtzin.import_dataset(opdset, input_column_fobs);
@@ -65,7 +68,7 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
         {
             if (mtzColumns[i].find("/FOBS ") != -1)
             {
-                std::cout << "\nMTZ file supplied. Using FOBS & SIGFOBS...\n";
+                messages << "\nMTZ file supplied. Using FOBS & SIGFOBS...\n";
                 mtzin.import_hkl_data( fobs, "*/*/[FOBS,SIGFOBS]" );
                 mtzin.import_crystal(opxtal, "*/*/[FOBS,SIGFOBS]" );
                 mtzin.import_dataset(opdset, "*/*/[FOBS,SIGFOBS]" );
@@ -74,7 +77,7 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
             }
             else if (mtzColumns[i].find("/FP ") != -1)
             {
-                std::cout << "\nMTZ file supplied. Using FP & SIGFP...\n";
+                messages << "\nMTZ file supplied. Using FP & SIGFP...\n";
                 mtzin.import_hkl_data( fobs, "*/*/[FP,SIGFP]" );
                 mtzin.import_crystal(opxtal, "*/*/[FP,SIGFP]" );
                 mtzin.import_dataset(opdset, "*/*/[FP,SIGFP]" );
@@ -83,7 +86,7 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
             }
             else if (mtzColumns[i].find("/FOSC ") != -1)
             {
-                std::cout << "\nMTZ file supplied. Using FOSC & SIGFOSC...\n";
+                messages << "\nMTZ file supplied. Using FOSC & SIGFOSC...\n";
                 mtzin.import_hkl_data( fobs, "*/*/[FOSC,SIGFOSC]" );
                 mtzin.import_crystal(opxtal, "*/*/[FOSC,SIGFOSC]" );
                 mtzin.import_dataset(opdset, "*/*/[FOSC,SIGFOSC]" );
@@ -92,7 +95,7 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
             }
             else if (mtzColumns[i].find("/F-obs ") != -1)
             {
-                std::cout << "\nMTZ file supplied. Using F-obs & SIGF-obs...\n";
+                messages << "\nMTZ file supplied. Using F-obs & SIGF-obs...\n";
                 mtzin.import_hkl_data( fobs, "*/*/[F-obs,SIGF-obs]" );
                 mtzin.import_crystal(opxtal, "*/*/[F-obs,SIGF-obs]" );
                 mtzin.import_dataset(opdset, "*/*/[F-obs,SIGF-obs]" );
@@ -101,7 +104,7 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
             }
             else if (mtzColumns[i].find("/F ") != -1)
             {
-                std::cout << "\nMTZ file supplied. Using F & SIGF...\n";
+                messages << "\nMTZ file supplied. Using F & SIGF...\n";
                 mtzin.import_hkl_data( fobs, "*/*/[F,SIGF]" );
                 mtzin.import_crystal(opxtal, "*/*/[F,SIGF]" );
                 mtzin.import_dataset(opdset, "*/*/[F,SIGF]" );
@@ -113,7 +116,7 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
 
     if (notFound)
     {
-        std::cout << "\nNo suitable amplitudes have been found in the MTZ file!\n\nSummoning ctruncate in case what we have are intensities...\n\n";
+        messages << "\nNo suitable amplitudes have been found in the MTZ file!\n\nSummoning ctruncate in case what we have are intensities...\n\n";
 
         char cmd[100];
         int exitCodeCTruncate;
@@ -125,11 +128,11 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
 
         // For future developer: Because I relocated this code from privateer.cpp to this file, I then couldn't return EXIT_FAILURE. If this thing is even called to begin with, then pass int exitCodeCTruncate by reference as a variable to this function as a fix to whatever bug may appear.
         if (exitCodeCTruncate != EXIT_SUCCESS)
-            std::cout << "CTruncate exited with a failure, Privateer is likely to fail subsequently." << std::endl;
+            messages << "CTruncate exited with a failure, Privateer is likely to fail subsequently." << std::endl;
         else
         {
-            std::cout << "\nReading output from ctruncate...\n" << "Previous hklinfo: " << hklinfo.cell().format() << std::endl;
-            std::cout << " " << hklinfo.spacegroup().spacegroup_number() << " " << hklinfo.num_reflections() << "\n";
+            messages << "\nReading output from ctruncate...\n" << "Previous hklinfo: " << hklinfo.cell().format() << std::endl;
+            messages << " " << hklinfo.spacegroup().spacegroup_number() << " " << hklinfo.num_reflections() << "\n";
     
 
             ampmtzin.set_column_label_mode( clipper::CCP4MTZfile::Legacy );
@@ -139,7 +142,192 @@ void privateer::xray::initialize_experimental_dataset(clipper::CCP4MTZfile& mtzi
             ampmtzin.import_dataset(opdset, "*/*/[F,SIGF]" );
             ampmtzin.close_read();
 
-            std::cout << "\nPresent hklinfo: " << hklinfo.cell().format() << " " << hklinfo.spacegroup().spacegroup_number() << " " << hklinfo.num_reflections() << "\n";
+            messages << "\nPresent hklinfo: " << hklinfo.cell().format() << " " << hklinfo.spacegroup().spacegroup_number() << " " << hklinfo.num_reflections() << "\n";
+        }
+    }
+}
+
+
+bool privateer::xray::calculate_sigmaa_coefficients ( const clipper::HKL_data<clipper::data32::F_sigF>& fobs,
+                                                      clipper::HKL_data<clipper::data32::F_sigF>& fobs_scaled,
+                                                      const clipper::Atom_list& mainAtoms,
+                                                      const clipper::Atom_list& ligandAtoms,
+                                                      const clipper::Atom_list& allAtoms,
+                                                      clipper::HKL_data<clipper::data32::F_phi>& fc_ligands,
+                                                      clipper::HKL_data<clipper::data32::F_phi>& fb_all,
+                                                      clipper::HKL_data<clipper::data32::F_phi>& fd_all,
+                                                      clipper::HKL_data<clipper::data32::F_phi>& fd_omit,
+                                                      int n_refln, int n_param,
+                                                      double& r_all, double& r_omit )
+{
+    typedef clipper::HKL_data_base::HKL_reference_index HRI;
+
+    const clipper::HKL_info& hklinfo = fobs.base_hkl_info();
+
+    clipper::HKL_data<clipper::data32::F_phi> fc_omit ( hklinfo );
+    clipper::HKL_data<clipper::data32::F_phi> fc_all ( hklinfo );
+
+    clipper::SFcalc_obs_bulk<float> sfcbligands;
+    clipper::SFcalc_obs_bulk<float> sfcb;
+    clipper::SFcalc_obs_bulk<float> sfcball;
+
+    bool unrecognised_atoms = false;
+
+    try
+    {   // calculate structure factors with bulk solvent correction
+    #pragma omp parallel sections
+        {
+    #pragma omp section
+            sfcbligands( fc_ligands, fobs, ligandAtoms );
+    #pragma omp section
+            sfcb( fc_omit, fobs, mainAtoms );  // calculation of omit SF with bulk solvent correction
+    #pragma omp section
+            sfcball( fc_all, fobs, allAtoms ); // calculation of SF with bulk solvent correction
+        }
+    }
+    catch ( ... )
+    {
+        unrecognised_atoms = true; // this causes clipper to freak out, so better remove those unknowns
+    }
+
+    fc_ligands[0].set_null();
+    fc_omit[0].set_null();
+    fc_all[0].set_null();
+
+    // scale data and flag R-free
+
+    clipper::HKL_data<clipper::data32::Flag> flag( hklinfo );     // same flag for both calculations, omit absent reflections
+    clipper::SFscale_aniso<float> sfscale;
+
+    #pragma omp parallel sections
+    {
+    #pragma omp section
+        {
+            sfscale( fobs_scaled, fc_all );  // anisotropic scaling of Fobs. We scale Fobs to Fcalc instead of scaling our 3 Fcalcs to Fobs
+        }
+    #pragma omp section
+        {
+            for ( HRI ih = flag.first(); !ih.last(); ih.next() ) // we want to use all available reflections
+            {
+                if ( !fobs_scaled[ih].missing() ) flag[ih].flag() = clipper::SFweight_spline<float>::BOTH;
+                else flag[ih].flag() = clipper::SFweight_spline<float>::NONE;
+            }
+        }
+    }
+
+    clipper::HKL_data<clipper::data32::F_phi> fb_omit( hklinfo );
+    clipper::HKL_data<clipper::data32::Phi_fom> phiw_omit( hklinfo );
+    clipper::HKL_data<clipper::data32::Phi_fom> phiw_all( hklinfo );
+
+    // now do sigmaa calc
+    #pragma omp parallel sections
+    {
+    #pragma omp section
+        {
+            clipper::SFweight_spline<float> sfw_omit ( n_refln, n_param );
+            sfw_omit( fb_omit, fd_omit, phiw_omit, fobs_scaled, fc_omit, flag ); // sigmaa omit
+        }
+    #pragma omp section
+        {
+            clipper::SFweight_spline<float> sfw_all( n_refln, n_param );
+            sfw_all( fb_all, fd_all, phiw_all, fobs_scaled, fc_all, flag ); // sigmaa all atoms
+        }
+    }
+
+    // R factors of the whole and omit models against the scaled data
+
+    std::vector<double> params( n_param, 2.0 );
+    clipper::BasisFn_spline wrk_basis( hklinfo, n_param, 2.0 );
+
+    clipper::TargetFn_scaleF1F2<clipper::data32::F_phi,clipper::data32::F_sigF> wrk_target_omit( fc_omit, fobs_scaled );
+    clipper::TargetFn_scaleF1F2<clipper::data32::F_phi,clipper::data32::F_sigF> wrk_target_all ( fc_all, fobs_scaled );
+    clipper::ResolutionFn wrk_scale_omit( hklinfo, wrk_basis, wrk_target_omit, params );
+    clipper::ResolutionFn wrk_scale_all ( hklinfo, wrk_basis, wrk_target_all,  params );
+
+    double FobsFcalcSum = 0.0;
+    double FobsFcalcAllSum = 0.0;
+    double FobsSum = 0.0;
+
+    for ( HRI ih = fobs_scaled.first(); !ih.last(); ih.next() )
+    {
+        if ( !fobs_scaled[ih].missing() )
+        {
+            const double Fo = fobs_scaled[ih].f();
+            const double Fc_all = sqrt ( wrk_scale_all.f(ih) ) * fc_all[ih].f() ;
+            const double Fc_omit = sqrt ( wrk_scale_omit.f(ih) ) * fc_omit[ih].f() ;
+            FobsFcalcSum += fabs( Fo - Fc_omit );
+            FobsFcalcAllSum += fabs( Fo - Fc_all );
+            FobsSum += Fo;
         }
     }
-}
\ No newline at end of file
+
+    r_all  = FobsFcalcAllSum / FobsSum;
+    r_omit = FobsFcalcSum / FobsSum;
+
+    return unrecognised_atoms;
+}
+
+
+template < class T >
+std::pair<double, double> privateer::xray::calculate_rscc ( const clipper::Xmap<T>& experimental_map,
+                                                            const clipper::Xmap<T>& fc_map,
+                                                            const clipper::Xmap<T>& mask,
+                                                            const clipper::Map_stats& map_stats,
+                                                            const clipper::HKL_info& hklinfo,
+                                                            const clipper::Grid_sampling& mygrid,
+                                                            const clipper::Coord_orth& origin,
+                                                            const clipper::Coord_orth& destination )
+{
+    double meanDensityExp, meanDensityCalc, num, den1, den2;
+    meanDensityCalc = meanDensityExp = num = den1 = den2 = 0.0;
+
+    int n_points = 0;
+
+    const clipper::Coord_grid last = destination.coord_frac(hklinfo.cell()).coord_grid(mygrid);
+    clipper::Xmap_base::Map_reference_coord i0, iu, iv, iw;
+
+    // calculation of the mean densities of the calc and weighted obs maps
+
+    i0 = clipper::Xmap_base::Map_reference_coord( experimental_map, origin.coord_frac(hklinfo.cell()).coord_grid(mygrid) );
+
+    for ( iu = i0; iu.coord().u() <= last.u(); iu.next_u() )
+        for ( iv = iu; iv.coord().v() <= last.v(); iv.next_v() )
+            for ( iw = iv; iw.coord().w() <= last.w(); iw.next_w() )
+            {
+                if ( mask[iw] == 1.0)
+                {
+                    meanDensityCalc = meanDensityCalc + fc_map[iw];
+                    meanDensityExp = meanDensityExp + experimental_map[iw];
+                    n_points++;
+                }
+            }
+
+    double accum = meanDensityExp / map_stats.std_dev();
+    accum /= n_points;
+
+    meanDensityCalc = meanDensityCalc / n_points;
+    meanDensityExp = meanDensityExp / n_points;
+
+    // calculation of the correlation coefficient between calc and weighted obs maps
+
+    for ( iu = i0; iu.coord().u() <= last.u(); iu.next_u() )
+        for ( iv = iu; iv.coord().v() <= last.v(); iv.next_v() )
+            for ( iw = iv; iw.coord().w() <= last.w(); iw.next_w() )
+            {
+                if ( mask[iw] == 1.0)
+                {
+                    num = num + (experimental_map[iw] - meanDensityExp) * (fc_map[iw] - meanDensityCalc);
+                    den1 = den1 + pow((experimental_map[iw] - meanDensityExp),2);
+                    den2 = den2 + pow((fc_map[iw] - meanDensityCalc),2);
+                }
+            }
+
+    return std::make_pair ( num / (sqrt(den1) * sqrt(den2)), accum );
+}
+
+template std::pair<double, double> privateer::xray::calculate_rscc<float> ( const clipper::Xmap<float>&, const clipper::Xmap<float>&, const clipper::Xmap<float>&,
+                                                                             const clipper::Map_stats&, const clipper::HKL_info&, const clipper::Grid_sampling&,
+                                                                             const clipper::Coord_orth&, const clipper::Coord_orth& );
+template std::pair<double, double> privateer::xray::calculate_rscc<double> ( const clipper::Xmap<double>&, const clipper::Xmap<double>&, const clipper::Xmap<double>&,
+                                                                              const clipper::Map_stats&, const clipper::HKL_info&, const clipper::Grid_sampling&,
+                                                                              const clipper::Coord_orth&, const clipper::Coord_orth& );
@@ -22,14 +22,44 @@
 #include <clipper/clipper-ccp4.h>
 #include <clipper/clipper-minimol.h>
 #include <clipper/clipper-contrib.h>
+#include <clipper/contrib/sfcalc_obs.h>
 
 
 namespace privateer
 {
   namespace xray
   {
-        void read_xray_map ( clipper::String const pathname, clipper::String const input_model_path, clipper::MiniMol& mmol, clipper::HKL_info& hklinfo, clipper::CCP4MTZfile& mtzin );
-        void initialize_experimental_dataset(clipper::CCP4MTZfile& mtzin, clipper::CCP4MTZfile& ampmtzin, clipper::String const input_column_fobs, clipper::HKL_data<clipper::data32::F_sigF>& fobs, clipper::HKL_info& hklinfo, clipper::MTZcrystal& opxtal, clipper::MTZdataset& opdset, clipper::String const input_reflections_mtz);
+        // batch silences the progress messages, for callers that are not the command line program
+        void read_xray_map ( clipper::String const pathname, clipper::String const input_model_path, const clipper::MiniMol& mmol, clipper::HKL_info& hklinfo, clipper::CCP4MTZfile& mtzin, bool batch = false );
+        void initialize_experimental_dataset(clipper::CCP4MTZfile& mtzin, clipper::CCP4MTZfile& ampmtzin, clipper::String const input_column_fobs, clipper::HKL_data<clipper::data32::F_sigF>& fobs, clipper::HKL_info& hklinfo, clipper::MTZcrystal& opxtal, clipper::MTZdataset& opdset, clipper::String const input_reflections_mtz, bool batch = false );
+
+        // Bulk-solvent corrected structure factors for the whole model, the model without ligandAtoms and the ligands alone,
+        // followed by anisotropic scaling of fobs_scaled and sigmaa weighting. fb_all and fd_all are the 2mFo-DFc and mFo-DFc
+        // coefficients, fd_omit the mFo-DFc coefficients of the omit model. Returns true if clipper rejected some of the atoms
+        bool calculate_sigmaa_coefficients ( const clipper::HKL_data<clipper::data32::F_sigF>& fobs,
+                                             clipper::HKL_data<clipper::data32::F_sigF>& fobs_scaled,
+                                             const clipper::Atom_list& mainAtoms,
+                                             const clipper::Atom_list& ligandAtoms,
+                                             const clipper::Atom_list& allAtoms,
+                                             clipper::HKL_data<clipper::data32::F_phi>& fc_ligands,
+                                             clipper::HKL_data<clipper::data32::F_phi>& fb_all,
+                                             clipper::HKL_data<clipper::data32::F_phi>& fd_all,
+                                             clipper::HKL_data<clipper::data32::F_phi>& fd_omit,
+                                             int n_refln, int n_param,
+                                             double& r_all, double& r_omit );
+
+        // RSCC between experimental_map and fc_map inside mask, scanning the box between origin and destination,
+        // and the mean experimental density there in units of the map_stats standard deviation.
+        // Instantiated for float (X-ray) and double (cryo-EM) maps; cryo_em::calculate_rscc forwards here
+        template < class T >
+        std::pair<double, double> calculate_rscc ( const clipper::Xmap<T>& experimental_map,
+                                                   const clipper::Xmap<T>& fc_map,
+                                                   const clipper::Xmap<T>& mask,
+                                                   const clipper::Map_stats& map_stats,
+                                                   const clipper::HKL_info& hklinfo,
+                                                   const clipper::Grid_sampling& mygrid,
+                                                   const clipper::Coord_orth& origin,
+                                                   const clipper::Coord_orth& destination );
   }
 }
 
@@ -39,6 +39,7 @@
 #include <tuple>
 #include <iostream>
 #include <iomanip>
+#include <cstdarg>
 #include "privateer-lib.h"
 #include "privateer-cryo_em.h"
 #include "privateer-xray.h"
@@ -64,6 +65,20 @@ using clipper::data32::Phi_fom;
 using clipper::data32::Flag;
 typedef clipper::HKL_data_base::HKL_reference_index HRI;
 
+// Per-sugar tables and blob reports go through table_printf and table_out, which follow the console output sink
+static bool print_tables = true;
+
+static void table_printf ( const char* format, ... )
+{
+    if ( !print_tables )
+        return;
+
+    va_list arguments;
+    va_start ( arguments, format );
+    vprintf ( format, arguments );
+    va_end ( arguments );
+}
+
 
 // Glytoucan has to be the last arguement for some reason, need to fix this bs. Otherwise new arguements will not be picked up.
 
@@ -97,6 +112,7 @@ int main(int argc, char** argv)
     clipper::String input_ccd_code          = "XXX";
     clipper::String ipwurcsjson             = "database.json";
     clipper::String output_mapcoeffs_mtz    = "privateer-hklout.mtz";
+    clipper::String output_columnar         = "NONE";
     clipper::String title                   = "generic title";
     clipper::String input_reflections_mtz   = "NONE";
     clipper::String input_expression_system = "undefined";
@@ -107,6 +123,8 @@ int main(int argc, char** argv)
     bool useSigmaa = false;
     bool oldstyleinput = false;
     bool vertical = false, original = true, invert = false;
+    bool svgSheet = false;
+    privateer::util::OutputSinks sinks;
     int n_refln = 1000;
     int n_param = 20;
     bool useMTZ = false;
@@ -121,6 +139,10 @@ int main(int argc, char** argv)
     float resolution = -1; 
     float ipradius = 2.5;    // default value, punishing enough!
     float thresholdElectronDensityValue = 0.02;
+    bool thresholdElectronDensitySet = false;
+    bool blobsMotifFilter = true;
+    bool blobsRemoveSolvent = false;
+    std::vector<clipper::String> blobsOGlycanMotifs;
     FILE *output;
     bool output_mtz = false;
     std::vector < clipper::MGlycan > list_of_glycans;
@@ -285,6 +307,28 @@ int main(int argc, char** argv)
         {
             invert = true;
         }
+        else if ( args[arg] == "-svg_sheet" )
+        {
+            svgSheet = true;
+        }
+        else if ( args[arg] == "-columnar" )
+        {
+            if ( ++arg < args.size() )
+                output_columnar = args[arg];
+        }
+        else if ( args[arg] == "-outputs" )
+        {
+            if ( ++arg < args.size() )
+            {
+                if ( sinks.parse ( args[arg] ) )
+                {
+                    std::cout << std::endl << std::endl << "Error: " << args[arg] << " is not a list of outputs. Known outputs are "
+                              << privateer::util::OutputSinks::known_names() << std::endl << std::endl;
+                    prog.set_termination_message( "Failed" );
+                    return 1;
+                }
+            }
+        }
         else if ( args[arg] == "-radiusin" )
         {
             if ( ++arg < args.size() )
@@ -331,6 +375,21 @@ int main(int argc, char** argv)
             if ( ++arg < args.size() )
             {
                 thresholdElectronDensityValue = clipper::String(args[arg]).f();
+                thresholdElectronDensitySet = true;
+            }
+        }
+
+        else if ( args[arg] == "-blobs_scan_all" )
+            blobsMotifFilter = false;
+
+        else if ( args[arg] == "-blobs_strip_solvent" )
+            blobsRemoveSolvent = true;
+
+        else if ( args[arg] == "-blobs_omotifs" )
+        {
+            if ( ++arg < args.size() )
+            {
+                blobsOGlycanMotifs = clipper::String(args[arg]).split(",");
             }
         }
 
@@ -370,6 +429,9 @@ int main(int argc, char** argv)
     }
 
     
+    print_tables = sinks.wants ( privateer::util::console_sink );
+    std::ostream table_out ( print_tables ? std::cout.rdbuf() : NULL ); // discards everything without a buffer
+
     if (batch)
     {
         output = fopen("validation_data-privateer","w");
@@ -429,6 +491,8 @@ int main(int argc, char** argv)
 
         if ( !batch ) std::cout << std::endl << "Number of detected glycosylations: " << list_of_glycans.size();
 
+        std::vector<privateer::util::GlycanPlotJob> plot_jobs; // SVGs are rendered together once all glycans have been listed
+
         if ( list_of_glycans.size() > 0 )
         {
             int glycansPermutated = 0;
@@ -458,47 +522,27 @@ int main(int argc, char** argv)
                             list_of_glycans_associated_to_permutations.at(i) = finalGlycanPermutationContainer;
                             for(int j = 0; j < finalGlycanPermutationContainer.size(); j++)
                                 {   
-                                    if(oldstyleinput) 
-                                    {
-                                        privateer::glycoplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                                        plot.plot_glycan ( finalGlycanPermutationContainer[j].first.first );
-                                        std::ostringstream os;
-                                        os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
-                                        plot.write_to_file ( os.str() );
-                                    }
-                                    else
-                                    {
-                                        privateer::glycanbuilderplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                                        plot.plot_glycan ( finalGlycanPermutationContainer[j].first.first );
-                                        std::ostringstream os;
-                                        os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
-                                        plot.write_to_file ( os.str() );
-                                    }
+                                    std::ostringstream os;
+                                    os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
+                                    plot_jobs.push_back ( privateer::util::GlycanPlotJob { &list_of_glycans_associated_to_permutations.at(i)[j].first.first, list_of_glycans[i].get_root_by_name(), os.str() } );
                                 }
                         }
                 }
-                if(oldstyleinput)
-                {
-                    privateer::glycoplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                    plot.plot_glycan ( list_of_glycans[i] );
-                    std::ostringstream os;
-                    os << list_of_glycans[i].get_root_for_filename() << ".svg";
-                    plot.write_to_file ( os.str() );
-                }
-                else
-                {
-                    privateer::glycanbuilderplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                    plot.plot_glycan ( list_of_glycans[i] );
-                    std::ostringstream os;
-                    os << list_of_glycans[i].get_root_for_filename() << ".svg";
-                    plot.write_to_file ( os.str() );
-                }
+                plot_jobs.push_back ( privateer::util::GlycanPlotJob { &list_of_glycans[i], list_of_glycans[i].get_root_by_name(), list_of_glycans[i].get_root_for_filename() + ".svg" } );
             }
             if(useWURCSDataBase && glycansPermutated > 0) std::cout << "Originally modelled glycans not found on GlyConnect database: " << glycansPermutated << "/" << list_of_glycans.size() << std::endl;
         }
 
-        if ( !batch ) std::cout << "\n\nDetailed validation data" << std::endl;
-        if ( !batch ) std::cout << "------------------------" << std::endl;
+        if ( sinks.wants ( privateer::util::svg_sink ) )
+        {
+            if ( svgSheet )
+                privateer::util::write_glycan_plot_sheet ( plot_jobs, "privateer-glycans.svg", oldstyleinput, vertical, original, invert );
+            else
+                privateer::util::render_glycan_plots ( plot_jobs, oldstyleinput, vertical, original, invert );
+        }
+
+        if ( !batch ) table_out << "\n\nDetailed validation data" << std::endl;
+        if ( !batch ) table_out << "------------------------" << std::endl;
 
         // erase ligand atoms from the model and then calculate phases using
         // the omitted model, effectively computing an omit map
@@ -623,11 +667,11 @@ int main(int argc, char** argv)
             }
         }
 
-        if (!batch) printf("\nPDB \t    Sugar   \t  Q  \t Phi  \tTheta \t   Detected type   \tCnf\t<Bfac>\tCtx\t Ok?");
-        if (!batch && showGeom) printf("\tBond lengths, angles and torsions, reported clockwise with in-ring oxygen as first vertex");
-        if (!batch) printf("\n----\t------------\t-----\t------\t------\t-------------------\t---\t------\t---\t-----");
-        if (!batch && showGeom) printf("\t------------------------------------------------------------------------------------------------------------");
-        if (!batch) printf("\n");
+        if (!batch) table_printf("\nPDB \t    Sugar   \t  Q  \t Phi  \tTheta \t   Detected type   \tCnf\t<Bfac>\tCtx\t Ok?");
+        if (!batch && showGeom) table_printf("\tBond lengths, angles and torsions, reported clockwise with in-ring oxygen as first vertex");
+        if (!batch) table_printf("\n----\t------------\t-----\t------\t------\t-------------------\t---\t------\t---\t-----");
+        if (!batch && showGeom) table_printf("\t------------------------------------------------------------------------------------------------------------");
+        if (!batch) table_printf("\n");
 
         for (int index = 0; index < ligandList.size(); index++)
         {
@@ -657,8 +701,8 @@ int main(int argc, char** argv)
             }
             else
             {
-                printf("%c%c%c%c\t%s-",input_model[1+pos_slash],input_model[2+pos_slash],input_model[3+pos_slash],input_model[4+pos_slash], ligandList[index].second.type().c_str());
-                std::cout << ligandList[index].first << "-" << ligandList[index].second.id().trim() << "  ";
+                table_printf("%c%c%c%c\t%s-",input_model[1+pos_slash],input_model[2+pos_slash],input_model[3+pos_slash],input_model[4+pos_slash], ligandList[index].second.type().c_str());
+                table_out << ligandList[index].first << "-" << ligandList[index].second.id().trim() << "  ";
             }
 
             if (batch)
@@ -788,10 +832,10 @@ int main(int argc, char** argv)
             {
                 std::vector<clipper::ftype> cpParams(10, 0);
                 cpParams = ligandList[index].second.cremer_pople_params();
-                printf("\t%1.3f\t%3.2f\t",cpParams[0],cpParams[1]);  // output cremer-pople parameters
-                if ( cpParams[2] == -1 ) printf ( " --  \t" ); else printf ( "%3.2f\t", cpParams[2] );
-                printf("%s\t", ligandList[index].second.type_of_sugar().c_str()); // output the type of sugar, e.g. alpha-D-aldopyranose
-                printf("%s\t", ligandList[index].second.conformation_name().c_str()); // output a 3 letter code for the conformation
+                table_printf("\t%1.3f\t%3.2f\t",cpParams[0],cpParams[1]);  // output cremer-pople parameters
+                if ( cpParams[2] == -1 ) table_printf ( " --  \t" ); else table_printf ( "%3.2f\t", cpParams[2] );
+                table_printf("%s\t", ligandList[index].second.type_of_sugar().c_str()); // output the type of sugar, e.g. alpha-D-aldopyranose
+                table_printf("%s\t", ligandList[index].second.conformation_name().c_str()); // output a 3 letter code for the conformation
 
                 float bfac = 0.0;
 
@@ -800,7 +844,7 @@ int main(int argc, char** argv)
 
                 bfac /= ligandList[index].second.size();
                 bfac  = clipper::Util::u2b(bfac);
-                printf ( "%3.2f", bfac ); // output <Bfactor>
+                table_printf ( "%3.2f", bfac ); // output <Bfactor>
 
 
                 std::vector < clipper::MGlycan > list_of_glycans = mgl.get_list_of_glycans();
@@ -816,22 +860,22 @@ int main(int argc, char** argv)
                             if ( list_of_glycans[i].get_type() == "n-glycan" )
                             {
                                 ligandList[index].second.set_context ( "n-glycan" );
-                                std::cout << "\t(n) ";
+                                table_out << "\t(n) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "c-glycan" )
                             {
                                 ligandList[index].second.set_context ( "c-glycan" );
-                                std::cout << "\t(c) ";
+                                table_out << "\t(c) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "o-glycan" )
                             {
                                 ligandList[index].second.set_context ( "o-glycan" );
-                                std::cout << "\t(o) ";
+                                table_out << "\t(o) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "s-glycan" )
                             {
                                 ligandList[index].second.set_context ( "s-glycan" );
-                                std::cout << "\t(s) ";
+                                table_out << "\t(s) ";
                             }
                             found_in_tree = true;
                             break;
@@ -843,7 +887,7 @@ int main(int argc, char** argv)
                 if ( !found_in_tree )
                 {
                     ligandList[index].second.set_context ( "ligand" );
-                    std::cout << "\t(l) ";
+                    table_out << "\t(l) ";
                 }
 
 
@@ -855,22 +899,22 @@ int main(int argc, char** argv)
                         {
                             if ( ! ligandList[index].second.ok_with_conformation () )
                             {
-                                printf("\tcheck");
+                                table_printf("\tcheck");
                             }
-                            else printf("\tyes");
+                            else table_printf("\tyes");
                         }
                         else
-                            printf ("\tno");
+                            table_printf ("\tno");
                     }
                     else
                         if (ligandList[index].second.is_sane())
-                            printf("\tyes");
+                            table_printf("\tyes");
                         else
                         {
-                            printf("\tno");
+                            table_printf("\tno");
                         }
                 }
-                else printf("\tunk");
+                else table_printf("\tunk");
 
                 if ( ! ligandList[index].second.ok_with_conformation () )
                     enable_torsions_for.push_back (ligandList[index].second.type().trim());
@@ -892,39 +936,34 @@ int main(int argc, char** argv)
 
 
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%1.2f", rbonds[i]);
+                        table_printf("\t%1.2f", rbonds[i]);
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%3.1f", rangles[i]);
+                        table_printf("\t%3.1f", rangles[i]);
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%3.1f", rtorsions[i]);
+                        table_printf("\t%3.1f", rtorsions[i]);
                 }
 
                 if (occupancy_check)
-                    std::cout << " (*)";
+                    table_out << " (*)";
 
-                std::cout << std::endl;
+                table_out << std::endl;
             }
         }
 
         if (!batch)
         {
-            std::cout << "\nPartially occupied monosaccharides, if any, are marked with an asterisk (*)";
-            std::cout << std::endl << std::endl;
+            table_out << "\nPartially occupied monosaccharides, if any, are marked with an asterisk (*)";
+            table_out << std::endl << std::endl;
         }
         else
             fclose(output);
 
-        std::fstream of_scm; std::fstream of_py;
-        of_scm.open("privateer-results.scm", std::fstream::out);
-        of_py.open("privateer-results.py", std::fstream::out);
-        privateer::coot::insert_coot_prologue_scheme ( of_scm );
-        privateer::coot::insert_coot_prologue_python ( of_py );
+        privateer::coot::NavigationList navigation; // rendered to the Scheme and Python scripts at the end
 
         clipper::String all_MapName, dif_MapName, omit_dif_MapName;
         all_MapName = ""; dif_MapName = ""; omit_dif_MapName = "";
 
-        privateer::coot::insert_coot_files_loadup_scheme (of_scm, input_model, all_MapName, dif_MapName, omit_dif_MapName, batch, "input_model_nowater.pdb", check_unmodelled);
-        privateer::coot::insert_coot_files_loadup_python (of_py , input_model, all_MapName, dif_MapName, omit_dif_MapName, batch, "input_model_nowater.pdb", check_unmodelled);
+        navigation.set_files ( input_model, all_MapName, dif_MapName, omit_dif_MapName, batch, "input_model_nowater.pdb", check_unmodelled );
 
 
 
@@ -986,8 +1025,7 @@ int main(int argc, char** argv)
                         n_errors++; n_conf++;
                     }
 
-                    privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, ligandList[k].second.ring_centre(), diagnostic );
-                    privateer::coot::insert_coot_go_to_sugar_python ( of_py, ligandList[k].second.ring_centre(), diagnostic );
+                    navigation.add ( ligandList[k].second.ring_centre(), diagnostic );
                 }
                 else // sugar is sane, but still need to check higher-energy conformations
                 {
@@ -1002,8 +1040,7 @@ int main(int argc, char** argv)
                         n_conf++;
                         sugar_count++;
 
-                        privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, ligandList[k].second.ring_centre(), diagnostic );
-                        privateer::coot::insert_coot_go_to_sugar_python ( of_py, ligandList[k].second.ring_centre(), diagnostic );
+                        navigation.add ( ligandList[k].second.ring_centre(), diagnostic );
                     }
                 }
             }
@@ -1011,23 +1048,31 @@ int main(int argc, char** argv)
 
         clipper::String status_msg = "Blue map: 2mFo-DFc. Pink map: omit mFo-DFc. Torsion restraints have been enabled.";
 
-        privateer::coot::insert_coot_epilogue_scheme ( of_scm );
-        privateer::coot::insert_coot_epilogue_python ( of_py );
+        navigation.set_status_bar_text ( status_msg );
 
-        privateer::coot::insert_coot_statusbar_text_scheme ( of_scm, status_msg );
-        privateer::coot::insert_coot_statusbar_text_python ( of_py, status_msg );
+        if ( navigation.write ( sinks.wants ( privateer::util::coot_scheme_sink ) ? "privateer-results.scm" : "",
+                                sinks.wants ( privateer::util::coot_python_sink ) ? "privateer-results.py" : "" ) )
+            std::cout << "Error: could not write the Coot navigation scripts privateer-results.scm/py" << std::endl;
 
-        of_scm.close();
-        of_py.close();
+        if ( sinks.wants ( privateer::util::console_sink ) )
+        {
+            std::cout << "SUMMARY: " << std::endl << std::endl ;
+            std::cout << "   Wrong anomer: " << n_anomer << std::endl;
+            std::cout << "   Wrong configuration: " << n_config << std::endl;
+            std::cout << "   Unphysical puckering amplitude: " << n_pucker << std::endl;
+            std::cout << "   In higher-energy conformations: " << n_conf << std::endl;
+            std::cout << std::endl;
+            std::cout << "   Privateer has identified " << n_anomer + n_config + n_pucker + n_conf;
+            std::cout << " issues, with " << sugar_count << " of " << ligandList.size() << " sugars affected." << std::endl;
+        }
 
-        std::cout << "SUMMARY: " << std::endl << std::endl ;
-        std::cout << "   Wrong anomer: " << n_anomer << std::endl;
-        std::cout << "   Wrong configuration: " << n_config << std::endl;
-        std::cout << "   Unphysical puckering amplitude: " << n_pucker << std::endl;
-        std::cout << "   In higher-energy conformations: " << n_conf << std::endl;
-        std::cout << std::endl;
-        std::cout << "   Privateer has identified " << n_anomer + n_config + n_pucker + n_conf;
-        std::cout << " issues, with " << sugar_count << " of " << ligandList.size() << " sugars affected." << std::endl;
+        if ( output_columnar != "NONE" )
+        {
+            if ( privateer::util::write_columnar_export ( ligandList, list_of_glycans, output_columnar ) )
+                std::cout << "Error: could not write " << output_columnar << std::endl;
+            else
+                std::cout << "Finished outputting " << output_columnar << std::endl;
+        }
 
         if ( enable_torsions_for.size() > 0 )
         {
@@ -1076,8 +1121,6 @@ int main(int argc, char** argv)
 
     clipper::HKL_data<clipper::data32::F_sigF> fobs;            // allocate space for F and sigF
     clipper::HKL_data<clipper::data32::F_sigF> fobs_scaled;     // allocate space for scaled F and sigF
-    clipper::HKL_data<clipper::data32::F_phi> fc_omit_bsc;      // allocate space for the omit calc data with bsc
-    clipper::HKL_data<clipper::data32::F_phi> fc_all_bsc;       // allocate space for the whole calculated data with bsc
     clipper::HKL_data<clipper::data32::F_phi> fc_ligands_bsc;    // allocate space for the ligand calculated data
 
 
@@ -1092,8 +1135,6 @@ int main(int argc, char** argv)
         {
             fobs = clipper::HKL_data<clipper::data32::F_sigF> ( hklinfo );
             fobs_scaled = clipper::HKL_data<clipper::data32::F_sigF> ( hklinfo );
-            fc_omit_bsc = clipper::HKL_data<clipper::data32::F_phi> ( hklinfo );
-            fc_all_bsc = clipper::HKL_data<clipper::data32::F_phi> ( hklinfo );
             fc_ligands_bsc = clipper::HKL_data<clipper::data32::F_phi> ( hklinfo );
 
             cifin.import_hkl_data( fobs );
@@ -1111,8 +1152,6 @@ int main(int argc, char** argv)
         {
             fobs = clipper::HKL_data<clipper::data32::F_sigF> ( hklinfo );
             fobs_scaled = clipper::HKL_data<clipper::data32::F_sigF> ( hklinfo );
-            fc_omit_bsc = clipper::HKL_data<clipper::data32::F_phi> ( hklinfo );
-            fc_all_bsc = clipper::HKL_data<clipper::data32::F_phi> ( hklinfo );
             fc_ligands_bsc = clipper::HKL_data<clipper::data32::F_phi> ( hklinfo );
 
             privateer::xray::initialize_experimental_dataset( mtzin, ampmtzin, input_column_fobs, fobs, hklinfo, opxtal, opdset, input_reflections_mtz);
@@ -1152,6 +1191,8 @@ int main(int argc, char** argv)
     // expand the alternativeGlycans big vector here to list of glycans and match indices. so like original glycan -> all of its permutations + scores and so on.
     //                                                                                             original glycan -> all of its permutations 
     // std::vector<std::vector<std::pair<clipper::MGlycan, std::vector<int>>>> originalGlycansAndPermutations(list_of_glycans.size());
+    std::vector<privateer::util::GlycanPlotJob> plot_jobs; // SVGs are rendered together once all glycans have been listed
+
     if ( !batch )
     {
         std::cout << std::endl << "Number of detected glycosylations: " << list_of_glycans.size();
@@ -1185,41 +1226,13 @@ int main(int argc, char** argv)
                             list_of_glycans_associated_to_permutations.at(i) = finalGlycanPermutationContainer;
                             for(int j = 0; j < finalGlycanPermutationContainer.size(); j++)
                                 {
-                                    if(oldstyleinput)
-                                    {
-                                        privateer::glycoplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                                        plot.plot_glycan ( finalGlycanPermutationContainer[j].first.first );
-                                        std::ostringstream os;
-                                        os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
-                                        plot.write_to_file ( os.str() );
-                                    }
-                                    else 
-                                    {
-                                        privateer::glycanbuilderplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                                        plot.plot_glycan ( finalGlycanPermutationContainer[j].first.first );
-                                        std::ostringstream os;
-                                        os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
-                                        plot.write_to_file ( os.str() );
-                                    }
+                                    std::ostringstream os;
+                                    os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
+                                    plot_jobs.push_back ( privateer::util::GlycanPlotJob { &list_of_glycans_associated_to_permutations.at(i)[j].first.first, list_of_glycans[i].get_root_by_name(), os.str() } );
                                 }
                         }
                 }
-                if(oldstyleinput)
-                {
-                    privateer::glycoplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                    plot.plot_glycan ( list_of_glycans[i] );
-                    std::ostringstream os;
-                    os << list_of_glycans[i].get_root_for_filename() << ".svg";
-                    plot.write_to_file ( os.str() );
-                }
-                else
-                {
-                    privateer::glycanbuilderplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                    plot.plot_glycan ( list_of_glycans[i] );
-                    std::ostringstream os;
-                    os << list_of_glycans[i].get_root_for_filename() << ".svg";
-                    plot.write_to_file ( os.str() );
-                }
+                plot_jobs.push_back ( privateer::util::GlycanPlotJob { &list_of_glycans[i], list_of_glycans[i].get_root_by_name(), list_of_glycans[i].get_root_for_filename() + ".svg" } );
             }
             
             if(useWURCSDataBase && glycansPermutated > 0) std::cout << "Originally modelled glycans not found on GlyConnect database: " << glycansPermutated << "/" << list_of_glycans.size() << std::endl;
@@ -1250,56 +1263,36 @@ int main(int argc, char** argv)
                         list_of_glycans_associated_to_permutations.at(i) = finalGlycanPermutationContainer;
                         for(int j = 0; j < finalGlycanPermutationContainer.size(); j++)
                             {
-                                    if(oldstyleinput)
-                                    {
-                                        privateer::glycoplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                                        plot.plot_glycan ( finalGlycanPermutationContainer[j].first.first );
-                                        std::ostringstream os;
-                                        os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
-                                        plot.write_to_file ( os.str() );
-                                    }
-                                    else 
-                                    {
-                                        privateer::glycanbuilderplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                                        plot.plot_glycan ( finalGlycanPermutationContainer[j].first.first );
-                                        std::ostringstream os;
-                                        os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
-                                        plot.write_to_file ( os.str() );
-                                    }
+                                    std::ostringstream os;
+                                    os << finalGlycanPermutationContainer[j].first.first.get_root_for_filename() << "-" << j << "-PERMUTATION.svg";
+                                    plot_jobs.push_back ( privateer::util::GlycanPlotJob { &list_of_glycans_associated_to_permutations.at(i)[j].first.first, list_of_glycans[i].get_root_by_name(), os.str() } );
                             }
                     }
             }
-            if(oldstyleinput)
-            {
-                privateer::glycoplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                plot.plot_glycan ( list_of_glycans[i] );
-                std::ostringstream os;
-                os << list_of_glycans[i].get_root_for_filename() << ".svg";
-                plot.write_to_file ( os.str() );
-            }
-            else
-            {
-                privateer::glycanbuilderplot::Plot plot(vertical, original, list_of_glycans[i].get_root_by_name(), invert, true);
-                plot.plot_glycan ( list_of_glycans[i] );
-                std::ostringstream os;
-                os << list_of_glycans[i].get_root_for_filename() << ".svg";
-                plot.write_to_file ( os.str() );
-            }
+            plot_jobs.push_back ( privateer::util::GlycanPlotJob { &list_of_glycans[i], list_of_glycans[i].get_root_by_name(), list_of_glycans[i].get_root_for_filename() + ".svg" } );
         }
 
     }
 
+    if ( sinks.wants ( privateer::util::svg_sink ) )
+    {
+        if ( svgSheet )
+            privateer::util::write_glycan_plot_sheet ( plot_jobs, "privateer-glycans.svg", oldstyleinput, vertical, original, invert );
+        else
+            privateer::util::render_glycan_plots ( plot_jobs, oldstyleinput, vertical, original, invert );
+    }
+
     std::vector<std::vector< std::tuple <clipper::String, clipper::MMonomer, double> > > blobsProteinBackboneSummaryForCoot(6);
     if ( check_unmodelled )
     {
         std::cout << std::endl << "___________________________________________________________________" << std::endl;
         std::cout << "Scanning a waterless difference map for unmodelled glycosylation sites on protein backbone..." << std::endl;
 
-        clipper::MiniMol modelRemovedWaters = get_model_without_waters(input_model);
+        clipper::MiniMol modelRemovedWaters = get_model_without_waters(mmol, blobsRemoveSolvent);
 
         clipper::Atom_list withoutWaterModelAtomList = modelRemovedWaters.atom_list();
         
-        std::vector<std::vector<GlycosylationMonomerMatch> > PotentialMonomers = get_matching_monomer_positions(modelRemovedWaters);
+        std::vector<std::vector<GlycosylationMonomerMatch> > PotentialMonomers = get_matching_monomer_positions(modelRemovedWaters, blobsMotifFilter, blobsOGlycanMotifs);
 
 
 
@@ -1318,48 +1311,76 @@ int main(int argc, char** argv)
             prog.set_termination_message( "Failed" );
             return 1;
         }
+        else if (useMTZ && useMRC)
+        {
+            std::cout << std::endl << "Error: Expected to only have a single map input, not both initialized MTZ and MRC objects. Aborting." << std::endl;
+            prog.set_termination_message( "Failed" );
+            return 1;
+        }
+        else if (useMTZ)
+            no_errors = privateer::util::calculate_sigmaa_maps ( withoutWaterModelAtomList, fobs, fc_cryoem_obs, sigmaa_all_map, sigmaa_dif_map, ignore_set_null, useMTZ );
+        else if (useMRC)
+        {
+            // Difference map against the water-free model, sampled at the map resolution rather than on the (often much finer) pixel grid of the input map
+            std::cout << "Calculating the cryo-EM difference map... ";
+            fflush(0);
+            no_errors = privateer::cryo_em::calculate_difference_map ( sigmaa_dif_map, fc_cryoem_obs, withoutWaterModelAtomList, hklinfo );
+            std::cout << "done." << std::endl;
+        }
         else
         {
-            if (useMTZ) 
-            {
-                if (useMRC)
-                {
-                    std::cout << std::endl << "Error: Expected to only have a single map input, not both initialized MTZ and MTZ objects. Aborting." << std::endl;
-                    prog.set_termination_message( "Failed" );
-                    return 1;
-                }
-                else 
-                    no_errors = privateer::util::calculate_sigmaa_maps ( withoutWaterModelAtomList, fobs, fc_cryoem_obs, sigmaa_all_map, sigmaa_dif_map, ignore_set_null, useMTZ );
-            }
-            else 
-            {
-                if (useMTZ)
-                {
-                    std::cout << std::endl << "Error: Expected to only have a single map input, not both initialized MTZ and MTZ objects. Aborting." << std::endl;
-                    prog.set_termination_message( "Failed" );
-                    return 1;
-                }
-                else 
-                    std::cout << std::endl << "Error: This function is currently unsupported for cryo em maps." << std::endl;
-                    prog.set_termination_message( "Failed" );
-                    return 1;
-                    // no_errors = privateer::util::calculate_sigmaa_maps ( withoutWaterModelAtomList, fobs, fc_cryoem_obs, sigmaa_all_map, sigmaa_dif_map, ignore_set_null, useMTZ);                                             
-            }
-
+            std::cout << std::endl << "Error: scanning for unmodelled glycosylation needs reflections in MTZ format (-mtzin) or a cryo-EM map (-mapin), mmCIF reflections are not supported. Aborting." << std::endl;
+            prog.set_termination_message( "Failed" );
+            return 1;
         }
         clipper::Map_stats ms(sigmaa_dif_map);
 	    float map_sigma = ms.std_dev();
+        // the sphere threshold actually applied, in map units; -blobs_threshold is in map sigmas for cryo-EM
+        float sphereThreshold = sphere_density_threshold(ms, useMRC && !thresholdElectronDensitySet ? cryoem_sphere_threshold_sigmas : thresholdElectronDensityValue, useMRC);
+        const clipper::Grid_sampling& mapGrid = sigmaa_dif_map.grid_sampling();
+        bool wholeMap = !useMRC || (size_t) mapGrid.nu() * mapGrid.nv() * mapGrid.nw() <= maximum_whole_map_grid_points;
+        DensitySummedAreaTable densityTable;
+        DensityBlobCatalogue blobCatalogue;
+        std::vector<std::vector<GlycosylationSiteBlobHit> > siteHits;
+        std::vector<std::vector<CarbohydrateBlobHit> > carbohydrateHits;
         std::cout << "Status of no_errors " << std::boolalpha << no_errors << std::endl;
         if (no_errors)
             {
-                std::cout << std::endl << "Sigmaa difference map was successfully generated: " << std::boolalpha << no_errors << std::endl;
+                std::cout << std::endl << "Difference map was successfully generated: " << std::boolalpha << no_errors << std::endl;
                 std::cout << std::endl;
                 std::stringstream buffer;
 
+                if ( useMRC )
+                    std::cout << "Probe spheres must reach a mean density of " << sphereThreshold << " ("
+                              << ( thresholdElectronDensitySet ? thresholdElectronDensityValue : cryoem_sphere_threshold_sigmas ) << " map sigmas)" << std::endl;
+
+                // integral image of the difference map, built once and shared by every probe below
+                // Cryo-EM boxes can be large, above maximum_whole_map_grid_points probes are summed locally instead of through a table
+                densityTable = DensitySummedAreaTable(sigmaa_dif_map, useMRC ? maximum_whole_map_grid_points : 0);
+                // connected blobs above 3 sigma: candidates out of reach of every blob are looked up and skipped without
+                // probing, so the table and the catalogue are built whatever the outputs. Hits are put in context, and
+                // the catalogue is exported for remediation with its nearest residues, which only the JSON output reads.
+                // The flood fill walks the whole cell, so it is skipped on the same large cryo-EM boxes, where every
+                // candidate is then probed and hits are reported without a blob
+                if ( wholeMap )
+                {
+                    blobCatalogue = DensityBlobCatalogue(sigmaa_dif_map, ms, 3.0);
+                    if ( sinks.wants ( privateer::util::json_sink ) )
+                        blobCatalogue.assign_nearest_residues(modelRemovedWaters);
+                }
+                else
+                    std::cout << "The map is too large to catalogue its difference density blobs, every candidate will be probed" << std::endl;
+
+                // all five residue classes are scored concurrently, DUM atoms are then added one class at a time
+                siteHits = score_potential_glycosylation_sites(PotentialMonomers, modelRemovedWaters, sigmaa_dif_map, densityTable, hklinfo, list_of_glycans, ms, sphereThreshold, probe_density_threshold(ms, useMRC), -1, &blobCatalogue);
+                for(int type = 0; type < siteHits.size(); type++)
+                    for(int i = 0; i < siteHits[type].size(); i++)
+                        siteHits[type][i].blobID = blobCatalogue.blob_at(siteHits[type][i].target);
+
                 for(int type = 0; type < 5; type++)
                 {
                     std::vector<std::pair<PotentialGlycosylationSiteInfo, double> > results;
-                    results = get_electron_density_of_potential_glycosylation_sites(PotentialMonomers, type, modelRemovedWaters, sigmaa_dif_map, hklinfo, list_of_glycans, ms, thresholdElectronDensityValue, check_unmodelled);
+                    results = apply_glycosylation_site_hits(siteHits[type], modelRemovedWaters, check_unmodelled);
 
 
                     if(!results.empty())
@@ -1370,9 +1391,9 @@ int main(int argc, char** argv)
                             for (int i = 0; i < results.size(); i++)
                             {
 
-                                buffer << "\tN-Glycosylation: Value of experimental mean electron density in detected consensus sequence for" << mmol[results[i].first.chainID][results[i].first.monomerID].id() <<
-                                "-" << mmol[results[i].first.chainID][results[i].first.monomerID].type()
-                                << " monomer in Chain " << mmol[results[i].first.chainID].id() << ": " << results[i].second << std::endl;
+                                buffer << "\tN-Glycosylation: Value of experimental mean electron density in detected consensus sequence for" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].id() <<
+                                "-" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].type()
+                                << " monomer in Chain " << modelRemovedWaters[results[i].first.chainID].id() << ": " << results[i].second << blobCatalogue.describe(siteHits[type][i].blobID) << std::endl;
 
                                 std::tuple <clipper::String, clipper::MMonomer, double> blobInfo(modelRemovedWaters[results[i].first.chainID].id(), modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID], results[i].second);
                                 N_SiteBlobs.push_back(blobInfo);
@@ -1386,9 +1407,9 @@ int main(int argc, char** argv)
                         std::vector< std::tuple <clipper::String, clipper::MMonomer, double> > C_SiteBlobs;
                             for (int i = 0; i < results.size(); i++)
                             {
-                                buffer << "\tC-Glycosylation: Value of experimental mean electron density in detected consensus sequence for" << mmol[results[i].first.chainID][results[i].first.monomerID].id() <<
-                                "-" << mmol[results[i].first.chainID][results[i].first.monomerID].type()
-                                << " monomer in Chain " << mmol[results[i].first.chainID].id() << ": " << results[i].second << std::endl;
+                                buffer << "\tC-Glycosylation: Value of experimental mean electron density in detected consensus sequence for" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].id() <<
+                                "-" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].type()
+                                << " monomer in Chain " << modelRemovedWaters[results[i].first.chainID].id() << ": " << results[i].second << blobCatalogue.describe(siteHits[type][i].blobID) << std::endl;
                             
                                 std::tuple <clipper::String, clipper::MMonomer, double> blobInfo(modelRemovedWaters[results[i].first.chainID].id(), modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID], results[i].second);
                                 C_SiteBlobs.push_back(blobInfo);
@@ -1401,9 +1422,9 @@ int main(int argc, char** argv)
                         std::vector< std::tuple <clipper::String, clipper::MMonomer, double> > O_SiteBlobs;
                             for (int i = 0; i < results.size(); i++)
                             {
-                                buffer << "\tO-Glycosylation: Value of experimental mean electron density in detected consensus sequence for" << mmol[results[i].first.chainID][results[i].first.monomerID].id() <<
-                                "-" << mmol[results[i].first.chainID][results[i].first.monomerID].type()
-                                << " monomer in Chain " << mmol[results[i].first.chainID].id() << ": " << results[i].second << std::endl;
+                                buffer << "\tO-Glycosylation: Value of experimental mean electron density in detected consensus sequence for" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].id() <<
+                                "-" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].type()
+                                << " monomer in Chain " << modelRemovedWaters[results[i].first.chainID].id() << ": " << results[i].second << blobCatalogue.describe(siteHits[type][i].blobID) << std::endl;
 
                                 std::tuple <clipper::String, clipper::MMonomer, double> blobInfo(modelRemovedWaters[results[i].first.chainID].id(), modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID], results[i].second);
                                 O_SiteBlobs.push_back(blobInfo);                            
@@ -1417,9 +1438,9 @@ int main(int argc, char** argv)
                         std::vector< std::tuple <clipper::String, clipper::MMonomer, double> > S_SiteBlobs;
                             for (int i = 0; i < results.size(); i++)
                             {
-                                buffer << "\tS-Glycosylation: Value of experimental mean electron density in detected consensus sequence for" << mmol[results[i].first.chainID][results[i].first.monomerID].id() <<
-                                "-" << mmol[results[i].first.chainID][results[i].first.monomerID].type()
-                                << " monomer in Chain " << mmol[results[i].first.chainID].id() << ": " << results[i].second << std::endl;
+                                buffer << "\tS-Glycosylation: Value of experimental mean electron density in detected consensus sequence for" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].id() <<
+                                "-" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].type()
+                                << " monomer in Chain " << modelRemovedWaters[results[i].first.chainID].id() << ": " << results[i].second << blobCatalogue.describe(siteHits[type][i].blobID) << std::endl;
 
                                 std::tuple <clipper::String, clipper::MMonomer, double> blobInfo(modelRemovedWaters[results[i].first.chainID].id(), modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID], results[i].second);
                                 S_SiteBlobs.push_back(blobInfo);                          
@@ -1433,9 +1454,9 @@ int main(int argc, char** argv)
                         std::vector< std::tuple <clipper::String, clipper::MMonomer, double> > NRem_SiteBlobs;
                             for (int i = 0; i < results.size(); i++)
                             {
-                                buffer << "\tPossibly processed by PNGase F: Value of experimental mean electron density in detected consensus sequence for" << mmol[results[i].first.chainID][results[i].first.monomerID].id() <<
-                                "-" << mmol[results[i].first.chainID][results[i].first.monomerID].type()
-                                << " monomer in Chain " << mmol[results[i].first.chainID].id() << ": " << results[i].second << std::endl;
+                                buffer << "\tPossibly processed by PNGase F: Value of experimental mean electron density in detected consensus sequence for" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].id() <<
+                                "-" << modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID].type()
+                                << " monomer in Chain " << modelRemovedWaters[results[i].first.chainID].id() << ": " << results[i].second << blobCatalogue.describe(siteHits[type][i].blobID) << std::endl;
 
                                 std::tuple <clipper::String, clipper::MMonomer, double> blobInfo(modelRemovedWaters[results[i].first.chainID].id(), modelRemovedWaters[results[i].first.chainID][results[i].first.monomerID], results[i].second);
                                 NRem_SiteBlobs.push_back(blobInfo);                            
@@ -1448,37 +1469,40 @@ int main(int argc, char** argv)
 
                 if (!buffer.str().empty())
                 {
-                    std::cout << "Detected possibly unmodelled Glycosylation sites on these protein backbones:" << std::endl;
-                    std::cout << buffer.str() << std::endl;
+                    table_out << "Detected possibly unmodelled Glycosylation sites on these protein backbones:" << std::endl;
+                    table_out << buffer.str() << std::endl;
                 }
                 else
                 {
-                    std::cout << "\tPossibly unmodelled Glycosylation was not detected in this model." << std::endl;
+                    table_out << "\tPossibly unmodelled Glycosylation was not detected in this model." << std::endl;
                 }
             }
 
             std::cout << "Finished scanning waterless difference map for unmodelled glycosylation sites on protein backbone..." << std::endl;
             
 
-            if(!list_of_glycans.empty())
+            if(no_errors && !list_of_glycans.empty())
             {
             int type = 5;
             std::vector< std::tuple <clipper::String, clipper::MMonomer, double> > MIA_CarbsBlobs;
             std::stringstream buffer;
             std::cout << std::endl << "Scanning for unmodelled glycan monomers at modelled glycan chains. " << std::endl;
+            carbohydrateHits = score_potential_unmodelled_carbohydrate_monomers(list_of_glycans, modelRemovedWaters, sigmaa_dif_map, densityTable, hklinfo, ms, sphereThreshold, probe_density_threshold(ms, useMRC), &blobCatalogue);
+            for (int id = 0; id < carbohydrateHits.size(); id++ )
+                for (int i = 0; i < carbohydrateHits[id].size(); i++ )
+                    carbohydrateHits[id][i].blobID = blobCatalogue.blob_at(carbohydrateHits[id][i].target);
             for (int id = 0; id < list_of_glycans.size(); id++ )
                 {
                     std::vector<std::pair<GlycanToMiniMolIDs, double> > densityInfo;
-                    std::vector < clipper::MSugar > glycanChain;
-                    glycanChain = list_of_glycans[id].get_sugars();
-                    densityInfo = get_electron_density_of_potential_unmodelled_carbohydrate_monomers(glycanChain, modelRemovedWaters, list_of_glycans, id, sigmaa_dif_map, hklinfo, ms, thresholdElectronDensityValue, check_unmodelled);
+                    std::vector < clipper::MSugar >& glycanChain = list_of_glycans[id].get_sugars();
+                    densityInfo = apply_carbohydrate_blob_hits(carbohydrateHits[id], modelRemovedWaters, check_unmodelled);
                     if (!densityInfo.empty())
                     {
                         for(int i = 0; i < densityInfo.size(); i++)
                         {
                             int sugarID = densityInfo[i].first.carbohydrateID;
                             double meanElectronDensity = densityInfo[i].second;
-                            buffer << "\tPossibly unmodelled carbohydrate in Chain " << list_of_glycans[id].get_chain()[0] << " of " << glycanChain[sugarID].id() << "-" << glycanChain[sugarID].type() << " - mean ED Value: " << meanElectronDensity << std::endl;
+                            buffer << "\tPossibly unmodelled carbohydrate in Chain " << list_of_glycans[id].get_chain()[0] << " of " << glycanChain[sugarID].id() << "-" << glycanChain[sugarID].type() << " - mean ED Value: " << meanElectronDensity << blobCatalogue.describe(carbohydrateHits[id][i].blobID) << std::endl;
                             std::tuple <clipper::String, clipper::MMonomer, double> blobInfo(modelRemovedWaters[densityInfo[i].first.proteinMiniMolID].id(), modelRemovedWaters[densityInfo[i].first.proteinMiniMolID][densityInfo[i].first.carbohydrateChainMiniMolID], meanElectronDensity);
                             MIA_CarbsBlobs.push_back(blobInfo);
                         }
@@ -1489,12 +1513,12 @@ int main(int argc, char** argv)
 
             if (!buffer.str().empty())
                 {
-                    std::cout << std::endl << "Detected possibly unmodelled Carbohydrate monomers in these Glycans:" << std::endl;
-                    std::cout << std::endl << buffer.str() << std::endl;
+                    table_out << std::endl << "Detected possibly unmodelled Carbohydrate monomers in these Glycans:" << std::endl;
+                    table_out << std::endl << buffer.str() << std::endl;
                 }
                 else
                 {
-                    std::cout << std::endl << "\tPossibly unmodelled Carbohydrate monomers were not detected in this model." << std::endl;
+                    table_out << std::endl << "\tPossibly unmodelled Carbohydrate monomers were not detected in this model." << std::endl;
                 }    
             }
 
@@ -1512,16 +1536,34 @@ int main(int argc, char** argv)
                     }
                 }
                  
-                clipper::MMDBfile pdbfile;
-                pdbfile.export_minimol( modelRemovedWaters );
-                pdbfile.write_file( "input_model_nowater.pdb" );
+                if ( sinks.wants ( privateer::util::maps_sink ) )
+                {
+                    clipper::MMDBfile pdbfile;
+                    pdbfile.export_minimol( modelRemovedWaters );
+                    pdbfile.write_file( "input_model_nowater.pdb" );
 
-                clipper::CCP4MAPfile sigmaa_dif_nowater;
-                sigmaa_dif_nowater.open_write( "sigmaa_diff_nowater.map" );
-                sigmaa_dif_nowater.export_xmap( sigmaa_dif_map );
-                sigmaa_dif_nowater.close_write();
+                    clipper::CCP4MAPfile sigmaa_dif_nowater;
+                    sigmaa_dif_nowater.open_write( "sigmaa_diff_nowater.map" );
+                    sigmaa_dif_nowater.export_xmap( sigmaa_dif_map );
+                    sigmaa_dif_nowater.close_write();
 
-                std::cout << "Finished outputting sigmaa_diff_nowater.map!" << std::endl;
+                    std::cout << "Finished outputting sigmaa_diff_nowater.map!" << std::endl;
+                }
+
+                if ( sinks.wants ( privateer::util::json_sink ) )
+                {
+                    if ( !wholeMap )
+                        std::cout << "blobs_catalogue.json was not written, the map is too large to catalogue its blobs" << std::endl;
+                    else if ( blobCatalogue.write_json( "blobs_catalogue.json" ) )
+                        std::cout << "Error: could not write blobs_catalogue.json" << std::endl;
+                    else
+                        std::cout << "Finished outputting blobs_catalogue.json with " << blobCatalogue.blobs().size() << " difference map blobs above 3 sigma" << std::endl;
+
+                    if ( write_blob_report( "blobs_report.jsonl", modelRemovedWaters, siteHits, carbohydrateHits, ms, sphereThreshold, blobCatalogue ) )
+                        std::cout << "Error: could not write blobs_report.jsonl" << std::endl;
+                    else
+                        std::cout << "Finished outputting blobs_report.jsonl" << std::endl;
+                }
             }
     }
 
@@ -1694,9 +1736,11 @@ int main(int argc, char** argv)
     #pragma omp parallel sections
         {
     #pragma omp section
-            cryo_em_dif_map_all.fft_from( difference_coefficients );
+            if ( sinks.wants ( privateer::util::maps_sink ) ) // both only ever written out
+                cryo_em_dif_map_all.fft_from( difference_coefficients );
     #pragma omp section
-            modelmap.fft_from( fc_all_cryoem_data ); 
+            if ( sinks.wants ( privateer::util::maps_sink ) )
+                modelmap.fft_from( fc_all_cryoem_data ); 
     #pragma omp section
             ligandmap.fft_from( fc_ligands_only_cryoem_data );       // this is the map that will serve as Fc map for the RSCC calculation
         }
@@ -1705,7 +1749,9 @@ int main(int argc, char** argv)
             std::cout << "done." << std::endl;
 
 
-        if (!batch)
+        const bool write_maps = !batch && sinks.wants ( privateer::util::maps_sink );
+
+        if ( write_maps )
         {
             std::cout << "\nWriting maps to disk... ";
             fflush(0);
@@ -1716,7 +1762,7 @@ int main(int argc, char** argv)
         if (allSugars)
             input_ccd_code = "all";
 
-        if (!batch)
+        if ( write_maps )
         {
     #pragma omp parallel sections
             {
@@ -1735,21 +1781,25 @@ int main(int argc, char** argv)
             }
 
             std::cout << "done." << std::endl;
-            std::cout << "\n\nDetailed validation data" << std::endl;
-            std::cout << "------------------------" << std::endl;
+        }
+
+        if (!batch)
+        {
+            table_out << "\n\nDetailed validation data" << std::endl;
+            table_out << "------------------------" << std::endl;
         }
         
 
         if (!batch)
-            printf("\nPDB \t    Sugar   \tRsln\t  Q  \t Phi  \tTheta \tRSCC\t   Detected type   \tCnf\t<Fo>\t<Bfac>\tCtx\t Ok?");
+            table_printf("\nPDB \t    Sugar   \tRsln\t  Q  \t Phi  \tTheta \tRSCC\t   Detected type   \tCnf\t<Fo>\t<Bfac>\tCtx\t Ok?");
         if (!batch && showGeom)
-            printf("\tBond lengths, angles and torsions, reported clockwise with in-ring oxygen as first vertex");
+            table_printf("\tBond lengths, angles and torsions, reported clockwise with in-ring oxygen as first vertex");
         if (!batch)
-            printf("\n----\t------------\t----\t-----\t------\t------\t----\t-------------------\t---\t-----\t------\t---\t-----");
+            table_printf("\n----\t------------\t----\t-----\t------\t------\t----\t-------------------\t---\t-----\t------\t---\t-----");
         if (!batch && showGeom)
-            printf("\t------------------------------------------------------------------------------------------------------------");
+            table_printf("\t------------------------------------------------------------------------------------------------------------");
         if (!batch)
-            printf("\n");
+            table_printf("\n");
 
         for (int index = 0; index < ligandList.size(); index++)
         {
@@ -1779,8 +1829,8 @@ int main(int argc, char** argv)
             }
             else
             {
-                printf("%c%c%c%c\t%s-",input_model[1+pos_slash],input_model[2+pos_slash],input_model[3+pos_slash],input_model[4+pos_slash], ligandList[index].second.type().c_str());
-                std::cout << ligandList[index].first << "-" << ligandList[index].second.id().trim() << "  ";
+                table_printf("%c%c%c%c\t%s-",input_model[1+pos_slash],input_model[2+pos_slash],input_model[3+pos_slash],input_model[4+pos_slash], ligandList[index].second.type().c_str());
+                table_out << ligandList[index].first << "-" << ligandList[index].second.id().trim() << "  ";
             }
 
             // now calculate the correlation between the weighted experimental & calculated maps
@@ -1940,12 +1990,12 @@ int main(int argc, char** argv)
             {
                 std::vector<clipper::ftype> cpParams(10, 0);
                 cpParams = ligandList[index].second.cremer_pople_params();
-                printf("\t%1.2f\t%1.3f\t%3.2f\t",hklinfo.resolution().limit(),cpParams[0],cpParams[1]);             // output cremer-pople parameters
-                if ( cpParams[2] == -1 ) printf ( " --  \t" ); else printf ( "%3.2f\t", cpParams[2] );
-                printf("%1.2f\t", corr_coeff);                                                                                              // output RSCC and data resolution
-                printf("%s\t", ligandList[index].second.type_of_sugar().c_str());                   // output the type of sugar, e.g. alpha-D-aldopyranose
-                printf("%s\t", ligandList[index].second.conformation_name().c_str());               // output a 3 letter code for the conformation
-                printf("%1.3f \t", accum);                                                                                                  // output <mFo>
+                table_printf("\t%1.2f\t%1.3f\t%3.2f\t",hklinfo.resolution().limit(),cpParams[0],cpParams[1]);             // output cremer-pople parameters
+                if ( cpParams[2] == -1 ) table_printf ( " --  \t" ); else table_printf ( "%3.2f\t", cpParams[2] );
+                table_printf("%1.2f\t", corr_coeff);                                                                                              // output RSCC and data resolution
+                table_printf("%s\t", ligandList[index].second.type_of_sugar().c_str());                   // output the type of sugar, e.g. alpha-D-aldopyranose
+                table_printf("%s\t", ligandList[index].second.conformation_name().c_str());               // output a 3 letter code for the conformation
+                table_printf("%1.3f \t", accum);                                                                                                  // output <mFo>
                 ligandList[index].second.set_rscc ( corr_coeff );
 
                 float bfac = 0.0;
@@ -1956,7 +2006,7 @@ int main(int argc, char** argv)
                 bfac /= ligandList[index].second.size();
                 bfac  = clipper::Util::u2b(bfac);
 
-                printf ( "%3.2f", bfac );                 // output <Bfactor>
+                table_printf ( "%3.2f", bfac );                 // output <Bfactor>
 
                 std::vector < clipper::MGlycan > list_of_glycans = mgl.get_list_of_glycans();
                 bool found_in_tree = false;
@@ -1972,22 +2022,22 @@ int main(int argc, char** argv)
                             if ( list_of_glycans[i].get_type() == "n-glycan" )
                             {
                                 ligandList[index].second.set_context ( "n-glycan" );
-                                std::cout << "\t(n) ";
+                                table_out << "\t(n) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "c-glycan" )
                             {
                                 ligandList[index].second.set_context ( "c-glycan" );
-                                std::cout << "\t(c) ";
+                                table_out << "\t(c) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "o-glycan" )
                             {
                                 ligandList[index].second.set_context ( "o-glycan" );
-                                std::cout << "\t(o) ";
+                                table_out << "\t(o) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "s-glycan" )
                             {
                                 ligandList[index].second.set_context ( "s-glycan" );
-                                std::cout << "\t(s) ";
+                                table_out << "\t(s) ";
                             }
                             found_in_tree = true;
                             break;
@@ -1999,7 +2049,7 @@ int main(int argc, char** argv)
                 if ( !found_in_tree )
                 {
                     ligandList[index].second.set_context ( "ligand" );
-                    std::cout << "\t(l) ";
+                    table_out << "\t(l) ";
                 }
 
                 if (ligandList[index].second.in_database(ligandList[index].second.type().trim()))
@@ -2009,20 +2059,20 @@ int main(int argc, char** argv)
                         if (ligandList[index].second.is_sane())
                         {
                             if ( ! ligandList[index].second.ok_with_conformation () )
-                                printf("\tcheck");
+                                table_printf("\tcheck");
                             else
-                                printf("\tyes");
+                                table_printf("\tyes");
                         }
                         else
-                            printf ("\tno");
+                            table_printf ("\tno");
                     }
                     else
                         if (ligandList[index].second.is_sane())
-                            printf("\tyes");
-                        else printf("\tno");
+                            table_printf("\tyes");
+                        else table_printf("\tno");
                 }
                 else
-                    printf("\tunk");
+                    table_printf("\tunk");
 
                 if ( ! ligandList[index].second.ok_with_conformation () )
                     enable_torsions_for.push_back (ligandList[index].second.type().trim());
@@ -2042,19 +2092,19 @@ int main(int argc, char** argv)
                     std::vector<clipper::ftype> rtorsions = ligandList[index].second.ring_torsions();
 
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%1.2f", rbonds[i]);
+                        table_printf("\t%1.2f", rbonds[i]);
 
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%3.1f", rangles[i]);
+                        table_printf("\t%3.1f", rangles[i]);
 
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%3.1f", rtorsions[i]);
+                        table_printf("\t%3.1f", rtorsions[i]);
                 }
 
                 if (occupancy_check)
-                    std::cout << " (*)";
+                    table_out << " (*)";
 
-                std::cout << std::endl;
+                table_out << std::endl;
             }
         }      
     }
@@ -2065,30 +2115,13 @@ int main(int argc, char** argv)
     {
         if (!batch) std::cout << "Done analyzing modelled carbohydrates.\nCalculating structure factors with bulk solvent correction... "; fflush(0);
 
-        clipper::SFcalc_obs_bulk<float> sfcbligands;
-        clipper::SFcalc_obs_bulk<float> sfcb;
-        clipper::SFcalc_obs_bulk<float> sfcball;
+        clipper::HKL_data<F_phi> fb_all( hklinfo ); // 2mFo-DFc coefficients of the whole model
+        clipper::HKL_data<F_phi> fd_all( hklinfo ); // mFo-DFc coefficients of the whole model
+        clipper::HKL_data<F_phi> fd_omit( hklinfo ); // mFo-DFc coefficients of the model without the sugars
+        double r_all, r_omit;
 
-        try
-        {   // calculate structure factors with bulk solvent correction
-    #pragma omp parallel sections
-            {
-    #pragma omp section
-                sfcbligands( fc_ligands_bsc, fobs, ligandAtoms ); // was fobs_scaled
-    #pragma omp section
-                sfcb( fc_omit_bsc, fobs, mainAtoms );  // calculation of omit SF with bulk solvent correction
-    #pragma omp section
-                sfcball( fc_all_bsc, fobs, allAtoms ); // calculation of SF with bulk solvent correction
-            }
-        }
-        catch ( ... )
-        {
+        if ( privateer::xray::calculate_sigmaa_coefficients ( fobs, fobs_scaled, mainAtoms, ligandAtoms, allAtoms, fc_ligands_bsc, fb_all, fd_all, fd_omit, n_refln, n_param, r_all, r_omit ) )
             if (!batch) std::cout << "\nThe input file has unrecognised atoms. Might cause unexpected results...\n";  // this causes clipper to freak out, so better remove those unknowns
-        }
-
-        fc_ligands_bsc[0].set_null();
-        fc_omit_bsc[0].set_null();
-        fc_all_bsc[0].set_null();
 
         if (!batch)
         {
@@ -2102,101 +2135,23 @@ int main(int argc, char** argv)
         clipper::Xmap<float> sigmaa_omit_fd( hklinfo.spacegroup(), hklinfo.cell(), mygrid );          // define sigmaa omit diff map
         clipper::Xmap<float> ligandmap( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
 
-        // scale data and flag R-free
-
-        HRI ih;
-        clipper::HKL_data<Flag> flag( hklinfo );     // same flag for both calculations, omit absent reflections
-        clipper::SFscale_aniso<float> sfscale;
-
-    #pragma omp parallel sections
-        {
-    #pragma omp section
-            {
-                sfscale( fobs_scaled, fc_all_bsc );  // anisotropic scaling of Fobs. We scale Fobs to Fcalc instead of scaling our 3 Fcalcs to Fobs
-            }
-    #pragma omp section
-            {
-                for ( ih = flag.first(); !ih.last(); ih.next() ) // we want to use all available reflections
-                {
-                    if ( !fobs_scaled[ih].missing() ) flag[ih].flag() = clipper::SFweight_spline<float>::BOTH;
-                    else flag[ih].flag() = clipper::SFweight_spline<float>::NONE;
-                }
-            }
-        }
-
-        double FobsFcalcSum = 0.0;
-        double FobsFcalcAllSum = 0.0;
-        double FobsSum = 0.0;
-
-        clipper::HKL_data<F_phi> fb_omit( hklinfo ); // new variables for omit sigmaa weighting calculation
-        clipper::HKL_data<F_phi> fd_omit( hklinfo );
-        clipper::HKL_data<Phi_fom> phiw_omit( hklinfo );
-        clipper::HKL_data<F_phi> fb_all( hklinfo ); // variables for all atom sigmaa weighting calculation
-        clipper::HKL_data<F_phi> fd_all( hklinfo );
-        clipper::HKL_data<Phi_fom> phiw_all( hklinfo );
-
-        // now do sigmaa calc
-    #pragma omp parallel sections
-        {
-    #pragma omp section
-            {
-                clipper::SFweight_spline<float> sfw_omit (n_refln, n_param );
-                sfw_omit( fb_omit, fd_omit, phiw_omit, fobs_scaled, fc_omit_bsc, flag ); // sigmaa omit
-            }
-
-    #pragma omp section
-            {
-                clipper::SFweight_spline<float> sfw_all( n_refln, n_param );
-                sfw_all( fb_all,  fd_all,  phiw_all,  fobs_scaled, fc_all_bsc,  flag ); // sigmaa all atoms
-            }
-        }
-
-        // fb:          output best map coefficients
-        // fd:          output difference map coefficients
-        // phiw:        output phase and fom
-        // fobs_scaled: input observed structure factors, previously scaled
-        // fc_omit_bsc: input calculated omit data, with bulk solvent correction
-        // fc_all_bsc:  input calculated data, with bsc
-
-        std::vector<double> params( n_param, 2.0 );
-        clipper::BasisFn_spline wrk_basis( hklinfo, n_param, 2.0 );
-
-        clipper::TargetFn_scaleF1F2<F_phi,F_sigF> wrk_target_omit( fc_omit_bsc, fobs_scaled ); // was just fobs
-        clipper::TargetFn_scaleF1F2<F_phi,F_sigF> wrk_target_all ( fc_all_bsc, fobs_scaled );
-        clipper::ResolutionFn wrk_scale_omit( hklinfo, wrk_basis, wrk_target_omit, params );
-        clipper::ResolutionFn wrk_scale_all ( hklinfo, wrk_basis, wrk_target_all,  params );
-
-        double Fo, Fc_all, Fc_omit;
-
     #pragma omp parallel sections
         {
     #pragma omp section
             sigmaa_all_map.fft_from( fb_all );  // calculate the maps
     #pragma omp section
-            sigmaa_dif_map.fft_from( fd_all );
+            if ( sinks.wants ( privateer::util::maps_sink ) ) // only ever written out
+                sigmaa_dif_map.fft_from( fd_all );
     #pragma omp section
             sigmaa_omit_fd.fft_from( fd_omit );
     #pragma omp section
             ligandmap.fft_from( fc_ligands_bsc );       // this is the map that will serve as Fc map for the RSCC calculation
-    #pragma omp section
-            for ( HRI ih = fobs_scaled.first(); !ih.last(); ih.next() )
-            {
-                if ( !fobs_scaled[ih].missing() )
-                {
-                    Fo = fobs_scaled[ih].f();
-                    Fc_all = sqrt ( wrk_scale_all.f(ih) ) * fc_all_bsc[ih].f() ;
-                    Fc_omit = sqrt ( wrk_scale_omit.f(ih) ) * fc_omit_bsc[ih].f() ;
-                    FobsFcalcSum += fabs( Fo - Fc_omit); // R factor calculation
-                    FobsFcalcAllSum += fabs( Fo- Fc_all);
-                    FobsSum += Fo;
-                }
-            }
         }
 
         if (!batch)
             std::cout << "done." << std::endl;
 
-        if ( output_mtz )
+        if ( output_mtz && sinks.wants ( privateer::util::mtz_sink ) )
         {
             if (!batch)
             {
@@ -2220,7 +2175,7 @@ int main(int argc, char** argv)
                     std::cout << "skipped. You must supply an input MTZ from which columns can be read and transferred to the output MTZ." << std::endl << std::endl;
         }
 
-        if (batch) // create miniMTZ files for ccp4i2
+        if ( batch && sinks.wants ( privateer::util::mtz_sink ) ) // create miniMTZ files for ccp4i2
         {
             std::cout << opxtal.crystal_name() << " " << opxtal.project_name() << " " << opdset.dataset_name() << " " << opdset.wavelength() << std::endl;
             clipper::String path = "/" + opxtal.crystal_name() + "/" + opdset.dataset_name() + "/[F,PHI]";
@@ -2243,15 +2198,15 @@ int main(int argc, char** argv)
 
 
         if (!batch)
-            printf("\n R-all = %1.3f  R-omit = %1.3f\n", (FobsFcalcAllSum / FobsSum), (FobsFcalcSum / FobsSum));
+            printf("\n R-all = %1.3f  R-omit = %1.3f\n", r_all, r_omit);
 
         if (!batch)
-            if (((FobsFcalcAllSum / FobsSum)*10) > hklinfo.resolution().limit() + 0.6)
+            if ((r_all*10) > hklinfo.resolution().limit() + 0.6)
                 std::cout << " Warning: R-work is unusually high. Please ensure that your PDB file contains full B-factors instead of residuals after TLS refinement!" << std::endl;
 
-        float difference = (FobsFcalcSum / FobsSum) - (FobsFcalcAllSum / FobsSum);
+        float difference = r_omit - r_all;
 
-        if (( difference > 0.15 ) || (clipper::Util::is_nan((FobsFcalcSum / FobsSum))))
+        if (( difference > 0.15 ) || (clipper::Util::is_nan(r_omit)))
         {
             useSigmaa = true;
 
@@ -2259,7 +2214,9 @@ int main(int argc, char** argv)
                 std::cout << std::endl << " The studied portions of the model account for a very significant part of the data. Calculating RSCC against a regular 2mFo-DFc map" << std::endl;
         }
 
-        if (!batch)
+        const bool write_maps = !batch && sinks.wants ( privateer::util::maps_sink );
+
+        if ( write_maps )
         {
             std::cout << "\nWriting maps to disk... ";
             fflush(0);
@@ -2279,7 +2236,7 @@ int main(int argc, char** argv)
         else
             ms = clipper::Map_stats(sigmaa_omit_fd);
 
-        if (!batch)
+        if ( write_maps )
         {
     #pragma omp parallel sections
             {
@@ -2304,21 +2261,25 @@ int main(int argc, char** argv)
             }
 
             std::cout << "done." << std::endl;
-            std::cout << "\n\nDetailed validation data" << std::endl;
-            std::cout << "------------------------" << std::endl;
+        }
+
+        if (!batch)
+        {
+            table_out << "\n\nDetailed validation data" << std::endl;
+            table_out << "------------------------" << std::endl;
         }
         
 
         if (!batch)
-            printf("\nPDB \t    Sugar   \tRsln\t  Q  \t Phi  \tTheta \tRSCC\t   Detected type   \tCnf\t<mFo>\t<Bfac>\tCtx\t Ok?");
+            table_printf("\nPDB \t    Sugar   \tRsln\t  Q  \t Phi  \tTheta \tRSCC\t   Detected type   \tCnf\t<mFo>\t<Bfac>\tCtx\t Ok?");
         if (!batch && showGeom)
-            printf("\tBond lengths, angles and torsions, reported clockwise with in-ring oxygen as first vertex");
+            table_printf("\tBond lengths, angles and torsions, reported clockwise with in-ring oxygen as first vertex");
         if (!batch)
-            printf("\n----\t------------\t----\t-----\t------\t------\t----\t-------------------\t---\t-----\t------\t---\t-----");
+            table_printf("\n----\t------------\t----\t-----\t------\t------\t----\t-------------------\t---\t-----\t------\t---\t-----");
         if (!batch && showGeom)
-            printf("\t------------------------------------------------------------------------------------------------------------");
+            table_printf("\t------------------------------------------------------------------------------------------------------------");
         if (!batch)
-            printf("\n");
+            table_printf("\n");
 
         for (int index = 0; index < ligandList.size(); index++)
         {
@@ -2348,19 +2309,14 @@ int main(int argc, char** argv)
             }
             else
             {
-                printf("%c%c%c%c\t%s-",input_model[1+pos_slash],input_model[2+pos_slash],input_model[3+pos_slash],input_model[4+pos_slash], ligandList[index].second.type().c_str());
-                std::cout << ligandList[index].first << "-" << ligandList[index].second.id().trim() << "  ";
+                table_printf("%c%c%c%c\t%s-",input_model[1+pos_slash],input_model[2+pos_slash],input_model[3+pos_slash],input_model[4+pos_slash], ligandList[index].second.type().c_str());
+                table_out << ligandList[index].first << "-" << ligandList[index].second.id().trim() << "  ";
             }
 
             // now calculate the correlation between the weighted experimental & calculated maps
             // maps are scanned only inside a sphere containing the sugar for performance reasons,
             // although RSCC and <RMS> are restricted to a mask surrounding the model
 
-            double meanDensityExp, meanDensityCalc, num, den1, den2, corr_coeff;
-            meanDensityCalc = meanDensityExp = num = den1 = den2 = corr_coeff = 0.0;
-
-            int n_points = 0;
-
             //////// mask calculation //////////
 
             clipper::Xmap<float> mask( hklinfo.spacegroup(), hklinfo.cell(), mygrid );
@@ -2373,71 +2329,10 @@ int main(int argc, char** argv)
             clipper::Coord_orth origin(minX-2,minY-2,minZ-2);
             clipper::Coord_orth destination(maxX+2,maxY+2,maxZ+2);
 
-            clipper::Xmap_base::Map_reference_coord i0, iu, iv, iw;
-
-            double accum = 0.0;
-
-            // calculation of the mean densities of the calc (ligandmap) and weighted obs (sigmaamap) maps
-
-            std::vector<clipper::Xmap_base::Map_reference_coord> buffer_coord;
-
-            if (useSigmaa)
-                i0 = clipper::Xmap_base::Map_reference_coord( sigmaa_all_map, origin.coord_frac(hklinfo.cell()).coord_grid(mygrid) );
-            else
-                i0 = clipper::Xmap_base::Map_reference_coord( sigmaa_omit_fd, origin.coord_frac(hklinfo.cell()).coord_grid(mygrid) );
-
-            for ( iu = i0; iu.coord().u() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).u(); iu.next_u() )
-                for ( iv = iu; iv.coord().v() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).v(); iv.next_v() )
-                    for ( iw = iv; iw.coord().w() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).w(); iw.next_w() )
-                    {
-                        if ( mask[iw] == 1.0)
-                        {
-                            meanDensityCalc = meanDensityCalc + ligandmap[iw];
-
-                            if (useSigmaa)
-                                meanDensityExp = meanDensityExp + sigmaa_all_map[iw];
-                            else
-                                meanDensityExp = meanDensityExp + sigmaa_omit_fd[iw];
-
-                            n_points++;
-                        }
-                    }
-
-            accum = meanDensityExp / ms.std_dev();
-            accum /= n_points;
-
-            meanDensityCalc = meanDensityCalc / n_points;
-            meanDensityExp = meanDensityExp / n_points;
-
-            // calculation of the correlation coefficient between calc (ligandmap) and weighted obs (sigmaamap) maps
-
-            if (useSigmaa)
-                i0 = clipper::Xmap_base::Map_reference_coord( sigmaa_all_map, origin.coord_frac(hklinfo.cell()).coord_grid(mygrid) );
-            else
-                i0 = clipper::Xmap_base::Map_reference_coord( sigmaa_omit_fd, origin.coord_frac(hklinfo.cell()).coord_grid(mygrid) );
-
-            for ( iu = i0; iu.coord().u() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).u(); iu.next_u() )
-                for ( iv = iu; iv.coord().v() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).v(); iv.next_v() )
-                    for ( iw = iv; iw.coord().w() <= destination.coord_frac(hklinfo.cell()).coord_grid(mygrid).w(); iw.next_w() )
-                    {
-                        if ( mask[iw] == 1.0)
-                        {
-                            if (useSigmaa)
-                            {
-                                num = num + (sigmaa_all_map[iw] - meanDensityExp) * (ligandmap[iw] - meanDensityCalc);
-                                den1 = den1 + pow((sigmaa_all_map[iw] - meanDensityExp),2);
-                                den2 = den2 + pow((ligandmap[iw] - meanDensityCalc),2);
-                            }
-                            else
-                            {
-                                num = num + (sigmaa_omit_fd[iw] - meanDensityExp) * (ligandmap[iw] - meanDensityCalc);
-                                den1 = den1 + pow((sigmaa_omit_fd[iw] - meanDensityExp),2);
-                                den2 = den2 + pow((ligandmap[iw] - meanDensityCalc),2);
-                            }
-                        }
-                    }
+            const std::pair<double, double> rscc_and_accum = privateer::xray::calculate_rscc ( useSigmaa ? sigmaa_all_map : sigmaa_omit_fd, ligandmap, mask, ms, hklinfo, mygrid, origin, destination );
 
-            corr_coeff = num / (sqrt(den1) * sqrt(den2));
+            const double corr_coeff = rscc_and_accum.first;
+            const double accum = rscc_and_accum.second;
             
 
             ///////////// here we deal with the sugar /////////////
@@ -2565,12 +2460,12 @@ int main(int argc, char** argv)
             {
                 std::vector<clipper::ftype> cpParams(10, 0);
                 cpParams = ligandList[index].second.cremer_pople_params();
-                printf("\t%1.2f\t%1.3f\t%3.2f\t",hklinfo.resolution().limit(),cpParams[0],cpParams[1]);             // output cremer-pople parameters
-                if ( cpParams[2] == -1 ) printf ( " --  \t" ); else printf ( "%3.2f\t", cpParams[2] );
-                printf("%1.2f\t", corr_coeff);                                                                                              // output RSCC and data resolution
-                printf("%s\t", ligandList[index].second.type_of_sugar().c_str());                   // output the type of sugar, e.g. alpha-D-aldopyranose
-                printf("%s\t", ligandList[index].second.conformation_name().c_str());               // output a 3 letter code for the conformation
-                printf("%1.3f \t", accum);                                                                                                  // output <mFo>
+                table_printf("\t%1.2f\t%1.3f\t%3.2f\t",hklinfo.resolution().limit(),cpParams[0],cpParams[1]);             // output cremer-pople parameters
+                if ( cpParams[2] == -1 ) table_printf ( " --  \t" ); else table_printf ( "%3.2f\t", cpParams[2] );
+                table_printf("%1.2f\t", corr_coeff);                                                                                              // output RSCC and data resolution
+                table_printf("%s\t", ligandList[index].second.type_of_sugar().c_str());                   // output the type of sugar, e.g. alpha-D-aldopyranose
+                table_printf("%s\t", ligandList[index].second.conformation_name().c_str());               // output a 3 letter code for the conformation
+                table_printf("%1.3f \t", accum);                                                                                                  // output <mFo>
                 ligandList[index].second.set_rscc ( corr_coeff );
 
                 float bfac = 0.0;
@@ -2581,7 +2476,7 @@ int main(int argc, char** argv)
                 bfac /= ligandList[index].second.size();
                 bfac  = clipper::Util::u2b(bfac);
 
-                printf ( "%3.2f", bfac );                 // output <Bfactor>
+                table_printf ( "%3.2f", bfac );                 // output <Bfactor>
 
                 std::vector < clipper::MGlycan > list_of_glycans = mgl.get_list_of_glycans();
                 bool found_in_tree = false;
@@ -2597,22 +2492,22 @@ int main(int argc, char** argv)
                             if ( list_of_glycans[i].get_type() == "n-glycan" )
                             {
                                 ligandList[index].second.set_context ( "n-glycan" );
-                                std::cout << "\t(n) ";
+                                table_out << "\t(n) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "c-glycan" )
                             {
                                 ligandList[index].second.set_context ( "c-glycan" );
-                                std::cout << "\t(c) ";
+                                table_out << "\t(c) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "o-glycan" )
                             {
                                 ligandList[index].second.set_context ( "o-glycan" );
-                                std::cout << "\t(o) ";
+                                table_out << "\t(o) ";
                             }
                             else if ( list_of_glycans[i].get_type() == "s-glycan" )
                             {
                                 ligandList[index].second.set_context ( "s-glycan" );
-                                std::cout << "\t(s) ";
+                                table_out << "\t(s) ";
                             }
                             found_in_tree = true;
                             break;
@@ -2624,7 +2519,7 @@ int main(int argc, char** argv)
                 if ( !found_in_tree )
                 {
                     ligandList[index].second.set_context ( "ligand" );
-                    std::cout << "\t(l) ";
+                    table_out << "\t(l) ";
                 }
 
                 if (ligandList[index].second.in_database(ligandList[index].second.type().trim()))
@@ -2634,20 +2529,20 @@ int main(int argc, char** argv)
                         if (ligandList[index].second.is_sane())
                         {
                             if ( ! ligandList[index].second.ok_with_conformation () )
-                                printf("\tcheck");
+                                table_printf("\tcheck");
                             else
-                                printf("\tyes");
+                                table_printf("\tyes");
                         }
                         else
-                            printf ("\tno");
+                            table_printf ("\tno");
                     }
                     else
                         if (ligandList[index].second.is_sane())
-                            printf("\tyes");
-                        else printf("\tno");
+                            table_printf("\tyes");
+                        else table_printf("\tno");
                 }
                 else
-                    printf("\tunk");
+                    table_printf("\tunk");
 
                 if ( ! ligandList[index].second.ok_with_conformation () )
                     enable_torsions_for.push_back (ligandList[index].second.type().trim());
@@ -2667,47 +2562,41 @@ int main(int argc, char** argv)
                     std::vector<clipper::ftype> rtorsions = ligandList[index].second.ring_torsions();
 
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%1.2f", rbonds[i]);
+                        table_printf("\t%1.2f", rbonds[i]);
 
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%3.1f", rangles[i]);
+                        table_printf("\t%3.1f", rangles[i]);
 
                     for (int i = 0 ; i < ligandList[index].second.ring_members().size(); i++ )
-                        printf("\t%3.1f", rtorsions[i]);
+                        table_printf("\t%3.1f", rtorsions[i]);
                 }
 
                 if (occupancy_check)
-                    std::cout << " (*)";
+                    table_out << " (*)";
 
-                std::cout << std::endl;
+                table_out << std::endl;
             }
         }
     }
 
     if (!batch)
     {
-        printf("\n");
-        std::cout << "\nPartially occupied monosaccharides, if any, are marked with an asterisk (*)";
-        std::cout << std::endl << std::endl;
+        table_printf("\n");
+        table_out << "\nPartially occupied monosaccharides, if any, are marked with an asterisk (*)";
+        table_out << std::endl << std::endl;
     }
     else
         fclose(output);
 
-    std::fstream of_scm; std::fstream of_py;
-    of_scm.open("privateer-results.scm", std::fstream::out);
-    of_py.open("privateer-results.py", std::fstream::out);
+    privateer::coot::NavigationList navigation; // rendered to the Scheme and Python scripts at the end
 
-    privateer::coot::insert_coot_prologue_scheme ( of_scm );
-    privateer::coot::insert_coot_prologue_python ( of_py );
     if (useMRC && !useMTZ && !noMaps) 
     {
-        privateer::coot::insert_coot_files_loadup_scheme (of_scm, input_model, "cryoem_calcmodel.map", "cryoem_diff.map", input_cryoem_map, batch, "input_model_nowater.pdb", check_unmodelled);
-        privateer::coot::insert_coot_files_loadup_python (of_py,  input_model, "cryoem_calcmodel.map", "cryoem_diff.map", input_cryoem_map, batch, "input_model_nowater.pdb", check_unmodelled);
+        navigation.set_files ( input_model, "cryoem_calcmodel.map", "cryoem_diff.map", input_cryoem_map, batch, "input_model_nowater.pdb", check_unmodelled );
     }
     else
     {
-        privateer::coot::insert_coot_files_loadup_scheme (of_scm, input_model, "sigmaa_best.map", "sigmaa_diff.map", "sigmaa_omit.map", batch, "input_model_nowater.pdb", check_unmodelled);
-        privateer::coot::insert_coot_files_loadup_python (of_py,  input_model, "sigmaa_best.map", "sigmaa_diff.map", "sigmaa_omit.map", batch, "input_model_nowater.pdb", check_unmodelled);
+        navigation.set_files ( input_model, "sigmaa_best.map", "sigmaa_diff.map", "sigmaa_omit.map", batch, "input_model_nowater.pdb", check_unmodelled );
     }
     
 
@@ -2798,8 +2687,7 @@ int main(int argc, char** argv)
                     n_conf++;
                 }
 
-                privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, ligandList[k].second.ring_centre(), diagnostic );
-                privateer::coot::insert_coot_go_to_sugar_python ( of_py, ligandList[k].second.ring_centre(), diagnostic );
+                navigation.add ( ligandList[k].second.ring_centre(), diagnostic );
             }
             else // sugar is sane, but still need to check higher-energy conformations
             {
@@ -2820,8 +2708,7 @@ int main(int argc, char** argv)
                     n_conf++;
 
                     sugar_count++;
-                    privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, ligandList[k].second.ring_centre(), diagnostic );
-                    privateer::coot::insert_coot_go_to_sugar_python ( of_py, ligandList[k].second.ring_centre(), diagnostic );
+                    navigation.add ( ligandList[k].second.ring_centre(), diagnostic );
                 }
 
             }
@@ -2849,8 +2736,7 @@ int main(int argc, char** argv)
                         clipper::MAtom DUMAtom;
                         DUMAtom = std::get<1>(blobsProteinBackboneSummaryForCoot[type][i]).find(" DUM", clipper::MM::ANY);
 
-                        privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, DUMAtom.coord_orth(), diagnostic);
-                        privateer::coot::insert_coot_go_to_sugar_python ( of_py, DUMAtom.coord_orth(), diagnostic);
+                        navigation.add ( DUMAtom.coord_orth(), diagnostic );
                     }
                 }
 
@@ -2863,8 +2749,7 @@ int main(int argc, char** argv)
                         clipper::MAtom DUMAtom;
                         DUMAtom = std::get<1>(blobsProteinBackboneSummaryForCoot[type][i]).find(" DUM", clipper::MM::ANY);
 
-                        privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, DUMAtom.coord_orth(), diagnostic);
-                        privateer::coot::insert_coot_go_to_sugar_python ( of_py, DUMAtom.coord_orth(), diagnostic);                       
+                        navigation.add ( DUMAtom.coord_orth(), diagnostic );
                     }
                 }
 
@@ -2877,8 +2762,7 @@ int main(int argc, char** argv)
                         clipper::MAtom DUMAtom;
                         DUMAtom = std::get<1>(blobsProteinBackboneSummaryForCoot[type][i]).find(" DUM", clipper::MM::ANY);
 
-                        privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, DUMAtom.coord_orth(), diagnostic);
-                        privateer::coot::insert_coot_go_to_sugar_python ( of_py, DUMAtom.coord_orth(), diagnostic);                        
+                        navigation.add ( DUMAtom.coord_orth(), diagnostic );
                     }
                 }
 
@@ -2891,8 +2775,7 @@ int main(int argc, char** argv)
                         clipper::MAtom DUMAtom;
                         DUMAtom = std::get<1>(blobsProteinBackboneSummaryForCoot[type][i]).find(" DUM", clipper::MM::ANY);
 
-                        privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, DUMAtom.coord_orth(), diagnostic);
-                        privateer::coot::insert_coot_go_to_sugar_python ( of_py, DUMAtom.coord_orth(), diagnostic);                        
+                        navigation.add ( DUMAtom.coord_orth(), diagnostic );
                     }
                 }   
 
@@ -2905,8 +2788,7 @@ int main(int argc, char** argv)
                         clipper::MAtom DUMAtom;
                         DUMAtom = std::get<1>(blobsProteinBackboneSummaryForCoot[type][i]).find(" DUM", clipper::MM::ANY);
 
-                        privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, DUMAtom.coord_orth(), diagnostic);
-                        privateer::coot::insert_coot_go_to_sugar_python ( of_py, DUMAtom.coord_orth(), diagnostic);                        
+                        navigation.add ( DUMAtom.coord_orth(), diagnostic );
                     }
                 }   
                 if(type == 5 && !blobsProteinBackboneSummaryForCoot[type].empty())
@@ -2918,8 +2800,7 @@ int main(int argc, char** argv)
                         clipper::MAtom DUMAtom;
                         DUMAtom = std::get<1>(blobsProteinBackboneSummaryForCoot[type][i]).find(" DUM", clipper::MM::ANY);
 
-                        privateer::coot::insert_coot_go_to_sugar_scheme ( of_scm, DUMAtom.coord_orth(), diagnostic);
-                        privateer::coot::insert_coot_go_to_sugar_python ( of_py, DUMAtom.coord_orth(), diagnostic);                        
+                        navigation.add ( DUMAtom.coord_orth(), diagnostic );
                     }
                 }                                          
 
@@ -2927,21 +2808,32 @@ int main(int argc, char** argv)
     }
 
     
-    privateer::coot::insert_coot_epilogue_scheme ( of_scm );
-    privateer::coot::insert_coot_epilogue_python ( of_py );
-    of_scm.close();
-    of_py.close();
-
-    std::cout << "SUMMARY: " << std::endl << std::endl ;
-    std::cout << "   Wrong anomer: " << n_anomer << std::endl;
-    std::cout << "   Wrong configuration: " << n_config << std::endl;
-    std::cout << "   Unphysical puckering amplitude: " << n_pucker << std::endl;
-    std::cout << "   In higher-energy conformations: " << n_conf << std::endl;
-    std::cout << std::endl;
-    std::cout << "   Privateer has identified " << n_anomer + n_config + n_pucker + n_conf;
-    std::cout << " issues, with " << sugar_count << " of " << ligandList.size() << " sugars affected." << std::endl;
-
-    privateer::util::print_XML(ligandList, list_of_glycans, list_of_glycans_associated_to_permutations, input_model, jsonObject);
+    if ( navigation.write ( sinks.wants ( privateer::util::coot_scheme_sink ) ? "privateer-results.scm" : "",
+                            sinks.wants ( privateer::util::coot_python_sink ) ? "privateer-results.py" : "" ) )
+        std::cout << "Error: could not write the Coot navigation scripts privateer-results.scm/py" << std::endl;
+
+    if ( sinks.wants ( privateer::util::console_sink ) )
+    {
+        std::cout << "SUMMARY: " << std::endl << std::endl ;
+        std::cout << "   Wrong anomer: " << n_anomer << std::endl;
+        std::cout << "   Wrong configuration: " << n_config << std::endl;
+        std::cout << "   Unphysical puckering amplitude: " << n_pucker << std::endl;
+        std::cout << "   In higher-energy conformations: " << n_conf << std::endl;
+        std::cout << std::endl;
+        std::cout << "   Privateer has identified " << n_anomer + n_config + n_pucker + n_conf;
+        std::cout << " issues, with " << sugar_count << " of " << ligandList.size() << " sugars affected." << std::endl;
+    }
+
+    if ( sinks.wants ( privateer::util::xml_sink ) )
+        privateer::util::print_XML(ligandList, list_of_glycans, list_of_glycans_associated_to_permutations, input_model, jsonObject);
+
+    if ( output_columnar != "NONE" )
+    {
+        if ( privateer::util::write_columnar_export ( ligandList, list_of_glycans, output_columnar ) )
+            std::cout << "Error: could not write " << output_columnar << std::endl;
+        else
+            std::cout << "Finished outputting " << output_columnar << std::endl;
+    }
 
     
 
@@ -1,8 +1,11 @@
 import unittest
 import os
+import re
 import shutil
+import subprocess
 import sys
 import privateer
+import privateer.columnar
 import test_data
 import requests
 import json
@@ -41,6 +44,22 @@ class Test(unittest.TestCase):
         #shutil.rmtree(self.test_output)
 
 
+    def run_privateer (self, arguments, directory=None):
+        '''
+        Runs the privateer program in the test output directory, or in a fresh subdirectory of it
+        so that only the files written by this run are there, skipping the test if it is not installed
+        '''
+        executable = shutil.which ( "privateer" )
+        if executable is None :
+            self.skipTest ( "privateer executable not found" )
+        working_directory = self.test_output
+        if directory is not None :
+            working_directory = os.path.join ( self.test_output, directory )
+            shutil.rmtree ( working_directory, ignore_errors=True )
+            os.makedirs ( working_directory )
+        return subprocess.run ( [ executable ] + arguments, cwd=working_directory, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True )
+
+
     def test_nomenclature (self, verbose=True):
         '''
         Test Privateer's nomenclature translations
@@ -95,6 +114,429 @@ class Test(unittest.TestCase):
         assert ( os.path.exists ( os.path.join ( self.test_output, "annotated_glycans_sequential.xml")) )
 
 
+    def test_persistent_model (self, verbose=False):
+
+        '''
+        Test that a Model read once answers like the per-call functions
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        assert os.path.exists(pdb_input)
+
+        print ("Testing persistent model         (heaviest glycosylation in PDB)")
+        model = privateer.Model ( pdb_input, "fungal" )
+
+        tick = datetime.now()
+        sequential   = model.get_annotated_glycans ( True )
+        hierarchical = model.get_annotated_glycans_hierarchical ( True )
+        wurcs        = model.print_wurcs ( )
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> three queries executed in %f seconds" % diff.total_seconds() )
+
+        assert ( model.number_of_glycans() > 0 )
+        assert ( model.expression_system == "fungal" )
+        assert ( sequential   == privateer.get_annotated_glycans ( pdb_input, True, "fungal" ) )
+        assert ( hierarchical == privateer.get_annotated_glycans_hierarchical ( pdb_input, True, "fungal" ) )
+        assert ( wurcs        == privateer.print_wurcs ( pdb_input, "fungal" ) )
+
+
+    def test_structured_glycans (self, verbose=False):
+
+        '''
+        Test that structured records agree with the hierarchical XML
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        assert os.path.exists(pdb_input)
+
+        print ("Testing structured glycans       (heaviest glycosylation in PDB)")
+        model = privateer.Model ( pdb_input, "fungal" )
+
+        tick = datetime.now()
+        glycans = model.get_glycans ( )
+        columns = model.get_sugar_columns ( )
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> records built in %f seconds" % diff.total_seconds() )
+
+        xml_tree = etree.fromstring ( model.get_annotated_glycans_hierarchical ( True ) )
+
+        assert ( len(glycans) == len(xml_tree.findall("glycan")) )
+        assert ( sum ( len(glycan.sugars) for glycan in glycans ) == len(xml_tree.findall(".//sugar")) )
+        assert ( len(columns["q"]) == len(xml_tree.findall(".//sugar")) )
+        assert ( glycans[0].sugars[0].parent_node == -1 )
+        assert ( all ( sugar.parent_node != sugar.node for glycan in glycans for sugar in glycan.sugars ) )
+        assert ( "<svg" in model.get_glycan_svg ( 0 ) )
+
+
+    def test_analyse_many (self, verbose=False):
+
+        '''
+        Test batch analysis on worker threads against single models
+        '''
+
+        names = [ "5fjj-high_mannose.pdb", "5ajm-mammalian_glycans.pdb", "5aog-plant_glycans.pdb", "3sgk-nglycans_antibodies.pdb", "missing.pdb" ]
+        paths = [ os.path.join(self.test_data_path, name) for name in names ]
+
+        print ("Testing batch analysis           (four models and a missing file)")
+        tick = datetime.now()
+        results = list ( privateer.analyse_many ( paths, 4 ) )
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+        assert ( sorted ( index for index, filename, model, error in results ) == list ( range ( len(paths) ) ) )
+
+        for index, filename, model, error in results :
+            assert ( filename == paths[index] )
+            if names[index] == "missing.pdb" :
+                continue
+            assert ( model is not None and error == "" )
+            assert ( model.print_wurcs ( ) == privateer.print_wurcs ( filename ) )
+
+        batch = privateer.analyse_many ( paths, 2 )
+        first = next ( batch )
+        batch.close ( )
+        rest = list ( batch )
+        assert ( len(rest) < len(paths) )
+        assert ( first[0] not in [ index for index, filename, model, error in rest ] )
+
+
+    def test_validate_xray (self, verbose=False):
+
+        '''
+        Test map-based validation of a model against its structure factors
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        mtz_input = os.path.join(self.test_data_path, "5fjj-sf.mtz")
+        assert os.path.exists(pdb_input) and os.path.exists(mtz_input)
+
+        print ("Testing X-ray validation         (heaviest glycosylation in PDB)")
+        model = privateer.Model ( pdb_input, "fungal" )
+
+        options = privateer.MapValidationOptions ( )
+        options.find_blobs = True
+
+        # the library must leave the console alone, so whatever reaches file descriptor 1 is captured
+        sys.stdout.flush()
+        console = os.dup ( 1 )
+        with open ( os.path.join ( self.test_output, "validate_xray.stdout" ), "w+" ) as captured :
+            os.dup2 ( captured.fileno(), 1 )
+            try :
+                tick = datetime.now()
+                validation = privateer.validate_xray ( model, mtz_input, options )
+                tock = datetime.now()
+            finally :
+                os.dup2 ( console, 1 )
+                os.close ( console )
+            captured.seek ( 0 )
+            chatter = captured.read ( )
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+        assert ( chatter == "" )
+        assert ( validation.resolution > 0.0 )
+        assert ( 0.0 < validation.r_all < 1.0 )
+        assert ( len(validation.sugars) >= sum ( len(glycan.sugars) for glycan in model.get_glycans() ) )
+        assert ( all ( -1.0 <= fit.rscc <= 1.0 for fit in validation.sugars ) )
+        assert ( any ( fit.glycan >= 0 for fit in validation.sugars ) )
+        assert ( len(validation.blobs) > 0 )
+
+
+    def test_numpy_views (self, verbose=False):
+
+        '''
+        Test that coordinates and maps reach NumPy as views that outlive their owners' Python names
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        mtz_input = os.path.join(self.test_data_path, "5fjj-sf.mtz")
+        assert os.path.exists(pdb_input) and os.path.exists(mtz_input)
+
+        print ("Testing NumPy views              (heaviest glycosylation in PDB)")
+        model = privateer.Model ( pdb_input, "fungal" )
+
+        xyz = model.sugar_coordinates
+        offsets = model.sugar_atom_offsets
+        columns = model.get_sugar_columns ( )
+
+        assert ( xyz.shape == ( len(model.sugar_atom_names), 3 ) )
+        assert ( len(offsets) == len(columns["q"]) + 1 and offsets[-1] == xyz.shape[0] )
+        assert ( not xyz.flags.writeable and not xyz.flags.owndata )
+
+        first = model.get_sugar_coordinates ( 0, 0 )
+        assert ( first.shape == ( offsets[1] - offsets[0], 3 ) )
+        assert ( ( first == xyz[:offsets[1]] ).all() )
+
+        options = privateer.MapValidationOptions ( )
+        options.keep_maps = True
+
+        tick = datetime.now()
+        maps = privateer.validate_xray ( model, mtz_input, options ).maps
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+        del model
+        assert ( xyz[0].tolist() == first[0].tolist() )
+
+        assert ( sorted ( maps.keys() ) == [ "best", "difference", "ligand", "omit" ] )
+        shape = tuple ( maps["best"].shape )
+        best = maps["best"].values
+        del maps
+        assert ( best.shape == shape and not best.flags.owndata )
+        assert ( best.std() > 0.0 )
+
+
+    def test_columnar_round_trip (self, verbose=False):
+
+        '''
+        Test that the columnar file written by the program reads back and places every glycan sugar
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        assert os.path.exists(pdb_input)
+        output = os.path.join(self.test_output, "5fjj-columns.bin")
+
+        print ("Testing columnar export          (heaviest glycosylation in PDB)")
+        tick = datetime.now()
+        result = self.run_privateer ( [ "-pdbin", pdb_input, "-columnar", output ] )
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+        assert ( result.returncode == 0 )
+        assert ( "Finished outputting " + output in result.stdout )
+
+        columns = privateer.columnar.read_columnar ( output )
+        rows = len ( columns["q"] )
+        assert ( rows > 0 )
+        assert ( all ( len(column) == rows for column in columns.values() ) )
+
+        model = privateer.Model ( pdb_input )
+        placed = set ( zip ( columns["glycan"].tolist(), columns["node"].tolist() ) )
+        placed.discard ( ( -1, -1 ) )
+        assert ( len(placed) == sum ( len(glycan.sugars) for glycan in model.get_glycans() ) )
+
+        n_glycan = columns["context"] == 1
+        assert ( n_glycan.any() and ( columns["glycan"][n_glycan] >= 0 ).all() )
+        assert ( ( columns["parent_node"][columns["node"] == 0] == -1 ).all() )
+        assert ( privateer.columnar.flag_set ( columns, "ring" ).any() )
+
+
+    def test_output_selection (self, verbose=False):
+
+        '''
+        Test that -outputs limits the files and console tables of a run to the ones asked for
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        assert os.path.exists(pdb_input)
+
+        print ("Testing output selection         (heaviest glycosylation in PDB)")
+        tick = datetime.now()
+        everything = self.run_privateer ( [ "-pdbin", pdb_input ], "outputs_all" )
+        coot_only = self.run_privateer ( [ "-pdbin", pdb_input, "-outputs", "coot" ], "outputs_coot" )
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+        assert ( everything.returncode == 0 and coot_only.returncode == 0 )
+
+        written = os.listdir ( os.path.join ( self.test_output, "outputs_all" ) )
+        assert ( any ( name.endswith ( ".svg" ) for name in written ) )
+        assert ( "privateer-results.scm" in written and "privateer-results.py" in written )
+        assert ( "SUMMARY:" in everything.stdout and "Detailed validation data" in everything.stdout )
+
+        written = os.listdir ( os.path.join ( self.test_output, "outputs_coot" ) )
+        assert ( not any ( name.endswith ( ".svg" ) for name in written ) )
+        assert ( "privateer-results.scm" in written and "privateer-results.py" in written )
+        assert ( "SUMMARY:" not in coot_only.stdout and "Detailed validation data" not in coot_only.stdout )
+
+        rejected = self.run_privateer ( [ "-pdbin", pdb_input, "-outputs", "coot,pdf" ], "outputs_rejected" )
+        assert ( rejected.returncode == 1 and "is not a list of outputs" in rejected.stdout )
+
+
+    def test_coot_navigation (self, verbose=False):
+
+        '''
+        Test that both Coot scripts written by the program list the same sugars, one per affected sugar
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        assert os.path.exists(pdb_input)
+
+        print ("Testing Coot navigation scripts  (heaviest glycosylation in PDB)")
+        tick = datetime.now()
+        result = self.run_privateer ( [ "-pdbin", pdb_input, "-outputs", "console,coot" ], "navigation" )
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+        assert ( result.returncode == 0 )
+        assert ( "Error: could not write" not in result.stdout )
+
+        with open ( os.path.join ( self.test_output, "navigation", "privateer-results.scm" ) ) as scheme :
+            scheme_entries = re.findall ( r'^\t\(list\t"([^"]*)"\t', scheme.read(), re.M )
+        with open ( os.path.join ( self.test_output, "navigation", "privateer-results.py" ) ) as python :
+            python_entries = re.findall ( r'^\t\["([^"]*)",\t', python.read(), re.M )
+
+        assert ( scheme_entries == python_entries )
+        affected = re.search ( r'issues, with (\d+) of \d+ sugars affected', result.stdout )
+        assert ( affected is not None and len(scheme_entries) == int ( affected.group(1) ) )
+
+
+    def test_svg_sheet (self, verbose=False):
+
+        '''
+        Test that -svg_sheet puts every glycan plot the program would write as a file into one SVG
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        assert os.path.exists(pdb_input)
+
+        print ("Testing SVG sheet output         (heaviest glycosylation in PDB)")
+        tick = datetime.now()
+        files = self.run_privateer ( [ "-pdbin", pdb_input, "-outputs", "svg" ], "plots_files" )
+        sheet = self.run_privateer ( [ "-pdbin", pdb_input, "-outputs", "svg", "-svg_sheet" ], "plots_sheet" )
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+        assert ( files.returncode == 0 and sheet.returncode == 0 )
+
+        plots = sorted ( name for name in os.listdir ( os.path.join ( self.test_output, "plots_files" ) ) if name.endswith ( ".svg" ) )
+        assert ( len(plots) == len ( privateer.Model ( pdb_input ).get_glycans() ) )
+        assert ( [ name for name in os.listdir ( os.path.join ( self.test_output, "plots_sheet" ) ) if name.endswith ( ".svg" ) ] == [ "privateer-glycans.svg" ] )
+
+        svg = "{http://www.w3.org/2000/svg}"
+        xml_tree = etree.parse ( os.path.join ( self.test_output, "plots_sheet", "privateer-glycans.svg" ) ).getroot()
+        symbols = [ symbol.get ( "id" ) for symbol in xml_tree.iter ( svg + "symbol" ) ]
+        instances = [ instance for instance in xml_tree.findall ( svg + "use" ) if instance.get ( "data-file" ) is not None ]
+
+        assert ( sorted ( instance.get ( "data-file" ) for instance in instances ) == plots )
+        assert ( sorted ( symbols ) == sorted ( instance.get ( "{http://www.w3.org/1999/xlink}href" )[1:] for instance in instances ) )
+
+        # the roots colour their link letter through these classes, so the sheet needs the same rules as the files
+        plot_tree = etree.parse ( os.path.join ( self.test_output, "plots_files", plots[0] ) ).getroot()
+        styles = [ style.text for style in xml_tree.findall ( svg + "style" ) ]
+        assert ( styles == [ style.text for style in plot_tree.findall ( svg + "style" ) ] )
+        assert ( len(styles) == 1 and all ( rule in styles[0] for rule in [ ".my_blue", ".my_red", ".my_yellow" ] ) )
+
+
+    def test_svg_plots_against_golden (self, verbose=False):
+
+        '''
+        Test the glycan plots of a real model, in both styles, against the ones the original plotting code drew for the same
+        glycan trees. The golden files were drawn without the model's geometry, so the text of the <title> tooltips, which
+        carries torsions, B-factors and conformations, is left out of the comparison; the rest has to be byte for byte the same
+        '''
+
+        def without_titles ( document ):
+            return re.sub ( b"<title>.*?</title>", b"<title></title>", document, flags=re.DOTALL )
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        golden = os.path.join(self.test_data_path, "golden", "5fjj-high_mannose")
+        assert os.path.exists(pdb_input) and os.path.exists(golden)
+
+        print ("Testing SVG plots against golden (heaviest glycosylation in PDB)")
+        tick = datetime.now()
+
+        for style, arguments in [ ( "glycanbuilderplot", [] ), ( "glycoplot", [ "-oldstyle" ] ) ]:
+            result = self.run_privateer ( [ "-pdbin", pdb_input, "-outputs", "svg" ] + arguments, "golden_" + style )
+            assert ( result.returncode == 0 )
+
+            plots = sorted ( name for name in os.listdir ( os.path.join ( self.test_output, "golden_" + style ) ) if name.endswith ( ".svg" ) )
+            assert ( plots == sorted ( os.listdir ( os.path.join ( golden, style ) ) ) )
+
+            for name in plots:
+                with open ( os.path.join ( self.test_output, "golden_" + style, name ), "rb" ) as output, open ( os.path.join ( golden, style, name ), "rb" ) as reference :
+                    assert without_titles ( output.read() ) == without_titles ( reference.read() ), name
+
+        # the embeddable flavour, with selection anchors, for the largest tree of the model
+        with open ( os.path.join ( golden, "glycan_4.svg" ), "rb" ) as reference :
+            assert ( without_titles ( privateer.Model ( pdb_input ).get_glycan_svg ( 4 ).encode() ) == without_titles ( reference.read() ) )
+
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+
+    def test_blob_scan_reports (self, verbose=False):
+
+        '''
+        Test the difference density blob catalogue and the JSON-lines report of a -check-unmodelled run
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj-high_mannose.pdb")
+        mtz_input = os.path.join(self.test_data_path, "5fjj-sf.mtz")
+        assert os.path.exists(pdb_input) and os.path.exists(mtz_input)
+
+        print ("Testing unmodelled blob scan     (heaviest glycosylation in PDB)")
+        tick = datetime.now()
+        result = self.run_privateer ( [ "-pdbin", pdb_input, "-mtzin", mtz_input, "-check-unmodelled", "-outputs", "json" ], "blobs" )
+        tock = datetime.now()
+
+        diff = tock - tick
+        print ( " -> executed in %f seconds" % diff.total_seconds() )
+
+        assert ( result.returncode == 0 )
+        assert ( "Finished outputting blobs_catalogue.json" in result.stdout )
+        assert ( "Finished outputting blobs_report.jsonl" in result.stdout )
+
+        written = os.listdir ( os.path.join ( self.test_output, "blobs" ) )
+        assert ( "sigmaa_diff_nowater.map" not in written and "privateer-results.scm" not in written )
+
+        with open ( os.path.join ( self.test_output, "blobs", "blobs_catalogue.json" ) ) as catalogue_file :
+            catalogue = json.load ( catalogue_file )
+
+        blobs = catalogue["blobs"]
+        assert ( catalogue["sigma_cutoff"] == 3.0 and len(blobs) > 0 )
+        assert ( [ blob["id"] for blob in blobs ] == list ( range ( len(blobs) ) ) )
+        assert ( all ( blob["volume"] > 0.0 and blob["grid_points"] > 0 for blob in blobs ) )
+        assert ( all ( blob["peak_density"] >= catalogue["sigma_cutoff"] * catalogue["map_sigma"] for blob in blobs ) )
+        assert ( any ( blob["nearest_residue"] is not None for blob in blobs ) )
+
+        with open ( os.path.join ( self.test_output, "blobs", "blobs_report.jsonl" ) ) as report_file :
+            report = [ json.loads ( line ) for line in report_file if line.strip() ]
+
+        classes = [ "N-linked", "C-linked", "O-linked", "S-linked", "PNGase", "Glycan chain" ]
+        assert ( all ( entry["class"] in classes for entry in report ) )
+        assert ( all ( entry["blob"] is None or 0 <= entry["blob"]["id"] < len(blobs) for entry in report ) )
+        assert ( all ( ( "glycan" in entry ) == ( entry["class"] == "Glycan chain" ) for entry in report ) )
+        assert ( all ( abs ( entry["threshold"] - 0.02 ) < 1e-6 for entry in report ) )
+        assert ( all ( len(entry["probe"]) == 3 and abs ( entry["map_sigma"] - catalogue["map_sigma"] ) <= 1e-5 * catalogue["map_sigma"] for entry in report ) )
+
+
+    def test_blob_scan_rejects_mmcif (self, verbose=False):
+
+        '''
+        Test that -check-unmodelled refuses mmCIF reflections instead of scanning a map it cannot build
+        '''
+
+        pdb_input = os.path.join(self.test_data_path, "5fjj.pdb")
+        cif_input = os.path.join(self.test_data_path, "5fjj-sf.cif")
+        assert os.path.exists(pdb_input) and os.path.exists(cif_input)
+
+        result = self.run_privateer ( [ "-pdbin", pdb_input, "-cifin", cif_input, "-check-unmodelled" ], "blobs_cif" )
+
+        assert ( result.returncode == 1 )
+        assert ( "mmCIF reflections are not supported" in result.stdout )
+        assert ( not os.path.exists ( os.path.join ( self.test_output, "blobs_cif", "blobs_catalogue.json" ) ) )
+
+
     def test_hierarchically_annotated_output (self, verbose=False):
 
         '''
@@ -3,6 +3,16 @@ import shutil
 import sys
 import privateer
 
+golden = os.path.join ( os.path.dirname ( os.path.realpath ( __file__ ) ), 'test_data', 'golden' )
+
+def same_as_golden ( path ):
+
+    '''
+    True if the file at path is byte for byte the reference copy of the same name in test_data/golden
+    '''
+    with open ( path, 'rb' ) as output, open ( os.path.join ( golden, os.path.basename ( path ) ), 'rb' ) as reference :
+        return output.read() == reference.read()
+
 def test_svg_graphics ( ):
 
     '''
@@ -20,6 +30,7 @@ def test_svg_graphics ( ):
 
     current_dir = cwd = os.getcwd()
     os.rename ( os.path.join(current_dir, "privateer-glycoplot_demo.svg"), os.path.join(test_output, "privateer-glycoplot_demo_original.svg") )
+    assert same_as_golden ( os.path.join(test_output, "privateer-glycoplot_demo_original.svg") )
 
     print ("Testing SVG graphics output demo (Privateer colour scheme)")
 
@@ -27,6 +38,7 @@ def test_svg_graphics ( ):
 
     assert os.path.exists ( "privateer-glycoplot_demo.svg" )
     os.rename ( os.path.join(current_dir, "privateer-glycoplot_demo.svg"), os.path.join(test_output, "privateer-glycoplot_demo_new.svg") )
+    assert same_as_golden ( os.path.join(test_output, "privateer-glycoplot_demo_new.svg") )
 
 
     print ("Testing SVG graphics output demo (Essentials colour scheme, dark background)")
@@ -35,6 +47,7 @@ def test_svg_graphics ( ):
 
     assert os.path.exists ( "privateer-glycoplot_demo.svg" )
     os.rename ( os.path.join(current_dir, "privateer-glycoplot_demo.svg"), os.path.join(test_output, "privateer-glycoplot_demo_original_dark.svg") )
+    assert same_as_golden ( os.path.join(test_output, "privateer-glycoplot_demo_original_dark.svg") )
 
     print ("Testing SVG graphics output demo (Privateer colour scheme, dark background)")
 
@@ -42,3 +55,4 @@ def test_svg_graphics ( ):
 
     assert os.path.exists ( "privateer-glycoplot_demo.svg" )
     os.rename ( os.path.join(current_dir, "privateer-glycoplot_demo.svg"), os.path.join(test_output, "privateer-glycoplot_demo_new_dark.svg") )
+    assert same_as_golden ( os.path.join(test_output, "privateer-glycoplot_demo_new_dark.svg") )